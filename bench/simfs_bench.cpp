@@ -0,0 +1,302 @@
+// Microbenchmarks of the hot paths behind a read: storage, streaming,
+// SSE parsing, prompt assembly and the per-path helpers. Prints Google
+// Benchmark's JSON unless another --benchmark_format is given; see the
+// Benchmarks section of README.md for the schema.
+
+#include <benchmark/benchmark.h>
+#include "content_store.h"
+#include "db_manager.h"
+#include "llm_client.h"
+#include "logger.h"
+#include "simfs.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// Bumped whenever a benchmark's name, arguments or counters change meaning,
+// so results are only compared within one version
+static const char* SCHEMA_VERSION = "1";
+
+static std::string temporaryPath(const std::string& name) {
+    static std::atomic<int> next{0};
+    return (std::filesystem::temp_directory_path() /
+            ("simfs_bench_" + std::to_string(getpid()) + "_" + name + "_" + std::to_string(next++))).string();
+}
+
+static std::string keyOf(int64_t i) {
+    char key[32];
+    snprintf(key, sizeof(key), "bench:%08lld", static_cast<long long>(i));
+    return key;
+}
+
+// A database removed again when the benchmark ends
+class ScratchDB {
+public:
+    ScratchDB() : path_(temporaryPath("db")), db_(std::make_unique<DBManager>(path_)) {}
+    ~ScratchDB() {
+        db_.reset();
+        std::filesystem::remove_all(path_);
+    }
+
+    DBManager& operator*() { return *db_; }
+    DBManager* operator->() { return db_.get(); }
+
+private:
+    std::string path_;
+    std::unique_ptr<DBManager> db_;
+};
+
+// A SimFS on a scratch database, for timing its context helpers
+class SimFSBench {
+public:
+    SimFSBench() : path_(temporaryPath("simfs")) {
+        MountConfig config;
+        config.logging.level = "warning";
+        // Nothing listens here; the helpers below never generate
+        fs_ = std::make_unique<SimFS>(path_, "http://127.0.0.1:1/v1/chat/completions", config);
+    }
+    ~SimFSBench() {
+        fs_.reset();
+        std::filesystem::remove_all(path_);
+    }
+
+    void put(const std::string& path, const std::string& body) { fs_->contentStore().put(path, body); }
+    void clearConfigCache() { fs_->clearConfigCache(); }
+    DirectoryConfig getConfigForPath(const std::string& path) { return fs_->getConfigForPath(path); }
+    std::vector<FileContext> getRecentFilesWithContent(const std::vector<std::string>& paths) {
+        return fs_->getRecentFilesWithContent(paths);
+    }
+    static bool isSpecialFile(const std::string& path) { return SimFS::isSpecialFile(path); }
+
+private:
+    std::string path_;
+    std::unique_ptr<SimFS> fs_;
+};
+
+// DBManager: args are value bytes and keys in the database
+
+static void BM_DBPut(benchmark::State& state) {
+    ScratchDB db;
+    std::string value(state.range(0), 'v');
+    int64_t keys = state.range(1);
+    int64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db->put(keyOf(i++ % keys), value));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DBPut)->ArgsProduct({{64, 1024, 16384}, {1000, 10000}});
+
+static void BM_DBGet(benchmark::State& state) {
+    ScratchDB db;
+    std::string value(state.range(0), 'v');
+    int64_t keys = state.range(1);
+    for (int64_t i = 0; i < keys; i++) {
+        db->put(keyOf(i), value);
+    }
+    std::mt19937_64 random(42);
+    std::string read;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db->get(keyOf(random() % keys), read));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DBGet)->ArgsProduct({{64, 1024, 16384}, {1000, 10000}});
+
+static void BM_DBListKeys(benchmark::State& state) {
+    ScratchDB db;
+    int64_t keys = state.range(0);
+    for (int64_t i = 0; i < keys; i++) {
+        db->put(keyOf(i), "v");
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db->listKeys("bench:"));
+    }
+    state.SetItemsProcessed(state.iterations() * keys);
+}
+BENCHMARK(BM_DBListKeys)->Arg(100)->Arg(10000)->Arg(100000);
+
+// StreamingBuffer: args are producer and reader threads sharing one stream
+
+static void BM_StreamingBuffer(benchmark::State& state) {
+    const int producers = state.range(0);
+    const int readers = state.range(1);
+    const size_t STREAM_BYTES = 256 * 1024;
+    const size_t CHUNK_BYTES = 16;  // About one token
+    const std::string chunk(CHUNK_BYTES, 't');
+
+    for (auto _ : state) {
+        auto buffer = std::make_shared<StreamingBuffer>();
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++) {
+            threads.emplace_back([&buffer]() {
+                char buf[4096];
+                off_t offset = 0;
+                size_t n;
+                while ((n = buffer->readData(buf, sizeof(buf), offset)) > 0) {
+                    offset += n;
+                }
+            });
+        }
+        std::vector<std::thread> writers;
+        for (int p = 0; p < producers; p++) {
+            writers.emplace_back([&buffer, &chunk, producers, STREAM_BYTES, CHUNK_BYTES]() {
+                for (size_t written = 0; written < STREAM_BYTES / producers; written += CHUNK_BYTES) {
+                    buffer->appendData(chunk);
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        buffer->markComplete();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * STREAM_BYTES * readers);
+}
+BENCHMARK(BM_StreamingBuffer)->ArgsProduct({{1, 4}, {1, 64}})->UseRealTime();
+
+// SseDecoder: a recorded completion stream fed in reads of arg bytes
+
+static std::string recordedStream() {
+    // Shaped like an OpenAI-compatible server's output: a role delta, one
+    // short delta per token, keep-alive comments and the terminator
+    std::string stream = "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+                         "\"choices\":[{\"index\":0,\"delta\":{\"role\":\"assistant\"}}]}\n\n";
+    static const char* tokens[] = {"int", " main", "(", "void", ")", " {\\n", "    return", " 0", ";\\n", "}\\n"};
+    for (int i = 0; i < 2000; i++) {
+        stream += "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+                  "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"";
+        stream += tokens[i % 10];
+        stream += "\"},\"finish_reason\":null}]}\n\n";
+        if (i % 500 == 0) {
+            stream += ": keep-alive\n\n";
+        }
+    }
+    stream += "data: [DONE]\n\n";
+    return stream;
+}
+
+static void BM_SseDecoder(benchmark::State& state) {
+    const std::string stream = recordedStream();
+    const size_t read_size = state.range(0);
+    size_t deltas = 0;
+    for (auto _ : state) {
+        SseDecoder decoder;
+        std::string content;
+        for (size_t offset = 0; offset < stream.size(); offset += read_size) {
+            decoder.feed(stream.data() + offset, std::min(read_size, stream.size() - offset),
+                         [&content, &deltas](const std::string& delta) { content += delta; deltas++; return true; },
+                         []() { return true; });
+        }
+        benchmark::DoNotOptimize(content);
+    }
+    state.SetBytesProcessed(state.iterations() * stream.size());
+    state.counters["deltas_per_second"] = benchmark::Counter(deltas, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SseDecoder)->Arg(64)->Arg(1500)->Arg(16384);
+
+// LLMClient::buildPrompt: args are folder entries and the token budget (0
+// for none)
+
+static void BM_BuildPrompt(benchmark::State& state) {
+    std::vector<FileContext> folder_context;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        folder_context.push_back({"/src/module" + std::to_string(i) + ".c", std::string(300, 'f')});
+    }
+    std::vector<FileContext> recent_files;
+    for (int i = 0; i < 6; i++) {
+        recent_files.push_back({"/include/header" + std::to_string(i) + ".h", std::string(4000, 'r')});
+    }
+    GenerationOptions options;
+    options.prompt_token_budget = state.range(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LLMClient::buildPrompt("/src/main.c", folder_context, recent_files, options));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildPrompt)->ArgsProduct({{10, 200}, {0, 2000}});
+
+// SimFS helpers
+
+static void BM_GetRecentFilesWithContent(benchmark::State& state) {
+    SimFSBench fs;
+    std::vector<std::string> recent;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        recent.push_back("/recent/file" + std::to_string(i) + ".txt");
+        fs.put(recent.back(), std::string(state.range(1), 'a' + i % 26));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fs.getRecentFilesWithContent(recent));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetRecentFilesWithContent)->ArgsProduct({{6, 64}, {512, 65536}});
+
+// Args are the directory depth, each level with its own config, and
+// whether the resolved config is cached (1) or resolved from scratch (0)
+static void BM_GetConfigForPath(benchmark::State& state) {
+    SimFSBench fs;
+    std::string dir;
+    fs.put("/.simfs_config.toml", "model = \"root-model\"\n");
+    for (int64_t level = 0; level < state.range(0); level++) {
+        dir += "/level" + std::to_string(level);
+        fs.put(dir + "/.simfs_config.toml", "temperature = 0.5\n");
+    }
+    const std::string path = dir + "/file.txt";
+    const bool cached = state.range(1);
+    for (auto _ : state) {
+        if (!cached) {
+            state.PauseTiming();
+            fs.clearConfigCache();
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(fs.getConfigForPath(path));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetConfigForPath)->ArgsProduct({{1, 8, 32}, {0, 1}});
+
+static void BM_IsSpecialFile(benchmark::State& state) {
+    const std::vector<std::string> paths = {
+        "/src/main.c", "/docs/README.md", "/.simfs_config.toml", "/photos/Thumbs.db",
+        "/a/very/deep/directory/tree/with/many/levels/notes.txt", "/.simfs/stats", "/.DS_Store",
+        "/data/pagefile.sys.bak"};
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(SimFSBench::isSpecialFile(paths[i++ % paths.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IsSpecialFile);
+
+int main(int argc, char** argv) {
+    // JSON by default, so runs can be compared without extra flags
+    std::vector<char*> args(argv, argv + argc);
+    bool has_format = false;
+    for (int i = 1; i < argc; i++) {
+        has_format |= strncmp(argv[i], "--benchmark_format", 18) == 0;
+    }
+    std::string json_format = "--benchmark_format=json";
+    if (!has_format) {
+        args.push_back(json_format.data());
+    }
+    int arg_count = static_cast<int>(args.size());
+
+    Logger::setLevel(LogLevel::Warning);
+    benchmark::Initialize(&arg_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(arg_count, args.data())) {
+        return 1;
+    }
+    benchmark::AddCustomContext("simfs_bench_schema", SCHEMA_VERSION);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
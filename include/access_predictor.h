@@ -0,0 +1,87 @@
+#ifndef ACCESS_PREDICTOR_H
+#define ACCESS_PREDICTOR_H
+
+#include "mount_config.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+class DBManager;
+
+struct PrefetchStats {
+    size_t issued = 0;        // Prefetch generations started
+    size_t completed = 0;     // Prefetch generations persisted
+    size_t hits = 0;          // Prefetched files later opened or read
+    size_t tokens_spent = 0;  // Tokens of completed prefetches
+    size_t tokens_wasted = 0; // Tokens of prefetched files not (yet) used
+};
+
+// Records the order in which files are opened and predicts which files are
+// likely to be opened next. Access sequences are persisted in the database:
+//   access:<dir>       - most recently opened file names in <dir>, in order
+//   transition:<path>  - "<count>\t<next path>" lines (first-order Markov)
+//   refs:<path>        - paths referenced by the generated content of <path>
+class AccessPredictor {
+public:
+    AccessPredictor(DBManager& db, const PrefetchConfig& config);
+
+    // Records an open by a foreground caller
+    void recordOpen(const std::string& path);
+    // Records opens in order, with one database write for all of them
+    void recordOpens(const std::vector<std::string>& paths);
+
+    // Stores includes/imports/links found in freshly generated content
+    void recordReferences(const std::string& path, const std::string& content);
+
+    // Most likely next files after `path`, best first
+    std::vector<std::string> predict(const std::string& path);
+
+    // Prefetch budget and hit accounting. A reservation charges the window
+    // `estimated_tokens` up front, so a burst of prefetches can't overshoot
+    // the budget before any completes; completion replaces the estimate
+    // with the tokens generated.
+    bool reservePrefetch(const std::string& path, size_t estimated_tokens);
+    void completePrefetch(const std::string& path, size_t tokens, bool success);
+    bool recordHit(const std::string& path);
+    PrefetchStats getStats() const;
+
+    // Includes, imports and links in the first MAX_SCANNED_BYTES of text
+    // content, resolved to absolute paths
+    static constexpr size_t MAX_SCANNED_BYTES = 256 * 1024;
+    static std::vector<std::string> extractReferences(const std::string& path, const std::string& content);
+
+private:
+    // Reads through `read` and stages writes in `updates`
+    void recordOpenLocked(const std::string& path, const std::function<std::string(const std::string&)>& read,
+                          std::unordered_map<std::string, std::string>& updates);
+    static std::string parentDirectory(const std::string& path);
+    static std::string normalizePath(const std::string& path);
+
+    DBManager& db_;
+    PrefetchConfig config_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::string> last_opened_;  // dir -> path
+    // Prefetched files not opened yet. Those left unused for a whole
+    // budget window are dropped, and then count as wasted in stats_.
+    struct Prefetched {
+        size_t tokens = 0;  // 0 while generating
+        std::chrono::steady_clock::time_point completed;
+    };
+    std::unordered_map<std::string, Prefetched> pending_;
+    // Generating paths, with the estimate charged for them and the window
+    // it was charged to
+    struct Reservation {
+        size_t tokens = 0;
+        std::chrono::steady_clock::time_point window_start;
+    };
+    std::unordered_map<std::string, Reservation> reserved_;
+    std::chrono::steady_clock::time_point window_start_;
+    size_t window_tokens_ = 0;
+    PrefetchStats stats_;
+};
+
+#endif
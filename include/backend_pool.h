@@ -0,0 +1,118 @@
+#ifndef BACKEND_POOL_H
+#define BACKEND_POOL_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include "mount_config.h"  // For BackendConfig, PoolConfig
+#include "rate_control.h"
+
+// Spreads requests over several inference servers. A request goes to the
+// backend serving its model with the fewest in-flight tokens per unit of
+// weight. Backends whose requests keep failing are taken out of rotation
+// (their circuit opens) until a health probe or a trial request succeeds.
+// Backends that throttle are given fewer requests at once (see AimdLimit)
+// and none until their Retry-After has passed.
+class BackendPool {
+public:
+    // Returns whether a backend is answering again; runs on the health thread
+    using Probe = std::function<bool(const BackendConfig&)>;
+
+    enum class Circuit {
+        Closed,    // In rotation
+        Open,      // Out of rotation after repeated failures
+        HalfOpen   // One trial request in flight
+    };
+
+    struct Stats {
+        std::string url;
+        Circuit circuit;
+        size_t in_flight;
+        size_t in_flight_tokens;
+        uint64_t requests;
+        uint64_t failures;
+        uint64_t throttled;
+        size_t concurrency_limit;  // 0 is unlimited
+    };
+
+    // How a request ended
+    struct Outcome {
+        bool success = false;
+        bool throttled = false;                     // 429/503: overloaded rather than broken
+        bool client_error = false;                  // Other 4xx: the request was rejected, not the backend broken
+        std::chrono::milliseconds latency{0};       // To the first token, or the whole response if not streamed
+        std::chrono::milliseconds retry_after{0};   // From a Retry-After header
+    };
+
+    // A null probe uses httpProbe
+    BackendPool(const std::vector<BackendConfig>& backends, const PoolConfig& config,
+                Probe probe = nullptr);
+    ~BackendPool();
+
+    // Reserves a backend for a request of about `tokens` tokens, waiting
+    // (if `wait` is set) while every candidate is at its concurrency limit,
+    // out of rate tokens or inside its Retry-After. Returns
+    // -1 if no backend outside `exclude` serves the model or all of those are
+    // out of rotation, or are busy and `wait` is unset.
+    int acquire(const std::string& model, size_t tokens, const std::vector<int>& exclude = {},
+                bool wait = true);
+
+    // Ends a request; a failure counts towards opening the circuit, while
+    // throttling and slow first tokens lower the concurrency limit
+    void release(int index, size_t tokens, const Outcome& outcome);
+    void release(int index, size_t tokens, bool success);
+
+    // Ends a request abandoned by the client, which says nothing about the
+    // backend's health
+    void cancel(int index, size_t tokens);
+
+    const BackendConfig& backend(int index) const { return backends_[index].config; }
+    size_t size() const { return backends_.size(); }
+    const PoolConfig& config() const { return config_; }
+    std::vector<Stats> stats() const;
+
+    // GET of the backend's health URL, answered with a 2xx status
+    static bool httpProbe(const BackendConfig& backend);
+    static std::string healthUrl(const BackendConfig& backend);
+    static const char* circuitName(Circuit circuit);
+
+private:
+    struct Backend {
+        BackendConfig config;
+        Circuit circuit = Circuit::Closed;
+        std::chrono::steady_clock::time_point open_until;
+        unsigned consecutive_failures = 0;
+        size_t in_flight = 0;
+        size_t in_flight_tokens = 0;
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        uint64_t throttled = 0;
+        TokenBucket bucket;
+        std::optional<AimdLimit> adaptive;
+        std::chrono::steady_clock::time_point retry_after;
+    };
+
+    bool serves(const Backend& backend, const std::string& model) const;
+    bool inRotation(const Backend& backend, std::chrono::steady_clock::time_point now) const;
+    size_t concurrencyLimit(const Backend& backend) const;
+    void openCircuit(Backend& backend);
+    void runHealthChecks();
+
+    std::vector<Backend> backends_;
+    PoolConfig config_;
+    Probe probe_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable available_cv_;  // A request finished
+    std::condition_variable health_cv_;
+    bool stopping_ = false;
+    std::thread health_thread_;
+};
+
+#endif
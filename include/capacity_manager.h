@@ -0,0 +1,99 @@
+#ifndef CAPACITY_MANAGER_H
+#define CAPACITY_MANAGER_H
+
+#include "mount_config.h"
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+class DBManager;
+class ContentStore;
+
+// Flags stored after "type:file" in meta:<path>, separated by ';'
+//   generated  content came from the LLM and was not modified since
+//   evicted    content was dropped to stay within budget, regenerated on read
+//   seed=<n>   generation seed pinned for reproducible regeneration
+struct FileMetadata {
+    static bool hasFlag(const std::string& metadata, const std::string& flag);
+    static std::string withFlag(const std::string& metadata, const std::string& flag);
+    static std::string withoutFlag(const std::string& metadata, const std::string& flag);
+
+    // The seed recorded in metadata, or one derived from the path
+    static uint64_t pinnedSeed(const std::string& path, const std::string& metadata);
+
+    // Generated versions of the file so far; 0 if none were recorded
+    static uint64_t version(const std::string& metadata);
+};
+
+struct CapacityStats {
+    uint64_t budget_bytes = 0;
+    uint64_t usage_bytes = 0;     // Blob bytes currently stored, shared blobs once
+    size_t files = 0;             // Files with stored content
+    size_t blobs = 0;             // Distinct bodies they share
+    size_t evictions = 0;
+    uint64_t evicted_bytes = 0;
+    size_t regenerations = 0;     // Evicted files read again
+};
+
+// Keeps generated content within a byte budget. Tracks a decaying access
+// frequency per file and, once usage exceeds the budget, evicts the coldest
+// generated files down to the low watermark. Evicted files keep their
+// metadata (marked evicted) and are regenerated on the next read. Files
+// written through the filesystem are never evicted.
+//
+// Usage is charged per blob, since identical bodies are stored once: a blob
+// counts when its first path is stored and is freed with its last one.
+// Paths sharing a blob are therefore evicted together or not at all.
+class CapacityManager {
+public:
+    CapacityManager(DBManager& db, ContentStore& content, const CapacityConfig& config);
+
+    bool enabled() const { return config_.enabled; }
+    bool pinSeeds() const { return config_.enabled && config_.pin_seeds; }
+
+    void recordStore(const std::string& path, uint64_t bytes, bool evictable);
+    void recordAccess(const std::string& path);
+    void recordRemove(const std::string& path);
+    void recordRegeneration(const std::string& path);
+
+    // Evicts until usage is at or below the low watermark. can_evict lets
+    // the caller protect files that are open or being generated.
+    size_t enforce(const std::function<bool(const std::string& path)>& can_evict);
+
+    CapacityStats getStats() const;
+
+private:
+    struct Entry {
+        std::string blob;  // Key into blobs_
+        uint64_t bytes = 0;
+        bool evictable = false;
+        double frequency = 0.0;  // Accesses, halved every half-life
+        std::chrono::steady_clock::time_point last_access;
+    };
+
+    // Tracked paths referencing a blob, mirroring its refcount: key
+    struct Blob {
+        uint64_t bytes = 0;
+        size_t paths = 0;
+    };
+
+    void load();
+    static std::string blobKey(const std::string& path, const std::string& value);
+    void acquireBlob(const std::string& key, uint64_t bytes);
+    uint64_t releaseBlob(const std::string& key);  // Returns the bytes freed
+    double decayedFrequency(const Entry& entry, std::chrono::steady_clock::time_point now) const;
+
+    DBManager& db_;
+    ContentStore& content_;
+    CapacityConfig config_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<std::string, Blob> blobs_;
+    CapacityStats stats_;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include "file_preview.h"
+#include "context_index.h"
+#include "db_manager.h"
+
+// Content-addressed storage for file bodies. Identical bodies are stored
+// once and shared between paths:
+//   content:<path>   - reference "\0blob:<xxh64 hex>:<size>" (or, for data
+//                      written before deduplication, the body itself)
+//   blob:<hash>      - body
+//   refcount:<hash>  - number of paths referencing the blob
+//   preview:<path>   - FilePreview of the body
+//   digest:<dir>     - DirectoryDigest of the files in <dir>
+//   index:, indexdoc: - ContextIndex entries for text files
+// Writes never modify a blob in place: a changed body gets a new blob and
+// the old one is released, so copies stay independent.
+class ContentStore {
+public:
+    explicit ContentStore(DBManager& db);
+
+    // Reads through a snapshot see the body as of the snapshot, even if it
+    // has since been replaced and its blob released
+    bool get(const std::string& path, std::string& body, const DBManager::Snapshot& snapshot = nullptr);
+    bool exists(const std::string& path);
+    bool size(const std::string& path, uint64_t& size, const DBManager::Snapshot& snapshot = nullptr);
+
+    // Stores bodies and removes paths atomically, together with any extra
+    // (non-content) keys, e.g. metadata. Without update_derived, the bodies
+    // keep their old preview, digest and index entries until
+    // refreshDerived(), so a file written in many chunks is analyzed, and
+    // its directory digest rewritten, once rather than per chunk.
+    bool write(const std::vector<std::pair<std::string, std::string>>& bodies,
+               const std::vector<std::string>& removed_paths = {},
+               const std::vector<std::pair<std::string, std::string>>& extra_puts = {},
+               const std::vector<std::string>& extra_removes = {},
+               bool update_derived = true);
+    bool put(const std::string& path, const std::string& body);
+    bool remove(const std::string& path);
+
+    // Points `to` at the body of `from` without copying it, together with
+    // any extra keys as in write()
+    bool copy(const std::string& from, const std::string& to,
+              const std::vector<std::pair<std::string, std::string>>& extra_puts = {});
+
+    // Drops one reference to a blob, e.g. after its content: key was
+    // overwritten by an ingested archive
+    bool release(const std::string& reference);
+
+    // Derived records, kept in step with every write that updates them.
+    // Missing for content that bypassed the store (archives, older
+    // databases) until rebuilt.
+    bool preview(const std::string& path, FilePreview& preview);
+    bool directoryDigest(const std::string& dir, DirectoryDigest& digest);
+    ContextIndex& index() { return index_; }
+    // Brings the derived records of path up to date with its current body
+    bool refreshDerived(const std::string& path);
+
+    // Recomputes previews, digests and index entries for everything under
+    // root ("" or "/" for the whole database). Returns the number of files.
+    size_t rebuildPreviews(const std::string& root = "");
+
+    // Converts bodies stored inline under content: into shared blobs.
+    // Returns the number of paths converted.
+    size_t deduplicate(size_t batch_size = 256);
+
+    // Helpers for code that scans the content: keyspace directly
+    static bool isReference(const std::string& value);
+    static uint64_t storedSize(const std::string& value);
+    static std::string blobOf(const std::string& value);  // Empty for inline bodies
+    bool resolve(const std::string& value, std::string& body, const DBManager::Snapshot& snapshot = nullptr);
+
+    static uint64_t hash(const std::string& body);
+
+private:
+    static std::string makeReference(uint64_t hash, uint64_t size);
+    static std::string hashOf(const std::string& reference);
+    uint64_t refcount(const std::string& hash);
+
+    // Stage preview and digest updates into a pending batch. Require mutex_.
+    using DigestMap = std::map<std::string, DirectoryDigest>;
+    DirectoryDigest& pendingDigest(DigestMap& digests, const std::string& path);
+    void stagePreview(const std::string& path, const FilePreview& preview,
+                      std::vector<std::pair<std::string, std::string>>& puts, DigestMap& digests);
+    void stageIndex(const std::string& path, const FilePreview& preview, const std::string& body,
+                    ContextIndex::Pending& pending, std::vector<std::pair<std::string, std::string>>& puts,
+                    std::vector<std::string>& removes);
+    void stageRemoval(const std::string& path, std::vector<std::string>& removes, DigestMap& digests,
+                      ContextIndex::Pending& pending);
+    static void stageDigests(const DigestMap& digests, std::vector<std::pair<std::string, std::string>>& puts,
+                             std::vector<std::string>& removes);
+
+    DBManager& db_;
+    ContextIndex index_;
+    std::mutex mutex_;  // Serializes reference count updates
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef CONTEXT_INDEX_H
+#define CONTEXT_INDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <utility>
+#include <cstdint>
+
+class DBManager;
+
+// BM25 inverted index over the identifiers and path components of stored
+// text files, used to pick related files for prompts:
+//   index:<term>:<path>  - "<term frequency> <file length>", so searches
+//                          need no per-file reads
+//   indexdoc:<path>      - the file's length and term frequencies, for updates
+//   state:index          - "<documents> <total length>"
+// ContentStore stages updates into the same batch as the content they
+// describe, so the index only lags the stored bodies for writes that
+// defer it (see ContentStore::write) until their refreshDerived().
+class ContextIndex {
+public:
+    explicit ContextIndex(DBManager& db);
+
+    struct Hit {
+        std::string path;
+        double score;
+    };
+
+    // Up to k indexed files, best first, scored against the terms of query
+    std::vector<Hit> search(const std::string& query, size_t k,
+                            const std::unordered_set<std::string>& exclude = {});
+
+    // Identifiers in text, lowercased. Compound identifiers (snake_case,
+    // camelCase) yield both the whole word and its parts.
+    static std::vector<std::string> terms(const std::string& text);
+
+    // The window of lines in body that mentions the query's terms most, at
+    // most max_bytes long
+    static std::string snippet(const std::string& body, const std::string& query, size_t max_bytes);
+
+    struct Document {
+        uint64_t length = 0;
+        std::map<std::string, uint32_t> frequencies;
+
+        static Document analyze(const std::string& path, const std::string& body);
+        std::string serialize() const;
+        static bool parse(const std::string& data, Document& document);
+    };
+
+    // Changes to one write batch, applied by stageStats. Callers serialize
+    // staging (ContentStore holds its mutex).
+    struct Pending {
+        int64_t documents = 0;
+        int64_t length = 0;
+    };
+    void stageDocument(const std::string& path, const Document& document, Pending& pending,
+                       std::vector<std::pair<std::string, std::string>>& puts, std::vector<std::string>& removes);
+    void stageRemoval(const std::string& path, Pending& pending, std::vector<std::string>& removes);
+    void stageStats(const Pending& pending, std::vector<std::pair<std::string, std::string>>& puts);
+
+    // Indexed documents and their total length
+    bool stats(uint64_t& documents, uint64_t& length);
+
+private:
+    static constexpr size_t MAX_INDEXED_BYTES = 256 * 1024;
+    static constexpr size_t MAX_TERMS_PER_FILE = 1024;
+    static constexpr size_t MAX_TERM_LENGTH = 48;
+    static constexpr uint32_t PATH_TERM_WEIGHT = 3;
+    static constexpr size_t MAX_POSTINGS = 5000;  // Terms in more files don't discriminate
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    DBManager& db_;
+};
+
+#endif
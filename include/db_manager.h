@@ -4,21 +4,85 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <utility>
+#include <functional>
 #include <rocksdb/db.h>
+#include <rocksdb/sst_file_writer.h>
 
+// RocksDB storage for SimFS. With a base_path, the database at db_path is a
+// writable upper layer over a read-only base shared with other mounts: reads
+// fall through to the base, writes only touch the upper layer, and deleting
+// a base key leaves a "whiteout:<key>" marker in the upper layer.
 class DBManager {
 public:
-    DBManager(const std::string& db_path);
+    // Point-in-time view of the upper layer (the base never changes). Reads
+    // through it don't see later writes, and the values it can see are kept
+    // until the last copy is released.
+    using Snapshot = std::shared_ptr<const rocksdb::Snapshot>;
+
+    DBManager(const std::string& db_path, const std::string& base_path = "");
     ~DBManager();
 
     bool put(const std::string& key, const std::string& value);
-    bool get(const std::string& key, std::string& value);
+    bool get(const std::string& key, std::string& value, const Snapshot& snapshot = nullptr);
+    Snapshot snapshot();
     bool remove(const std::string& key);
     bool exists(const std::string& key);
     std::vector<std::string> listKeys(const std::string& prefix);
+    
+    // Applies all puts and removes atomically in a single write
+    bool writeBatch(const std::vector<std::pair<std::string, std::string>>& puts,
+                    const std::vector<std::string>& removes = {});
+    
+    // Visits the keys under each prefix in order, all from one snapshot.
+    // Stops early (and returns false) when the visitor returns false.
+    // Bulk scans bypass the block cache unless fill_cache is set, for
+    // small ranges read over and over, like index postings.
+    bool scan(const std::vector<std::string>& prefixes,
+              const std::function<bool(const std::string& key, const std::string& value)>& visitor,
+              bool fill_cache = false);
+    
+    // Bulk loads SST files (see SstExportWriter), bypassing the write path.
+    // On a layered database, ingested keys also drop their whiteouts.
+    bool ingestFiles(const std::vector<std::string>& sst_paths, bool move_files = false);
+    
+    // Hard-links the current state into checkpoint_dir, e.g. to freeze a
+    // base for layered mounts. Not supported on layered databases.
+    bool createCheckpoint(const std::string& checkpoint_dir);
 
 private:
+    bool isWhitedOut(const std::string& key, const rocksdb::ReadOptions& options);
+    // Whiteout keys of the keys in the SST files
+    bool findWhiteouts(const std::vector<std::string>& sst_paths, std::vector<std::string>& whiteouts);
+
     std::unique_ptr<rocksdb::DB> db_;
+    std::unique_ptr<rocksdb::DB> base_db_;  // Read-only lower layer, if any
+};
+
+// Writes strictly ascending key/value pairs into numbered SST files
+// (000001.sst, ...) in a directory, starting a new file at max_file_size.
+class SstExportWriter {
+public:
+    SstExportWriter(const std::string& directory, uint64_t max_file_size);
+
+    bool put(const std::string& key, const std::string& value);
+    bool finish();
+
+    const std::vector<std::string>& files() const { return files_; }
+    uint64_t entries() const { return entries_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    bool finishFile();
+
+    std::string directory_;
+    uint64_t max_file_size_;
+    rocksdb::Options options_;
+    std::unique_ptr<rocksdb::SstFileWriter> writer_;
+    uint64_t file_bytes_ = 0;
+    std::vector<std::string> files_;
+    uint64_t entries_ = 0;
+    uint64_t bytes_ = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef FILE_PREVIEW_H
+#define FILE_PREVIEW_H
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+// Small derived record kept next to each file body (preview:<path>), so
+// prompts can be built without loading sibling files in full
+struct FilePreview {
+    static constexpr size_t HEAD_BYTES = 200;
+    static constexpr size_t TAIL_BYTES = 3600;
+
+    uint64_t size = 0;
+    std::string type;   // "text", "empty", or a binary format ("png", "zip", ..., "binary")
+    std::string head;   // Start of text files, cut at a UTF-8 boundary
+    std::string tail;   // End of text files
+
+    static FilePreview fromContent(const std::string& content);
+    static std::string detectType(const std::string& content);
+    bool isText() const { return type == "text"; }
+
+    std::string serialize() const;
+    static bool parse(const std::string& data, FilePreview& preview);
+};
+
+// Previews (without tails) of every file with content in one directory,
+// kept under digest:<dir> and updated whenever one of them changes
+struct DirectoryDigest {
+    std::map<std::string, FilePreview> files;  // By path
+
+    std::string serialize() const;
+    static bool parse(const std::string& data, DirectoryDigest& digest);
+};
+
+#endif
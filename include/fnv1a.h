@@ -0,0 +1,20 @@
+#ifndef FNV1A_H
+#define FNV1A_H
+
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. Unlike std::hash it is stable across builds, so values
+// derived from it (seeds, slots, placeholder bytes) survive restarts.
+// Pass a previous result as `hash` to continue it.
+inline constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+inline constexpr uint64_t FNV1A_PRIME = 1099511628211ull;
+
+inline uint64_t fnv1a(const std::string& data, uint64_t hash = FNV1A_OFFSET_BASIS) {
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * FNV1A_PRIME;
+    }
+    return hash;
+}
+
+#endif
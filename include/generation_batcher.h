@@ -0,0 +1,52 @@
+#ifndef GENERATION_BATCHER_H
+#define GENERATION_BATCHER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+class StreamingBuffer;
+
+// Collects generations that arrive close together under one key (files of
+// one directory, for one caller) into a single request. The first file of
+// a batch supplies how the batch is sent; the batch goes out once its
+// window has passed or it is full.
+class GenerationBatcher {
+public:
+    using Send = std::function<void(const std::vector<std::string>& paths,
+                                    const std::vector<std::shared_ptr<StreamingBuffer>>& buffers)>;
+
+    GenerationBatcher();
+    ~GenerationBatcher();  // Sends whatever is still pending
+
+    // Returns the buffer path's content will stream into
+    std::shared_ptr<StreamingBuffer> add(const std::string& key, const std::string& path,
+                                         std::chrono::milliseconds window, size_t max_files,
+                                         const Send& send);
+
+    size_t pendingFiles() const;
+
+private:
+    struct Batch {
+        std::vector<std::string> paths;
+        std::vector<std::shared_ptr<StreamingBuffer>> buffers;
+        Send send;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void run();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, Batch> batches_;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef HEDGE_POLICY_H
+#define HEDGE_POLICY_H
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <cstdint>
+#include "mount_config.h"  // For HedgeConfig
+
+// Decides when a streaming request that has not produced its first token
+// gets a duplicate on another backend. The wait is a percentile of recent
+// times to first token, so only the slow tail is hedged, and hedges are
+// capped at a fraction of requests.
+class HedgePolicy {
+public:
+    static constexpr size_t MAX_SAMPLES = 512;       // Recent first-token times kept
+    static constexpr uint64_t BUDGET_WINDOW = 1000;  // Requests the hedge budget looks back over, roughly
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t hedged = 0;
+        uint64_t hedge_wins = 0;  // Hedges that produced the first token
+        std::optional<std::chrono::milliseconds> delay;
+    };
+
+    explicit HedgePolicy(const HedgeConfig& config);
+
+    // How long a request waits for its first token before it is hedged;
+    // nullopt while hedging is off or too few requests have been seen
+    std::optional<std::chrono::milliseconds> delay() const;
+
+    void recordRequest();
+
+    // Takes a hedge from the budget, if there is one left
+    bool admitHedge();
+
+    // A request's primary attempt got its first token after `ttft`. When
+    // `hedge` is set the hedge won, and `ttft` is how long the primary had
+    // waited by then, a lower bound.
+    void recordFirstToken(std::chrono::milliseconds ttft, bool hedge);
+
+    Stats stats() const;
+
+private:
+    std::optional<std::chrono::milliseconds> delayLocked() const;
+
+    HedgeConfig config_;
+    mutable std::mutex mutex_;
+    std::vector<int64_t> samples_;  // Ring of first-token times in ms
+    size_t next_sample_ = 0;
+    uint64_t window_requests_ = 0;
+    uint64_t window_hedged_ = 0;
+    Stats stats_;
+};
+
+#endif
@@ -9,6 +9,12 @@
 #include <condition_variable>
 #include <queue>
 #include <atomic>
+#include <optional>
+#include <cstdint>
+#include "tokenizer.h"
+#include "mount_config.h"  // For BackendConfig, PoolConfig
+#include "backend_pool.h"
+#include "hedge_policy.h"
 
 struct FileContext {
     std::string path;
@@ -33,26 +39,131 @@ public:
     std::string getError() const;
     size_t getTotalSize() const;
     
+    std::string getContent() const;
+    
+    // Registers a callback run once the stream completes or fails. Runs
+    // immediately if the stream has already finished.
+    void onComplete(std::function<void(const StreamingBuffer&)> callback);
+    
+    // Registers a one-shot callback run once data past `offset` is available
+    // or the stream finishes. Returns false (and does not keep the callback)
+    // if that is already the case.
+    bool notifyWhenReadable(off_t offset, std::function<void()> callback);
+    
 private:
+    void runCompletionCallbacks();
+    void runReadableCallbacks(bool all);
+    
     mutable std::mutex mutex_;
     mutable std::condition_variable cv_;
     std::string buffer_;
     bool complete_ = false;
     bool error_ = false;
     std::string error_msg_;
+    std::vector<std::function<void(const StreamingBuffer&)>> completion_callbacks_;
+    std::vector<std::pair<off_t, std::function<void()>>> readable_callbacks_;
+};
+
+// Splits the streamed response to a batched request into per-file
+// buffers. Each file's section is delimited by marker lines:
+//   <<<FILE /abs/path>>>
+//   ...content...
+//   <<<END>>>
+class BatchDemultiplexer {
+public:
+    static constexpr const char* FILE_MARKER = "<<<FILE ";
+    static constexpr const char* MARKER_END = ">>>";
+    static constexpr const char* END_MARKER = "<<<END>>>";
+    
+    BatchDemultiplexer(const std::vector<std::string>& paths,
+                       const std::vector<std::shared_ptr<StreamingBuffer>>& buffers);
+    
+    // Feeds response text as it arrives
+    void append(const std::string& data);
+    
+    // Ends the stream, completing (or failing, given an error) a section
+    // still open. Returns the indices of files the response never started.
+    std::vector<size_t> finish(const std::string& error = "");
+    
+private:
+    void processLine(const std::string& line);
+    void forward(const std::string& data);
+    
+    std::vector<std::string> paths_;
+    std::vector<std::shared_ptr<StreamingBuffer>> buffers_;
+    std::vector<bool> started_;
+    int current_ = -1;             // Index of the section being received
+    std::string line_;             // Unforwarded part of the current line
+    bool line_forwarded_ = false;  // Part of the current line already went out, so it is content
+};
+
+// Incremental decoder of a streamed chat completion: "data: {...}" events
+// separated by blank lines, ending with "data: [DONE]"
+class SseDecoder {
+public:
+    // Feeds received bytes, passing each content delta to on_content and
+    // calling on_done at [DONE]. Stops and returns false as soon as a
+    // callback returns false.
+    bool feed(const char* data, size_t size,
+              const std::function<bool(const std::string&)>& on_content,
+              const std::function<bool()>& on_done);
+    
+    // Received bytes that don't end an event yet, e.g. a JSON error body
+    const std::string& pending() const { return pending_; }
+    
+private:
+    std::string pending_;
+};
+
+// Per-request options for streaming generation
+struct GenerationOptions {
+    // Called on the worker thread before the request is sent. May block to
+    // queue this generation behind higher-priority work.
+    std::function<void()> wait_for_admission;
+    
+    // Called on the worker thread after admission, for context that is too
+    // slow to gather under the caller's locks. Its files go after the
+    // recent files, so the prompt budget trims them last.
+    std::function<std::vector<FileContext>()> related_files;
+    
+    // Sampling seed, for backends that support reproducible outputs
+    std::optional<uint64_t> seed;
+    double temperature = 0.7;
+    size_t max_tokens = 0;  // Response limit per file; zero for the default of 2048
+    
+    // Token budget for the whole prompt: instructions, folder previews and
+    // recent files. Zero leaves the prompt unbounded.
+    size_t prompt_token_budget = 0;
+    std::shared_ptr<const Tokenizer> tokenizer;  // Estimated counts if unset
+    
+    // Requests with the same key share a server slot (see BackendConfig),
+    // e.g. the directory, whose context they have in common
+    std::string affinity_key;
+    
+    // Generation the worker thread's trace spans belong to (see TraceFlow)
+    uint64_t trace_id = 0;
 };
 
 class LLMClient {
 public:
-    LLMClient(const std::string& endpoint);
+    // A single server at `endpoint`, configured by `backend`
+    LLMClient(const std::string& endpoint, const BackendConfig& backend = BackendConfig());
+    // Requests are spread over `backends` (see BackendPool); streaming
+    // requests slow to start are hedged on a second backend (see HedgePolicy)
+    LLMClient(const std::vector<BackendConfig>& backends, const PoolConfig& pool,
+              const HedgeConfig& hedging = HedgeConfig());
     ~LLMClient();
+    
+    BackendPool& pool() { return *pool_; }
+    const HedgePolicy& hedging() const { return *hedger_; }
 
     // Original blocking API (kept for compatibility)
     std::string generateFileContent(
         const std::string& file_path,
         const std::vector<FileContext>& folder_context,
         const std::vector<FileContext>& recent_files,
-        const std::string& model_name = "meta-llama/Llama-3.2-3B-Instruct"
+        const std::string& model_name = "meta-llama/Llama-3.2-3B-Instruct",
+        const GenerationOptions& options = GenerationOptions()
     );
     
     // New streaming API
@@ -60,11 +171,78 @@ public:
         const std::string& file_path,
         const std::vector<FileContext>& folder_context,
         const std::vector<FileContext>& recent_files,
-        const std::string& model_name = "meta-llama/Llama-3.2-3B-Instruct"
+        const std::string& model_name = "meta-llama/Llama-3.2-3B-Instruct",
+        const GenerationOptions& options = GenerationOptions()
+    );
+    
+    // Generates several files of one directory with a single request,
+    // splitting the response into their buffers as it streams in. Files the
+    // response leaves out are then generated one request at a time.
+    void generateFilesStream(
+        const std::vector<std::string>& file_paths,
+        const std::vector<std::shared_ptr<StreamingBuffer>>& buffers,
+        const std::vector<FileContext>& folder_context,
+        const std::vector<FileContext>& recent_files,
+        const std::string& model_name = "meta-llama/Llama-3.2-3B-Instruct",
+        const GenerationOptions& options = GenerationOptions()
+    );
+    
+    // The user message sent for a streaming generation, fitted to
+    // options.prompt_token_budget. Parts shared between files come first
+    // (instructions, then the folder, then other files) and the target path
+    // last, so consecutive prompts for one directory share a long prefix.
+    static std::string buildPrompt(
+        const std::string& file_path,
+        const std::vector<FileContext>& folder_context,
+        const std::vector<FileContext>& recent_files,
+        const GenerationOptions& options = GenerationOptions()
     );
 
+    // The user message for generateFilesStream, sharing buildPrompt's prefix
+    static std::string buildBatchPrompt(
+        const std::vector<std::string>& file_paths,
+        const std::vector<FileContext>& folder_context,
+        const std::vector<FileContext>& recent_files,
+        const GenerationOptions& options = GenerationOptions()
+    );
+    
+    // Server slot for an affinity key, stable across runs
+    static unsigned slotFor(const std::string& affinity_key, unsigned slots);
+
 private:
-    std::string endpoint_;
+    // recent_files followed by options.related_files, if set
+    static std::vector<FileContext> withRelatedFiles(const std::string& file_path,
+                                                     const std::vector<FileContext>& recent_files,
+                                                     const GenerationOptions& options);
+    
+    // Blocking streaming request for one file into buffer
+    void streamInto(const std::string& file_path,
+                    const std::vector<FileContext>& folder_context,
+                    const std::vector<FileContext>& recent_files,
+                    const std::string& model_name,
+                    const GenerationOptions& options,
+                    const std::shared_ptr<StreamingBuffer>& buffer);
+    
+    // Posts a streaming chat completion to a backend serving model_name,
+    // passing content deltas to on_content and calling on_done (if set) at
+    // [DONE]. make_request builds the body for the chosen backend. Requests
+    // that fail before their first token are retried on another backend,
+    // and ones slow to start race a hedge there. Returns an error message,
+    // or "" on success.
+    std::string postStream(const std::string& model_name, size_t tokens,
+                           const std::function<std::string(const BackendConfig&)>& make_request,
+                           const std::function<void(const std::string&)>& on_content,
+                           const std::function<void()>& on_done);
+    
+    // Runs work on a detached thread the destructor waits for, since it
+    // uses the pool and hedger after its buffers complete
+    void startWorker(std::function<void()> work);
+    
+    std::unique_ptr<BackendPool> pool_;
+    std::unique_ptr<HedgePolicy> hedger_;
+    std::mutex workers_mutex_;
+    std::condition_variable workers_done_;
+    size_t workers_ = 0;
     class Impl;
     std::unique_ptr<Impl> pImpl;
 };
@@ -0,0 +1,140 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tracer.h"  // For AccessRecord
+
+// Outcomes and latencies of operations, by kind ("stat", "cat", ...).
+// Each worker fills its own; they are merged at the end.
+class LoadStats {
+public:
+    struct Op {
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        std::vector<uint64_t> latencies_us;
+    };
+
+    void record(const std::string& op, uint64_t latency_us, bool ok, uint64_t bytes = 0);
+    void merge(const LoadStats& other);
+
+    const std::map<std::string, Op>& ops() const { return ops_; }
+    uint64_t count() const;
+    uint64_t errors() const;
+    uint64_t bytes() const;
+    std::vector<uint64_t> latencies() const;  // All operations, sorted
+
+    // Nearest-rank percentile of sorted latencies; 0 if empty
+    static uint64_t percentile(const std::vector<uint64_t>& sorted, double q);
+
+private:
+    std::map<std::string, Op> ops_;
+};
+
+struct LoadConfig {
+    // ls-storm, herd, distinct, writes, mixed or replay
+    std::string workload;
+    size_t threads = 8;
+    // Walks per thread (ls-storm), rounds (herd), files (distinct, writes)
+    // or directory visits per thread (mixed)
+    size_t ops = 100;
+    std::string dir = "/load";  // Where synthetic files go, and what ls-storm walks
+
+    size_t file_size = 1 << 20;  // writes
+    size_t block_size = 128 * 1024;
+
+    // mixed: each visit lists one of `dirs` directories, stats `fanout` of
+    // its files and reads one, files picked by a Zipf distribution.
+    // Setup stores `populated` of the files; the rest are missing.
+    size_t dirs = 16;
+    size_t files_per_dir = 32;
+    size_t fanout = 8;
+    double populated = 0.5;
+
+    std::vector<AccessRecord> trace;  // replay, in time order
+    double speed = 1.0;               // Replay time scale; 2 replays twice as fast
+
+    uint64_t seed = 1;
+
+    static const std::vector<std::string>& workloads();
+};
+
+struct LoadResult {
+    LoadStats stats;
+    double elapsed_seconds = 0;
+    // Replay only: operations started over 1ms after their recorded time
+    uint64_t late_ops = 0;
+    uint64_t max_lag_us = 0;
+
+    // Machine-readable report: totals, ops_per_second, p50/p99/p999
+    // latencies overall and per operation kind
+    std::string toJson(const LoadConfig& config) const;
+};
+
+// File operations under a root directory (a mountpoint, or any directory),
+// timed into a LoadStats
+class LoadWorker {
+public:
+    LoadWorker(const std::string& root, LoadStats& stats);
+    ~LoadWorker();
+
+    bool stat(const std::string& path);
+    // Names and whether each is a directory
+    bool list(const std::string& path, std::vector<std::pair<std::string, bool>>* entries = nullptr);
+    bool cat(const std::string& path);  // Open, read to the end, close
+    bool writeFile(const std::string& path, size_t size, size_t block_size);
+    bool makeDirectories(const std::string& path);  // Untimed, like mkdir -p
+
+    // Issues the system call closest to a recorded FUSE operation. Opens are
+    // kept by their recorded file handle until the matching release.
+    void replay(const AccessRecord& record);
+
+private:
+    std::string full(const std::string& path) const { return root_ + path; }
+
+    std::string root_;
+    LoadStats& stats_;
+    std::vector<char> buffer_;
+    std::unordered_map<uint64_t, int> open_files_;  // Recorded fh to descriptor
+};
+
+// Runs one workload with a pool of threads against a root directory
+class LoadGenerator {
+public:
+    LoadGenerator(const std::string& root, const LoadConfig& config);
+
+    // Creates what the workload expects to exist (mixed only). Untimed.
+    void setup();
+    // Throws std::invalid_argument for an unknown workload
+    LoadResult run();
+
+private:
+    void lsStorm(LoadWorker& worker, size_t thread);
+    void herd(LoadWorker& worker, size_t thread);
+    void distinct(LoadWorker& worker, size_t thread);
+    void writes(LoadWorker& worker, size_t thread);
+    void mixed(LoadWorker& worker, size_t thread);
+    void replay(LoadWorker& worker, const std::vector<const AccessRecord*>& records,
+                std::chrono::steady_clock::time_point start, LoadResult& result);
+    void walk(LoadWorker& worker, const std::string& dir);
+    void awaitRound();  // Returns once every thread has called it
+
+    std::string mixedPath(size_t dir, size_t file) const;
+
+    std::string root_;
+    LoadConfig config_;
+
+    std::mutex round_mutex_;
+    std::condition_variable round_cv_;
+    size_t round_waiting_ = 0;
+    uint64_t round_ = 0;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef LOCAL_GENERATOR_H
+#define LOCAL_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+// Rule from .simfs_config.toml selecting a generator by file name:
+//   [[generators]]
+//   match = "*.png"       # fnmatch pattern; matched against the full path
+//                         # if it contains '/', otherwise the file name
+//   generator = "png"     # registered generator, or "llm" to force the LLM
+//   size = 65536          # remaining keys are passed to the generator
+struct GeneratorRule {
+    std::string pattern;
+    std::string generator;
+    std::map<std::string, std::string> params;
+};
+
+// In-process generator for files an LLM cannot (or need not) write. Must be
+// deterministic and fast; returns false to fall back to the LLM.
+class LocalGenerator {
+public:
+    virtual ~LocalGenerator() = default;
+    virtual bool generate(const std::string& path, const std::map<std::string, std::string>& params,
+                          std::string& content) const = 0;
+};
+
+// Built-in generators:
+//   empty    - zero bytes (.gitkeep, __init__.py, ...)
+//   text     - the `content` parameter verbatim
+//   license  - well-known license text (`license`, `holder`, `year`)
+//   png      - valid RGB image (`width`, `height`, `size` in bytes)
+//   jpeg     - valid baseline JPEG (`width`, `height`, `size` in bytes)
+//   zip      - valid archive holding one stored text file (`size` in bytes)
+class GeneratorRegistry {
+public:
+    GeneratorRegistry();
+
+    void add(const std::string& name, std::unique_ptr<LocalGenerator> generator);
+    bool has(const std::string& name) const;
+
+    // Applies the first rule matching the path. Returns false if no rule
+    // matches, the rule selects the LLM, or its generator declines.
+    bool generate(const std::string& path, const std::vector<GeneratorRule>& rules,
+                  std::string& content, std::string* generator_name = nullptr) const;
+
+    // Rules used after any configured ones unless use_default_generators
+    // is turned off
+    static const std::vector<GeneratorRule>& defaultRules();
+
+    static bool matches(const std::string& pattern, const std::string& path);
+
+private:
+    std::map<std::string, std::unique_ptr<LocalGenerator>> generators_;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel { Debug = 0, Info = 1, Warning = 2, Error = 3, Off = 4 };
+
+// Statements below this level are compiled out (CMake option of the same name)
+#ifndef SIMFS_MIN_LOG_LEVEL
+#define SIMFS_MIN_LOG_LEVEL 0
+#endif
+
+// Asynchronous log. Threads append finished lines to their own lock-free
+// queue; a background thread writes them out in order, in one write per
+// batch. Lines are dropped (and counted) when a thread's queue is full,
+// rather than blocking the thread. Use the LOG_* macros, which skip all
+// formatting for disabled levels and rate-limited call sites.
+class Logger {
+public:
+    static Logger& global();
+
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= SIMFS_MIN_LOG_LEVEL &&
+               static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+    static void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    static LogLevel level() { return static_cast<LogLevel>(level_.load(std::memory_order_relaxed)); }
+    static std::optional<LogLevel> parseLevel(const std::string& name);
+    static const char* levelName(LogLevel level);
+
+    // Lines per second each call site may write; 0 for no limit
+    static void setRateLimit(unsigned lines_per_second) { rate_limit_.store(lines_per_second); }
+    static unsigned rateLimit() { return rate_limit_.load(std::memory_order_relaxed); }
+
+    void write(LogLevel level, std::string line);
+    // Returns once everything written so far is out
+    void flush();
+    void setOutput(std::ostream& out);
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    static constexpr size_t QUEUE_LINES = 1024;
+
+    // Single producer (the owning thread), single consumer (whoever holds
+    // drain_mutex_)
+    struct ThreadQueue {
+        struct Entry {
+            uint64_t sequence = 0;
+            std::string line;
+        };
+        Entry entries[QUEUE_LINES];
+        std::atomic<size_t> head{0};  // Next to drain
+        std::atomic<size_t> tail{0};  // Next to fill
+        std::atomic<bool> retired{false};
+    };
+    friend struct ThreadQueueHolder;
+
+    Logger();
+    ~Logger();
+    ThreadQueue& threadQueue();
+    void run();
+    void drain();  // Caller holds drain_mutex_
+
+    static std::atomic<int> level_;
+    static std::atomic<unsigned> rate_limit_;
+
+    std::mutex queues_mutex_;
+    std::vector<std::shared_ptr<ThreadQueue>> queues_;
+    std::atomic<uint64_t> sequence_{0};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_dropped_ = 0;
+
+    std::mutex drain_mutex_;
+    std::ostream* out_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+// Rate limit state of one LOG_* statement
+class LogSite {
+public:
+    bool admit();
+    uint64_t takeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> window_{-1};  // Second the count is for
+    std::atomic<unsigned> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+// One line being composed: "[LEVEL] message key=value ...". Written when
+// destroyed.
+class LogLine {
+public:
+    LogLine(LogLevel level, LogSite& site) : level_(level), site_(site) {}
+    ~LogLine();
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        message_ << value;
+        return *this;
+    }
+
+    // Structured field, e.g. field("path", path).field("latency_us", 12)
+    template <typename T>
+    LogLine& field(const char* key, const T& value) {
+        std::ostringstream formatted;
+        formatted << value;
+        appendField(key, formatted.str());
+        return *this;
+    }
+
+private:
+    void appendField(const char* key, const std::string& value);
+
+    LogLevel level_;
+    LogSite& site_;
+    std::ostringstream message_;
+    std::string fields_;
+};
+
+// LOG_INFO << "Loaded " << n << " files"; nothing after LOG_* is evaluated
+// when the level is disabled or the statement is over its rate limit
+#define SIMFS_LOG(level)                                                                              \
+    for (LogSite* simfs_log_site = Logger::enabled(level)                                            \
+                                       ? &[]() -> LogSite& { static LogSite site; return site; }() \
+                                       : nullptr;                                                    \
+         simfs_log_site && simfs_log_site->admit(); simfs_log_site = nullptr)                        \
+    LogLine(level, *simfs_log_site)
+
+#define LOG_DEBUG SIMFS_LOG(LogLevel::Debug)
+#define LOG_INFO SIMFS_LOG(LogLevel::Info)
+#define LOG_WARNING SIMFS_LOG(LogLevel::Warning)
+#define LOG_ERROR SIMFS_LOG(LogLevel::Error)
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Monotonic count, safe to bump from any thread
+class Counter {
+public:
+    void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// Distribution of non-negative values in log-linear buckets, as in HDR
+// histograms: values below SUB_BUCKETS are exact, larger ones land in one
+// of SUB_BUCKETS buckets per power of two, so percentiles are within 12.5%.
+// Recording is a few relaxed atomic adds; readers may see a value counted
+// in its bucket but not yet in the sum.
+class Histogram {
+public:
+    static constexpr int SUB_BUCKETS = 8;
+    static constexpr int BUCKETS = 62 * SUB_BUCKETS;
+
+    void record(uint64_t value);
+
+    uint64_t count() const;
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the q-th quantile; 0 if empty
+    uint64_t percentile(double q) const;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketLowerBound(int bucket);
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS] = {};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Records the microseconds from construction to destruction
+class LatencyTimer {
+public:
+    explicit LatencyTimer(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~LatencyTimer() { histogram_.record(elapsedMicroseconds()); }
+
+    uint64_t elapsedMicroseconds() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+enum class FuseOp {
+    Getattr, Readdir, Open, Read, Write, Create, Release, Poll,
+    Setxattr, Getxattr, CopyFileRange, Unlink, Mkdir, Rmdir
+};
+static constexpr size_t FUSE_OP_COUNT = static_cast<size_t>(FuseOp::Rmdir) + 1;
+
+// Process-wide instrumentation. Latencies are in microseconds.
+class Metrics {
+public:
+    static Metrics& global();
+
+    struct Op {
+        Counter calls;
+        Counter errors;  // Negative results
+        Histogram latency_us;
+    };
+    Op& op(FuseOp op) { return ops_[static_cast<size_t>(op)]; }
+    static const char* opName(FuseOp op);
+
+    // Storage
+    Histogram db_get_us;
+    Histogram db_write_us;  // Puts, removes and batches
+
+    // Generation, from admission to the end of the stream
+    Counter generations;
+    Counter generation_failures;
+    Counter cancelled_attempts;  // Hedges that lost the race
+    Histogram queue_wait_us;     // Waiting for admission by the process policy
+    Histogram ttft_us;           // Request sent to first token, across retries
+    Histogram generation_us;     // Request sent to end of stream
+    Histogram chunks_per_second; // Content chunks per second after the first
+
+    // Reads. First reads of a file are hits when the content is stored,
+    // joins when it is already streaming, and misses when they start it.
+    Counter cache_hits;
+    Counter cache_misses;
+    Counter stream_joins;
+    Counter bytes_from_db;
+    Counter bytes_from_stream;
+
+    // "key=value" lines, like the user.simfs.* attributes
+    std::string formatText() const;
+    // Prometheus text exposition format, version 0.0.4
+    std::string formatPrometheus() const;
+
+private:
+    Op ops_[FUSE_OP_COUNT];
+};
+
+// Serves Metrics::formatPrometheus over HTTP on a Unix socket, for
+// `curl --unix-socket` or a scraping proxy. Throws if the socket can't be
+// bound.
+class MetricsServer {
+public:
+    MetricsServer(const std::string& socket_path, Metrics& metrics = Metrics::global());
+    ~MetricsServer();
+
+private:
+    void run();
+
+    std::string socket_path_;
+    Metrics& metrics_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef MOCK_BACKEND_H
+#define MOCK_BACKEND_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A delay in milliseconds drawn per request or per token
+struct LatencyDistribution {
+    enum class Kind { Fixed, Uniform, Normal, LogNormal };
+
+    Kind kind = Kind::Fixed;
+    double mean_ms = 0;
+    // Half-width for Uniform, standard deviation for Normal and LogNormal
+    double spread_ms = 0;
+
+    // "fixed:200", "uniform:200:50", "normal:200:50" or "lognormal:200:50";
+    // a bare number is fixed. Throws std::invalid_argument.
+    static LatencyDistribution parse(const std::string& spec);
+    double sample(std::mt19937_64& random) const;
+};
+
+struct MockBackendConfig {
+    std::string address = "127.0.0.1";
+    uint16_t port = 0;  // 0 picks a free port
+
+    LatencyDistribution ttft{LatencyDistribution::Kind::Fixed, 200, 0};
+    double tokens_per_second = 50;
+    double token_jitter = 0;  // Relative standard deviation of the gaps between tokens
+
+    // Completion length, capped by the request's max_tokens (per file for
+    // batch prompts)
+    size_t response_tokens = 200;
+
+    // Injected failures, as fractions of admitted requests
+    double error_rate = 0;       // 500 before the first token
+    double throttle_rate = 0;    // 429 with Retry-After
+    double disconnect_rate = 0;  // Stream cut halfway, without [DONE]
+    unsigned retry_after_seconds = 1;
+
+    // Completions served at once; further requests get a 429. 0 for no limit.
+    size_t max_concurrency = 0;
+
+    // Seeds the latency and failure draws. Content depends only on the
+    // request, so the same prompt always gets the same completion.
+    uint64_t seed = 1;
+};
+
+struct MockBackendStats {
+    uint64_t requests = 0;   // Completion requests received
+    uint64_t completed = 0;  // Served in full
+    uint64_t streamed = 0;   // Of those, as SSE
+    uint64_t throttled = 0;  // 429s, injected or over max_concurrency
+    uint64_t errors = 0;     // Injected 500s
+    uint64_t disconnected = 0;
+    uint64_t tokens = 0;
+    uint64_t peak_in_flight = 0;
+};
+
+// Local OpenAI-compatible inference server for tests and load runs without
+// a network. Serves POST /v1/chat/completions (streaming and not), plus
+// GET /health for the backend pool's probes, one thread per connection.
+class MockBackend {
+public:
+    explicit MockBackend(const MockBackendConfig& config = MockBackendConfig());
+    ~MockBackend();
+
+    uint16_t port() const { return port_; }
+    std::string url() const;  // The completions endpoint
+    MockBackendStats stats() const;
+    std::string formatStats() const;  // As JSON
+
+    // The completion for a user message: whitespace-separated tokens, or
+    // batch marker sections when the message asks for several files
+    std::vector<std::string> completionTokens(const std::string& prompt, size_t max_tokens) const;
+
+private:
+    void run();
+    void serve(int fd);
+    void respond(int fd, const std::string& method, const std::string& target, const std::string& body);
+    void complete(int fd, const std::string& body);
+
+    // Per-request draws, under random_mutex_
+    double draw(const LatencyDistribution& distribution);
+    bool chance(double probability);
+    double tokenGapMs();
+
+    MockBackendConfig config_;
+    int listen_fd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+
+    std::mutex random_mutex_;
+    std::mt19937_64 random_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    size_t connections_ = 0;  // Serving threads still running
+    size_t in_flight_ = 0;
+    MockBackendStats stats_;
+};
+
+#endif
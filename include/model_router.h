@@ -0,0 +1,63 @@
+#ifndef MODEL_ROUTER_H
+#define MODEL_ROUTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <cstdint>
+
+// Expected size of a file that has not been generated yet
+enum class SizeClass {
+    Small,   // Config files, stubs
+    Medium,
+    Large    // Long documents, data
+};
+
+// Rule from .simfs_config.toml choosing model settings by path:
+//   [[routes]]
+//   match = "*.json"         # fnmatch pattern, as for generators; omit to match any file
+//   size = "small"           # optional: small, medium or large
+//   model = "qwen2.5-0.5b"
+//   max_tokens = 512
+//   temperature = 0.2
+//   draft_model = "..."      # optional: stream this model's draft while `model` writes the file
+// Unset settings come from the directory's model, max_tokens, temperature
+// and draft_model.
+struct ModelRoute {
+    std::string pattern;
+    std::optional<SizeClass> size;
+    std::optional<std::string> model;
+    std::optional<size_t> max_tokens;
+    std::optional<double> temperature;
+    std::optional<std::string> draft_model;
+};
+
+// Model settings for one generation
+struct ModelChoice {
+    std::string model;
+    size_t max_tokens = 2048;
+    double temperature = 0.7;
+    std::string draft_model;  // Empty: no draft
+};
+
+class ModelRouter {
+public:
+    static constexpr uint64_t SMALL_BYTES = 2048;   // Smaller files are small
+    static constexpr uint64_t LARGE_BYTES = 16384;  // Files this size or more are large
+
+    static SizeClass classify(uint64_t bytes);
+    static std::optional<SizeClass> parseSizeClass(const std::string& name);
+    static const char* sizeClassName(SizeClass size);
+
+    // Median size of the siblings sharing the file's extension, or failing
+    // that a guess from the extension alone
+    static SizeClass expectedSize(const std::string& path, const std::map<std::string, uint64_t>& sibling_sizes);
+
+    // Settings of the first route matching the path and size, over the
+    // defaults. Routes of deeper directories come first.
+    static ModelChoice route(const std::string& path, SizeClass size, const std::vector<ModelRoute>& routes,
+                             const ModelChoice& defaults);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef MOUNT_CONFIG_H
+#define MOUNT_CONFIG_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <sys/types.h>
+
+// How generations triggered by a caller are scheduled
+enum class GenerationClass {
+    Foreground,  // Interactive users, served first
+    Background,  // Crawlers, backups, prefetch - only uses spare capacity
+    Denied       // Never triggers generation (reads of missing files return EOF)
+};
+
+// A single caller-matching rule. Empty/unset fields match any caller.
+struct PolicyRule {
+    std::string process;       // Glob matched against /proc/<pid>/comm
+    std::optional<uid_t> uid;
+    std::optional<pid_t> pid;
+    GenerationClass action = GenerationClass::Background;
+};
+
+// Per-uid limits. Zero means unlimited.
+struct UidQuota {
+    uid_t uid = 0;
+    size_t max_concurrent = 0;
+    size_t tokens_per_window = 0;
+};
+
+struct PolicyConfig {
+    // Rules are evaluated in order, first match wins. The built-in crawler
+    // rules are appended after user rules unless use_default_rules is false.
+    std::vector<PolicyRule> rules;
+    bool use_default_rules = true;
+
+    size_t max_concurrent_generations = 0;  // 0 = unlimited
+    size_t background_max_concurrent = 1;
+
+    // Quotas for uids without an explicit entry in `quotas`
+    size_t default_max_concurrent = 0;
+    size_t default_tokens_per_window = 0;
+    unsigned quota_window_seconds = 3600;
+    std::vector<UidQuota> quotas;
+};
+
+// Predictive pre-generation of files likely to be opened next
+struct PrefetchConfig {
+    bool enabled = false;
+    size_t token_budget = 50000;        // Tokens prefetch may spend per window
+    unsigned budget_window_seconds = 3600;
+    size_t max_predictions = 2;         // Files prefetched per access
+    double min_probability = 0.3;       // Markov transition threshold
+    bool follow_references = true;      // Prefetch files referenced by generated content
+};
+
+// Disk budget for generated content
+struct CapacityConfig {
+    bool enabled = false;
+    uint64_t budget_bytes = 0;          // Content bytes before eviction starts
+    double low_watermark = 0.9;         // Evict down to this fraction of the budget
+    unsigned frequency_half_life_seconds = 3600;  // Access counts halve this often
+    bool pin_seeds = true;              // Generate with a per-file seed so regeneration is reproducible
+};
+
+// One inference server. Prompt caching hints apply to llama.cpp-compatible
+// servers (llama-server, koboldcpp): with slots set, all requests for one
+// directory go to the same server slot, whose KV cache then already holds
+// their shared prefix.
+struct BackendConfig {
+    std::string url;                       // Chat completions endpoint; empty means --llm-endpoint
+    unsigned weight = 1;                   // Relative share of in-flight tokens
+    size_t max_concurrent = 0;             // Requests at once; 0 is unlimited
+    double requests_per_second = 0;        // Request rate; 0 is unlimited
+    unsigned burst = 0;                    // Requests above the rate allowed at once; 0 is one second's worth
+    std::vector<std::string> models;       // Models served; empty serves any model
+    std::string health_url;                // Probed while the circuit is open; defaults to <origin>/health
+    bool cache_prompt = false;             // Send "cache_prompt": true
+    unsigned slots = 0;                    // Server slots (llama-server --parallel); 0 lets the server pick
+    std::string slot_field = "id_slot";    // "slot_id" on older llama.cpp builds
+};
+
+// Failure and load handling across backends (see BackendPool)
+struct PoolConfig {
+    unsigned failure_threshold = 3;        // Consecutive failures that take a backend out of rotation
+    unsigned open_seconds = 30;            // Before a trial request is let through again
+    unsigned health_check_seconds = 10;    // Probe interval for backends out of rotation; 0 disables
+    
+    // Per-backend concurrency limit that grows while requests succeed and
+    // halves on 429/503 responses or first tokens slower than the target
+    bool adaptive_concurrency = false;
+    size_t initial_concurrency = 4;
+    size_t max_adaptive_concurrency = 64;  // Ceiling when the backend has no max_concurrent
+    unsigned latency_target_ms = 0;        // 0: only throttling responses cut the limit
+    
+    // Rounds over all backends for a request that failed before delivering
+    // anything, after a jittered exponential backoff
+    unsigned max_retries = 2;
+    unsigned retry_base_ms = 250;
+    unsigned retry_max_ms = 10000;         // Also caps Retry-After
+};
+
+// Duplicating slow requests on a second backend (see HedgePolicy)
+struct HedgeConfig {
+    bool enabled = false;
+    double percentile = 0.95;              // Hedge once a request waits longer than this share of first tokens did
+    unsigned min_delay_ms = 250;           // Never hedge sooner
+    unsigned min_samples = 20;             // First tokens observed before hedging starts
+    double max_fraction = 0.05;            // Share of requests that may be hedged
+};
+
+// Instrumentation (see Metrics); /.simfs/stats is always available
+struct MetricsConfig {
+    std::string prometheus_socket;         // Unix socket serving Prometheus text format; empty for none
+};
+
+// Span tracing of generations (see Tracer); user.simfs.tracing toggles it at runtime
+struct TracingConfig {
+    bool enabled = false;
+    size_t buffer_events = 16384;          // Spans kept per thread
+    std::string dump_path;                 // Written on SIGUSR2; empty for no handler
+    std::string access_trace;              // Every FUSE operation, for simfs-load --replay; empty for none
+};
+
+// Log verbosity (see Logger); -d on the command line turns on debug lines
+struct LoggingConfig {
+    std::string level = "info";            // debug, info, warning, error or off
+    unsigned rate_limit = 20;              // Lines per second per log statement; 0 for no limit
+};
+
+// Mount-wide settings loaded from the host-side file given with --config.
+// Per-directory settings live in .simfs_config.toml (see DirectoryConfig).
+struct MountConfig {
+    PolicyConfig policy;
+    PrefetchConfig prefetch;
+    CapacityConfig capacity;
+    BackendConfig backend;                 // [backend]: the --llm-endpoint server
+    std::vector<BackendConfig> backends;   // [[backends]]: replaces it when given
+    PoolConfig pool;
+    HedgeConfig hedging;
+    MetricsConfig metrics;
+    TracingConfig tracing;
+    LoggingConfig logging;
+
+    static MountConfig loadFromFile(const std::string& path);
+    static MountConfig parse(const std::string& toml_text);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PROCESS_POLICY_H
+#define PROCESS_POLICY_H
+
+#include "mount_config.h"
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unordered_map>
+#include <sys/types.h>
+
+// Identity of the process behind the current FUSE request
+struct CallerInfo {
+    pid_t pid = 0;
+    uid_t uid = 0;
+    gid_t gid = 0;
+    std::string comm;  // Process name from /proc/<pid>/comm
+};
+
+// Decides which callers may trigger generation and schedules their
+// generations so crawlers only get capacity that foreground users leave idle.
+class ProcessPolicy {
+public:
+    explicit ProcessPolicy(const PolicyConfig& config);
+
+    // Caller of the FUSE operation running on this thread. Outside of a FUSE
+    // request (tests, tools) this is the current process.
+    static CallerInfo currentCaller();
+    // The same without comm, which costs a /proc read; resolveComm fills it
+    // in later, e.g. off the request thread
+    static CallerInfo currentCallerIds();
+    static void resolveComm(CallerInfo& caller);
+
+    GenerationClass classify(const CallerInfo& caller) const;
+
+    // False once the uid has spent its token quota for the current window
+    bool hasTokenBudget(uid_t uid);
+
+    // Blocks until a generation slot is available for this uid and class.
+    // Every admit() must be paired with a release(), given the tokens the
+    // generation produced.
+    void admit(uid_t uid, GenerationClass generation_class);
+    void release(uid_t uid, GenerationClass generation_class, size_t generated_tokens);
+
+    // Rules appended when use_default_rules is set
+    static std::vector<PolicyRule> defaultRules();
+
+private:
+    struct UidState {
+        size_t active = 0;
+        size_t tokens_used = 0;
+        std::chrono::steady_clock::time_point window_start;
+    };
+
+    UidQuota quotaFor(uid_t uid) const;
+    UidState& stateFor(uid_t uid);
+    bool uidHasSlot(uid_t uid);
+    bool hasCapacity() const;
+
+    PolicyConfig config_;
+    std::vector<PolicyRule> rules_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<uid_t, UidState> uid_state_;
+    size_t active_total_ = 0;
+    size_t active_background_ = 0;
+    size_t waiting_foreground_ = 0;
+};
+
+#endif
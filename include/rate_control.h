@@ -0,0 +1,55 @@
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+#include <chrono>
+#include <cstddef>
+
+// Request rate limit: up to `burst` requests at once, refilled at `rate`
+// per second. A zero rate never limits.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double rate = 0, double burst = 1);
+
+    // Takes a token if one is available
+    bool take(Clock::time_point now);
+
+    // When take will next succeed
+    Clock::time_point nextAvailable(Clock::time_point now) const;
+
+private:
+    double available(Clock::time_point now) const;
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    Clock::time_point last_;
+};
+
+// Concurrency limit adjusted by additive increase, multiplicative decrease:
+// each success grows the limit by one per limit's worth of requests, and
+// each sign of overload (throttling, slow responses) cuts it by `factor`,
+// at most once per `cooldown` so one burst of errors counts once.
+class AimdLimit {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    AimdLimit(size_t initial, size_t max, double factor = 0.5,
+              std::chrono::milliseconds cooldown = std::chrono::milliseconds(1000));
+
+    size_t limit() const { return static_cast<size_t>(limit_); }
+
+    void onSuccess();
+    void onOverload(Clock::time_point now);
+
+private:
+    double limit_;
+    double max_;
+    double factor_;
+    std::chrono::milliseconds cooldown_;
+    Clock::time_point last_decrease_;
+    bool decreased_ = false;
+};
+
+#endif
@@ -8,26 +8,76 @@
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <deque>
+#include <condition_variable>
+#include <thread>
+#include <functional>
 #include "llm_client.h"  // For FileContext
+#include "mount_config.h"
+#include "process_policy.h"  // For CallerInfo
+#include "local_generator.h"  // For GeneratorRule
+#include "model_router.h"
 
 class DBManager;
 class LLMClient;
 class StreamingBuffer;
+class ProcessPolicy;
+class AccessPredictor;
+class CapacityManager;
+class ContentStore;
+class GenerationBatcher;
+class MetricsServer;
+class TraceDumper;
+class AccessRecorder;
+namespace rocksdb { class Snapshot; }
 
 // Configuration for per-directory settings
 struct DirectoryConfig {
     std::string model_name = "meta-llama/Llama-3.2-3B-Instruct";  // Default model
+    size_t max_tokens = 2048;
+    double temperature = 0.7;
+    
+    // When set, this model's output is streamed to readers while model_name
+    // writes the file; the larger model's version is what gets stored
+    std::string draft_model;
+    
+    // Model settings by path and expected size (see ModelRoute). Deeper
+    // directories' routes come first; the first match wins.
+    std::vector<ModelRoute> routes;
+    
+    bool generate_on_open = false;  // Start generating missing files at open() instead of first read()
+    
+    // Files matched here are produced in-process instead of by the LLM.
+    // Deeper directories' rules come first; the first match wins.
+    std::vector<GeneratorRule> generators;
+    bool use_default_generators = true;  // Fall back to GeneratorRegistry::defaultRules()
+    
+    // Prompt size limit, counted with the model's own vocabulary when
+    // tokenizer names one on the host (tiktoken file or tokenizer.json)
+    std::string tokenizer;
+    size_t prompt_token_budget = 8192;
+    
+    // Files outside the directory that best match the path (BM25 over the
+    // context index), added to prompts after recently read files
+    size_t related_files = 4;
+    
+    // Files of this directory requested within batch_window_ms of each
+    // other are generated by one request, up to batch_max_files at a time
+    bool batch_generation = false;
+    unsigned batch_window_ms = 50;
+    size_t batch_max_files = 8;
     
     // Future expansion possibilities:
-    // float temperature = 0.7;
-    // int max_tokens = 2048;
     // std::string system_prompt;
 };
 
 class SimFS {
 public:
-    SimFS(const std::string& db_path, const std::string& llm_endpoint);
+    SimFS(const std::string& db_path, const std::string& llm_endpoint,
+          const MountConfig& mount_config = MountConfig(),
+          const std::string& base_db_path = "");
     ~SimFS();
 
     static int getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
@@ -39,6 +89,14 @@ public:
     static int write(const char *path, const char *buf, size_t size, off_t offset,
                      struct fuse_file_info *fi);
     static int create(const char *path, mode_t mode, struct fuse_file_info *fi);
+    static int release(const char *path, struct fuse_file_info *fi);
+    static int poll(const char *path, struct fuse_file_info *fi,
+                    struct fuse_pollhandle *ph, unsigned *reventsp);
+    static int setxattr(const char *path, const char *name, const char *value, size_t size, int flags);
+    static int getxattr(const char *path, const char *name, char *value, size_t size);
+    static ssize_t copy_file_range(const char *path_in, struct fuse_file_info *fi_in, off_t offset_in,
+                                   const char *path_out, struct fuse_file_info *fi_out, off_t offset_out,
+                                   size_t size, int flags);
     static int unlink(const char *path);
     static int mkdir(const char *path, mode_t mode);
     static int rmdir(const char *path);
@@ -46,38 +104,191 @@ public:
     static void setInstance(SimFS* instance) { instance_ = instance; }
     static SimFS* getInstance() { return instance_; }
 
-    struct fuse_operations* getOperations();
+    static struct fuse_operations* getOperations();
+    
+    // Offline generation without a mount (simfs-gen). Uses the same context
+    // and config rules as reads through the mount, but the caller persists
+    // the results, typically in batches. Files generated locally are stored
+    // right away and flagged through `stored`, so they are not stored twice.
+    bool hasContent(const std::string& path);
+    std::shared_ptr<StreamingBuffer> startOfflineGeneration(const std::string& path, bool* stored = nullptr);
+    bool storeGeneratedFiles(const std::vector<std::pair<std::string, std::string>>& files);
+    std::vector<std::string> listUngeneratedFiles();
+    // Config files and /.simfs entries, which are never generated
+    static bool isSpecialFile(const std::string& path);
+    
+    // Prompt context and configuration as a generation of path would see
+    // them, e.g. for tests and bench/simfs_bench.cpp
+    std::vector<FileContext> getFolderContext(const std::string& path);
+    std::vector<FileContext> getRecentFilesWithContent(
+        const std::vector<std::string>& recent_paths,
+        const std::vector<std::string>& exclude_paths = {});
+    DirectoryConfig getConfigForPath(const std::string& path);
+    void clearConfigCache();
+    
+    // The stored bodies, bypassing generation and the FUSE bookkeeping
+    ContentStore& contentStore() { return *content_; }
+    // Returns once the generation streaming to path, if any, has been
+    // committed or dropped
+    void waitForStream(const std::string& path);
+    // Runs an eviction pass now instead of on the eviction worker
+    void evictColdFiles();
 
 private:
     std::string generateContent(const std::string& path);
     std::string getFileContent(const std::string& path);
     bool fileExists(const std::string& path);
     std::vector<std::string> getDirectoryContents(const std::string& path);
-    std::string getFolderContext(const std::string& path);
+    
+    // Streaming generation. startGeneration requires mutex_ to be held and
+    // leaves buffer empty if the caller may not trigger generation. `stored`
+    // is set when the file was generated locally and is already persisted.
+    // Callers must call registerPendingCommits once they release mutex_.
+    enum class GenerationSource {
+        Caller,    // A FUSE request, subject to the process policy
+        Prefetch,  // Predicted access, background priority
+        Offline,   // simfs-gen, persisted by the caller
+        Regenerate // New version of a stored file, committed once complete
+    };
+    int startGeneration(const std::string& path, std::shared_ptr<StreamingBuffer>& buffer,
+                        GenerationSource source = GenerationSource::Caller, bool* stored = nullptr);
+    bool kickoffGeneration(const std::string& path, bool ignore_config = false);
+    // Stores a finished generation, unless the file was written since
+    // `base` was read, and retires the streamed buffer (the completed one
+    // unless a draft was streamed in its place). Takes mutex_.
+    void commitGeneratedContent(const std::string& path, const StreamingBuffer& completed,
+                                const std::string& base, const StreamingBuffer* streamed = nullptr);
+    void registerPendingCommits();
+    ModelChoice chooseModel(const std::string& path, const DirectoryConfig& config);
+    bool persistGeneratedFiles(const std::vector<std::pair<std::string, std::string>>& files);
+    bool generateLocally(const std::string& path, const DirectoryConfig& config,
+                         std::shared_ptr<StreamingBuffer>& buffer);
+    
+    // Stale-while-regenerate: readers keep getting the stored version while
+    // a new one is generated in the background, which then replaces it in
+    // one write unless the file changed in the meantime
+    int regenerate(const std::string& path);
+    void commitRegeneration(const std::string& path, const StreamingBuffer& completed, const std::string& base);
+    void endRegeneration(const std::string& path, bool committed);
+    std::string formatVersionStats(const std::string& path);
+    std::string formatRegenerationStats() const;
+    
+    // Access recording and predictive pre-generation. Opens are queued for
+    // the prefetch worker, so the request thread only pays for the queueing.
+    void recordAccessAndPrefetch(const std::string& path);
+    void runPrefetchWorker();
+    void prefetch(const std::string& path);
+    std::string formatPrefetchStats() const;
+    
+    // Disk budget enforcement. Eviction runs on the eviction worker under
+    // mutex_, so it can't interleave with writes; callers that may already
+    // hold mutex_ only request it.
+    void enforceCapacity();
+    void runEvictionWorker();
+    // Generates an evicted file again and waits until it is stored, so a
+    // write can apply to its body. Returns -EIO if that failed.
+    int restoreEvicted(const std::string& path);
+    std::string formatCapacityStats() const;
+    
+    // Per-backend load and circuit state
+    std::string formatBackendStats() const;
+    
+    // Open file tracking (fuse_file_info::fh), used for poll readiness
+    uint64_t registerOpenFile(const std::string& path, bool pin_version,
+                              std::shared_ptr<const std::string> contents = nullptr);
+    void advanceOpenFile(struct fuse_file_info *fi, off_t offset);
+    off_t openFileOffset(struct fuse_file_info *fi);
+    std::shared_ptr<const rocksdb::Snapshot> openFileSnapshot(struct fuse_file_info *fi);
+    std::shared_ptr<const std::string> openFileContents(struct fuse_file_info *fi);
     
     // Configuration management
-    DirectoryConfig getConfigForPath(const std::string& path);
-    DirectoryConfig loadConfigFromDirectory(const std::string& dir_path);
-    static bool isSpecialFile(const std::string& path);
+    void loadConfigFromDirectory(const std::string& dir_path, DirectoryConfig& config);
+    std::shared_ptr<const Tokenizer> tokenizerFor(const DirectoryConfig& config);
     
     // Helper functions
-    std::string getTailContent(const std::string& content, size_t max_chars);
-    std::vector<FileContext> getRecentFilesWithContent(
-        const std::vector<std::string>& recent_paths,
-        const std::vector<std::string>& exclude_paths = {});
+    // Up to count indexed files related to path, as snippets of their
+    // previews. Reads only the database, so it needs no lock.
+    std::vector<FileContext> getRelatedFiles(const std::string& path, size_t count,
+                                             const std::unordered_set<std::string>& exclude);
+    // getRelatedFiles, deferred to the generation's worker thread
+    std::function<std::vector<FileContext>()> relatedFilesProvider(
+        const std::string& path, size_t count, const std::vector<std::string>& exclude_paths,
+        const std::vector<FileContext>& files);
 
     std::unique_ptr<DBManager> db_;
+    std::unique_ptr<ContentStore> content_;
     std::unique_ptr<LLMClient> llm_client_;
+    std::unique_ptr<ProcessPolicy> policy_;
+    std::unique_ptr<AccessPredictor> predictor_;
+    PrefetchConfig prefetch_config_;
+    std::unique_ptr<CapacityManager> capacity_;
+    std::unique_ptr<GeneratorRegistry> generators_;
+    std::unique_ptr<MetricsServer> metrics_server_;
+    std::unique_ptr<TraceDumper> trace_dumper_;
+    std::unique_ptr<AccessRecorder> access_recorder_;
+    std::unique_ptr<GenerationBatcher> batcher_;  // Reset by ~SimFS, then llm_client_: pending batches use the members above
     mutable std::mutex mutex_;
     
+    // Commit callbacks of streams started under mutex_. They are attached
+    // once it is released, since a stream that has already finished runs
+    // its callback right away and the commit takes mutex_.
+    std::vector<std::function<void()>> pending_commits_;
+    
     // Streaming support
     mutable std::mutex streaming_mutex_;
     mutable std::unordered_map<std::string, std::shared_ptr<StreamingBuffer>> streaming_buffers_;
+    std::condition_variable streaming_retired_;  // A buffer was committed or dropped
+    
+    // Open files, keyed by fuse_file_info::fh
+    struct OpenFile {
+        std::string path;
+        off_t offset;  // Next sequential read offset
+        // Read-only opens of stored files read the version they opened
+        std::shared_ptr<const rocksdb::Snapshot> snapshot;
+        // Files under /.simfs that are too costly to format per read, as of the open
+        std::shared_ptr<const std::string> contents;
+        bool written = false;  // Derived records are refreshed on release
+    };
+    mutable std::mutex open_files_mutex_;
+    std::unordered_map<uint64_t, OpenFile> open_files_;
+    uint64_t next_file_handle_ = 1;
+    
+    // Regenerations under way, by path
+    struct RegenerationStats {
+        size_t requested = 0;
+        size_t committed = 0;
+        size_t discarded = 0;  // Failed, or the file changed meanwhile
+    };
+    mutable std::mutex regeneration_mutex_;
+    std::unordered_set<std::string> regenerating_;
+    RegenerationStats regeneration_stats_;
     
     // Configuration cache
     mutable std::mutex config_mutex_;
     mutable std::unordered_map<std::string, DirectoryConfig> config_cache_;
     
+    // Loaded tokenizers by file path; null if the file couldn't be loaded
+    std::mutex tokenizers_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Tokenizer>> tokenizers_;
+    
+    // Opens waiting for the prefetch worker, with their callers
+    static constexpr size_t MAX_QUEUED_OPENS = 1024;  // Beyond this, opens go unrecorded
+    std::mutex prefetch_mutex_;
+    std::condition_variable prefetch_cv_;
+    std::deque<std::pair<std::string, CallerInfo>> prefetch_queue_;
+    // Generated text files, cut to AccessPredictor::MAX_SCANNED_BYTES,
+    // whose references the worker records
+    std::deque<std::pair<std::string, std::string>> reference_queue_;
+    bool prefetch_stopping_ = false;
+    std::thread prefetch_worker_;
+    
+    // Pending eviction pass for the eviction worker
+    std::mutex eviction_mutex_;
+    std::condition_variable eviction_cv_;
+    bool eviction_requested_ = false;
+    bool eviction_stopping_ = false;
+    std::thread eviction_worker_;
+    
     static SimFS* instance_;
     static struct fuse_operations operations_;
 };
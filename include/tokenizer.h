@@ -0,0 +1,53 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+// Byte-level BPE tokenizer for prompt budgeting. Loads either a tiktoken
+// rank file (one "<base64 token> <rank>" per line, e.g. cl100k_base.tiktoken)
+// or a Hugging Face tokenizer.json with a byte-level BPE model (GPT-2,
+// Llama 3, Qwen, ...). Pre-tokenization follows the cl100k pattern, with
+// all non-ASCII characters treated as letters.
+//
+// A default-constructed Tokenizer has no vocabulary and estimates three
+// bytes per token, as SimFS did before tokenizers were configurable.
+class Tokenizer {
+public:
+    Tokenizer();
+
+    // Throws std::runtime_error if the file can't be read or parsed
+    static std::shared_ptr<const Tokenizer> load(const std::string& path);
+
+    bool exact() const { return !ranks_.empty(); }
+
+    std::vector<uint32_t> encode(const std::string& text) const;
+    size_t count(const std::string& text) const;
+
+    // Longest prefix (or suffix) of text that fits in max_tokens, cut at a
+    // token boundary
+    std::string truncate(const std::string& text, size_t max_tokens) const;
+    std::string truncateTail(const std::string& text, size_t max_tokens) const;
+
+    // Splits text into pre-tokens, exposed for testing
+    static std::vector<std::string> pretokenize(const std::string& text);
+
+private:
+    static const size_t APPROXIMATE_BYTES_PER_TOKEN = 3;
+
+    void addRank(const std::string& token, uint32_t rank);
+    void loadTiktoken(const std::string& data);
+    void loadHuggingFace(const std::string& data);
+
+    // Calls visit(rank, byte_length) for each token of text, in order
+    void forEachToken(const std::string& text, const std::function<void(uint32_t, size_t)>& visit) const;
+    void encodePiece(const std::string& piece, const std::function<void(uint32_t, size_t)>& visit) const;
+
+    std::unordered_map<std::string, uint32_t> ranks_;
+};
+
+#endif
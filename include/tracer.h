@@ -0,0 +1,190 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct TraceEvent {
+    const char* name;      // Static strings only
+    const char* category;
+    uint64_t start_us;     // steady_clock
+    uint64_t duration_us;
+    uint64_t flow;         // Generation the span belongs to; 0 for none
+    std::string detail;    // Path or backend URL
+};
+
+// Span tracing of the read -> generation -> commit pipeline, exported as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Each thread
+// records into its own ring buffer of the last buffer_events spans, so
+// threads never contend with each other. Events of threads that have
+// exited move to one shared ring of the same size. While disabled, a span
+// costs one relaxed load.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t DEFAULT_BUFFER_EVENTS = 16384;
+
+    static Tracer& global();
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    // Applies to buffers created afterwards
+    void setBufferEvents(size_t events);
+
+    void record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                std::string_view detail = {}, uint64_t flow = 0);
+
+    std::vector<TraceEvent> events() const;
+    void clear();
+
+    std::string exportChromeJson() const;
+    // Written to a temporary file and renamed, so readers never see half a trace
+    bool dump(const std::string& path) const;
+
+private:
+    struct ThreadBuffer {
+        std::mutex mutex;  // Only contended while exporting
+        std::vector<TraceEvent> events;
+        size_t capacity = 0;
+        size_t next = 0;   // Oldest event once full
+        uint64_t tid = 0;
+
+        void append(TraceEvent event);
+        void copyTo(std::vector<TraceEvent>& out, std::vector<uint64_t>* tids) const;
+    };
+    friend struct ThreadBufferHolder;
+
+    Tracer() = default;
+    ThreadBuffer& threadBuffer();
+    void retire(const std::shared_ptr<ThreadBuffer>& buffer);
+    std::vector<TraceEvent> collect(std::vector<uint64_t>& tids) const;
+
+    static std::atomic<bool> enabled_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+    std::deque<std::pair<TraceEvent, uint64_t>> retired_;  // With the thread id
+    std::atomic<size_t> buffer_events_{DEFAULT_BUFFER_EVENTS};
+};
+
+// Marks the spans a thread records as belonging to one generation, so the
+// export can draw arrows between its stages across threads
+class TraceFlow {
+public:
+    explicit TraceFlow(uint64_t id) : previous_(current_) { current_ = id; }
+    ~TraceFlow() { current_ = previous_; }
+    TraceFlow(const TraceFlow&) = delete;
+    TraceFlow& operator=(const TraceFlow&) = delete;
+
+    static uint64_t current() { return current_; }
+    // A new id while tracing, 0 otherwise
+    static uint64_t next();
+
+private:
+    uint64_t previous_;
+    static thread_local uint64_t current_;
+};
+
+// Records the time from construction to end() or destruction
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category, std::string_view detail = {})
+        : name_(name), category_(category), active_(Tracer::enabled()) {
+        if (active_) {
+            detail_ = detail;
+            flow_ = TraceFlow::current();
+            start_ = Tracer::Clock::now();
+        }
+    }
+    ~TraceSpan() { end(); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void end() {
+        if (active_) {
+            active_ = false;
+            Tracer::global().record(name_, category_, start_, Tracer::Clock::now(), detail_, flow_);
+        }
+    }
+
+private:
+    const char* name_;
+    const char* category_;
+    bool active_;
+    std::string detail_;
+    uint64_t flow_ = 0;
+    Tracer::Clock::time_point start_;
+};
+
+// One FUSE operation as recorded for replay by simfs-load
+struct AccessRecord {
+    uint64_t time_us = 0;  // Since recording started
+    std::string op;        // Metrics::opName
+    int64_t result = 0;
+    uint64_t fh = 0;       // Pairs an open with its reads, writes and release
+    int flags = 0;         // Open flags
+    uint64_t size = 0;
+    int64_t offset = 0;
+    std::string path;
+
+    // One tab-separated line, path last and escaped, without the newline
+    std::string format() const;
+    static bool parse(const std::string& line, AccessRecord& record);
+};
+
+// Appends every FUSE operation to a trace file, with its start time. Lines
+// are written in blocks, at least once a second; the file is complete once
+// the recorder is destroyed, after the last operation. One per process.
+// Throws if the file can't be created.
+class AccessRecorder {
+public:
+    explicit AccessRecorder(const std::string& path);
+    ~AccessRecorder();
+    AccessRecorder(const AccessRecorder&) = delete;
+    AccessRecorder& operator=(const AccessRecorder&) = delete;
+
+    static AccessRecorder* active() { return active_.load(std::memory_order_acquire); }
+    void record(Tracer::Clock::time_point start, AccessRecord record);
+
+    static constexpr const char* HEADER = "# simfs access trace v1";
+
+private:
+    void writePending();  // Caller holds mutex_
+
+    static std::atomic<AccessRecorder*> active_;
+
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::string pending_;
+    Tracer::Clock::time_point start_;
+    Tracer::Clock::time_point last_write_;
+};
+
+// Dumps Tracer::global() to a file whenever the process gets a signal.
+// The handler only writes to a pipe; a thread does the dumping. One per
+// process. Throws if the handler can't be installed.
+class TraceDumper {
+public:
+    TraceDumper(const std::string& path, int signum = SIGUSR2);
+    ~TraceDumper();
+
+private:
+    void run();
+
+    std::string path_;
+    int signum_;
+    struct sigaction previous_;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef WORLD_ARCHIVE_H
+#define WORLD_ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class DBManager;
+
+struct ArchiveStats {
+    std::string root;          // Subtree root as stored in the archive
+    size_t sst_files = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;        // Uncompressed key + value bytes
+};
+
+// Moves generated subtrees between databases as sorted SST files.
+//
+// An archive is a directory holding 000001.sst, 000002.sst, ... and a
+// MANIFEST.simfs text file. Keys of every path-keyed keyspace (meta:,
+// content:, access:, transition:, refs:) under the subtree are exported
+// from a single snapshot, optionally rebased under another root. Imports
+// ingest the files directly into the LSM tree; existing keys are
+// overwritten, other keys are left alone, so archives also work as deltas.
+class WorldArchive {
+public:
+    static const uint64_t DEFAULT_MAX_FILE_SIZE = 256ull << 20;
+
+    // Throws std::runtime_error on failure
+    static ArchiveStats exportSubtree(DBManager& db, const std::string& subtree,
+                                      const std::string& output_dir,
+                                      const std::string& rebase_to = "",
+                                      uint64_t max_file_size = DEFAULT_MAX_FILE_SIZE);
+    static ArchiveStats importArchive(DBManager& db, const std::string& input_dir,
+                                      bool move_files = false);
+
+    // Maps `path` from under `from` to under `to`, or returns "" if it is
+    // outside `from`
+    static std::string rebasePath(const std::string& path, const std::string& from, const std::string& to);
+
+private:
+    static std::string rebaseValue(const std::string& keyspace, const std::string& value,
+                                   const std::string& from, const std::string& to);
+};
+
+#endif
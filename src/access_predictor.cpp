@@ -0,0 +1,499 @@
+#include "access_predictor.h"
+#include "db_manager.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <string_view>
+#include <unordered_set>
+
+static const size_t MAX_SEQUENCE_LENGTH = 64;
+static const size_t MAX_TRANSITIONS_PER_FILE = 32;
+static const size_t MAX_REFERENCES_PER_FILE = 16;
+
+struct Transition {
+    size_t count;
+    std::string path;
+};
+
+static std::vector<Transition> parseTransitions(const std::string& value) {
+    std::vector<Transition> transitions;
+    std::istringstream lines(value);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            continue;
+        }
+        try {
+            transitions.push_back({std::stoul(line.substr(0, tab)), line.substr(tab + 1)});
+        } catch (const std::exception&) {
+            // A corrupt line loses its count, not the file's predictions
+        }
+    }
+    return transitions;
+}
+
+static std::vector<std::string> splitLines(const std::string& value) {
+    std::vector<std::string> lines;
+    std::istringstream stream(value);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+AccessPredictor::AccessPredictor(DBManager& db, const PrefetchConfig& config)
+    : db_(db), config_(config), window_start_(std::chrono::steady_clock::now()) {
+}
+
+std::string AccessPredictor::parentDirectory(const std::string& path) {
+    size_t last_slash = path.find_last_of('/');
+    if (last_slash == std::string::npos || last_slash == 0) {
+        return "/";
+    }
+    return path.substr(0, last_slash);
+}
+
+std::string AccessPredictor::normalizePath(const std::string& path) {
+    std::vector<std::string> components;
+    std::istringstream stream(path);
+    std::string component;
+    while (std::getline(stream, component, '/')) {
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == "..") {
+            if (!components.empty()) {
+                components.pop_back();
+            }
+            continue;
+        }
+        components.push_back(component);
+    }
+
+    std::string normalized;
+    for (const auto& c : components) {
+        normalized += "/" + c;
+    }
+    return normalized.empty() ? "/" : normalized;
+}
+
+void AccessPredictor::recordOpen(const std::string& path) {
+    recordOpens({path});
+}
+
+void AccessPredictor::recordOpens(const std::vector<std::string>& paths) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Later opens in the batch build on the updates of earlier ones
+    std::unordered_map<std::string, std::string> updates;
+    auto read = [this, &updates](const std::string& key) {
+        auto it = updates.find(key);
+        if (it != updates.end()) {
+            return it->second;
+        }
+        std::string value;
+        db_.get(key, value);
+        return value;
+    };
+    for (const auto& path : paths) {
+        recordOpenLocked(path, read, updates);
+    }
+    if (!updates.empty()) {
+        db_.writeBatch(std::vector<std::pair<std::string, std::string>>(updates.begin(), updates.end()));
+    }
+}
+
+void AccessPredictor::recordOpenLocked(const std::string& path,
+                                       const std::function<std::string(const std::string&)>& read,
+                                       std::unordered_map<std::string, std::string>& updates) {
+    std::string dir = parentDirectory(path);
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    std::string sequence_key = "access:" + dir;
+
+    std::vector<std::string> names = splitLines(read(sequence_key));
+
+    // Fall back to the persisted sequence after a restart
+    std::string previous = last_opened_[dir];
+    if (previous.empty() && !names.empty()) {
+        previous = (dir == "/" ? "" : dir) + "/" + names.back();
+    }
+    if (previous == path) {
+        return;
+    }
+    last_opened_[dir] = path;
+
+    // Update the first-order transition counts for previous -> path
+    if (!previous.empty()) {
+        std::string transition_key = "transition:" + previous;
+        auto transitions = parseTransitions(read(transition_key));
+
+        auto it = std::find_if(transitions.begin(), transitions.end(),
+                               [&path](const Transition& t) { return t.path == path; });
+        if (it != transitions.end()) {
+            it->count++;
+        } else {
+            transitions.push_back({1, path});
+        }
+
+        std::stable_sort(transitions.begin(), transitions.end(),
+                         [](const Transition& a, const Transition& b) { return a.count > b.count; });
+        if (transitions.size() > MAX_TRANSITIONS_PER_FILE) {
+            transitions.resize(MAX_TRANSITIONS_PER_FILE);
+        }
+
+        std::ostringstream serialized;
+        for (const auto& t : transitions) {
+            serialized << t.count << '\t' << t.path << '\n';
+        }
+        updates[transition_key] = serialized.str();
+    }
+
+    // Append to the directory's access sequence
+    names.push_back(name);
+    if (names.size() > MAX_SEQUENCE_LENGTH) {
+        names.erase(names.begin(), names.end() - MAX_SEQUENCE_LENGTH);
+    }
+    std::ostringstream serialized;
+    for (const auto& n : names) {
+        serialized << n << '\n';
+    }
+    updates[sequence_key] = serialized.str();
+}
+
+void AccessPredictor::recordReferences(const std::string& path, const std::string& content) {
+    auto references = extractReferences(path, content);
+    if (references.empty()) {
+        return;
+    }
+
+    std::ostringstream serialized;
+    for (const auto& reference : references) {
+        serialized << reference << '\n';
+    }
+    db_.put("refs:" + path, serialized.str());
+}
+
+std::vector<std::string> AccessPredictor::predict(const std::string& path) {
+    std::vector<std::string> predictions;
+    std::unordered_set<std::string> seen{path};
+
+    std::string value;
+    if (db_.get("transition:" + path, value)) {
+        auto transitions = parseTransitions(value);
+        size_t total = 0;
+        for (const auto& t : transitions) {
+            total += t.count;
+        }
+        for (const auto& t : transitions) {
+            double probability = static_cast<double>(t.count) / total;
+            if (probability >= config_.min_probability && seen.insert(t.path).second) {
+                predictions.push_back(t.path);
+            }
+        }
+    }
+
+    if (config_.follow_references && db_.get("refs:" + path, value)) {
+        for (const auto& reference : splitLines(value)) {
+            if (seen.insert(reference).second) {
+                predictions.push_back(reference);
+            }
+        }
+    }
+
+    if (predictions.size() > config_.max_predictions) {
+        predictions.resize(config_.max_predictions);
+    }
+    return predictions;
+}
+
+bool AccessPredictor::reservePrefetch(const std::string& path, size_t estimated_tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - window_start_ >= std::chrono::seconds(config_.budget_window_seconds)) {
+        // Prefetches unused since before the window that just ended are
+        // given up on, so they may be prefetched again
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (!reserved_.count(it->first) && it->second.completed < window_start_) {
+                stats_.tokens_wasted += it->second.tokens;
+                it = pending_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        window_start_ = now;
+        window_tokens_ = 0;
+    }
+    if (window_tokens_ >= config_.token_budget || pending_.count(path)) {
+        return false;
+    }
+
+    pending_[path] = Prefetched();
+    reserved_[path] = Reservation{estimated_tokens, window_start_};
+    window_tokens_ += estimated_tokens;
+    stats_.issued++;
+    return true;
+}
+
+void AccessPredictor::completePrefetch(const std::string& path, size_t tokens, bool success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto reservation = reserved_.find(path);
+    if (reservation != reserved_.end()) {
+        // A window that rolled over since was never charged the estimate
+        if (reservation->second.window_start == window_start_) {
+            window_tokens_ -= std::min(window_tokens_, reservation->second.tokens);
+        }
+        reserved_.erase(reservation);
+    }
+    window_tokens_ += tokens;
+    stats_.tokens_spent += tokens;
+
+    auto it = pending_.find(path);
+    if (!success) {
+        if (it != pending_.end()) {
+            pending_.erase(it);
+        }
+        return;
+    }
+
+    stats_.completed++;
+    if (it != pending_.end()) {
+        it->second.tokens = tokens;  // Not used yet
+        it->second.completed = std::chrono::steady_clock::now();
+    }
+}
+
+bool AccessPredictor::recordHit(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(path);
+    if (it == pending_.end()) {
+        return false;
+    }
+    pending_.erase(it);
+    stats_.hits++;
+    return true;
+}
+
+PrefetchStats AccessPredictor::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PrefetchStats stats = stats_;
+    for (const auto& entry : pending_) {
+        stats.tokens_wasted += entry.second.tokens;
+    }
+    return stats;
+}
+
+// Hand-written matchers for the reference syntaxes below. Targets are
+// bounded in length and never cross a line, so every pass is linear in
+// the scanned text and needs constant stack, whatever the input.
+static const size_t MAX_TARGET_LENGTH = 1024;
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static size_t skipSpaces(std::string_view text, size_t pos) {
+    while (pos < text.size() && isSpace(text[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static bool hasWordAt(std::string_view text, size_t pos, std::string_view word) {
+    return text.substr(pos, word.size()) == word;
+}
+
+// A target at pos opened by one of `quotes` (none if empty) and closed by
+// one of `closers`, made of characters outside `stops`. Returns the
+// position after the closer, or npos.
+static size_t readTarget(std::string_view text, size_t pos, std::string_view quotes, std::string_view stops,
+                         std::string_view closers, std::string& target) {
+    if (!quotes.empty()) {
+        if (pos >= text.size() || quotes.find(text[pos]) == std::string_view::npos) {
+            return std::string_view::npos;
+        }
+        pos++;
+    }
+    size_t end = pos;
+    while (end < text.size() && end - pos <= MAX_TARGET_LENGTH && text[end] != '\n' &&
+           stops.find(text[end]) == std::string_view::npos) {
+        end++;
+    }
+    if (end == pos || end - pos > MAX_TARGET_LENGTH || end >= text.size() ||
+        closers.find(text[end]) == std::string_view::npos) {
+        return std::string_view::npos;
+    }
+    target.assign(text.substr(pos, end - pos));
+    return end + 1;
+}
+
+// #include "target"
+static void scanIncludes(std::string_view text, const std::function<void(std::string)>& add) {
+    for (size_t pos = text.find('#'); pos != std::string_view::npos; pos = text.find('#', pos + 1)) {
+        size_t word = skipSpaces(text, pos + 1);
+        if (!hasWordAt(text, word, "include")) {
+            continue;
+        }
+        size_t quote = skipSpaces(text, word + 7);
+        std::string target;
+        if (quote > word + 7 && readTarget(text, quote, "\"", "\"", "\"", target) != std::string_view::npos) {
+            add(target);
+        }
+    }
+}
+
+// Calls match at every occurrence of one of words, in order, resuming
+// after a successful match
+static void scanWords(std::string_view text, const std::vector<std::string_view>& words,
+                      const std::function<size_t(size_t)>& match) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t next = pos + 1;
+        for (const auto& word : words) {
+            if (hasWordAt(text, pos, word)) {
+                size_t end = match(pos + word.size());
+                if (end != std::string_view::npos) {
+                    next = end;
+                    break;
+                }
+            }
+        }
+        pos = next;
+    }
+}
+
+// from './target', import "../target", require('./target')
+static void scanImports(std::string_view text, const std::function<void(std::string)>& add) {
+    scanWords(text, {"from", "import", "require("}, [&](size_t pos) {
+        std::string target;
+        size_t end = readTarget(text, skipSpaces(text, pos), "'\"", "'\"", "'\"", target);
+        if (end == std::string_view::npos || !(target.rfind("./", 0) == 0 || target.rfind("../", 0) == 0)) {
+            return std::string_view::npos;
+        }
+        add(target);
+        return end;
+    });
+}
+
+// [text](target)
+static void scanMarkdownLinks(std::string_view text, const std::function<void(std::string)>& add) {
+    for (size_t pos = text.find("]("); pos != std::string_view::npos; pos = text.find("](", pos + 1)) {
+        std::string target;
+        if (readTarget(text, pos + 2, "", ")# \t\r\f\v", ")", target) != std::string_view::npos) {
+            add(target);
+        }
+    }
+}
+
+// href="target", src='target'
+static void scanHtmlLinks(std::string_view text, const std::function<void(std::string)>& add) {
+    scanWords(text, {"href", "src"}, [&](size_t pos) {
+        size_t equals = skipSpaces(text, pos);
+        if (equals >= text.size() || text[equals] != '=') {
+            return std::string_view::npos;
+        }
+        std::string target;
+        size_t end = readTarget(text, skipSpaces(text, equals + 1), "\"'", "\"'#", "\"'", target);
+        if (end != std::string_view::npos) {
+            add(target);
+        }
+        return end;
+    });
+}
+
+// Relative Python imports at the start of a line: from .module import ...
+static void scanPythonImports(std::string_view text, const std::function<void(std::string)>& add) {
+    for (size_t line = 0; line < text.size(); ) {
+        size_t pos = skipSpaces(text, line);
+        size_t next = text.find('\n', line);
+        line = next == std::string_view::npos ? text.size() : next + 1;
+        if (!hasWordAt(text, pos, "from")) {
+            continue;
+        }
+        size_t module = skipSpaces(text, pos + 4);
+        size_t end = module;
+        while (end < text.size() && text[end] == '.') {
+            end++;
+        }
+        if (module == pos + 4 || end == module) {
+            continue;
+        }
+        while (end < text.size() && (isWordChar(text[end]) || text[end] == '.')) {
+            end++;
+        }
+        size_t keyword = skipSpaces(text, end);
+        if (keyword > end && hasWordAt(text, keyword, "import")) {
+            add(std::string(text.substr(module, end - module)));
+        }
+    }
+}
+
+std::vector<std::string> AccessPredictor::extractReferences(const std::string& path, const std::string& content) {
+    // References sit near the top of a file; the rest isn't worth scanning
+    std::string_view text(content.data(), std::min(content.size(), MAX_SCANNED_BYTES));
+
+    std::string dir = parentDirectory(path);
+    size_t last_dot = path.find_last_of('.');
+    std::string extension = (last_dot != std::string::npos && last_dot > path.find_last_of('/'))
+        ? path.substr(last_dot) : "";
+
+    std::vector<std::string> references;
+    std::unordered_set<std::string> seen{path};
+
+    auto add = [&](std::string target) {
+        if (target.empty() || target.find("://") != std::string::npos ||
+            target.rfind("mailto:", 0) == 0) {
+            return;
+        }
+        std::string resolved = normalizePath(target[0] == '/' ? target : dir + "/" + target);
+
+        // Only files with an extension are generated lazily
+        size_t slash = resolved.find_last_of('/');
+        size_t dot = resolved.find_last_of('.');
+        if (dot == std::string::npos || dot < slash) {
+            if (extension.empty()) {
+                return;
+            }
+            resolved += extension;
+        }
+        if (references.size() < MAX_REFERENCES_PER_FILE && seen.insert(resolved).second) {
+            references.push_back(resolved);
+        }
+    };
+
+    scanIncludes(text, add);
+    scanImports(text, add);
+    scanMarkdownLinks(text, add);
+    scanHtmlLinks(text, add);
+
+    // Relative Python imports: leading dots climb directories, other dots
+    // are separators. Absolute imports are mostly third-party and skipped.
+    if (extension == ".py") {
+        scanPythonImports(text, [&](const std::string& module) {
+            std::string target;
+            size_t i = 0;
+            while (i < module.size() && module[i] == '.') {
+                if (i > 0) {
+                    target += "../";
+                }
+                i++;
+            }
+            std::string rest = module.substr(i);
+            if (rest.empty()) {
+                return;
+            }
+            std::replace(rest.begin(), rest.end(), '.', '/');
+            add(target + rest + ".py");
+        });
+    }
+
+    return references;
+}
@@ -0,0 +1,268 @@
+#include "backend_pool.h"
+#include "logger.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <cmath>
+
+static size_t discardBody(char*, size_t size, size_t nmemb, void*) {
+    return size * nmemb;
+}
+
+BackendPool::BackendPool(const std::vector<BackendConfig>& backends, const PoolConfig& config, Probe probe)
+    : config_(config), probe_(probe ? probe : httpProbe) {
+    for (const auto& backend : backends) {
+        Backend state;
+        state.config = backend;
+        state.bucket = TokenBucket(backend.requests_per_second,
+                                   backend.burst ? backend.burst : std::ceil(backend.requests_per_second));
+        if (config_.adaptive_concurrency) {
+            size_t ceiling = backend.max_concurrent ? backend.max_concurrent : config_.max_adaptive_concurrency;
+            state.adaptive.emplace(config_.initial_concurrency, ceiling);
+        }
+        backends_.push_back(state);
+    }
+    if (config_.health_check_seconds > 0) {
+        health_thread_ = std::thread([this]() { runHealthChecks(); });
+    }
+}
+
+BackendPool::~BackendPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    health_cv_.notify_all();
+    if (health_thread_.joinable()) {
+        health_thread_.join();
+    }
+}
+
+bool BackendPool::serves(const Backend& backend, const std::string& model) const {
+    const auto& models = backend.config.models;
+    return models.empty() || std::find(models.begin(), models.end(), model) != models.end();
+}
+
+bool BackendPool::inRotation(const Backend& backend, std::chrono::steady_clock::time_point now) const {
+    switch (backend.circuit) {
+        case Circuit::Closed:
+            return true;
+        case Circuit::Open:
+            return now >= backend.open_until;  // Ready for a trial request
+        case Circuit::HalfOpen:
+            return false;  // Until the trial request finishes
+    }
+    return false;
+}
+
+size_t BackendPool::concurrencyLimit(const Backend& backend) const {
+    return backend.adaptive ? backend.adaptive->limit() : backend.config.max_concurrent;
+}
+
+int BackendPool::acquire(const std::string& model, size_t tokens, const std::vector<int>& exclude, bool wait) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        bool candidates = false;
+        auto wake = std::chrono::steady_clock::time_point::max();  // A candidate held back by time frees up
+        int best = -1;
+        double best_load = 0;
+        for (size_t i = 0; i < backends_.size(); i++) {
+            const Backend& backend = backends_[i];
+            if (!serves(backend, model) || !inRotation(backend, now) ||
+                std::find(exclude.begin(), exclude.end(), static_cast<int>(i)) != exclude.end()) {
+                continue;
+            }
+            candidates = true;
+            size_t limit = concurrencyLimit(backend);
+            if (limit > 0 && backend.in_flight >= limit) {
+                continue;
+            }
+            if (now < backend.retry_after) {
+                wake = std::min(wake, backend.retry_after);
+                continue;
+            }
+            auto next_token = backend.bucket.nextAvailable(now);
+            if (next_token > now) {
+                wake = std::min(wake, next_token);
+                continue;
+            }
+            double load = static_cast<double>(backend.in_flight_tokens + tokens) /
+                          std::max(1u, backend.config.weight);
+            if (best < 0 || load < best_load) {
+                best = static_cast<int>(i);
+                best_load = load;
+            }
+        }
+
+        if (best >= 0) {
+            Backend& backend = backends_[best];
+            if (backend.circuit == Circuit::Open) {
+                backend.circuit = Circuit::HalfOpen;  // This request is the trial
+            }
+            backend.bucket.take(now);
+            backend.in_flight++;
+            backend.in_flight_tokens += tokens;
+            backend.requests++;
+            return best;
+        }
+        if (!candidates || !wait) {
+            return -1;
+        }
+        if (wake == std::chrono::steady_clock::time_point::max()) {
+            available_cv_.wait(lock);
+        } else {
+            available_cv_.wait_until(lock, wake);
+        }
+    }
+}
+
+void BackendPool::release(int index, size_t tokens, bool success) {
+    Outcome outcome;
+    outcome.success = success;
+    release(index, tokens, outcome);
+}
+
+void BackendPool::release(int index, size_t tokens, const Outcome& outcome) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Backend& backend = backends_[index];
+    backend.in_flight--;
+    backend.in_flight_tokens -= std::min(tokens, backend.in_flight_tokens);
+    auto now = std::chrono::steady_clock::now();
+
+    if (outcome.throttled) {
+        // Overloaded, but answering: back off without opening the circuit
+        backend.throttled++;
+        if (backend.adaptive) {
+            backend.adaptive->onOverload(now);
+        }
+        auto wait = std::min(outcome.retry_after, std::chrono::milliseconds(config_.retry_max_ms));
+        backend.retry_after = std::max(backend.retry_after, now + wait);
+    } else if (outcome.success) {
+        if (backend.adaptive) {
+            if (config_.latency_target_ms > 0 &&
+                outcome.latency > std::chrono::milliseconds(config_.latency_target_ms)) {
+                backend.adaptive->onOverload(now);
+            } else {
+                backend.adaptive->onSuccess();
+            }
+        }
+    }
+
+    // Throttling and rejected requests show the backend is answering
+    if (outcome.success || outcome.throttled || outcome.client_error) {
+        if (backend.circuit != Circuit::Closed) {
+            LOG_INFO << "Backend " << backend.config.url << " is back in rotation";
+        }
+        backend.circuit = Circuit::Closed;
+        backend.consecutive_failures = 0;
+    } else {
+        backend.failures++;
+        backend.consecutive_failures++;
+        if (backend.circuit == Circuit::HalfOpen ||
+            (backend.circuit == Circuit::Closed && config_.failure_threshold > 0 &&
+             backend.consecutive_failures >= config_.failure_threshold)) {
+            openCircuit(backend);
+        }
+    }
+    available_cv_.notify_all();
+}
+
+void BackendPool::cancel(int index, size_t tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Backend& backend = backends_[index];
+    backend.in_flight--;
+    backend.in_flight_tokens -= std::min(tokens, backend.in_flight_tokens);
+    if (backend.circuit == Circuit::HalfOpen) {
+        // The trial proved nothing; the next request gets to be one
+        backend.circuit = Circuit::Open;
+        backend.open_until = std::chrono::steady_clock::now();
+    }
+    available_cv_.notify_all();
+}
+
+void BackendPool::openCircuit(Backend& backend) {
+    backend.circuit = Circuit::Open;
+    backend.open_until = std::chrono::steady_clock::now() + std::chrono::seconds(config_.open_seconds);
+    LOG_WARNING << "Backend " << backend.config.url << " taken out of rotation after "
+              << backend.consecutive_failures << " consecutive failures";
+}
+
+void BackendPool::runHealthChecks() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        health_cv_.wait_for(lock, std::chrono::seconds(config_.health_check_seconds),
+                            [this]() { return stopping_; });
+        if (stopping_) {
+            return;
+        }
+
+        for (size_t i = 0; i < backends_.size(); i++) {
+            if (backends_[i].circuit != Circuit::Open) {
+                continue;
+            }
+            // Configs never change, so the probe can run unlocked
+            lock.unlock();
+            bool healthy = probe_(backends_[i].config);
+            lock.lock();
+            if (stopping_) {
+                return;
+            }
+            Backend& backend = backends_[i];
+            if (healthy && backend.circuit == Circuit::Open) {
+                LOG_INFO << "Backend " << backend.config.url << " passed its health check";
+                backend.circuit = Circuit::Closed;
+                backend.consecutive_failures = 0;
+                available_cv_.notify_all();
+            }
+        }
+    }
+}
+
+std::vector<BackendPool::Stats> BackendPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Stats> result;
+    for (const auto& backend : backends_) {
+        result.push_back({backend.config.url, backend.circuit, backend.in_flight, backend.in_flight_tokens,
+                          backend.requests, backend.failures, backend.throttled, concurrencyLimit(backend)});
+    }
+    return result;
+}
+
+std::string BackendPool::healthUrl(const BackendConfig& backend) {
+    if (!backend.health_url.empty()) {
+        return backend.health_url;
+    }
+    size_t scheme = backend.url.find("://");
+    size_t path = backend.url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    return backend.url.substr(0, path) + "/health";
+}
+
+bool BackendPool::httpProbe(const BackendConfig& backend) {
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+    std::string url = healthUrl(backend);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardBody);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(curl);
+    return res == CURLE_OK && status >= 200 && status < 300;
+}
+
+const char* BackendPool::circuitName(Circuit circuit) {
+    switch (circuit) {
+        case Circuit::Closed:
+            return "closed";
+        case Circuit::Open:
+            return "open";
+        case Circuit::HalfOpen:
+            return "half_open";
+    }
+    return "unknown";
+}
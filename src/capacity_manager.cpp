@@ -0,0 +1,311 @@
+#include "capacity_manager.h"
+#include "logger.h"
+#include "db_manager.h"
+#include "content_store.h"
+#include "fnv1a.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+bool FileMetadata::hasFlag(const std::string& metadata, const std::string& flag) {
+    size_t pos = 0;
+    while ((pos = metadata.find(';' + flag, pos)) != std::string::npos) {
+        size_t end = pos + 1 + flag.size();
+        if (end == metadata.size() || metadata[end] == ';' || metadata[end] == '=') {
+            return true;
+        }
+        pos = end;
+    }
+    return false;
+}
+
+std::string FileMetadata::withFlag(const std::string& metadata, const std::string& flag) {
+    std::string name = flag.substr(0, flag.find('='));
+    std::string result = withoutFlag(metadata, name);
+    return result + ";" + flag;
+}
+
+std::string FileMetadata::withoutFlag(const std::string& metadata, const std::string& flag) {
+    std::string result;
+    size_t start = 0;
+    while (start <= metadata.size()) {
+        size_t end = metadata.find(';', start);
+        if (end == std::string::npos) {
+            end = metadata.size();
+        }
+        std::string field = metadata.substr(start, end - start);
+        if (field != flag && field.compare(0, flag.size() + 1, flag + "=") != 0) {
+            result += (result.empty() ? "" : ";") + field;
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+uint64_t FileMetadata::pinnedSeed(const std::string& path, const std::string& metadata) {
+    size_t pos = metadata.find(";seed=");
+    if (pos != std::string::npos) {
+        try {
+            return std::stoull(metadata.substr(pos + 6));
+        } catch (const std::exception&) {
+            // Fall back to the derived seed
+        }
+    }
+
+    // Stable across builds; kept below 2^31 since some backends reject
+    // larger seeds
+    return fnv1a(path) & 0x7fffffff;
+}
+
+uint64_t FileMetadata::version(const std::string& metadata) {
+    size_t pos = metadata.find(";version=");
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    try {
+        return std::stoull(metadata.substr(pos + 9));
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+CapacityManager::CapacityManager(DBManager& db, ContentStore& content, const CapacityConfig& config)
+    : db_(db), content_(content), config_(config) {
+    stats_.budget_bytes = config_.budget_bytes;
+    if (config_.enabled) {
+        load();
+    }
+}
+
+void CapacityManager::load() {
+    // Sizes are not persisted separately, so rebuild usage from the content
+    // keyspace. Files start out equally cold.
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Entry> files;
+    std::vector<std::string> paths;
+    db_.scan({"content:"}, [&](const std::string& key, const std::string& value) {
+        Entry entry;
+        paths.push_back(key.substr(8));
+        entry.blob = blobKey(paths.back(), value);
+        entry.bytes = ContentStore::storedSize(value);
+        files.push_back(entry);
+        return true;
+    });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string metadata;
+        Entry& entry = files[i];
+        entry.evictable = db_.get("meta:" + paths[i], metadata) &&
+                          FileMetadata::hasFlag(metadata, "generated");
+        entry.last_access = now;
+        acquireBlob(entry.blob, entry.bytes);
+        entries_[paths[i]] = entry;
+    }
+    stats_.files = entries_.size();
+
+    LOG_INFO << "Capacity: " << stats_.usage_bytes << " of " << config_.budget_bytes
+              << " bytes used by " << stats_.files << " files in " << stats_.blobs << " blobs";
+}
+
+double CapacityManager::decayedFrequency(const Entry& entry, std::chrono::steady_clock::time_point now) const {
+    double age = std::chrono::duration<double>(now - entry.last_access).count();
+    double half_life = std::max(1u, config_.frequency_half_life_seconds);
+    return entry.frequency * std::exp2(-age / half_life);
+}
+
+std::string CapacityManager::blobKey(const std::string& path, const std::string& value) {
+    // Inline bodies (stored before deduplication, or after a hash
+    // collision) belong to their path alone
+    std::string hash = ContentStore::blobOf(value);
+    return hash.empty() ? "inline:" + path : hash;
+}
+
+void CapacityManager::acquireBlob(const std::string& key, uint64_t bytes) {
+    Blob& blob = blobs_[key];
+    if (blob.paths++ == 0) {
+        blob.bytes = bytes;
+        stats_.usage_bytes += bytes;
+    }
+    stats_.blobs = blobs_.size();
+}
+
+uint64_t CapacityManager::releaseBlob(const std::string& key) {
+    auto it = blobs_.find(key);
+    if (it == blobs_.end() || --it->second.paths > 0) {
+        return 0;
+    }
+    uint64_t bytes = it->second.bytes;
+    stats_.usage_bytes -= bytes;
+    blobs_.erase(it);
+    stats_.blobs = blobs_.size();
+    return bytes;
+}
+
+void CapacityManager::recordStore(const std::string& path, uint64_t bytes, bool evictable) {
+    if (!config_.enabled) {
+        return;
+    }
+
+    // The caller has just stored the body, so its reference names the blob
+    std::string value;
+    std::string blob = db_.get("content:" + path, value) ? blobKey(path, value) : "inline:" + path;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        it = entries_.emplace(path, Entry()).first;
+        it->second.last_access = now;
+    }
+
+    Entry& entry = it->second;
+    if (entry.blob != blob) {
+        acquireBlob(blob, bytes);
+        if (!entry.blob.empty()) {
+            releaseBlob(entry.blob);
+        }
+        entry.blob = blob;
+    }
+    entry.bytes = bytes;
+    entry.evictable = evictable;
+    entry.frequency = decayedFrequency(entry, now) + 1;
+    entry.last_access = now;
+    stats_.files = entries_.size();
+}
+
+void CapacityManager::recordAccess(const std::string& path) {
+    if (!config_.enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    it->second.frequency = decayedFrequency(it->second, now) + 1;
+    it->second.last_access = now;
+}
+
+void CapacityManager::recordRemove(const std::string& path) {
+    if (!config_.enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return;
+    }
+    releaseBlob(it->second.blob);
+    entries_.erase(it);
+    stats_.files = entries_.size();
+}
+
+void CapacityManager::recordRegeneration(const std::string& path) {
+    (void) path;
+    if (!config_.enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.regenerations++;
+}
+
+size_t CapacityManager::enforce(const std::function<bool(const std::string& path)>& can_evict) {
+    if (!config_.enabled) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.usage_bytes <= config_.budget_bytes) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(config_.budget_bytes * config_.low_watermark);
+    auto now = std::chrono::steady_clock::now();
+
+    // Paths sharing a blob are one candidate, since only evicting all of
+    // them frees it; accesses to any of them keep it warm
+    struct Candidate {
+        double frequency = 0.0;
+        std::chrono::steady_clock::time_point last_access;
+        std::vector<std::string> paths;
+        bool evictable = true;
+    };
+    std::unordered_map<std::string, Candidate> by_blob;
+    for (const auto& entry : entries_) {
+        if (entry.second.bytes == 0) {
+            continue;
+        }
+        Candidate& candidate = by_blob[entry.second.blob];
+        candidate.frequency += decayedFrequency(entry.second, now);
+        candidate.last_access = std::max(candidate.last_access, entry.second.last_access);
+        candidate.paths.push_back(entry.first);
+        candidate.evictable = candidate.evictable && entry.second.evictable;
+    }
+    std::vector<Candidate> candidates;
+    for (auto& entry : by_blob) {
+        if (entry.second.evictable) {
+            candidates.push_back(std::move(entry.second));
+        }
+    }
+
+    // Coldest first: lowest decayed frequency, then least recently used
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.frequency != b.frequency) {
+            return a.frequency < b.frequency;
+        }
+        return a.last_access < b.last_access;
+    });
+
+    size_t evicted = 0;
+    for (const auto& candidate : candidates) {
+        if (stats_.usage_bytes <= target) {
+            break;
+        }
+        if (!std::all_of(candidate.paths.begin(), candidate.paths.end(), can_evict)) {
+            continue;
+        }
+
+        // Re-check the flags in case a file was written since it was tracked
+        std::vector<std::pair<std::string, std::string>> flags;
+        for (const auto& path : candidate.paths) {
+            std::string metadata;
+            if (!db_.get("meta:" + path, metadata) || !FileMetadata::hasFlag(metadata, "generated")) {
+                entries_[path].evictable = false;
+                break;
+            }
+            flags.emplace_back("meta:" + path, FileMetadata::withFlag(metadata, "evicted"));
+        }
+        if (flags.size() < candidate.paths.size() || !content_.write({}, candidate.paths, flags)) {
+            continue;
+        }
+
+        for (const auto& path : candidate.paths) {
+            stats_.evicted_bytes += releaseBlob(entries_[path].blob);
+            entries_.erase(path);
+            stats_.evictions++;
+            evicted++;
+        }
+    }
+    stats_.files = entries_.size();
+
+    if (evicted > 0) {
+        LOG_INFO << "Capacity: evicted " << evicted << " files, "
+                  << stats_.usage_bytes << " of " << config_.budget_bytes << " bytes used";
+    }
+    if (stats_.usage_bytes > config_.budget_bytes) {
+        LOG_WARNING << "Capacity: over budget with nothing left to evict ("
+                  << stats_.usage_bytes << " bytes)";
+    }
+    return evicted;
+}
+
+CapacityStats CapacityManager::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
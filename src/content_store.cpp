@@ -0,0 +1,527 @@
+#include "content_store.h"
+#include "logger.h"
+#include "db_manager.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+static const std::string REFERENCE_PREFIX = std::string("\0blob:", 6);
+static const size_t HASH_HEX_LENGTH = 16;
+
+// XXH64 (seed 0). Bodies are hashed on every write, so this needs to be
+// much faster than a cryptographic hash; collisions are caught by comparing
+// bodies before a blob is shared.
+static const uint64_t PRIME1 = 11400714785074694791ull;
+static const uint64_t PRIME2 = 14029467366897019727ull;
+static const uint64_t PRIME3 = 1609587929392839161ull;
+static const uint64_t PRIME4 = 9650029242287828579ull;
+static const uint64_t PRIME5 = 2870177450012600261ull;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t val) {
+    acc ^= xxhRound(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t ContentStore::hash(const std::string& body) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(body.data());
+    const unsigned char* end = p + body.size();
+    uint64_t h;
+
+    if (body.size() >= 32) {
+        uint64_t v1 = PRIME1 + PRIME2;
+        uint64_t v2 = PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - PRIME1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    } else {
+        h = PRIME5;
+    }
+
+    h += body.size();
+
+    while (p + 8 <= end) {
+        h ^= xxhRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+ContentStore::ContentStore(DBManager& db) : db_(db), index_(db) {
+}
+
+std::string ContentStore::makeReference(uint64_t hash, uint64_t size) {
+    char hex[HASH_HEX_LENGTH + 1];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return REFERENCE_PREFIX + hex + ":" + std::to_string(size);
+}
+
+bool ContentStore::isReference(const std::string& value) {
+    size_t size_start = REFERENCE_PREFIX.size() + HASH_HEX_LENGTH + 1;
+    if (value.size() <= size_start || value.compare(0, REFERENCE_PREFIX.size(), REFERENCE_PREFIX) != 0 ||
+        value[size_start - 1] != ':') {
+        return false;
+    }
+    return value.find_first_not_of("0123456789", size_start) == std::string::npos;
+}
+
+std::string ContentStore::hashOf(const std::string& reference) {
+    return reference.substr(REFERENCE_PREFIX.size(), HASH_HEX_LENGTH);
+}
+
+uint64_t ContentStore::storedSize(const std::string& value) {
+    if (!isReference(value)) {
+        return value.size();
+    }
+    return std::stoull(value.substr(REFERENCE_PREFIX.size() + HASH_HEX_LENGTH + 1));
+}
+
+std::string ContentStore::blobOf(const std::string& value) {
+    return isReference(value) ? hashOf(value) : std::string();
+}
+
+bool ContentStore::resolve(const std::string& value, std::string& body, const DBManager::Snapshot& snapshot) {
+    if (!isReference(value)) {
+        body = value;
+        return true;
+    }
+    return db_.get("blob:" + hashOf(value), body, snapshot);
+}
+
+uint64_t ContentStore::refcount(const std::string& hash) {
+    std::string value;
+    if (!db_.get("refcount:" + hash, value)) {
+        return 0;
+    }
+    return std::stoull(value);
+}
+
+bool ContentStore::get(const std::string& path, std::string& body, const DBManager::Snapshot& snapshot) {
+    // A concurrent write may release the blob between the two lookups;
+    // re-read the reference in that case
+    for (int attempt = 0; attempt < 3; attempt++) {
+        std::string value;
+        if (!db_.get("content:" + path, value, snapshot)) {
+            return false;
+        }
+        if (resolve(value, body, snapshot)) {
+            return true;
+        }
+    }
+    LOG_WARNING << "Missing blob for " << path;
+    return false;
+}
+
+bool ContentStore::exists(const std::string& path) {
+    return db_.exists("content:" + path);
+}
+
+bool ContentStore::size(const std::string& path, uint64_t& size, const DBManager::Snapshot& snapshot) {
+    std::string value;
+    if (!db_.get("content:" + path, value, snapshot)) {
+        return false;
+    }
+    size = storedSize(value);
+    return true;
+}
+
+bool ContentStore::write(const std::vector<std::pair<std::string, std::string>>& bodies,
+                         const std::vector<std::string>& removed_paths,
+                         const std::vector<std::pair<std::string, std::string>>& extra_puts,
+                         const std::vector<std::string>& extra_removes,
+                         bool update_derived) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<std::string, std::string>> puts = extra_puts;
+    std::vector<std::string> removes = extra_removes;
+    std::unordered_map<std::string, int64_t> deltas;
+    std::unordered_map<std::string, const std::string*> new_bodies;
+    DigestMap digests;
+    ContextIndex::Pending index_changes;
+
+    auto releaseOld = [&](const std::string& path) {
+        std::string old;
+        if (db_.get("content:" + path, old) && isReference(old)) {
+            deltas[hashOf(old)]--;
+        }
+    };
+
+    for (const auto& entry : bodies) {
+        releaseOld(entry.first);
+        if (update_derived) {
+            FilePreview preview = FilePreview::fromContent(entry.second);
+            stagePreview(entry.first, preview, puts, digests);
+            stageIndex(entry.first, preview, entry.second, index_changes, puts, removes);
+        }
+
+        std::string reference = makeReference(hash(entry.second), entry.second.size());
+        std::string blob_hash = hashOf(reference);
+
+        // Share an existing blob only if it really holds the same bytes
+        bool collision = false;
+        auto pending = new_bodies.find(blob_hash);
+        if (pending != new_bodies.end()) {
+            collision = *pending->second != entry.second;
+        } else {
+            std::string existing;
+            if (db_.get("blob:" + blob_hash, existing)) {
+                collision = existing != entry.second;
+            } else {
+                new_bodies[blob_hash] = &entry.second;
+            }
+        }
+
+        if (collision) {
+            if (isReference(entry.second)) {
+                return false;  // Would be misread as a reference if stored inline
+            }
+            LOG_WARNING << "Hash collision, storing " << entry.first << " inline";
+            puts.emplace_back("content:" + entry.first, entry.second);
+            continue;
+        }
+
+        deltas[blob_hash]++;
+        puts.emplace_back("content:" + entry.first, reference);
+    }
+
+    for (const auto& path : removed_paths) {
+        releaseOld(path);
+        removes.push_back("content:" + path);
+        stageRemoval(path, removes, digests, index_changes);
+    }
+    stageDigests(digests, puts, removes);
+    index_.stageStats(index_changes, puts);
+
+    for (const auto& delta : deltas) {
+        if (delta.second == 0) {
+            continue;
+        }
+        int64_t count = static_cast<int64_t>(refcount(delta.first)) + delta.second;
+        if (count <= 0) {
+            removes.push_back("blob:" + delta.first);
+            removes.push_back("refcount:" + delta.first);
+            continue;
+        }
+        puts.emplace_back("refcount:" + delta.first, std::to_string(count));
+        auto body = new_bodies.find(delta.first);
+        if (body != new_bodies.end()) {
+            puts.emplace_back("blob:" + delta.first, *body->second);
+        }
+    }
+
+    return db_.writeBatch(puts, removes);
+}
+
+bool ContentStore::refreshDerived(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<std::string, std::string>> puts;
+    std::vector<std::string> removes;
+    DigestMap digests;
+    ContextIndex::Pending index_changes;
+    std::string body;
+    if (get(path, body)) {
+        FilePreview preview = FilePreview::fromContent(body);
+        stagePreview(path, preview, puts, digests);
+        stageIndex(path, preview, body, index_changes, puts, removes);
+    } else {
+        stageRemoval(path, removes, digests, index_changes);
+    }
+    stageDigests(digests, puts, removes);
+    index_.stageStats(index_changes, puts);
+    return db_.writeBatch(puts, removes);
+}
+
+bool ContentStore::put(const std::string& path, const std::string& body) {
+    return write({{path, body}});
+}
+
+bool ContentStore::remove(const std::string& path) {
+    return write({}, {path});
+}
+
+bool ContentStore::copy(const std::string& from, const std::string& to,
+                        const std::vector<std::pair<std::string, std::string>>& extra_puts) {
+    std::string value;
+    if (!db_.get("content:" + from, value)) {
+        return false;
+    }
+    if (!isReference(value)) {
+        return write({{to, value}}, {}, extra_puts);
+    }
+    if (from == to) {
+        return extra_puts.empty() || db_.writeBatch(extra_puts, {});
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Re-read under the lock so the blob can't be released in between
+    if (!db_.get("content:" + from, value) || !isReference(value)) {
+        return false;
+    }
+    std::string blob_hash = hashOf(value);
+    std::unordered_map<std::string, int64_t> deltas{{blob_hash, 1}};
+
+    std::string old;
+    if (db_.get("content:" + to, old) && isReference(old)) {
+        deltas[hashOf(old)]--;
+    }
+
+    std::vector<std::pair<std::string, std::string>> puts = extra_puts;
+    puts.emplace_back("content:" + to, value);
+    std::vector<std::string> removes;
+
+    FilePreview copied;
+    std::string record;
+    std::string body;
+    bool have_preview = db_.get("preview:" + from, record) && FilePreview::parse(record, copied);
+    if (!have_preview || copied.isText()) {
+        // The index needs the words of text files, not just their preview
+        if (!resolve(value, body)) {
+            return false;
+        }
+        copied = FilePreview::fromContent(body);
+    }
+    DigestMap digests;
+    ContextIndex::Pending index_changes;
+    stagePreview(to, copied, puts, digests);
+    stageIndex(to, copied, body, index_changes, puts, removes);
+    stageDigests(digests, puts, removes);
+    index_.stageStats(index_changes, puts);
+    for (const auto& delta : deltas) {
+        if (delta.second == 0) {
+            continue;
+        }
+        int64_t count = static_cast<int64_t>(refcount(delta.first)) + delta.second;
+        if (count <= 0) {
+            removes.push_back("blob:" + delta.first);
+            removes.push_back("refcount:" + delta.first);
+        } else {
+            puts.emplace_back("refcount:" + delta.first, std::to_string(count));
+        }
+    }
+    return db_.writeBatch(puts, removes);
+}
+
+static std::string parentOf(const std::string& path) {
+    return path.substr(0, path.find_last_of('/'));
+}
+
+DirectoryDigest& ContentStore::pendingDigest(DigestMap& digests, const std::string& path) {
+    std::string dir = parentOf(path);
+    auto it = digests.find(dir);
+    if (it == digests.end()) {
+        it = digests.emplace(dir, DirectoryDigest()).first;
+        directoryDigest(dir, it->second);
+    }
+    return it->second;
+}
+
+void ContentStore::stagePreview(const std::string& path, const FilePreview& preview,
+                                std::vector<std::pair<std::string, std::string>>& puts, DigestMap& digests) {
+    puts.emplace_back("preview:" + path, preview.serialize());
+    FilePreview entry = preview;
+    entry.tail.clear();
+    pendingDigest(digests, path).files[path] = entry;
+}
+
+void ContentStore::stageIndex(const std::string& path, const FilePreview& preview, const std::string& body,
+                              ContextIndex::Pending& pending, std::vector<std::pair<std::string, std::string>>& puts,
+                              std::vector<std::string>& removes) {
+    if (preview.isText()) {
+        index_.stageDocument(path, ContextIndex::Document::analyze(path, body), pending, puts, removes);
+    } else {
+        index_.stageRemoval(path, pending, removes);
+    }
+}
+
+void ContentStore::stageRemoval(const std::string& path, std::vector<std::string>& removes, DigestMap& digests,
+                                ContextIndex::Pending& pending) {
+    removes.push_back("preview:" + path);
+    pendingDigest(digests, path).files.erase(path);
+    index_.stageRemoval(path, pending, removes);
+}
+
+void ContentStore::stageDigests(const DigestMap& digests, std::vector<std::pair<std::string, std::string>>& puts,
+                                std::vector<std::string>& removes) {
+    for (const auto& digest : digests) {
+        if (digest.second.files.empty()) {
+            removes.push_back("digest:" + digest.first);
+        } else {
+            puts.emplace_back("digest:" + digest.first, digest.second.serialize());
+        }
+    }
+}
+
+bool ContentStore::preview(const std::string& path, FilePreview& preview) {
+    std::string record;
+    return db_.get("preview:" + path, record) && FilePreview::parse(record, preview);
+}
+
+bool ContentStore::directoryDigest(const std::string& dir, DirectoryDigest& digest) {
+    std::string record;
+    if (!db_.get("digest:" + dir, record)) {
+        digest.files.clear();
+        return false;
+    }
+    return DirectoryDigest::parse(record, digest);
+}
+
+size_t ContentStore::rebuildPreviews(const std::string& root) {
+    std::string dir_root = root == "/" ? "" : root;
+    std::string prefix = dir_root + "/";
+    auto under = [&dir_root, &prefix](const std::string& path) {
+        return path == dir_root || path.compare(0, prefix.size(), prefix) == 0;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<std::string, std::string>> puts;
+    std::vector<std::string> removes;
+    std::unordered_set<std::string> has_content;
+    DigestMap digests;
+    ContextIndex::Pending index_changes;
+    size_t files = 0;
+
+    db_.scan({"content:" + prefix}, [&](const std::string& key, const std::string& value) {
+        std::string path = key.substr(8);
+        std::string body;
+        if (!resolve(value, body)) {
+            return true;
+        }
+        FilePreview preview = FilePreview::fromContent(body);
+        puts.emplace_back("preview:" + path, preview.serialize());
+        stageIndex(path, preview, body, index_changes, puts, removes);
+        preview.tail.clear();
+        digests[parentOf(path)].files[path] = preview;
+        has_content.insert(path);
+        files++;
+
+        if (puts.size() >= 256) {
+            db_.writeBatch(puts, removes);
+            puts.clear();
+            removes.clear();
+        }
+        return true;
+    });
+
+    // Drop records of files that no longer have content
+    std::vector<std::string> unindexed;
+    db_.scan({"preview:" + prefix, "indexdoc:" + prefix, "digest:" + dir_root},
+             [&](const std::string& key, const std::string&) {
+        if (key.compare(0, 8, "preview:") == 0) {
+            if (!has_content.count(key.substr(8))) {
+                removes.push_back(key);
+            }
+        } else if (key.compare(0, 9, "indexdoc:") == 0) {
+            if (!has_content.count(key.substr(9))) {
+                unindexed.push_back(key.substr(9));
+            }
+        } else if (under(key.substr(7)) && !digests.count(key.substr(7))) {
+            removes.push_back(key);
+        }
+        return true;
+    });
+
+    for (const auto& path : unindexed) {
+        index_.stageRemoval(path, index_changes, removes);
+    }
+
+    stageDigests(digests, puts, removes);
+    index_.stageStats(index_changes, puts);
+    if (!db_.writeBatch(puts, removes)) {
+        LOG_WARNING << "Failed to rebuild previews under " << (root.empty() ? "/" : root);
+    }
+    return files;
+}
+
+bool ContentStore::release(const std::string& reference) {
+    if (!isReference(reference)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string blob_hash = hashOf(reference);
+    uint64_t count = refcount(blob_hash);
+    if (count <= 1) {
+        return db_.writeBatch({}, {"blob:" + blob_hash, "refcount:" + blob_hash});
+    }
+    return db_.put("refcount:" + blob_hash, std::to_string(count - 1));
+}
+
+size_t ContentStore::deduplicate(size_t batch_size) {
+    std::vector<std::pair<std::string, std::string>> batch;
+    size_t converted = 0;
+
+    auto flush = [&]() {
+        if (!batch.empty() && write(batch)) {
+            converted += batch.size();
+        }
+        batch.clear();
+    };
+
+    db_.scan({"content:"}, [&](const std::string& key, const std::string& value) {
+        if (!isReference(value)) {
+            batch.emplace_back(key.substr(8), value);
+            if (batch.size() >= batch_size) {
+                flush();
+            }
+        }
+        return true;
+    });
+    flush();
+
+    return converted;
+}
@@ -0,0 +1,311 @@
+#include "context_index.h"
+#include "db_manager.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <unordered_map>
+
+static bool isWordStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isWordChar(char c) {
+    return isWordStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool isUpper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+static bool isLower(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+static std::string lowercase(const std::string& word) {
+    std::string lowered = word;
+    for (char& c : lowered) {
+        if (isUpper(c)) {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return lowered;
+}
+
+ContextIndex::ContextIndex(DBManager& db) : db_(db) {
+}
+
+std::vector<std::string> ContextIndex::terms(const std::string& text) {
+    std::vector<std::string> result;
+    auto add = [&result](const std::string& word) {
+        if (word.size() >= 2 && word.size() <= MAX_TERM_LENGTH) {
+            result.push_back(lowercase(word));
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        if (!isWordStart(text[pos])) {
+            pos++;  // Numbers are skipped like any other non-identifier character
+            continue;
+        }
+
+        size_t end = pos;
+        while (end < text.size() && isWordChar(text[end])) {
+            end++;
+        }
+        std::string word = text.substr(pos, end - pos);
+        pos = end;
+        add(word);
+
+        // Split at underscores and case changes: parseHTTPHeader -> parse, http, header
+        std::vector<std::string> parts;
+        std::string part;
+        for (size_t i = 0; i < word.size(); i++) {
+            char c = word[i];
+            bool boundary = c == '_' ||
+                (isUpper(c) && i > 0 && isLower(word[i - 1])) ||
+                (isUpper(c) && i + 1 < word.size() && isLower(word[i + 1]) && i > 0 && isUpper(word[i - 1]));
+            if (boundary && !part.empty()) {
+                parts.push_back(part);
+                part.clear();
+            }
+            if (c != '_') {
+                part += c;
+            }
+        }
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+        if (parts.size() > 1) {
+            for (const auto& p : parts) {
+                add(p);
+            }
+        }
+    }
+    return result;
+}
+
+ContextIndex::Document ContextIndex::Document::analyze(const std::string& path, const std::string& body) {
+    std::unordered_map<std::string, uint32_t> counts;
+    for (const auto& term : terms(body.substr(0, MAX_INDEXED_BYTES))) {
+        counts[term]++;
+    }
+    // The path says what a file is about more reliably than any one line
+    for (const auto& term : terms(path)) {
+        counts[term] += PATH_TERM_WEIGHT;
+    }
+
+    // Keep the most frequent terms of large files
+    std::vector<std::pair<std::string, uint32_t>> ranked(counts.begin(), counts.end());
+    if (ranked.size() > MAX_TERMS_PER_FILE) {
+        std::partial_sort(ranked.begin(), ranked.begin() + MAX_TERMS_PER_FILE, ranked.end(),
+                          [](const auto& a, const auto& b) {
+                              return a.second != b.second ? a.second > b.second : a.first < b.first;
+                          });
+        ranked.resize(MAX_TERMS_PER_FILE);
+    }
+
+    Document document;
+    for (const auto& entry : ranked) {
+        document.frequencies.insert(entry);
+        document.length += entry.second;
+    }
+    return document;
+}
+
+std::string ContextIndex::Document::serialize() const {
+    std::string out = std::to_string(length) + "\n";
+    for (const auto& entry : frequencies) {
+        out += entry.first + " " + std::to_string(entry.second) + "\n";
+    }
+    return out;
+}
+
+bool ContextIndex::Document::parse(const std::string& data, Document& document) {
+    std::istringstream lines(data);
+    document = Document();
+    if (!(lines >> document.length)) {
+        return false;
+    }
+    std::string term;
+    uint32_t frequency;
+    while (lines >> term >> frequency) {
+        document.frequencies[term] = frequency;
+    }
+    return lines.eof();
+}
+
+void ContextIndex::stageDocument(const std::string& path, const Document& document, Pending& pending,
+                                 std::vector<std::pair<std::string, std::string>>& puts,
+                                 std::vector<std::string>& removes) {
+    Document old;
+    std::string record;
+    bool existed = db_.get("indexdoc:" + path, record) && Document::parse(record, old);
+
+    // Only touch postings that change; a key both put and removed in one
+    // batch would end up removed. Postings carry the document length, so
+    // all of them change with it.
+    for (const auto& entry : old.frequencies) {
+        if (!document.frequencies.count(entry.first)) {
+            removes.push_back("index:" + entry.first + ":" + path);
+        }
+    }
+    std::string length = std::to_string(document.length);
+    for (const auto& entry : document.frequencies) {
+        auto previous = old.frequencies.find(entry.first);
+        if (previous == old.frequencies.end() || previous->second != entry.second || old.length != document.length) {
+            puts.emplace_back("index:" + entry.first + ":" + path, std::to_string(entry.second) + " " + length);
+        }
+    }
+    puts.emplace_back("indexdoc:" + path, document.serialize());
+
+    pending.documents += existed ? 0 : 1;
+    pending.length += static_cast<int64_t>(document.length) - static_cast<int64_t>(old.length);
+}
+
+void ContextIndex::stageRemoval(const std::string& path, Pending& pending, std::vector<std::string>& removes) {
+    Document old;
+    std::string record;
+    if (!db_.get("indexdoc:" + path, record) || !Document::parse(record, old)) {
+        return;
+    }
+    for (const auto& entry : old.frequencies) {
+        removes.push_back("index:" + entry.first + ":" + path);
+    }
+    removes.push_back("indexdoc:" + path);
+    pending.documents--;
+    pending.length -= static_cast<int64_t>(old.length);
+}
+
+bool ContextIndex::stats(uint64_t& documents, uint64_t& length) {
+    documents = 0;
+    length = 0;
+    std::string record;
+    if (!db_.get("state:index", record)) {
+        return false;
+    }
+    std::istringstream fields(record);
+    return static_cast<bool>(fields >> documents >> length);
+}
+
+void ContextIndex::stageStats(const Pending& pending, std::vector<std::pair<std::string, std::string>>& puts) {
+    uint64_t documents, length;
+    bool existed = stats(documents, length);
+    if (existed && pending.documents == 0 && pending.length == 0) {
+        return;
+    }
+    int64_t new_documents = std::max<int64_t>(0, static_cast<int64_t>(documents) + pending.documents);
+    int64_t new_length = std::max<int64_t>(0, static_cast<int64_t>(length) + pending.length);
+    puts.emplace_back("state:index", std::to_string(new_documents) + " " + std::to_string(new_length));
+}
+
+std::vector<ContextIndex::Hit> ContextIndex::search(const std::string& query, size_t k,
+                                                    const std::unordered_set<std::string>& exclude) {
+    uint64_t documents, total_length;
+    if (k == 0 || !stats(documents, total_length) || documents == 0) {
+        return {};
+    }
+    double average_length = static_cast<double>(total_length) / documents;
+
+    std::vector<std::string> query_terms = terms(query);
+    std::sort(query_terms.begin(), query_terms.end());
+    query_terms.erase(std::unique(query_terms.begin(), query_terms.end()), query_terms.end());
+
+    struct Posting {
+        std::string path;
+        uint32_t frequency;
+        uint64_t length;
+    };
+    std::unordered_map<std::string, double> scores;
+    for (const auto& term : query_terms) {
+        std::string prefix = "index:" + term + ":";
+        std::vector<Posting> postings;
+        bool common = !db_.scan({prefix}, [&](const std::string& key, const std::string& value) {
+            if (postings.size() >= MAX_POSTINGS) {
+                return false;
+            }
+            std::istringstream fields(value);
+            Posting posting{key.substr(prefix.size()), 0, 0};
+            if (fields >> posting.frequency >> posting.length) {
+                postings.push_back(std::move(posting));
+            }
+            return true;
+        }, true);  // Postings of common terms are read on every generation
+        if (common || postings.empty()) {
+            continue;
+        }
+
+        double df = static_cast<double>(postings.size());
+        double idf = std::log(1.0 + (static_cast<double>(documents) - df + 0.5) / (df + 0.5));
+        for (const auto& posting : postings) {
+            if (exclude.count(posting.path)) {
+                continue;
+            }
+            double tf = posting.frequency;
+            double norm = K1 * (1.0 - B + B * static_cast<double>(posting.length) / average_length);
+            scores[posting.path] += idf * tf * (K1 + 1.0) / (tf + norm);
+        }
+    }
+
+    std::vector<Hit> hits;
+    for (const auto& entry : scores) {
+        hits.push_back({entry.first, entry.second});
+    }
+    auto better = [](const Hit& a, const Hit& b) {
+        return a.score != b.score ? a.score > b.score : a.path < b.path;
+    };
+    if (hits.size() > k) {
+        std::partial_sort(hits.begin(), hits.begin() + k, hits.end(), better);
+        hits.resize(k);
+    } else {
+        std::sort(hits.begin(), hits.end(), better);
+    }
+    return hits;
+}
+
+std::string ContextIndex::snippet(const std::string& body, const std::string& query, size_t max_bytes) {
+    const size_t WINDOW_LINES = 40;
+
+    std::vector<size_t> line_starts{0};
+    for (size_t i = 0; i < body.size(); i++) {
+        if (body[i] == '\n' && i + 1 < body.size()) {
+            line_starts.push_back(i + 1);
+        }
+    }
+    auto lineEnd = [&](size_t line) {
+        return line + 1 < line_starts.size() ? line_starts[line + 1] : body.size();
+    };
+
+    std::vector<std::string> query_list = terms(query);
+    std::unordered_set<std::string> query_terms(query_list.begin(), query_list.end());
+    std::vector<size_t> matches(line_starts.size(), 0);
+    for (size_t line = 0; line < line_starts.size(); line++) {
+        for (const auto& term : terms(body.substr(line_starts[line], lineEnd(line) - line_starts[line]))) {
+            matches[line] += query_terms.count(term);
+        }
+    }
+
+    // Slide a window over the lines; the earliest best window wins
+    size_t best_start = 0;
+    size_t best_score = 0;
+    size_t score = 0;
+    for (size_t line = 0; line < line_starts.size(); line++) {
+        score += matches[line];
+        if (line >= WINDOW_LINES) {
+            score -= matches[line - WINDOW_LINES];
+        }
+        size_t start = line >= WINDOW_LINES - 1 ? line + 1 - WINDOW_LINES : 0;
+        if (score > best_score) {
+            best_score = score;
+            best_start = start;
+        }
+    }
+
+    size_t begin = line_starts[best_start];
+    size_t end = lineEnd(std::min(line_starts.size(), best_start + WINDOW_LINES) - 1);
+    end = std::min(end, begin + max_bytes);
+    while (end > begin && end < body.size() && (static_cast<unsigned char>(body[end]) & 0xc0) == 0x80) {
+        end--;
+    }
+    return body.substr(begin, end - begin);
+}
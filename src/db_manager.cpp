@@ -1,8 +1,16 @@
 #include "db_manager.h"
+#include "logger.h"
+#include "metrics.h"
 #include <rocksdb/options.h>
-#include <iostream>
+#include <rocksdb/write_batch.h>
+#include <rocksdb/sst_file_reader.h>
+#include <rocksdb/utilities/checkpoint.h>
+#include <cstdio>
 
-DBManager::DBManager(const std::string& db_path) {
+// Upper-layer marker for keys deleted from the read-only base
+static const std::string WHITEOUT_PREFIX = "whiteout:";
+
+DBManager::DBManager(const std::string& db_path, const std::string& base_path) {
     rocksdb::Options options;
     options.create_if_missing = true;
     
@@ -14,34 +22,74 @@ DBManager::DBManager(const std::string& db_path) {
     }
     
     db_.reset(db_ptr);
+    
+    if (!base_path.empty()) {
+        // Read-only opens take no lock, so any number of mounts can share a base
+        rocksdb::Options base_options;
+        status = rocksdb::DB::OpenForReadOnly(base_options, base_path, &db_ptr);
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to open base database: " + status.ToString());
+        }
+        base_db_.reset(db_ptr);
+    }
 }
 
 DBManager::~DBManager() = default;
 
 bool DBManager::put(const std::string& key, const std::string& value) {
+    if (base_db_) {
+        return writeBatch({{key, value}});
+    }
+    LatencyTimer timer(Metrics::global().db_write_us);
     rocksdb::Status status = db_->Put(rocksdb::WriteOptions(), key, value);
     return status.ok();
 }
 
-bool DBManager::get(const std::string& key, std::string& value) {
-    rocksdb::Status status = db_->Get(rocksdb::ReadOptions(), key, &value);
+bool DBManager::get(const std::string& key, std::string& value, const Snapshot& snapshot) {
+    LatencyTimer timer(Metrics::global().db_get_us);
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = snapshot.get();
+    rocksdb::Status status = db_->Get(read_options, key, &value);
+    if (status.ok() || !base_db_ || !status.IsNotFound() || isWhitedOut(key, read_options)) {
+        return status.ok();
+    }
+    status = base_db_->Get(rocksdb::ReadOptions(), key, &value);
     return status.ok();
 }
 
+DBManager::Snapshot DBManager::snapshot() {
+    // Holders must let go before the database closes
+    rocksdb::DB* db = db_.get();
+    return Snapshot(db->GetSnapshot(), [db](const rocksdb::Snapshot* snapshot) {
+        db->ReleaseSnapshot(snapshot);
+    });
+}
+
 bool DBManager::remove(const std::string& key) {
+    if (base_db_) {
+        return writeBatch({}, {key});
+    }
+    LatencyTimer timer(Metrics::global().db_write_us);
     rocksdb::Status status = db_->Delete(rocksdb::WriteOptions(), key);
     return status.ok();
 }
 
 bool DBManager::exists(const std::string& key) {
     std::string value;
-    rocksdb::Status status = db_->Get(rocksdb::ReadOptions(), key, &value);
-    return status.ok();
+    return get(key, value);
 }
 
 std::vector<std::string> DBManager::listKeys(const std::string& prefix) {
     std::vector<std::string> keys;
     
+    if (base_db_) {
+        scan({prefix}, [&keys](const std::string& key, const std::string&) {
+            keys.push_back(key);
+            return true;
+        });
+        return keys;
+    }
+    
     rocksdb::Iterator* it = db_->NewIterator(rocksdb::ReadOptions());
     for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
         keys.push_back(it->key().ToString());
@@ -49,4 +97,231 @@ std::vector<std::string> DBManager::listKeys(const std::string& prefix) {
     
     delete it;
     return keys;
+}
+
+bool DBManager::writeBatch(const std::vector<std::pair<std::string, std::string>>& puts,
+                           const std::vector<std::string>& removes) {
+    LatencyTimer timer(Metrics::global().db_write_us);
+    rocksdb::WriteBatch batch;
+    for (const auto& entry : puts) {
+        batch.Put(entry.first, entry.second);
+        if (base_db_ && isWhitedOut(entry.first, rocksdb::ReadOptions())) {
+            batch.Delete(WHITEOUT_PREFIX + entry.first);
+        }
+    }
+    for (const auto& key : removes) {
+        batch.Delete(key);
+        
+        // Hide the base copy, if any
+        std::string value;
+        if (base_db_ && base_db_->Get(rocksdb::ReadOptions(), key, &value).ok()) {
+            batch.Put(WHITEOUT_PREFIX + key, "");
+        }
+    }
+    
+    rocksdb::Status status = db_->Write(rocksdb::WriteOptions(), &batch);
+    return status.ok();
+}
+
+bool DBManager::isWhitedOut(const std::string& key, const rocksdb::ReadOptions& options) {
+    std::string value;
+    return db_->Get(options, WHITEOUT_PREFIX + key, &value).ok();
+}
+
+bool DBManager::scan(const std::vector<std::string>& prefixes,
+                     const std::function<bool(const std::string& key, const std::string& value)>& visitor,
+                     bool fill_cache) {
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = db_->GetSnapshot();
+    read_options.fill_cache = fill_cache;  // Bulk scans would evict the working set
+    
+    rocksdb::ReadOptions base_options;
+    base_options.fill_cache = fill_cache;
+    
+    bool completed = true;
+    rocksdb::Iterator* it = db_->NewIterator(read_options);
+    rocksdb::Iterator* base_it = base_db_ ? base_db_->NewIterator(base_options) : nullptr;
+    for (const auto& prefix : prefixes) {
+        it->Seek(prefix);
+        if (base_it) {
+            base_it->Seek(prefix);
+        }
+        
+        // Merge both layers in key order; the upper layer wins on equal keys
+        while (completed) {
+            bool upper_valid = it->Valid() && it->key().starts_with(prefix);
+            bool base_valid = base_it && base_it->Valid() && base_it->key().starts_with(prefix);
+            if (!upper_valid && !base_valid) {
+                break;
+            }
+            
+            int order = !base_valid ? -1 : !upper_valid ? 1 : it->key().compare(base_it->key());
+            std::string key = (order <= 0 ? it : base_it)->key().ToString();
+            if (base_it && key.compare(0, WHITEOUT_PREFIX.size(), WHITEOUT_PREFIX) == 0) {
+                // Layer bookkeeping, not data (only reachable with a short prefix)
+            } else if (order > 0 && isWhitedOut(key, read_options)) {
+                // Deleted from the base
+            } else if (!visitor(key, (order <= 0 ? it : base_it)->value().ToString())) {
+                completed = false;
+            }
+            
+            if (order <= 0) {
+                it->Next();
+            }
+            if (order >= 0) {
+                base_it->Next();
+            }
+        }
+        if (!completed || !it->status().ok() || (base_it && !base_it->status().ok())) {
+            completed = false;
+            break;
+        }
+    }
+    
+    delete it;
+    delete base_it;
+    db_->ReleaseSnapshot(read_options.snapshot);
+    return completed;
+}
+
+bool DBManager::ingestFiles(const std::vector<std::string>& sst_paths, bool move_files) {
+    if (sst_paths.empty()) {
+        return true;
+    }
+    
+    // Looked up first, since the files may be moved. Like a put, an
+    // ingested key replaces what was deleted from the base.
+    std::vector<std::string> whiteouts;
+    if (base_db_ && !findWhiteouts(sst_paths, whiteouts)) {
+        return false;
+    }
+    
+    rocksdb::IngestExternalFileOptions options;
+    options.move_files = move_files;
+    
+    rocksdb::Status status = db_->IngestExternalFile(sst_paths, options);
+    if (!status.ok()) {
+        LOG_WARNING << "Failed to ingest SST files: " << status.ToString();
+        return false;
+    }
+    
+    if (!whiteouts.empty()) {
+        rocksdb::WriteBatch batch;
+        for (const auto& key : whiteouts) {
+            batch.Delete(key);
+        }
+        status = db_->Write(rocksdb::WriteOptions(), &batch);
+        if (!status.ok()) {
+            LOG_WARNING << "Failed to clear whiteouts of ingested keys: " << status.ToString();
+        }
+    }
+    return status.ok();
+}
+
+bool DBManager::findWhiteouts(const std::vector<std::string>& sst_paths, std::vector<std::string>& whiteouts) {
+    // Whiteouts are few, so each one in a file's key range is looked up in
+    // the file rather than every key of the file in the database
+    rocksdb::Options options;
+    std::unique_ptr<rocksdb::Iterator> it(db_->NewIterator(rocksdb::ReadOptions()));
+    for (const auto& path : sst_paths) {
+        rocksdb::SstFileReader reader(options);
+        rocksdb::Status status = reader.Open(path);
+        if (!status.ok()) {
+            LOG_WARNING << "Failed to open " << path << ": " << status.ToString();
+            return false;
+        }
+        std::unique_ptr<rocksdb::Iterator> file_it(reader.NewIterator(rocksdb::ReadOptions()));
+        file_it->SeekToLast();
+        if (!file_it->Valid()) {
+            continue;
+        }
+        std::string last = file_it->key().ToString();
+        file_it->SeekToFirst();
+        
+        for (it->Seek(WHITEOUT_PREFIX + file_it->key().ToString());
+             it->Valid() && it->key().starts_with(WHITEOUT_PREFIX); it->Next()) {
+            std::string key = it->key().ToString().substr(WHITEOUT_PREFIX.size());
+            if (key > last) {
+                break;
+            }
+            file_it->Seek(key);
+            if (file_it->Valid() && file_it->key() == key) {
+                whiteouts.push_back(it->key().ToString());
+            }
+        }
+        if (!file_it->status().ok() || !it->status().ok()) {
+            LOG_WARNING << "Failed to read " << path << ": " << file_it->status().ToString();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DBManager::createCheckpoint(const std::string& checkpoint_dir) {
+    if (base_db_) {
+        LOG_WARNING << "Checkpoints of layered databases would miss the base layer";
+        return false;
+    }
+    
+    rocksdb::Checkpoint* checkpoint_ptr;
+    rocksdb::Status status = rocksdb::Checkpoint::Create(db_.get(), &checkpoint_ptr);
+    if (!status.ok()) {
+        return false;
+    }
+    std::unique_ptr<rocksdb::Checkpoint> checkpoint(checkpoint_ptr);
+    
+    status = checkpoint->CreateCheckpoint(checkpoint_dir);
+    if (!status.ok()) {
+        LOG_WARNING << "Failed to create checkpoint: " << status.ToString();
+    }
+    return status.ok();
+}
+
+SstExportWriter::SstExportWriter(const std::string& directory, uint64_t max_file_size)
+    : directory_(directory), max_file_size_(max_file_size) {
+}
+
+bool SstExportWriter::put(const std::string& key, const std::string& value) {
+    if (!writer_) {
+        char name[32];
+        snprintf(name, sizeof(name), "%06zu.sst", files_.size() + 1);
+        std::string file_path = directory_ + "/" + name;
+        
+        writer_ = std::make_unique<rocksdb::SstFileWriter>(rocksdb::EnvOptions(), options_);
+        rocksdb::Status status = writer_->Open(file_path);
+        if (!status.ok()) {
+            LOG_WARNING << "Failed to create " << file_path << ": " << status.ToString();
+            writer_.reset();
+            return false;
+        }
+        files_.push_back(file_path);
+        file_bytes_ = 0;
+    }
+    
+    rocksdb::Status status = writer_->Put(key, value);
+    if (!status.ok()) {
+        LOG_WARNING << "Failed to write SST entry " << key << ": " << status.ToString();
+        return false;
+    }
+    entries_++;
+    file_bytes_ += key.size() + value.size();
+    bytes_ += key.size() + value.size();
+    
+    if (file_bytes_ >= max_file_size_) {
+        return finishFile();
+    }
+    return true;
+}
+
+bool SstExportWriter::finish() {
+    return !writer_ || finishFile();
+}
+
+bool SstExportWriter::finishFile() {
+    rocksdb::Status status = writer_->Finish();
+    writer_.reset();
+    if (!status.ok()) {
+        LOG_WARNING << "Failed to finish SST file: " << status.ToString();
+    }
+    return status.ok();
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "file_preview.h"
+#include <algorithm>
+#include <vector>
+
+// Fields are length-prefixed ("<length>:<bytes>") so bodies may contain
+// any byte
+static void appendField(std::string& out, const std::string& field) {
+    out += std::to_string(field.size());
+    out += ':';
+    out += field;
+}
+
+static bool readField(const std::string& data, size_t& pos, std::string& field) {
+    size_t colon = data.find(':', pos);
+    if (colon == std::string::npos || colon == pos) {
+        return false;
+    }
+    size_t length;
+    try {
+        length = std::stoull(data.substr(pos, colon - pos));
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (length > data.size() - colon - 1) {
+        return false;
+    }
+    field = data.substr(colon + 1, length);
+    pos = colon + 1 + length;
+    return true;
+}
+
+static bool readNumber(const std::string& data, size_t& pos, uint64_t& value) {
+    std::string field;
+    if (!readField(data, pos, field)) {
+        return false;
+    }
+    try {
+        value = std::stoull(field);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Length of the longest prefix of `text` that doesn't end inside a UTF-8
+// sequence
+static size_t utf8PrefixLength(const std::string& text, size_t length) {
+    if (length >= text.size()) {
+        return text.size();
+    }
+    size_t end = length;
+    while (end > 0 && (static_cast<unsigned char>(text[end]) & 0xc0) == 0x80) {
+        end--;
+    }
+    return end;
+}
+
+std::string FilePreview::detectType(const std::string& content) {
+    static const std::vector<std::pair<std::string, std::string>> signatures = {
+        {std::string("\x89PNG", 4), "png"},
+        {std::string("\xff\xd8\xff", 3), "jpeg"},
+        {"GIF8", "gif"},
+        {std::string("PK\x03\x04", 4), "zip"},
+        {std::string("PK\x05\x06", 4), "zip"},
+        {std::string("\x1f\x8b", 2), "gzip"},
+        {"%PDF", "pdf"},
+        {std::string("\x7f" "ELF", 4), "elf"},
+    };
+
+    if (content.empty()) {
+        return "empty";
+    }
+    for (const auto& signature : signatures) {
+        if (content.compare(0, signature.first.size(), signature.first) == 0) {
+            return signature.second;
+        }
+    }
+
+    // Same heuristic as git: a NUL byte early on means binary
+    size_t scanned = std::min<size_t>(content.size(), 8000);
+    if (content.find('\0') < scanned) {
+        return "binary";
+    }
+    return "text";
+}
+
+FilePreview FilePreview::fromContent(const std::string& content) {
+    FilePreview preview;
+    preview.size = content.size();
+    preview.type = detectType(content);
+    if (!preview.isText()) {
+        return preview;
+    }
+
+    preview.head = content.substr(0, utf8PrefixLength(content, HEAD_BYTES));
+    size_t tail_start = content.size() > TAIL_BYTES ? content.size() - TAIL_BYTES : 0;
+    while (tail_start < content.size() && (static_cast<unsigned char>(content[tail_start]) & 0xc0) == 0x80) {
+        tail_start++;
+    }
+    preview.tail = content.substr(tail_start);
+    return preview;
+}
+
+std::string FilePreview::serialize() const {
+    std::string out;
+    appendField(out, std::to_string(size));
+    appendField(out, type);
+    appendField(out, head);
+    appendField(out, tail);
+    return out;
+}
+
+bool FilePreview::parse(const std::string& data, FilePreview& preview) {
+    size_t pos = 0;
+    return readNumber(data, pos, preview.size) &&
+           readField(data, pos, preview.type) &&
+           readField(data, pos, preview.head) &&
+           readField(data, pos, preview.tail) &&
+           pos == data.size();
+}
+
+std::string DirectoryDigest::serialize() const {
+    std::string out;
+    appendField(out, std::to_string(files.size()));
+    for (const auto& file : files) {
+        appendField(out, file.first);
+        appendField(out, std::to_string(file.second.size));
+        appendField(out, file.second.type);
+        appendField(out, file.second.head);
+    }
+    return out;
+}
+
+bool DirectoryDigest::parse(const std::string& data, DirectoryDigest& digest) {
+    size_t pos = 0;
+    uint64_t count;
+    if (!readNumber(data, pos, count)) {
+        return false;
+    }
+    digest.files.clear();
+    for (uint64_t i = 0; i < count; i++) {
+        std::string path;
+        FilePreview preview;
+        if (!readField(data, pos, path) || !readNumber(data, pos, preview.size) ||
+            !readField(data, pos, preview.type) || !readField(data, pos, preview.head)) {
+            return false;
+        }
+        digest.files[path] = preview;
+    }
+    return pos == data.size();
+}
@@ -0,0 +1,91 @@
+#include "generation_batcher.h"
+#include "llm_client.h"
+#include <algorithm>
+
+GenerationBatcher::GenerationBatcher() {
+    worker_ = std::thread([this]() { run(); });
+}
+
+GenerationBatcher::~GenerationBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+std::shared_ptr<StreamingBuffer> GenerationBatcher::add(const std::string& key, const std::string& path,
+                                                        std::chrono::milliseconds window, size_t max_files,
+                                                        const Send& send) {
+    auto buffer = std::make_shared<StreamingBuffer>();
+    Batch full;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = batches_.find(key);
+        if (it == batches_.end()) {
+            Batch batch;
+            batch.send = send;
+            batch.deadline = std::chrono::steady_clock::now() + window;
+            it = batches_.emplace(key, std::move(batch)).first;
+            cv_.notify_all();
+        }
+        it->second.paths.push_back(path);
+        it->second.buffers.push_back(buffer);
+
+        if (it->second.paths.size() < max_files) {
+            return buffer;
+        }
+        full = std::move(it->second);
+        batches_.erase(it);
+    }
+
+    full.send(full.paths, full.buffers);
+    return buffer;
+}
+
+size_t GenerationBatcher::pendingFiles() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t files = 0;
+    for (const auto& batch : batches_) {
+        files += batch.second.paths.size();
+    }
+    return files;
+}
+
+void GenerationBatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // Take every batch whose window has passed (all of them when stopping)
+        auto now = std::chrono::steady_clock::now();
+        auto next_deadline = std::chrono::steady_clock::time_point::max();
+        std::vector<Batch> due;
+        for (auto it = batches_.begin(); it != batches_.end();) {
+            if (stopping_ || it->second.deadline <= now) {
+                due.push_back(std::move(it->second));
+                it = batches_.erase(it);
+            } else {
+                next_deadline = std::min(next_deadline, it->second.deadline);
+                ++it;
+            }
+        }
+
+        if (!due.empty()) {
+            lock.unlock();
+            for (auto& batch : due) {
+                batch.send(batch.paths, batch.buffers);
+            }
+            lock.lock();
+            continue;
+        }
+        if (stopping_) {
+            return;
+        }
+
+        if (next_deadline == std::chrono::steady_clock::time_point::max()) {
+            cv_.wait(lock);
+        } else {
+            cv_.wait_until(lock, next_deadline);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#include "hedge_policy.h"
+#include <algorithm>
+
+HedgePolicy::HedgePolicy(const HedgeConfig& config) : config_(config) {
+}
+
+std::optional<std::chrono::milliseconds> HedgePolicy::delay() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delayLocked();
+}
+
+std::optional<std::chrono::milliseconds> HedgePolicy::delayLocked() const {
+    if (!config_.enabled || samples_.empty() || samples_.size() < config_.min_samples) {
+        return std::nullopt;
+    }
+    std::vector<int64_t> sorted = samples_;
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(config_.percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return std::chrono::milliseconds(std::max<int64_t>(sorted[rank], config_.min_delay_ms));
+}
+
+void HedgePolicy::recordRequest() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.requests++;
+    // Halving keeps the budget about recent requests, so a long quiet
+    // stretch doesn't bank hedges for a later burst
+    if (++window_requests_ >= 2 * BUDGET_WINDOW) {
+        window_requests_ /= 2;
+        window_hedged_ /= 2;
+    }
+}
+
+bool HedgePolicy::admitHedge() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<double>(window_hedged_ + 1) > config_.max_fraction * window_requests_) {
+        return false;
+    }
+    window_hedged_++;
+    stats_.hedged++;
+    return true;
+}
+
+void HedgePolicy::recordFirstToken(std::chrono::milliseconds ttft, bool hedge) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (samples_.size() < MAX_SAMPLES) {
+        samples_.push_back(ttft.count());
+    } else {
+        samples_[next_sample_] = ttft.count();
+        next_sample_ = (next_sample_ + 1) % MAX_SAMPLES;
+    }
+    if (hedge) {
+        stats_.hedge_wins++;
+    }
+}
+
+HedgePolicy::Stats HedgePolicy::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.delay = delayLocked();
+    return stats;
+}
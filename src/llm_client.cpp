@@ -1,10 +1,18 @@
 #include "llm_client.h"
+#include "logger.h"
+#include "fnv1a.h"
+#include "metrics.h"
+#include "tracer.h"
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <random>
+#include <strings.h>
 
 using json = nlohmann::json;
 
@@ -14,23 +22,91 @@ StreamingBuffer::StreamingBuffer() {}
 StreamingBuffer::~StreamingBuffer() {}
 
 void StreamingBuffer::appendData(const std::string& data) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.append(data);
-    cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_.append(data);
+        cv_.notify_all();
+    }
+    runReadableCallbacks(false);
 }
 
 void StreamingBuffer::markComplete() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    complete_ = true;
-    cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (complete_) {
+            return;
+        }
+        complete_ = true;
+        cv_.notify_all();
+    }
+    runReadableCallbacks(true);
+    runCompletionCallbacks();
 }
 
 void StreamingBuffer::markError(const std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (complete_) {
+            return;
+        }
+        error_ = true;
+        error_msg_ = error;
+        complete_ = true;
+        cv_.notify_all();
+    }
+    runReadableCallbacks(true);
+    runCompletionCallbacks();
+}
+
+void StreamingBuffer::onComplete(std::function<void(const StreamingBuffer&)> callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!complete_) {
+            completion_callbacks_.push_back(std::move(callback));
+            return;
+        }
+    }
+    callback(*this);
+}
+
+bool StreamingBuffer::notifyWhenReadable(off_t offset, std::function<void()> callback) {
     std::lock_guard<std::mutex> lock(mutex_);
-    error_ = true;
-    error_msg_ = error;
-    complete_ = true;
-    cv_.notify_all();
+    if (complete_ || offset < static_cast<off_t>(buffer_.size())) {
+        return false;
+    }
+    readable_callbacks_.emplace_back(offset, std::move(callback));
+    return true;
+}
+
+void StreamingBuffer::runReadableCallbacks(bool all) {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = readable_callbacks_.begin();
+        while (it != readable_callbacks_.end()) {
+            if (all || it->first < static_cast<off_t>(buffer_.size())) {
+                ready.push_back(std::move(it->second));
+                it = readable_callbacks_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto& callback : ready) {
+        callback();
+    }
+}
+
+void StreamingBuffer::runCompletionCallbacks() {
+    // Callbacks run without the lock held so they can read the buffer
+    std::vector<std::function<void(const StreamingBuffer&)>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callbacks.swap(completion_callbacks_);
+    }
+    for (auto& callback : callbacks) {
+        callback(*this);
+    }
 }
 
 size_t StreamingBuffer::readData(char* buf, size_t size, off_t offset) {
@@ -77,6 +153,11 @@ size_t StreamingBuffer::getTotalSize() const {
     return buffer_.size();
 }
 
+std::string StreamingBuffer::getContent() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffer_;
+}
+
 // LLMClient implementation
 class LLMClient::Impl {
 public:
@@ -87,112 +168,157 @@ public:
     }
     
     struct StreamContext {
-        std::shared_ptr<StreamingBuffer> buffer;
-        std::string accumulated_data;
+        std::function<void(const std::string&)> on_content;
+        std::function<void()> on_done;  // Optional, at [DONE]
+        SseDecoder decoder;
+        bool received = false;          // Content was delivered, so the request can't be retried
+        std::chrono::steady_clock::time_point first_token;
+        
+        // When racing a hedge: claim must succeed before anything is
+        // delivered, and lost aborts the transfer once the other attempt won
+        std::function<bool()> claim;
+        std::function<bool()> lost;
     };
     
-    static size_t StreamCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-        size_t totalSize = size * nmemb;
-        StreamContext* ctx = static_cast<StreamContext*>(userp);
-        
-        ctx->accumulated_data.append(static_cast<char*>(contents), totalSize);
+    // Attempts at one request racing for its first token. The first to
+    // deliver anything owns the stream; the others are cancelled.
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable cv;
+        int winner = -1;
+        bool primary_done = false;
         
-        // Process SSE chunks
-        size_t pos = 0;
-        while ((pos = ctx->accumulated_data.find("\n\n")) != std::string::npos) {
-            std::string chunk = ctx->accumulated_data.substr(0, pos);
-            ctx->accumulated_data.erase(0, pos + 2);
-            
-            if (chunk.find("data: ") == 0) {
-                std::string data = chunk.substr(6);
-                
-                if (data == "[DONE]") {
-                    ctx->buffer->markComplete();
-                    continue;
-                }
-                
-                try {
-                    json event = json::parse(data);
-                    if (event.contains("choices") && !event["choices"].empty()) {
-                        auto& choice = event["choices"][0];
-                        if (choice.contains("delta") && choice["delta"].contains("content")) {
-                            std::string content = choice["delta"]["content"];
-                            ctx->buffer->appendData(content);
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    // Ignore parse errors for now
-                }
+        bool claim(int attempt) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (winner < 0) {
+                winner = attempt;
+                cv.notify_all();
             }
+            return winner == attempt;
         }
         
-        return totalSize;
+        bool lost(int attempt) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return winner >= 0 && winner != attempt;
+        }
+    };
+    
+    // Called before anything reaches on_content or on_done
+    static bool deliver(StreamContext* ctx) {
+        if (ctx->received) {
+            return true;
+        }
+        if (ctx->claim && !ctx->claim()) {
+            return false;
+        }
+        ctx->received = true;
+        ctx->first_token = std::chrono::steady_clock::now();
+        return true;
     }
-};
-
-LLMClient::LLMClient(const std::string& endpoint) 
-    : endpoint_(endpoint), pImpl(std::make_unique<Impl>()) {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-}
-
-LLMClient::~LLMClient() {
-    curl_global_cleanup();
-}
-
-std::string LLMClient::generateFileContent(
-    const std::string& file_path,
-    const std::vector<FileContext>& folder_context,
-    const std::vector<FileContext>& recent_files,
-    const std::string& model_name) {
     
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        throw std::runtime_error("Failed to initialize CURL");
+    static int ProgressCallback(void* userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        StreamContext* ctx = static_cast<StreamContext*>(userp);
+        return ctx->lost && ctx->lost() ? 1 : 0;
     }
-
-    std::string response;
     
-    try {
-        json request_body;
+    static size_t StreamCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        size_t totalSize = size * nmemb;
+        StreamContext* ctx = static_cast<StreamContext*>(userp);
         
-        std::stringstream prompt;
-        prompt << "Generate content for the file at absolute path: " << file_path << "\n";
-        prompt << "This path represents the file's location in the entire filesystem.\n\n";
+        bool delivered = ctx->decoder.feed(static_cast<char*>(contents), totalSize,
+            [ctx](const std::string& content) {
+                if (!deliver(ctx)) {
+                    return false;
+                }
+                ctx->on_content(content);
+                return true;
+            },
+            [ctx]() {
+                if (!deliver(ctx)) {
+                    return false;
+                }
+                if (ctx->on_done) {
+                    ctx->on_done();
+                }
+                return true;
+            });
+        return delivered ? totalSize : 0;  // 0 aborts the transfer
+    }
+    
+    // What the backend answered, beyond the body
+    struct Reply {
+        long status = 0;
+        std::chrono::milliseconds retry_after{0};
         
-        if (!folder_context.empty()) {
-            prompt << "Files in the same folder:\n";
-            for (const auto& ctx : folder_context) {
-                prompt << "- " << ctx.path << " (preview):\n";
-                prompt << ctx.content.substr(0, 200) << "...\n\n";
-            }
-        }
+        // Microseconds from the start of the transfer until each phase
+        // ended, as measured by curl; 0 for phases that didn't happen
+        curl_off_t dns_us = 0;
+        curl_off_t connect_us = 0;
+        curl_off_t tls_us = 0;
+        curl_off_t request_sent_us = 0;
         
-        if (!recent_files.empty()) {
-            prompt << "\nRecently accessed files (showing tail of content):\n";
-            for (const auto& ctx : recent_files) {
-                prompt << "\n--- " << ctx.path << " ---\n";
-                prompt << ctx.content << "\n";
-            }
+        bool throttled() const {
+            return status == 429 || status == 503;
         }
         
-        prompt << "\nBased on the absolute path and context, generate only the raw file content for " << file_path << ". No explanations or markdown.";
-        
-        request_body["model"] = model_name;
-        request_body["messages"] = json::array({
-            {{"role", "user"}, {"content", "You are a file content generator. Pay careful attention to the absolute file path to understand the file's purpose and location in the filesystem. Generate ONLY the raw file content without any explanation, commentary, or markdown formatting. Do not include phrases like 'Here is the content' or 'Based on the context'. Start directly with the actual file content.\n\n" + prompt.str()}}
-        });
-        request_body["temperature"] = 0.7;
-        request_body["max_tokens"] = 2048;
+        // No answer, throttling or a server error, rather than a rejected request
+        bool retryable() const {
+            return status < 400 || status == 408 || status == 429 || status >= 500;
+        }
         
-        std::string request_str = request_body.dump();
+        BackendPool::Outcome outcome(const std::string& error, std::chrono::milliseconds latency) const {
+            BackendPool::Outcome outcome;
+            outcome.success = error.empty();
+            outcome.throttled = throttled();
+            outcome.client_error = !retryable();
+            outcome.latency = latency;
+            outcome.retry_after = retry_after;
+            return outcome;
+        }
+    };
+    
+    static size_t HeaderCallback(char* data, size_t size, size_t nmemb, void* userp) {
+        size_t total = size * nmemb;
+        static const char name[] = "retry-after:";
+        if (total > sizeof(name) - 1 && strncasecmp(data, name, sizeof(name) - 1) == 0) {
+            std::string value(data + sizeof(name) - 1, total - (sizeof(name) - 1));
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t\r\n") + 1);
+            Reply* reply = static_cast<Reply*>(userp);
+            if (!value.empty() && value.find_first_not_of("0123456789") == std::string::npos) {
+                reply->retry_after = std::chrono::seconds(std::stol(value));
+            } else {
+                // An HTTP date
+                time_t when = curl_getdate(value.c_str(), nullptr);
+                time_t now = time(nullptr);
+                if (when > now) {
+                    reply->retry_after = std::chrono::seconds(when - now);
+                }
+            }
+        }
+        return total;
+    }
+    
+    // Sends one request to one backend, streaming into ctx if it is set and
+    // collecting the body into response otherwise. Returns an error message,
+    // or "" on success.
+    static std::string post(const std::string& url, const std::string& request_str,
+                            StreamContext* ctx, std::string& response, Reply& reply) {
+        CURL* curl = curl_easy_init();
+        if (!curl) {
+            return "Failed to initialize CURL";
+        }
         
-        curl_easy_setopt(curl, CURLOPT_URL, endpoint_.c_str());
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_POST, 1L);
         curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_str.c_str());
         curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, request_str.length());
         
         struct curl_slist* headers = nullptr;
         headers = curl_slist_append(headers, "Content-Type: application/json");
+        if (ctx) {
+            headers = curl_slist_append(headers, "Accept: text/event-stream");
+        }
         
         const char* api_key = std::getenv("OPENAI_API_KEY");
         if (api_key) {
@@ -201,32 +327,483 @@ std::string LLMClient::generateFileContent(
         }
         
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Impl::WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+        if (ctx) {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, ctx);
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+            if (ctx->lost) {
+                curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+                curl_easy_setopt(curl, CURLOPT_XFERINFODATA, ctx);
+                curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            }
+        } else {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+        }
+        
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &reply);
         
         CURLcode res = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &reply.status);
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &reply.dns_us);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &reply.connect_us);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &reply.tls_us);
+        curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &reply.request_sent_us);
         
         curl_slist_free_all(headers);
+        curl_easy_cleanup(curl);
         
         if (res != CURLE_OK) {
-            throw std::runtime_error("CURL request failed: " + std::string(curl_easy_strerror(res)));
+            return "CURL request failed: " + std::string(curl_easy_strerror(res));
         }
-        
-        json response_json = json::parse(response);
-        
-        if (response_json.contains("error")) {
-            throw std::runtime_error("API error: " + response_json["error"]["message"].get<std::string>());
+        if (reply.status >= 400) {
+            // Error bodies are JSON, not events, so they are left unparsed
+            std::string body = ctx ? ctx->decoder.pending() : response;
+            return "HTTP " + std::to_string(reply.status) + ": " + body.substr(0, 200);
+        }
+        return "";
+    }
+    
+    // Splits one streaming attempt into the phases of its trace: name
+    // resolution, connection and TLS setup, then the wait for the first
+    // token (queueing and prefill on the server) and the token stream
+    static void traceAttempt(const std::string& url, std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end, const Reply& reply,
+                             const StreamContext& ctx) {
+        Tracer& tracer = Tracer::global();
+        uint64_t flow = TraceFlow::current();
+        auto at = [start](curl_off_t us) { return start + std::chrono::microseconds(us); };
+        tracer.record("backend_attempt", "http", start, end, url, flow);
+        tracer.record("dns", "http", start, at(reply.dns_us), url, flow);
+        if (reply.connect_us > reply.dns_us) {
+            tracer.record("connect", "http", at(reply.dns_us), at(reply.connect_us), url, flow);
+        }
+        if (reply.tls_us > reply.connect_us) {
+            tracer.record("tls", "http", at(reply.connect_us), at(reply.tls_us), url, flow);
+        }
+        if (ctx.received) {
+            tracer.record("server_wait", "http", at(reply.request_sent_us), ctx.first_token, url, flow);
+            tracer.record("stream_tokens", "http", ctx.first_token, end, url, flow);
+        }
+    }
+};
+
+static const char* INSTRUCTIONS = "You are a file content generator. Pay careful attention to the absolute file path to understand the file's purpose and location in the filesystem. Generate ONLY the raw file content without any explanation, commentary, or markdown formatting. Do not include phrases like 'Here is the content' or 'Based on the context'. Start directly with the actual file content.\n\n";
+
+// Per-entry caps within the prompt budget
+static const size_t MAX_PREVIEW_TOKENS = 64;
+static const size_t MAX_RECENT_FILE_TOKENS = 1200;
+
+// Response limit for one file; batched requests get this per file
+static const size_t MAX_TOKENS_PER_FILE = 2048;
+
+static size_t maxTokensPerFile(const GenerationOptions& options) {
+    return options.max_tokens ? options.max_tokens : MAX_TOKENS_PER_FILE;
+}
+
+// Only this part differs between siblings
+static std::string targetSection(const std::string& file_path, const std::string& closing) {
+    return "\nGenerate content for the file at absolute path: " + file_path + "\n" +
+           "This path represents the file's location in the entire filesystem.\n" + closing;
+}
+
+// Builds the user message. Instructions and the target always go in;
+// folder previews get at most half of the rest, so other files are not
+// crowded out, and other files are added from the end of the list. The
+// folder's share doesn't depend on the target, so siblings get the same
+// folder section and servers can reuse its cached prefill.
+static std::string composePrompt(const std::vector<FileContext>& folder_context,
+                                 const std::vector<FileContext>& recent_files,
+                                 const std::string& target,
+                                 const GenerationOptions& options) {
+    static const Tokenizer estimator;
+    const Tokenizer& tokenizer = options.tokenizer ? *options.tokenizer : estimator;
+    const std::string folder_heading = "Files in the same folder:\n";
+    const std::string recent_heading = "\nRelated and recently accessed files (showing excerpts):\n";
+    
+    bool bounded = options.prompt_token_budget > 0;
+    size_t fixed = bounded ? tokenizer.count(INSTRUCTIONS) : 0;
+    size_t shared = options.prompt_token_budget > fixed ? options.prompt_token_budget - fixed : 0;
+    size_t used = bounded ? fixed + tokenizer.count(target) : 0;
+    size_t available = bounded && options.prompt_token_budget > used ? options.prompt_token_budget - used : 0;
+    
+    std::string folder_section;
+    if (!folder_context.empty()) {
+        size_t folder_budget = std::min(shared / 2, available);
+        size_t folder_used = tokenizer.count(folder_heading);
+        for (const auto& ctx : folder_context) {
+            std::string entry = "- " + ctx.path + " (preview):\n" +
+                                tokenizer.truncate(ctx.content, MAX_PREVIEW_TOKENS) + "...\n\n";
+            if (bounded) {
+                size_t cost = tokenizer.count(entry);
+                if (folder_used + cost > folder_budget) {
+                    break;
+                }
+                folder_used += cost;
+            }
+            folder_section += entry;
+        }
+        if (!folder_section.empty()) {
+            folder_section = folder_heading + folder_section;
+            available -= bounded ? folder_used : 0;
+        }
+    }
+    
+    std::vector<std::string> recent_entries;
+    if (!recent_files.empty()) {
+        size_t recent_used = tokenizer.count(recent_heading);
+        for (auto it = recent_files.rbegin(); it != recent_files.rend(); ++it) {
+            std::string entry_header = "\n--- " + it->path + " ---\n";
+            std::string tail = it->content;
+            if (bounded) {
+                size_t overhead = tokenizer.count(entry_header) + tokenizer.count("\n");
+                if (recent_used + overhead >= available) {
+                    break;
+                }
+                tail = tokenizer.truncateTail(tail, std::min(MAX_RECENT_FILE_TOKENS, available - recent_used - overhead));
+                recent_used += overhead + tokenizer.count(tail);
+            }
+            recent_entries.push_back(entry_header + tail + "\n");
+        }
+    }
+    
+    std::string prompt = INSTRUCTIONS + folder_section;
+    if (!recent_entries.empty()) {
+        prompt += recent_heading;
+        for (auto it = recent_entries.rbegin(); it != recent_entries.rend(); ++it) {
+            prompt += *it;
+        }
+    }
+    return prompt + target;
+}
+
+std::string LLMClient::buildPrompt(
+    const std::string& file_path,
+    const std::vector<FileContext>& folder_context,
+    const std::vector<FileContext>& recent_files,
+    const GenerationOptions& options) {
+    std::string closing = "Based on the absolute path, please generate appropriate content for " + file_path +
+                          ". The content should be realistic and consistent "
+                          "with what would be expected at this location in the filesystem.";
+    return composePrompt(folder_context, recent_files, targetSection(file_path, closing), options);
+}
+
+std::string LLMClient::buildBatchPrompt(
+    const std::vector<std::string>& file_paths,
+    const std::vector<FileContext>& folder_context,
+    const std::vector<FileContext>& recent_files,
+    const GenerationOptions& options) {
+    std::string target = "\nGenerate content for each of these files, given by absolute path in the filesystem:\n";
+    for (const auto& path : file_paths) {
+        target += "- " + path + "\n";
+    }
+    target += "\nWrite every file in full, in this order. Put each file between marker lines exactly like this:\n";
+    target += BatchDemultiplexer::FILE_MARKER + file_paths.front() + BatchDemultiplexer::MARKER_END + "\n";
+    target += "(raw file content)\n";
+    target += std::string(BatchDemultiplexer::END_MARKER) + "\n";
+    target += "Based on the absolute paths and context, generate only the raw file contents. "
+              "Nothing outside the markers, no explanations or markdown.";
+    return composePrompt(folder_context, recent_files, target, options);
+}
+
+bool SseDecoder::feed(const char* data, size_t size,
+                      const std::function<bool(const std::string&)>& on_content,
+                      const std::function<bool()>& on_done) {
+    static const char PREFIX[] = "data: ";
+    static const size_t PREFIX_LENGTH = sizeof(PREFIX) - 1;
+    
+    pending_.append(data, size);
+    
+    // Events are consumed in place and erased once, at the end
+    bool proceed = true;
+    size_t start = 0;
+    size_t end;
+    while (proceed && (end = pending_.find("\n\n", start)) != std::string::npos) {
+        size_t event = start;
+        start = end + 2;
+        if (pending_.compare(event, PREFIX_LENGTH, PREFIX) != 0) {
+            continue;
         }
         
-        std::string content = response_json["choices"][0]["message"]["content"].get<std::string>();
+        size_t payload = event + PREFIX_LENGTH;
+        if (pending_.compare(payload, end - payload, "[DONE]") == 0) {
+            proceed = on_done();
+            continue;
+        }
         
-        curl_easy_cleanup(curl);
-        return content;
+        // Events that don't parse or carry no content are skipped
+        json parsed = json::parse(pending_.begin() + payload, pending_.begin() + end, nullptr, false);
+        if (parsed.is_discarded() || !parsed.is_object()) {
+            continue;
+        }
+        auto choices = parsed.find("choices");
+        if (choices == parsed.end() || !choices->is_array() || choices->empty() || !(*choices)[0].is_object()) {
+            continue;
+        }
+        const json& choice = (*choices)[0];
+        auto delta = choice.find("delta");
+        if (delta == choice.end() || !delta->is_object()) {
+            continue;
+        }
+        auto content = delta->find("content");
+        if (content != delta->end() && content->is_string()) {
+            proceed = on_content(content->get_ref<const std::string&>());
+        }
+    }
+    pending_.erase(0, start);
+    return proceed;
+}
+
+// BatchDemultiplexer implementation
+BatchDemultiplexer::BatchDemultiplexer(const std::vector<std::string>& paths,
+                                       const std::vector<std::shared_ptr<StreamingBuffer>>& buffers)
+    : paths_(paths), buffers_(buffers), started_(paths.size(), false) {}
+
+void BatchDemultiplexer::append(const std::string& data) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t newline = data.find('\n', pos);
+        if (newline == std::string::npos) {
+            line_ += data.substr(pos);
+            break;
+        }
+        line_ += data.substr(pos, newline - pos);
+        pos = newline + 1;
+        if (line_forwarded_) {
+            forward(line_ + "\n");
+        } else {
+            processLine(line_);
+        }
+        line_.clear();
+        line_forwarded_ = false;
+    }
+    
+    // Stream the partial line as soon as it can't become a marker
+    std::string marker_start = "<<<";
+    size_t compared = std::min(line_.size(), marker_start.size());
+    if (!line_.empty() && (line_forwarded_ || line_.compare(0, compared, marker_start, 0, compared) != 0)) {
+        forward(line_);
+        line_.clear();
+        line_forwarded_ = true;
+    }
+}
+
+void BatchDemultiplexer::forward(const std::string& data) {
+    if (current_ >= 0) {
+        buffers_[current_]->appendData(data);
+    }
+}
+
+void BatchDemultiplexer::processLine(const std::string& line) {
+    std::string trimmed = line;
+    while (!trimmed.empty() && (trimmed.back() == '\r' || trimmed.back() == ' ')) {
+        trimmed.pop_back();
+    }
+    
+    if (trimmed == END_MARKER) {
+        if (current_ >= 0) {
+            buffers_[current_]->markComplete();
+        }
+        current_ = -1;
+        return;
+    }
+    
+    std::string file_marker = FILE_MARKER;
+    std::string marker_end = MARKER_END;
+    if (trimmed.size() > file_marker.size() + marker_end.size() &&
+        trimmed.compare(0, file_marker.size(), file_marker) == 0 &&
+        trimmed.compare(trimmed.size() - marker_end.size(), marker_end.size(), marker_end) == 0) {
+        // A new section also ends one the model forgot to close
+        if (current_ >= 0) {
+            buffers_[current_]->markComplete();
+        }
+        std::string path = trimmed.substr(file_marker.size(), trimmed.size() - file_marker.size() - marker_end.size());
+        auto it = std::find(paths_.begin(), paths_.end(), path);
+        current_ = -1;
+        if (it != paths_.end() && !started_[it - paths_.begin()]) {
+            current_ = static_cast<int>(it - paths_.begin());
+            started_[current_] = true;
+        }
+        return;
+    }
+    
+    forward(line + "\n");
+}
+
+std::vector<size_t> BatchDemultiplexer::finish(const std::string& error) {
+    if (!line_.empty() && !line_forwarded_) {
+        processLine(line_);
+    }
+    line_.clear();
+    
+    // A section cut off by the end of the stream keeps what arrived, like
+    // a single response that hit its token limit
+    if (current_ >= 0) {
+        if (error.empty()) {
+            buffers_[current_]->markComplete();
+        } else {
+            buffers_[current_]->markError(error);
+        }
+        current_ = -1;
+    }
+    
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < paths_.size(); i++) {
+        if (!started_[i]) {
+            missing.push_back(i);
+        }
+    }
+    return missing;
+}
+
+unsigned LLMClient::slotFor(const std::string& affinity_key, unsigned slots) {
+    // A stable hash, so a directory keeps its slot across restarts
+    return slots ? static_cast<unsigned>(fnv1a(affinity_key) % slots) : 0;
+}
+
+static void addBackendOptions(json& request_body, const BackendConfig& backend, const GenerationOptions& options) {
+    if (backend.cache_prompt) {
+        request_body["cache_prompt"] = true;
+    }
+    if (backend.slots > 0 && !options.affinity_key.empty()) {
+        request_body[backend.slot_field] = LLMClient::slotFor(options.affinity_key, backend.slots);
+    }
+}
+
+// In-flight cost of a request for balancing: its prompt plus the most it may generate
+static size_t requestTokens(const std::string& prompt, size_t max_tokens, const GenerationOptions& options) {
+    static const Tokenizer estimator;
+    return (options.tokenizer ? *options.tokenizer : estimator).count(prompt) + max_tokens;
+}
+
+// Full jitter: a random wait up to a cap that doubles with each retry, so
+// clients throttled together don't come back together
+static std::chrono::milliseconds retryDelay(const PoolConfig& config, unsigned retry) {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    double cap = std::min<double>(config.retry_max_ms, config.retry_base_ms * std::pow(2.0, retry));
+    return std::chrono::milliseconds(static_cast<int64_t>(std::uniform_real_distribution<double>(0, cap)(rng)));
+}
+
+static std::vector<BackendConfig> singleBackend(const std::string& endpoint, BackendConfig backend) {
+    backend.url = endpoint;
+    return {backend};
+}
+
+LLMClient::LLMClient(const std::string& endpoint, const BackendConfig& backend)
+    : LLMClient(singleBackend(endpoint, backend), PoolConfig()) {
+}
+
+LLMClient::LLMClient(const std::vector<BackendConfig>& backends, const PoolConfig& pool,
+                     const HedgeConfig& hedging)
+    : hedger_(std::make_unique<HedgePolicy>(hedging)), pImpl(std::make_unique<Impl>()) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    pool_ = std::make_unique<BackendPool>(backends, pool);
+}
+
+LLMClient::~LLMClient() {
+    {
+        std::unique_lock<std::mutex> lock(workers_mutex_);
+        workers_done_.wait(lock, [this]() { return workers_ == 0; });
+    }
+    pool_.reset();  // Its health checks use curl
+    curl_global_cleanup();
+}
+
+void LLMClient::startWorker(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        workers_++;
+    }
+    std::thread([this, work = std::move(work)]() {
+        work();
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (--workers_ == 0) {
+            workers_done_.notify_all();
+        }
+    }).detach();
+}
+
+std::vector<FileContext> LLMClient::withRelatedFiles(const std::string& file_path,
+                                                     const std::vector<FileContext>& recent_files,
+                                                     const GenerationOptions& options) {
+    std::vector<FileContext> files = recent_files;
+    if (options.related_files) {
+        TraceSpan span("related_files", "generation", file_path);
+        std::vector<FileContext> related = options.related_files();
+        files.insert(files.end(), related.begin(), related.end());
+    }
+    return files;
+}
+
+std::string LLMClient::generateFileContent(
+    const std::string& file_path,
+    const std::vector<FileContext>& folder_context,
+    const std::vector<FileContext>& recent_files,
+    const std::string& model_name,
+    const GenerationOptions& options) {
+    
+    std::string closing = "Based on the absolute path and context, generate only the raw file content for " +
+                          file_path + ". No explanations or markdown.";
+    std::string prompt = composePrompt(folder_context, withRelatedFiles(file_path, recent_files, options),
+                                       targetSection(file_path, closing), options);
+    size_t tokens = requestTokens(prompt, maxTokensPerFile(options), options);
+    
+    json request_body;
+    request_body["model"] = model_name;
+    request_body["messages"] = json::array({
+        {{"role", "user"}, {"content", prompt}}
+    });
+    request_body["temperature"] = options.temperature;
+    request_body["max_tokens"] = maxTokensPerFile(options);
+    
+    // Nothing reaches the caller before the response is complete, so any
+    // failure can move on to another backend, and then go round again
+    std::vector<int> tried;
+    std::string error;
+    bool retryable = true;
+    unsigned retries = 0;
+    while (true) {
+        int index = pool_->acquire(model_name, tokens, tried);
+        if (index < 0) {
+            if (tried.empty() || !retryable || retries >= pool_->config().max_retries) {
+                throw std::runtime_error(error.empty() ? "No backend available for model " + model_name : error);
+            }
+            std::this_thread::sleep_for(retryDelay(pool_->config(), retries++));
+            tried.clear();
+            continue;
+        }
+        const BackendConfig& backend = pool_->backend(index);
+        json request = request_body;
+        addBackendOptions(request, backend, options);
         
-    } catch (...) {
-        curl_easy_cleanup(curl);
-        throw;
+        std::string response;
+        std::string content;
+        Impl::Reply reply;
+        auto start = std::chrono::steady_clock::now();
+        error = Impl::post(backend.url, request.dump(), nullptr, response, reply);
+        // The whole response, which is what a blocking caller waits for
+        auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (error.empty()) {
+            try {
+                json response_json = json::parse(response);
+                if (response_json.contains("error")) {
+                    error = "API error: " + response_json["error"]["message"].get<std::string>();
+                } else {
+                    content = response_json["choices"][0]["message"]["content"].get<std::string>();
+                }
+            } catch (const std::exception& e) {
+                error = "Invalid response: " + std::string(e.what());
+            }
+        }
+        pool_->release(index, tokens, reply.outcome(error, latency));
+        if (error.empty()) {
+            return content;
+        }
+        retryable = reply.retryable();
+        tried.push_back(index);
+        LOG_WARNING << "Backend " << backend.url << " failed (" << error << ")";
     }
 }
 
@@ -234,96 +811,294 @@ std::shared_ptr<StreamingBuffer> LLMClient::generateFileContentStream(
     const std::string& file_path,
     const std::vector<FileContext>& folder_context,
     const std::vector<FileContext>& recent_files,
-    const std::string& model_name) {
+    const std::string& model_name,
+    const GenerationOptions& options) {
     
     auto buffer = std::make_shared<StreamingBuffer>();
     
     // Run the streaming request in a separate thread
-    std::thread([this, file_path, folder_context, recent_files, model_name, buffer]() {
-        CURL* curl = curl_easy_init();
-        if (!curl) {
-            buffer->markError("Failed to initialize CURL");
+    startWorker([this, file_path, folder_context, recent_files, model_name, options, buffer]() {
+        TraceFlow flow(options.trace_id);
+        if (options.wait_for_admission) {
+            LatencyTimer timer(Metrics::global().queue_wait_us);
+            TraceSpan span("admission", "generation", file_path);
+            options.wait_for_admission();
+        }
+        streamInto(file_path, folder_context, withRelatedFiles(file_path, recent_files, options), model_name,
+                   options, buffer);
+    });
+    
+    return buffer;
+}
+
+void LLMClient::generateFilesStream(
+    const std::vector<std::string>& file_paths,
+    const std::vector<std::shared_ptr<StreamingBuffer>>& buffers,
+    const std::vector<FileContext>& folder_context,
+    const std::vector<FileContext>& recent_files,
+    const std::string& model_name,
+    const GenerationOptions& options) {
+    
+    startWorker([this, file_paths, buffers, folder_context, recent_files, model_name, options]() {
+        TraceFlow flow(options.trace_id);
+        if (options.wait_for_admission) {
+            LatencyTimer timer(Metrics::global().queue_wait_us);
+            TraceSpan span("admission", "generation", file_paths[0]);
+            options.wait_for_admission();
+        }
+        std::vector<FileContext> other_files = withRelatedFiles(file_paths[0], recent_files, options);
+        
+        // Seeds are per file, so they only apply to single requests
+        GenerationOptions single = options;
+        single.seed.reset();
+        if (file_paths.size() == 1) {
+            streamInto(file_paths[0], folder_context, other_files, model_name, options, buffers[0]);
             return;
         }
         
+        BatchDemultiplexer demux(file_paths, buffers);
+        std::string error;
         try {
+            TraceSpan prompt_span("build_prompt", "generation", file_paths[0]);
+            std::string prompt = buildBatchPrompt(file_paths, folder_context, other_files, options);
+            prompt_span.end();
+            size_t max_tokens = maxTokensPerFile(options) * file_paths.size();
             json request_body;
-            
-            std::stringstream prompt;
-            prompt << "Generate content for the file at absolute path: " << file_path << "\n";
-            prompt << "This path represents the file's location in the entire filesystem.\n\n";
-            
-            if (!folder_context.empty()) {
-                prompt << "Files in the same folder:\n";
-                for (const auto& ctx : folder_context) {
-                    prompt << "- " << ctx.path << " (preview):\n";
-                    prompt << ctx.content.substr(0, 200) << "...\n\n";
-                }
-            }
-            
-            if (!recent_files.empty()) {
-                prompt << "\nRecently accessed files (showing tail of content):\n";
-                for (const auto& ctx : recent_files) {
-                    prompt << "\n--- " << ctx.path << " ---\n";
-                    prompt << ctx.content << "\n";
-                }
-            }
-            
-            prompt << "\nBased on the absolute path, please generate appropriate content for " << file_path;
-            prompt << ". The content should be realistic and consistent ";
-            prompt << "with what would be expected at this location in the filesystem.";
-            
             request_body["model"] = model_name;
             request_body["messages"] = json::array({
-                {{"role", "user"}, {"content", "You are a file content generator. Pay careful attention to the absolute file path to understand the file's purpose and location in the filesystem. Generate ONLY the raw file content without any explanation, commentary, or markdown formatting. Do not include phrases like 'Here is the content' or 'Based on the context'. Start directly with the actual file content.\n\n" + prompt.str()}}
+                {{"role", "user"}, {"content", prompt}}
             });
-            request_body["temperature"] = 0.7;
-            request_body["max_tokens"] = 2048;
-            request_body["stream"] = true;  // Enable streaming
-            
-            std::string request_str = request_body.dump();
-            
-            curl_easy_setopt(curl, CURLOPT_URL, endpoint_.c_str());
-            curl_easy_setopt(curl, CURLOPT_POST, 1L);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_str.c_str());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, request_str.length());
-            
-            struct curl_slist* headers = nullptr;
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            headers = curl_slist_append(headers, "Accept: text/event-stream");
+            request_body["temperature"] = options.temperature;
+            request_body["max_tokens"] = max_tokens;
+            request_body["stream"] = true;
             
-            const char* api_key = std::getenv("OPENAI_API_KEY");
-            if (api_key) {
-                std::string auth_header = "Authorization: Bearer " + std::string(api_key);
-                headers = curl_slist_append(headers, auth_header.c_str());
+            error = postStream(model_name, requestTokens(prompt, max_tokens, options),
+                               [&](const BackendConfig& backend) {
+                                   json request = request_body;
+                                   addBackendOptions(request, backend, options);
+                                   return request.dump();
+                               },
+                               [&demux](const std::string& content) { demux.append(content); },
+                               nullptr);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        std::vector<size_t> missing = demux.finish(error);
+        if (!missing.empty()) {
+            LOG_INFO << "Batched response left out " << missing.size() << " of " << file_paths.size()
+                      << " files, generating them one by one";
+        }
+        for (size_t index : missing) {
+            streamInto(file_paths[index], folder_context, other_files, model_name, single, buffers[index]);
+        }
+    });
+}
+
+void LLMClient::streamInto(
+    const std::string& file_path,
+    const std::vector<FileContext>& folder_context,
+    const std::vector<FileContext>& recent_files,
+    const std::string& model_name,
+    const GenerationOptions& options,
+    const std::shared_ptr<StreamingBuffer>& buffer) {
+    
+    std::string error;
+    try {
+        TraceSpan prompt_span("build_prompt", "generation", file_path);
+        std::string prompt = buildPrompt(file_path, folder_context, recent_files, options);
+        prompt_span.end();
+        json request_body;
+        
+        request_body["model"] = model_name;
+        request_body["messages"] = json::array({
+            {{"role", "user"}, {"content", prompt}}
+        });
+        request_body["temperature"] = options.temperature;
+        request_body["max_tokens"] = maxTokensPerFile(options);
+        request_body["stream"] = true;  // Enable streaming
+        if (options.seed) {
+            request_body["seed"] = *options.seed;
+        }
+        
+        error = postStream(model_name, requestTokens(prompt, maxTokensPerFile(options), options),
+                           [&](const BackendConfig& backend) {
+                               json request = request_body;
+                               addBackendOptions(request, backend, options);
+                               return request.dump();
+                           },
+                           [&buffer](const std::string& content) { buffer->appendData(content); },
+                           [&buffer]() { buffer->markComplete(); });
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    if (!error.empty()) {
+        buffer->markError(error);
+    } else if (!buffer->isComplete()) {
+        buffer->markComplete();
+    }
+}
+
+std::string LLMClient::postStream(const std::string& model_name, size_t tokens,
+                                  const std::function<std::string(const BackendConfig&)>& make_request,
+                                  const std::function<void(const std::string&)>& on_content,
+                                  const std::function<void()>& on_done) {
+    struct Attempt {
+        int index = -1;
+        std::string error;
+        Impl::Reply reply;
+        bool received = false;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point first_token;
+        std::chrono::steady_clock::time_point end;
+    };
+    
+    Metrics& metrics = Metrics::global();
+    metrics.generations.add();
+    auto request_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point first_token;  // Of the attempt that streamed
+    size_t chunks = 0;
+    auto count_content = [&on_content, &chunks](const std::string& content) {
+        chunks++;
+        on_content(content);
+    };
+    auto finish = [&](const std::string& result) {
+        auto end = std::chrono::steady_clock::now();
+        if (!result.empty()) {
+            metrics.generation_failures.add();
+        } else {
+            metrics.generation_us.record(
+                std::chrono::duration_cast<std::chrono::microseconds>(end - request_start).count());
+            double seconds = std::chrono::duration<double>(end - first_token).count();
+            if (chunks > 1 && seconds > 0) {
+                metrics.chunks_per_second.record(static_cast<uint64_t>((chunks - 1) / seconds));
             }
-            
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            
+        }
+        return result;
+    };
+    
+    hedger_->recordRequest();
+    std::vector<int> tried;
+    std::string error;
+    bool retryable = true;
+    unsigned retries = 0;
+    while (true) {
+        Attempt primary;
+        TraceSpan acquire_span("acquire_backend", "generation");
+        primary.index = pool_->acquire(model_name, tokens, tried);
+        acquire_span.end();
+        if (primary.index < 0) {
+            // Every backend has been tried and nothing was delivered, so the
+            // request can go round again after a pause
+            if (tried.empty() || !retryable || retries >= pool_->config().max_retries) {
+                return finish(error.empty() ? "No backend available for model " + model_name : error);
+            }
+            std::this_thread::sleep_for(retryDelay(pool_->config(), retries++));
+            tried.clear();
+            continue;
+        }
+        tried.push_back(primary.index);
+        
+        auto race = std::make_shared<Impl::Race>();
+        auto run = [&](Attempt& attempt, int id) {
+            const BackendConfig& backend = pool_->backend(attempt.index);
             Impl::StreamContext ctx;
-            ctx.buffer = buffer;
-            
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Impl::StreamCallback);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
-            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-            
-            CURLcode res = curl_easy_perform(curl);
-            
-            curl_slist_free_all(headers);
+            ctx.on_content = count_content;
+            ctx.on_done = on_done;
+            ctx.claim = [race, id]() { return race->claim(id); };
+            ctx.lost = [race, id]() { return race->lost(id); };
             
-            if (res != CURLE_OK) {
-                buffer->markError("CURL request failed: " + std::string(curl_easy_strerror(res)));
-            } else if (!buffer->isComplete()) {
-                buffer->markComplete();
+            attempt.start = std::chrono::steady_clock::now();
+            std::string unused;
+            attempt.error = Impl::post(backend.url, make_request(backend), &ctx, unused, attempt.reply);
+            attempt.end = std::chrono::steady_clock::now();
+            attempt.received = ctx.received;
+            attempt.first_token = ctx.first_token;
+            if (Tracer::enabled()) {
+                Impl::traceAttempt(backend.url, attempt.start, attempt.end, attempt.reply, ctx);
             }
-            
-            curl_easy_cleanup(curl);
-            
-        } catch (const std::exception& e) {
-            curl_easy_cleanup(curl);
-            buffer->markError(e.what());
+            auto ttft = std::chrono::milliseconds(0);
+            if (ctx.received) {
+                ttft = std::chrono::duration_cast<std::chrono::milliseconds>(ctx.first_token - attempt.start);
+            }
+            if (race->lost(id)) {
+                metrics.cancelled_attempts.add();
+                pool_->cancel(attempt.index, tokens);
+            } else {
+                if (ctx.received) {
+                    first_token = ctx.first_token;
+                    metrics.ttft_us.record(
+                        std::chrono::duration_cast<std::chrono::microseconds>(first_token - request_start).count());
+                }
+                pool_->release(attempt.index, tokens, attempt.reply.outcome(attempt.error, ttft));
+            }
+        };
+        
+        // The hedge waits for the primary's first token; if it is late, the
+        // same request goes to another backend and the two race
+        Attempt hedge;
+        std::thread hedge_thread;
+        std::optional<std::chrono::milliseconds> delay = hedger_->delay();
+        if (delay && pool_->size() > 1) {
+            std::vector<int> exclude = tried;
+            hedge_thread = std::thread([&, exclude, delay, trace_id = TraceFlow::current()]() {
+                TraceFlow flow(trace_id);
+                {
+                    std::unique_lock<std::mutex> lock(race->mutex);
+                    if (race->cv.wait_for(lock, *delay, [&race]() { return race->winner >= 0 || race->primary_done; })) {
+                        return;
+                    }
+                }
+                int index = pool_->acquire(model_name, tokens, exclude, false);
+                if (index < 0) {
+                    return;
+                }
+                if (!hedger_->admitHedge()) {
+                    pool_->cancel(index, tokens);
+                    return;
+                }
+                LOG_INFO << "No first token after " << delay->count() << "ms, hedging on "
+                          << pool_->backend(index).url;
+                hedge.index = index;
+                run(hedge, 1);
+            });
         }
-    }).detach();
-    
-    return buffer;
-}
\ No newline at end of file
+        
+        run(primary, 0);
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->primary_done = true;
+        }
+        race->cv.notify_all();
+        if (hedge_thread.joinable()) {
+            hedge_thread.join();
+        }
+        
+        // The hedge delay is a percentile of the primary's time to first
+        // token, so it is sampled whoever wins: only sampling winners would
+        // drop the slow primaries hedges beat and pull the delay down. A
+        // cancelled primary waited at least until it was cancelled, and at
+        // least until the hedge's first token counted from its own start.
+        if (primary.received) {
+            hedger_->recordFirstToken(
+                std::chrono::duration_cast<std::chrono::milliseconds>(primary.first_token - primary.start), false);
+        } else if (race->winner == 1) {
+            auto waited = std::max(primary.end, hedge.first_token) - primary.start;
+            hedger_->recordFirstToken(std::chrono::duration_cast<std::chrono::milliseconds>(waited), true);
+        }
+        
+        // Once tokens have reached the reader, a retry would repeat them
+        if (race->winner >= 0) {
+            return finish(race->winner == 1 ? hedge.error : primary.error);
+        }
+        if (primary.error.empty() || (hedge.index >= 0 && hedge.error.empty())) {
+            return finish("");
+        }
+        if (hedge.index >= 0) {
+            tried.push_back(hedge.index);
+        }
+        error = primary.error;
+        retryable = primary.reply.retryable();
+        LOG_WARNING << "Backend " << pool_->backend(primary.index).url << " failed before the first token ("
+                  << error << ")";
+    }
+}
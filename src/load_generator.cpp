@@ -0,0 +1,466 @@
+#include "load_generator.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+void LoadStats::record(const std::string& op, uint64_t latency_us, bool ok, uint64_t bytes) {
+    Op& stats = ops_[op];
+    stats.latencies_us.push_back(latency_us);
+    stats.bytes += bytes;
+    if (!ok) {
+        stats.errors++;
+    }
+}
+
+void LoadStats::merge(const LoadStats& other) {
+    for (const auto& entry : other.ops_) {
+        Op& stats = ops_[entry.first];
+        stats.errors += entry.second.errors;
+        stats.bytes += entry.second.bytes;
+        stats.latencies_us.insert(stats.latencies_us.end(), entry.second.latencies_us.begin(),
+                                  entry.second.latencies_us.end());
+    }
+}
+
+uint64_t LoadStats::count() const {
+    uint64_t total = 0;
+    for (const auto& entry : ops_) {
+        total += entry.second.latencies_us.size();
+    }
+    return total;
+}
+
+uint64_t LoadStats::errors() const {
+    uint64_t total = 0;
+    for (const auto& entry : ops_) {
+        total += entry.second.errors;
+    }
+    return total;
+}
+
+uint64_t LoadStats::bytes() const {
+    uint64_t total = 0;
+    for (const auto& entry : ops_) {
+        total += entry.second.bytes;
+    }
+    return total;
+}
+
+std::vector<uint64_t> LoadStats::latencies() const {
+    std::vector<uint64_t> all;
+    for (const auto& entry : ops_) {
+        all.insert(all.end(), entry.second.latencies_us.begin(), entry.second.latencies_us.end());
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+uint64_t LoadStats::percentile(const std::vector<uint64_t>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+const std::vector<std::string>& LoadConfig::workloads() {
+    static const std::vector<std::string> names = {"ls-storm", "herd", "distinct", "writes", "mixed", "replay"};
+    return names;
+}
+
+static json latencySummary(const std::vector<uint64_t>& sorted) {
+    uint64_t sum = 0;
+    for (uint64_t latency : sorted) {
+        sum += latency;
+    }
+    return {{"p50", LoadStats::percentile(sorted, 0.5)},
+            {"p99", LoadStats::percentile(sorted, 0.99)},
+            {"p999", LoadStats::percentile(sorted, 0.999)},
+            {"max", sorted.empty() ? 0 : sorted.back()},
+            {"mean", sorted.empty() ? 0.0 : static_cast<double>(sum) / sorted.size()}};
+}
+
+std::string LoadResult::toJson(const LoadConfig& config) const {
+    uint64_t ops = stats.count();
+    json report = {{"schema", 1},
+                   {"workload", config.workload},
+                   {"threads", config.threads},
+                   {"elapsed_seconds", elapsed_seconds},
+                   {"ops", ops},
+                   {"errors", stats.errors()},
+                   {"ops_per_second", elapsed_seconds > 0 ? ops / elapsed_seconds : 0.0},
+                   {"bytes", stats.bytes()},
+                   {"latency_us", latencySummary(stats.latencies())}};
+    json by_op = json::object();
+    for (const auto& entry : stats.ops()) {
+        std::vector<uint64_t> sorted = entry.second.latencies_us;
+        std::sort(sorted.begin(), sorted.end());
+        by_op[entry.first] = {{"count", sorted.size()},
+                              {"errors", entry.second.errors},
+                              {"bytes", entry.second.bytes},
+                              {"latency_us", latencySummary(sorted)}};
+    }
+    report["ops_by_type"] = by_op;
+    if (config.workload == "replay") {
+        report["replay"] = {{"records", config.trace.size()}, {"speed", config.speed},
+                            {"late_ops", late_ops}, {"max_lag_us", max_lag_us}};
+    }
+    return report.dump(2);
+}
+
+// Times one operation into stats when it goes out of scope
+class OpTimer {
+public:
+    OpTimer(LoadStats& stats, const char* op)
+        : stats_(stats), op_(op), start_(std::chrono::steady_clock::now()) {}
+    ~OpTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        stats_.record(op_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), ok, bytes);
+    }
+
+    bool ok = true;
+    uint64_t bytes = 0;
+
+private:
+    LoadStats& stats_;
+    const char* op_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+LoadWorker::LoadWorker(const std::string& root, LoadStats& stats)
+    : root_(root), stats_(stats), buffer_(128 * 1024) {
+    while (!root_.empty() && root_.back() == '/') {
+        root_.pop_back();
+    }
+}
+
+LoadWorker::~LoadWorker() {
+    for (const auto& open_file : open_files_) {
+        close(open_file.second);
+    }
+}
+
+bool LoadWorker::stat(const std::string& path) {
+    OpTimer timer(stats_, "stat");
+    struct stat st;
+    timer.ok = lstat(full(path).c_str(), &st) == 0;
+    return timer.ok;
+}
+
+bool LoadWorker::list(const std::string& path, std::vector<std::pair<std::string, bool>>* entries) {
+    OpTimer timer(stats_, "list");
+    DIR* dir = opendir(full(path).c_str());
+    if (!dir) {
+        timer.ok = false;
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (entries && name != "." && name != "..") {
+            entries->emplace_back(name, entry->d_type == DT_DIR);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+bool LoadWorker::cat(const std::string& path) {
+    OpTimer timer(stats_, "cat");
+    int fd = open(full(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        timer.ok = false;
+        return false;
+    }
+    ssize_t n;
+    while ((n = read(fd, buffer_.data(), buffer_.size())) > 0) {
+        timer.bytes += n;
+    }
+    timer.ok = n == 0;
+    close(fd);
+    return timer.ok;
+}
+
+bool LoadWorker::writeFile(const std::string& path, size_t size, size_t block_size) {
+    OpTimer timer(stats_, "write_file");
+    int fd = open(full(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        timer.ok = false;
+        return false;
+    }
+    std::vector<char> block(std::max<size_t>(1, block_size), 'w');
+    while (timer.bytes < size) {
+        ssize_t n = write(fd, block.data(), std::min<uint64_t>(block.size(), size - timer.bytes));
+        if (n <= 0) {
+            timer.ok = false;
+            break;
+        }
+        timer.bytes += n;
+    }
+    if (close(fd) != 0) {
+        timer.ok = false;
+    }
+    return timer.ok;
+}
+
+bool LoadWorker::makeDirectories(const std::string& path) {
+    size_t slash = 0;
+    while ((slash = path.find('/', slash + 1)) != std::string::npos) {
+        mkdir(full(path.substr(0, slash)).c_str(), 0755);
+    }
+    return mkdir(full(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+void LoadWorker::replay(const AccessRecord& record) {
+    const std::string path = full(record.path);
+    const std::string& op = record.op;
+    if (op == "getattr") {
+        stat(record.path);
+    } else if (op == "readdir") {
+        list(record.path);
+    } else if (op == "open" || op == "create") {
+        OpTimer timer(stats_, op == "open" ? "open" : "create");
+        int flags = (record.flags & (O_ACCMODE | O_APPEND | O_TRUNC | O_EXCL)) | O_CLOEXEC;
+        int fd = open(path.c_str(), op == "create" ? flags | O_CREAT : flags, 0644);
+        timer.ok = fd >= 0;
+        if (fd >= 0) {
+            auto previous = open_files_.find(record.fh);
+            if (previous != open_files_.end()) {
+                close(previous->second);  // Its release wasn't recorded
+            }
+            open_files_[record.fh] = fd;
+        }
+    } else if (op == "read" || op == "write") {
+        auto open_file = open_files_.find(record.fh);
+        OpTimer timer(stats_, op == "read" ? "read" : "write");
+        if (open_file == open_files_.end()) {
+            timer.ok = false;  // Its open failed or came before the trace
+            return;
+        }
+        if (buffer_.size() < record.size) {
+            buffer_.resize(record.size, 'w');
+        }
+        ssize_t n = op == "read" ? pread(open_file->second, buffer_.data(), record.size, record.offset)
+                                 : pwrite(open_file->second, buffer_.data(), record.size, record.offset);
+        timer.ok = n >= 0;
+        timer.bytes = std::max<ssize_t>(n, 0);
+    } else if (op == "release") {
+        auto open_file = open_files_.find(record.fh);
+        if (open_file != open_files_.end()) {
+            OpTimer timer(stats_, "release");
+            timer.ok = close(open_file->second) == 0;
+            open_files_.erase(open_file);
+        }
+    } else if (op == "unlink") {
+        OpTimer timer(stats_, "unlink");
+        timer.ok = unlink(path.c_str()) == 0;
+    } else if (op == "mkdir") {
+        OpTimer timer(stats_, "mkdir");
+        timer.ok = mkdir(path.c_str(), 0755) == 0;
+    } else if (op == "rmdir") {
+        OpTimer timer(stats_, "rmdir");
+        timer.ok = rmdir(path.c_str()) == 0;
+    }
+    // poll, xattrs and copy_file_range have no plain equivalent and are skipped
+}
+
+LoadGenerator::LoadGenerator(const std::string& root, const LoadConfig& config)
+    : root_(root), config_(config) {
+    config_.threads = std::max<size_t>(1, config_.threads);
+    while (config_.dir.size() > 1 && config_.dir.back() == '/') {
+        config_.dir.pop_back();
+    }
+}
+
+std::string LoadGenerator::mixedPath(size_t dir, size_t file) const {
+    return config_.dir + "/dir" + std::to_string(dir) + "/file" + std::to_string(file) + ".txt";
+}
+
+void LoadGenerator::setup() {
+    if (config_.workload != "mixed") {
+        return;
+    }
+    LoadStats untimed;
+    LoadWorker worker(root_, untimed);
+    std::mt19937_64 random(config_.seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (size_t d = 0; d < config_.dirs; d++) {
+        worker.makeDirectories(config_.dir + "/dir" + std::to_string(d));
+        for (size_t f = 0; f < config_.files_per_dir; f++) {
+            if (unit(random) < config_.populated) {
+                worker.writeFile(mixedPath(d, f), 4096, 4096);
+            }
+        }
+    }
+}
+
+void LoadGenerator::awaitRound() {
+    std::unique_lock<std::mutex> lock(round_mutex_);
+    uint64_t round = round_;
+    if (++round_waiting_ == config_.threads) {
+        round_waiting_ = 0;
+        round_++;
+        round_cv_.notify_all();
+    } else {
+        round_cv_.wait(lock, [this, round]() { return round_ != round; });
+    }
+}
+
+// ls -lR: list every directory and stat every entry, skipping dot files
+void LoadGenerator::walk(LoadWorker& worker, const std::string& dir) {
+    std::vector<std::pair<std::string, bool>> entries;
+    if (!worker.list(dir, &entries)) {
+        return;
+    }
+    std::string prefix = dir == "/" ? "/" : dir + "/";
+    for (const auto& entry : entries) {
+        if (entry.first[0] == '.') {
+            continue;
+        }
+        worker.stat(prefix + entry.first);
+        if (entry.second) {
+            walk(worker, prefix + entry.first);
+        }
+    }
+}
+
+void LoadGenerator::lsStorm(LoadWorker& worker, size_t) {
+    for (size_t i = 0; i < config_.ops; i++) {
+        walk(worker, config_.dir);
+    }
+}
+
+// Every thread reads the same missing file at once, a new one each round
+void LoadGenerator::herd(LoadWorker& worker, size_t) {
+    for (size_t round = 0; round < config_.ops; round++) {
+        awaitRound();
+        worker.cat(config_.dir + "/herd" + std::to_string(round) + ".txt");
+    }
+}
+
+void LoadGenerator::distinct(LoadWorker& worker, size_t thread) {
+    for (size_t i = thread; i < config_.ops; i += config_.threads) {
+        worker.cat(config_.dir + "/distinct/file" + std::to_string(i) + ".txt");
+    }
+}
+
+void LoadGenerator::writes(LoadWorker& worker, size_t thread) {
+    for (size_t i = thread; i < config_.ops; i += config_.threads) {
+        worker.writeFile(config_.dir + "/writes/file" + std::to_string(i) + ".bin", config_.file_size,
+                         config_.block_size);
+    }
+}
+
+void LoadGenerator::mixed(LoadWorker& worker, size_t thread) {
+    std::mt19937_64 random(config_.seed + thread + 1);
+    // Zipf (s = 1) over a directory's files: a few are hot, most are cold
+    std::vector<double> weights;
+    for (size_t f = 0; f < config_.files_per_dir; f++) {
+        weights.push_back(1.0 / (f + 1));
+    }
+    std::discrete_distribution<size_t> file(weights.begin(), weights.end());
+    std::uniform_int_distribution<size_t> dir(0, std::max<size_t>(1, config_.dirs) - 1);
+
+    for (size_t visit = 0; visit < config_.ops; visit++) {
+        size_t d = dir(random);
+        worker.list(config_.dir + "/dir" + std::to_string(d));
+        for (size_t i = 0; i < config_.fanout; i++) {
+            worker.stat(mixedPath(d, file(random)));
+        }
+        worker.cat(mixedPath(d, file(random)));
+    }
+}
+
+void LoadGenerator::replay(LoadWorker& worker, const std::vector<const AccessRecord*>& records,
+                           std::chrono::steady_clock::time_point start, LoadResult& result) {
+    double speed = config_.speed > 0 ? config_.speed : 1.0;
+    for (const AccessRecord* record : records) {
+        auto due = start + std::chrono::microseconds(static_cast<int64_t>(record->time_us / speed));
+        std::this_thread::sleep_until(due);
+        auto lag = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - due);
+        if (lag > std::chrono::milliseconds(1)) {
+            result.late_ops++;
+        }
+        result.max_lag_us = std::max<uint64_t>(result.max_lag_us, std::max<int64_t>(lag.count(), 0));
+        worker.replay(*record);
+    }
+}
+
+LoadResult LoadGenerator::run() {
+    const auto& names = LoadConfig::workloads();
+    if (std::find(names.begin(), names.end(), config_.workload) == names.end()) {
+        throw std::invalid_argument("Unknown workload '" + config_.workload + "'");
+    }
+    size_t threads = config_.threads;
+
+    // Replayed operations on one file handle (or, without one, one path)
+    // stay on one thread and in order; different ones run concurrently
+    std::vector<std::vector<const AccessRecord*>> shares(threads);
+    if (config_.workload == "replay") {
+        for (const auto& record : config_.trace) {
+            size_t key = record.fh ? std::hash<uint64_t>()(record.fh) : std::hash<std::string>()(record.path);
+            shares[key % threads].push_back(&record);
+        }
+        for (auto& share : shares) {
+            std::stable_sort(share.begin(), share.end(), [](const AccessRecord* a, const AccessRecord* b) {
+                return a->time_us < b->time_us;
+            });
+        }
+    }
+    if (config_.workload == "distinct") {
+        LoadStats untimed;
+        LoadWorker(root_, untimed).makeDirectories(config_.dir + "/distinct");
+    } else if (config_.workload == "writes") {
+        LoadStats untimed;
+        LoadWorker(root_, untimed).makeDirectories(config_.dir + "/writes");
+    } else if (config_.workload == "herd") {
+        LoadStats untimed;
+        LoadWorker(root_, untimed).makeDirectories(config_.dir);
+    }
+
+    std::vector<LoadResult> results(threads);
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);  // Once all are up
+    for (size_t t = 0; t < threads; t++) {
+        pool.emplace_back([this, t, start, &results, &shares]() {
+            LoadWorker worker(root_, results[t].stats);
+            std::this_thread::sleep_until(start);
+            const std::string& workload = config_.workload;
+            if (workload == "ls-storm") {
+                lsStorm(worker, t);
+            } else if (workload == "herd") {
+                herd(worker, t);
+            } else if (workload == "distinct") {
+                distinct(worker, t);
+            } else if (workload == "writes") {
+                writes(worker, t);
+            } else if (workload == "mixed") {
+                mixed(worker, t);
+            } else {
+                replay(worker, shares[t], start, results[t]);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    LoadResult result;
+    result.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& partial : results) {
+        result.stats.merge(partial.stats);
+        result.late_ops += partial.late_ops;
+        result.max_lag_us = std::max(result.max_lag_us, partial.max_lag_us);
+    }
+    return result;
+}
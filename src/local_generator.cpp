@@ -0,0 +1,623 @@
+#include "local_generator.h"
+#include "logger.h"
+#include "fnv1a.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fnmatch.h>
+
+// Upper bound for the `size` parameter, so a typo can't exhaust memory
+static const uint64_t MAX_GENERATED_SIZE = 64ull * 1024 * 1024;
+static const uint64_t MAX_DIMENSION = 8192;
+static const char* const DEFAULT_LICENSE_YEAR = "2024";
+
+static uint64_t numericParam(const std::map<std::string, std::string>& params, const std::string& name,
+                             uint64_t default_value, uint64_t max_value) {
+    auto it = params.find(name);
+    if (it == params.end()) {
+        return default_value;
+    }
+    try {
+        return std::min<uint64_t>(std::stoull(it->second), max_value);
+    } catch (const std::exception&) {
+        LOG_WARNING << "Invalid generator parameter " << name << " = " << it->second;
+        return default_value;
+    }
+}
+
+static std::string stringParam(const std::map<std::string, std::string>& params, const std::string& name,
+                               const std::string& default_value) {
+    auto it = params.find(name);
+    return it != params.end() ? it->second : default_value;
+}
+
+static std::string fileName(const std::string& path) {
+    size_t last_slash = path.find_last_of('/');
+    return last_slash != std::string::npos ? path.substr(last_slash + 1) : path;
+}
+
+// Varies placeholders between files without losing determinism
+static uint64_t pathHash(const std::string& path) {
+    return fnv1a(path);
+}
+
+static void put16be(std::string& out, uint32_t v) {
+    out += static_cast<char>((v >> 8) & 0xff);
+    out += static_cast<char>(v & 0xff);
+}
+
+static void put32be(std::string& out, uint32_t v) {
+    put16be(out, v >> 16);
+    put16be(out, v & 0xffff);
+}
+
+static void put16le(std::string& out, uint32_t v) {
+    out += static_cast<char>(v & 0xff);
+    out += static_cast<char>((v >> 8) & 0xff);
+}
+
+static void put32le(std::string& out, uint32_t v) {
+    put16le(out, v & 0xffff);
+    put16le(out, v >> 16);
+}
+
+static uint32_t crc32(const std::string& data) {
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xffffffffu;
+    for (unsigned char c : data) {
+        crc = table[(crc ^ c) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+static uint32_t adler32(const std::string& data) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (unsigned char c : data) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+class EmptyGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string&, const std::map<std::string, std::string>&,
+                  std::string& content) const override {
+        content.clear();
+        return true;
+    }
+};
+
+class TextGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string&, const std::map<std::string, std::string>& params,
+                  std::string& content) const override {
+        auto it = params.find("content");
+        if (it == params.end()) {
+            return false;
+        }
+        content = it->second;
+        return true;
+    }
+};
+
+static const char* MIT_LICENSE = R"(MIT License
+
+Copyright (c) {year} {holder}
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+)";
+
+static const char* BSD_LICENSE_HEAD = R"(BSD {clauses}-Clause License
+
+Copyright (c) {year}, {holder}
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+)";
+
+static const char* BSD_THIRD_CLAUSE = R"(3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+)";
+
+static const char* BSD_LICENSE_TAIL = R"(THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+)";
+
+static const char* ISC_LICENSE = R"(ISC License
+
+Copyright (c) {year}, {holder}
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+)";
+
+static const char* UNLICENSE = R"(This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+)";
+
+static void replaceAll(std::string& text, const std::string& placeholder, const std::string& value) {
+    size_t pos = 0;
+    while ((pos = text.find(placeholder, pos)) != std::string::npos) {
+        text.replace(pos, placeholder.size(), value);
+        pos += value.size();
+    }
+}
+
+class LicenseGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string& path, const std::map<std::string, std::string>& params,
+                  std::string& content) const override {
+        std::string license = stringParam(params, "license", "mit");
+        std::transform(license.begin(), license.end(), license.begin(), ::tolower);
+
+        if (license == "mit") {
+            content = MIT_LICENSE;
+        } else if (license == "bsd-2-clause" || license == "bsd-3-clause") {
+            bool three = license == "bsd-3-clause";
+            content = std::string(BSD_LICENSE_HEAD) + (three ? BSD_THIRD_CLAUSE : "") + BSD_LICENSE_TAIL;
+            replaceAll(content, "{clauses}", three ? "3" : "2");
+        } else if (license == "isc") {
+            content = ISC_LICENSE;
+        } else if (license == "unlicense") {
+            content = UNLICENSE;
+        } else {
+            return false;  // Let the LLM write anything we don't carry
+        }
+
+        // Default holder: the directory the license sits in, e.g. a project root
+        std::string dir = path.substr(0, path.find_last_of('/'));
+        std::string project = fileName(dir);
+        std::string holder = stringParam(params, "holder", project.empty() ? "The Authors" : "The " + project + " Authors");
+
+        // Fixed rather than the current year, so a LICENSE evicted and
+        // regenerated later comes back byte for byte
+        std::string year = stringParam(params, "year", DEFAULT_LICENSE_YEAR);
+
+        replaceAll(content, "{year}", year);
+        replaceAll(content, "{holder}", holder);
+        return true;
+    }
+};
+
+// Two colors per file, derived from the path
+static void placeholderColors(const std::string& path, unsigned char from[3], unsigned char to[3]) {
+    uint64_t hash = pathHash(path);
+    for (int i = 0; i < 3; i++) {
+        from[i] = static_cast<unsigned char>(hash >> (8 * i));
+        to[i] = static_cast<unsigned char>(hash >> (8 * (i + 3)));
+    }
+}
+
+class PngGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string& path, const std::map<std::string, std::string>& params,
+                  std::string& content) const override {
+        uint64_t size = numericParam(params, "size", 0, MAX_GENERATED_SIZE);
+        uint64_t width = numericParam(params, "width", 0, MAX_DIMENSION);
+        uint64_t height = numericParam(params, "height", 0, MAX_DIMENSION);
+
+        // Without explicit dimensions, shrink the default image to fit the size
+        if (width == 0 || height == 0) {
+            width = height = 64;
+            while (size > 0 && width > 1 && encodedSize(width, height) > size) {
+                width /= 2;
+                height /= 2;
+            }
+        }
+
+        // The raw scanlines are held in memory too, so they get the same cap
+        // as size; large images keep their aspect ratio
+        while (height * (1 + 3 * width) > MAX_GENERATED_SIZE) {
+            width = std::max<uint64_t>(1, width / 2);
+            height = std::max<uint64_t>(1, height / 2);
+        }
+
+        unsigned char from[3], to[3];
+        placeholderColors(path, from, to);
+
+        // Diagonal gradient, filter type 0 on every scanline
+        std::string raw;
+        raw.reserve(height * (1 + 3 * width));
+        uint64_t span = std::max<uint64_t>(1, width + height - 2);
+        for (uint64_t y = 0; y < height; y++) {
+            raw += '\0';
+            for (uint64_t x = 0; x < width; x++) {
+                uint64_t t = x + y;
+                for (int c = 0; c < 3; c++) {
+                    raw += static_cast<char>((from[c] * (span - t) + to[c] * t) / span);
+                }
+            }
+        }
+
+        std::string header;
+        put32be(header, width);
+        put32be(header, height);
+        header += std::string("\x08\x02\x00\x00\x00", 5);  // 8-bit RGB
+
+        content = std::string("\x89PNG\r\n\x1a\n", 8);
+        content += chunk("IHDR", header);
+        content += chunk("IDAT", storedZlib(raw));
+
+        // Pad with a comment to the requested size
+        const uint64_t padding_overhead = 12 + 8;
+        uint64_t current = content.size() + 12;
+        if (size >= current + padding_overhead) {
+            std::string text = std::string("Comment\0", 8);
+            text.append(size - current - padding_overhead, ' ');
+            content += chunk("tEXt", text);
+        }
+        content += chunk("IEND", "");
+        return true;
+    }
+
+private:
+    static uint64_t encodedSize(uint64_t width, uint64_t height) {
+        uint64_t raw = height * (1 + 3 * width);
+        uint64_t blocks = (raw + 65534) / 65535;
+        return 8 + (12 + 13) + (12 + 2 + 5 * blocks + raw + 4) + 12;
+    }
+
+    static std::string chunk(const char* type, const std::string& data) {
+        std::string body = std::string(type, 4) + data;
+        std::string out;
+        put32be(out, data.size());
+        out += body;
+        put32be(out, crc32(body));
+        return out;
+    }
+
+    // zlib stream of uncompressed deflate blocks; placeholders are small and
+    // must be cheap to produce
+    static std::string storedZlib(const std::string& raw) {
+        std::string out("\x78\x01", 2);
+        size_t pos = 0;
+        do {
+            size_t length = std::min<size_t>(65535, raw.size() - pos);
+            out += static_cast<char>(pos + length == raw.size() ? 1 : 0);
+            put16le(out, length);
+            put16le(out, ~length & 0xffff);
+            out.append(raw, pos, length);
+            pos += length;
+        } while (pos < raw.size());
+        put32be(out, adler32(raw));
+        return out;
+    }
+};
+
+class JpegGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string& path, const std::map<std::string, std::string>& params,
+                  std::string& content) const override {
+        uint64_t size = numericParam(params, "size", 0, MAX_GENERATED_SIZE);
+        uint64_t width = std::max<uint64_t>(1, numericParam(params, "width", 64, MAX_DIMENSION));
+        uint64_t height = std::max<uint64_t>(1, numericParam(params, "height", 64, MAX_DIMENSION));
+
+        // A uniform grayscale image: every 8x8 block has only a DC
+        // coefficient, and all but the first repeat it (difference 0)
+        int shade = 32 + static_cast<int>(pathHash(path) % 192);
+        int dc = (shade - 128) * 8;
+        int category = 0;
+        for (int magnitude = std::abs(dc); magnitude > 0; magnitude >>= 1) {
+            category++;
+        }
+
+        std::string segments("\xff\xd8", 2);
+
+        // JFIF APP0
+        segments += std::string("\xff\xe0\x00\x10JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00", 18);
+
+        // Quantization table of ones
+        segments += std::string("\xff\xdb\x00\x43\x00", 5);
+        segments.append(64, '\x01');
+
+        // Baseline frame, one component
+        segments += std::string("\xff\xc0\x00\x0b\x08", 5);
+        put16be(segments, height);
+        put16be(segments, width);
+        segments += std::string("\x01\x01\x11\x00", 4);
+
+        // Minimal Huffman tables: DC symbols {0, category} coded "0" and
+        // "10", AC has only end-of-block coded "0"
+        std::vector<unsigned char> dc_symbols{0};
+        if (category > 0) {
+            dc_symbols.push_back(static_cast<unsigned char>(category));
+        }
+        segments += std::string("\xff\xc4", 2);
+        put16be(segments, 2 + 1 + 16 + dc_symbols.size());
+        segments += '\x00';
+        for (int length = 1; length <= 16; length++) {
+            segments += static_cast<char>(length <= static_cast<int>(dc_symbols.size()) ? 1 : 0);
+        }
+        for (unsigned char symbol : dc_symbols) {
+            segments += static_cast<char>(symbol);
+        }
+        segments += std::string("\xff\xc4\x00\x14\x10\x01", 6);
+        segments.append(15, '\0');
+        segments += '\0';
+
+        segments += std::string("\xff\xda\x00\x08\x01\x01\x00\x00\x3f\x00", 10);
+
+        BitWriter bits;
+        if (category > 0) {
+            bits.write(0b10, 2);
+            int value = dc >= 0 ? dc : dc + (1 << category) - 1;
+            bits.write(value, category);
+        } else {
+            bits.write(0, 1);
+        }
+        bits.write(0, 1);  // End of block
+        uint64_t blocks = ((width + 7) / 8) * ((height + 7) / 8);
+        for (uint64_t i = 1; i < blocks; i++) {
+            bits.write(0, 2);  // Same DC, end of block
+        }
+        std::string scan = bits.finish();
+
+        // Pad with comment segments (at most 65533 bytes each) before the scan
+        const size_t header_end = 20;  // After SOI and APP0
+        uint64_t current = segments.size() + scan.size() + 2;
+        std::string comments;
+        if (size > current) {
+            uint64_t remaining = size - current;
+            while (remaining >= 4) {
+                uint64_t segment = std::min<uint64_t>(remaining, 4 + 65533);
+                if (remaining - segment > 0 && remaining - segment < 4) {
+                    segment -= 4;
+                }
+                comments += std::string("\xff\xfe", 2);
+                put16be(comments, segment - 2);
+                comments.append(segment - 4, ' ');
+                remaining -= segment;
+            }
+        }
+
+        content = segments.substr(0, header_end) + comments + segments.substr(header_end) + scan;
+        content += std::string("\xff\xd9", 2);
+        return true;
+    }
+
+private:
+    class BitWriter {
+    public:
+        void write(uint32_t value, int count) {
+            for (int i = count - 1; i >= 0; i--) {
+                current_ = (current_ << 1) | ((value >> i) & 1);
+                if (++used_ == 8) {
+                    flush();
+                }
+            }
+        }
+
+        std::string finish() {
+            while (used_ != 0) {
+                write(1, 1);  // Pad with ones
+            }
+            return out_;
+        }
+
+    private:
+        void flush() {
+            out_ += static_cast<char>(current_);
+            if (current_ == 0xff) {
+                out_ += '\0';  // Byte stuffing
+            }
+            current_ = 0;
+            used_ = 0;
+        }
+
+        std::string out_;
+        uint32_t current_ = 0;
+        int used_ = 0;
+    };
+};
+
+class ZipGenerator : public LocalGenerator {
+public:
+    bool generate(const std::string& path, const std::map<std::string, std::string>& params,
+                  std::string& content) const override {
+        uint64_t size = numericParam(params, "size", 0, MAX_GENERATED_SIZE);
+
+        std::string name = fileName(path);
+        size_t dot = name.find_last_of('.');
+        std::string entry = (dot != std::string::npos && dot > 0 ? name.substr(0, dot) : name) + ".txt";
+        std::string line = "Placeholder content for " + name + "\n";
+
+        // Fill the single stored entry up to the requested archive size
+        uint64_t overhead = 30 + entry.size() + 46 + entry.size() + 22;
+        std::string data = line;
+        if (size > overhead + line.size()) {
+            data.clear();
+            while (data.size() < size - overhead) {
+                data += line;
+            }
+            data.resize(size - overhead);
+        }
+        uint32_t crc = crc32(data);
+
+        // DOS date 1980-01-01 00:00, so output is stable
+        auto common = [&](std::string& out) {
+            put16le(out, 10);       // Version needed
+            put16le(out, 0);        // Flags
+            put16le(out, 0);        // Stored
+            put16le(out, 0);        // Time
+            put16le(out, 0x21);     // Date
+            put32le(out, crc);
+            put32le(out, data.size());
+            put32le(out, data.size());
+            put16le(out, entry.size());
+            put16le(out, 0);        // Extra field length
+        };
+
+        content.clear();
+        put32le(content, 0x04034b50);
+        common(content);
+        content += entry;
+        content += data;
+
+        uint32_t directory_offset = content.size();
+        put32le(content, 0x02014b50);
+        put16le(content, 10);       // Version made by
+        common(content);
+        put16le(content, 0);        // Comment length
+        put16le(content, 0);        // Disk number
+        put16le(content, 0);        // Internal attributes
+        put32le(content, 0);        // External attributes
+        put32le(content, 0);        // Local header offset
+        content += entry;
+        uint32_t directory_size = content.size() - directory_offset;
+
+        put32le(content, 0x06054b50);
+        put16le(content, 0);
+        put16le(content, 0);
+        put16le(content, 1);
+        put16le(content, 1);
+        put32le(content, directory_size);
+        put32le(content, directory_offset);
+        put16le(content, 0);
+        return true;
+    }
+};
+
+GeneratorRegistry::GeneratorRegistry() {
+    add("empty", std::make_unique<EmptyGenerator>());
+    add("text", std::make_unique<TextGenerator>());
+    add("license", std::make_unique<LicenseGenerator>());
+    add("png", std::make_unique<PngGenerator>());
+    add("jpeg", std::make_unique<JpegGenerator>());
+    add("zip", std::make_unique<ZipGenerator>());
+}
+
+void GeneratorRegistry::add(const std::string& name, std::unique_ptr<LocalGenerator> generator) {
+    generators_[name] = std::move(generator);
+}
+
+bool GeneratorRegistry::has(const std::string& name) const {
+    return generators_.count(name) > 0;
+}
+
+bool GeneratorRegistry::matches(const std::string& pattern, const std::string& path) {
+    const std::string& subject = pattern.find('/') != std::string::npos ? path : fileName(path);
+    return fnmatch(pattern.c_str(), subject.c_str(), FNM_CASEFOLD) == 0;
+}
+
+bool GeneratorRegistry::generate(const std::string& path, const std::vector<GeneratorRule>& rules,
+                                 std::string& content, std::string* generator_name) const {
+    for (const auto& rule : rules) {
+        if (!matches(rule.pattern, path)) {
+            continue;
+        }
+        if (rule.generator == "llm") {
+            return false;
+        }
+
+        auto it = generators_.find(rule.generator);
+        if (it == generators_.end()) {
+            LOG_WARNING << "Unknown generator '" << rule.generator << "' for " << rule.pattern;
+            return false;
+        }
+        if (!it->second->generate(path, rule.params, content)) {
+            return false;
+        }
+        if (generator_name) {
+            *generator_name = rule.generator;
+        }
+        return true;
+    }
+    return false;
+}
+
+const std::vector<GeneratorRule>& GeneratorRegistry::defaultRules() {
+    static const std::vector<GeneratorRule> rules = {
+        {".gitkeep", "empty", {}},
+        {".keep", "empty", {}},
+        {".nojekyll", "empty", {}},
+        {"__init__.py", "empty", {}},
+        {"py.typed", "empty", {}},
+        {"LICENSE", "license", {}},
+        {"LICENSE.txt", "license", {}},
+        {"LICENSE.md", "license", {}},
+        {"LICENCE", "license", {}},
+        {"*.png", "png", {}},
+        {"*.jpg", "jpeg", {}},
+        {"*.jpeg", "jpeg", {}},
+        {"*.zip", "zip", {}},
+    };
+    return rules;
+}
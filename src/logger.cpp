@@ -0,0 +1,204 @@
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+std::atomic<int> Logger::level_{static_cast<int>(LogLevel::Info)};
+std::atomic<unsigned> Logger::rate_limit_{20};
+
+// Drains a thread's queue one last time when the thread exits
+struct ThreadQueueHolder {
+    std::shared_ptr<Logger::ThreadQueue> queue;
+
+    ~ThreadQueueHolder() {
+        if (queue) {
+            queue->retired = true;
+        }
+    }
+};
+
+Logger& Logger::global() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : out_(&std::cerr) {
+    thread_ = std::thread([this]() { run(); });
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    flush();
+}
+
+std::optional<LogLevel> Logger::parseLevel(const std::string& name) {
+    static const LogLevel levels[] = {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error,
+                                      LogLevel::Off};
+    for (LogLevel level : levels) {
+        std::string level_name = levelName(level);
+        std::transform(level_name.begin(), level_name.end(), level_name.begin(), ::tolower);
+        if (name == level_name) {
+            return level;
+        }
+    }
+    return std::nullopt;
+}
+
+const char* Logger::levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warning: return "WARNING";
+        case LogLevel::Error: return "ERROR";
+        case LogLevel::Off: return "OFF";
+    }
+    return "UNKNOWN";
+}
+
+Logger::ThreadQueue& Logger::threadQueue() {
+    thread_local ThreadQueueHolder holder;
+    if (!holder.queue) {
+        holder.queue = std::make_shared<ThreadQueue>();
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues_.push_back(holder.queue);
+    }
+    return *holder.queue;
+}
+
+void Logger::write(LogLevel level, std::string line) {
+    ThreadQueue& queue = threadQueue();
+    size_t tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == QUEUE_LINES) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ThreadQueue::Entry& entry = queue.entries[tail % QUEUE_LINES];
+    entry.sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+    entry.line = std::move(line);
+    queue.tail.store(tail + 1, std::memory_order_release);
+
+    // Problems show up right away; everything else waits for the next round
+    if (level >= LogLevel::Warning) {
+        wake_.notify_one();
+    }
+}
+
+void Logger::drain() {
+    std::vector<std::shared_ptr<ThreadQueue>> queues;
+    {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues = queues_;
+    }
+
+    std::vector<ThreadQueue::Entry> entries;
+    for (const auto& queue : queues) {
+        // Retired before draining, so nothing can follow what is drained
+        bool retired = queue->retired.load();
+        size_t head = queue->head.load(std::memory_order_relaxed);
+        size_t tail = queue->tail.load(std::memory_order_acquire);
+        for (; head < tail; head++) {
+            entries.push_back(std::move(queue->entries[head % QUEUE_LINES]));
+        }
+        queue->head.store(head, std::memory_order_release);
+        if (retired) {
+            std::lock_guard<std::mutex> lock(queues_mutex_);
+            queues_.erase(std::remove(queues_.begin(), queues_.end(), queue), queues_.end());
+        }
+    }
+
+    // Interleaved as the lines were written
+    std::sort(entries.begin(), entries.end(),
+              [](const ThreadQueue::Entry& a, const ThreadQueue::Entry& b) { return a.sequence < b.sequence; });
+    std::string batch;
+    for (const auto& entry : entries) {
+        batch += entry.line;
+        batch += '\n';
+    }
+    uint64_t dropped = dropped_.load();
+    if (dropped > reported_dropped_) {
+        batch += "[WARNING] Log queue full, dropped " + std::to_string(dropped - reported_dropped_) + " lines\n";
+        reported_dropped_ = dropped;
+    }
+    if (!batch.empty()) {
+        out_->write(batch.data(), batch.size());
+        out_->flush();
+    }
+}
+
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain();
+}
+
+void Logger::setOutput(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain();
+    out_ = &out;
+}
+
+void Logger::run() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(50));
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+bool LogSite::admit() {
+    unsigned limit = Logger::rateLimit();
+    if (limit == 0) {
+        return true;
+    }
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < limit) {
+        return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void LogLine::appendField(const char* key, const std::string& value) {
+    fields_ += ' ';
+    fields_ += key;
+    fields_ += '=';
+    if (value.empty() || value.find_first_of(" \t\"=") != std::string::npos) {
+        fields_ += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                fields_ += '\\';
+            }
+            fields_ += c;
+        }
+        fields_ += '"';
+    } else {
+        fields_ += value;
+    }
+}
+
+LogLine::~LogLine() {
+    // Lines the rate limit held back since this site last got through
+    uint64_t suppressed = site_.takeSuppressed();
+    if (suppressed) {
+        field("suppressed", suppressed);
+    }
+    std::string message = message_.str();
+    std::string line = std::string("[") + Logger::levelName(level_) + "]";
+    if (!message.empty()) {
+        line += " " + message;
+    }
+    Logger::global().write(level_, line + fields_);
+}
@@ -1,14 +1,25 @@
 #include "simfs.h"
+#include "mount_config.h"
+#include <fuse3/fuse_lowlevel.h>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <cstdlib>
+#include <filesystem>
+#include <memory>
+
+// Relative paths are resolved against the directory simfs was started in
+static std::string absolutePath(const std::string& path) {
+    return path.empty() ? path : std::filesystem::absolute(path).string();
+}
 
 void print_usage(const char* program_name) {
     std::cerr << "Usage: " << program_name << " <mountpoint> [options]\n";
     std::cerr << "\nOptions:\n";
     std::cerr << "  --db-path=PATH       Path to RocksDB database (default: ./simfs.db)\n";
+    std::cerr << "  --base-db=PATH       Read-only baseline; --db-path then only holds this mount's changes\n";
     std::cerr << "  --llm-endpoint=URL   LLM API endpoint (default: https://api.openai.com/v1/chat/completions)\n";
+    std::cerr << "  --config=PATH        Mount-wide TOML config (process policy, quotas)\n";
     std::cerr << "  -f                   Run in foreground\n";
     std::cerr << "  -d                   Enable debug output\n";
     std::cerr << "  -h                   Print this help message\n";
@@ -24,6 +35,9 @@ int main(int argc, char *argv[]) {
 
     std::string db_path = "./simfs.db";
     std::string llm_endpoint = "https://api.openai.com/v1/chat/completions";
+    std::string config_path;
+    std::string base_db_path;
+    bool debug = false;
     
     std::vector<char*> fuse_args;
     fuse_args.push_back(argv[0]);
@@ -35,6 +49,13 @@ int main(int argc, char *argv[]) {
             db_path = arg.substr(10);
         } else if (arg.find("--llm-endpoint=") == 0) {
             llm_endpoint = arg.substr(15);
+        } else if (arg.find("--config=") == 0) {
+            config_path = arg.substr(9);
+        } else if (arg.find("--base-db=") == 0) {
+            base_db_path = arg.substr(10);
+        } else if (arg == "-d") {
+            debug = true;  // Also FUSE's own debug output
+            fuse_args.push_back(argv[i]);
         } else if (arg == "-h" || arg == "--help") {
             print_usage(argv[0]);
             return 0;
@@ -58,21 +79,82 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    MountConfig mount_config;
     try {
-        SimFS simfs(db_path, llm_endpoint);
-        SimFS::setInstance(&simfs);
-        
-        std::cout << "Mounting SimFS at " << fuse_args[1] << "\n";
-        std::cout << "Database: " << db_path << "\n";
-        std::cout << "LLM endpoint: " << llm_endpoint << "\n";
-        
-        int ret = fuse_main(fuse_args.size(), fuse_args.data(), 
-                           simfs.getOperations(), nullptr);
-        
-        return ret;
-        
+        if (!config_path.empty()) {
+            mount_config = MountConfig::loadFromFile(config_path);
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
         return 1;
     }
-}
\ No newline at end of file
+    if (debug) {
+        mount_config.logging.level = "debug";
+    }
+    
+    struct fuse_args args = FUSE_ARGS_INIT(static_cast<int>(fuse_args.size()), fuse_args.data());
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(&args, &opts) != 0) {
+        return 1;
+    }
+    if (opts.show_version) {
+        std::cout << "FUSE library version " << fuse_pkgversion() << "\n";
+        fuse_opt_free_args(&args);
+        return 0;
+    }
+    if (!opts.mountpoint) {
+        std::cerr << "Error: No mountpoint specified\n";
+        print_usage(argv[0]);
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+    
+    // Daemonizing moves the working directory to /
+    db_path = absolutePath(db_path);
+    base_db_path = absolutePath(base_db_path);
+    mount_config.metrics.prometheus_socket = absolutePath(mount_config.metrics.prometheus_socket);
+    mount_config.tracing.dump_path = absolutePath(mount_config.tracing.dump_path);
+    mount_config.tracing.access_trace = absolutePath(mount_config.tracing.access_trace);
+    
+    std::cout << "Mounting SimFS at " << opts.mountpoint << "\n";
+    std::cout << "Database: " << db_path << "\n";
+    if (!base_db_path.empty()) {
+        std::cout << "Base database: " << base_db_path << " (read-only)\n";
+    }
+    std::cout << "LLM endpoint: " << llm_endpoint << "\n";
+    if (!config_path.empty()) {
+        std::cout << "Mount config: " << config_path << "\n";
+    }
+    std::cout.flush();
+    
+    // What fuse_main does, except that SimFS is only created once the
+    // process has forked into the background: its worker threads, the
+    // logger's and RocksDB's would not survive the fork
+    int ret = 1;
+    std::unique_ptr<SimFS> simfs;
+    struct fuse* fuse = fuse_new(&args, SimFS::getOperations(), sizeof(struct fuse_operations), nullptr);
+    if (fuse) {
+        if (fuse_mount(fuse, opts.mountpoint) == 0) {
+            if (fuse_daemonize(opts.foreground) == 0) {
+                try {
+                    simfs = std::make_unique<SimFS>(db_path, llm_endpoint, mount_config, base_db_path);
+                    SimFS::setInstance(simfs.get());
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << "\n";
+                }
+            }
+            if (simfs && fuse_set_signal_handlers(fuse_get_session(fuse)) == 0) {
+                if ((opts.singlethread ? fuse_loop(fuse) : fuse_loop_mt(fuse, opts.clone_fd)) == 0) {
+                    ret = 0;
+                }
+                fuse_remove_signal_handlers(fuse_get_session(fuse));
+            }
+            fuse_unmount(fuse);
+        }
+        fuse_destroy(fuse);
+    }
+    simfs.reset();  // Only once unmounted, since it waits for generations in flight
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    return ret;
+}
@@ -0,0 +1,286 @@
+#include "metrics.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int Histogram::bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);  // >= 3
+    int sub = static_cast<int>((value >> (exponent - 3)) & (SUB_BUCKETS - 1));
+    return (exponent - 2) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucketLowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / SUB_BUCKETS + 2;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (exponent - 3);
+}
+
+void Histogram::record(uint64_t value) {
+    buckets_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::count() const {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t Histogram::percentile(double q) const {
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t upper = i + 1 < BUCKETS ? bucketLowerBound(i + 1) - 1 : UINT64_MAX;
+            return std::min(upper, max());
+        }
+    }
+    return max();
+}
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+const char* Metrics::opName(FuseOp op) {
+    switch (op) {
+        case FuseOp::Getattr: return "getattr";
+        case FuseOp::Readdir: return "readdir";
+        case FuseOp::Open: return "open";
+        case FuseOp::Read: return "read";
+        case FuseOp::Write: return "write";
+        case FuseOp::Create: return "create";
+        case FuseOp::Release: return "release";
+        case FuseOp::Poll: return "poll";
+        case FuseOp::Setxattr: return "setxattr";
+        case FuseOp::Getxattr: return "getxattr";
+        case FuseOp::CopyFileRange: return "copy_file_range";
+        case FuseOp::Unlink: return "unlink";
+        case FuseOp::Mkdir: return "mkdir";
+        case FuseOp::Rmdir: return "rmdir";
+    }
+    return "unknown";
+}
+
+static const double QUANTILES[] = {0.5, 0.9, 0.99};
+
+static void formatHistogramText(std::ostream& out, const std::string& name, const Histogram& histogram) {
+    uint64_t count = histogram.count();
+    out << name << ".count=" << count << "\n"
+        << name << ".mean=" << (count ? histogram.sum() / count : 0) << "\n"
+        << name << ".p50=" << histogram.percentile(0.5) << "\n"
+        << name << ".p90=" << histogram.percentile(0.9) << "\n"
+        << name << ".p99=" << histogram.percentile(0.99) << "\n"
+        << name << ".max=" << histogram.max() << "\n";
+}
+
+std::string Metrics::formatText() const {
+    std::ostringstream out;
+    for (size_t i = 0; i < FUSE_OP_COUNT; i++) {
+        const Op& stats = ops_[i];
+        if (stats.calls.value() == 0) {
+            continue;
+        }
+        std::string prefix = std::string("fuse.") + opName(static_cast<FuseOp>(i));
+        out << prefix << ".calls=" << stats.calls.value() << "\n"
+            << prefix << ".errors=" << stats.errors.value() << "\n";
+        formatHistogramText(out, prefix + ".latency_us", stats.latency_us);
+    }
+
+    formatHistogramText(out, "db.get_us", db_get_us);
+    formatHistogramText(out, "db.write_us", db_write_us);
+
+    out << "generation.requests=" << generations.value() << "\n"
+        << "generation.failures=" << generation_failures.value() << "\n"
+        << "generation.cancelled_attempts=" << cancelled_attempts.value() << "\n";
+    formatHistogramText(out, "generation.queue_wait_us", queue_wait_us);
+    formatHistogramText(out, "generation.ttft_us", ttft_us);
+    formatHistogramText(out, "generation.total_us", generation_us);
+    formatHistogramText(out, "generation.chunks_per_second", chunks_per_second);
+
+    uint64_t hits = cache_hits.value();
+    uint64_t first_reads = hits + cache_misses.value() + stream_joins.value();
+    out << "read.cache_hits=" << hits << "\n"
+        << "read.cache_misses=" << cache_misses.value() << "\n"
+        << "read.stream_joins=" << stream_joins.value() << "\n"
+        << "read.hit_rate=" << (first_reads ? static_cast<double>(hits) / first_reads : 0.0) << "\n"
+        << "read.bytes_from_db=" << bytes_from_db.value() << "\n"
+        << "read.bytes_from_stream=" << bytes_from_stream.value() << "\n";
+    return out.str();
+}
+
+// Summaries rather than histograms: the quantiles are computed here, and
+// a scrape stays a few lines per metric
+static void formatSummary(std::ostream& out, const std::string& name, const std::string& labels,
+                          const Histogram& histogram) {
+    std::string separator = labels.empty() ? "" : ",";
+    for (double q : QUANTILES) {
+        out << name << "{" << labels << separator << "quantile=\"" << q << "\"} " << histogram.percentile(q) << "\n";
+    }
+    std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << suffix << " " << histogram.sum() << "\n"
+        << name << "_count" << suffix << " " << histogram.count() << "\n";
+}
+
+static void formatCounter(std::ostream& out, const std::string& name, const std::string& help, const Counter& counter) {
+    out << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " counter\n"
+        << name << " " << counter.value() << "\n";
+}
+
+static void formatSummaryFamily(std::ostream& out, const std::string& name, const std::string& help,
+                                const Histogram& histogram) {
+    out << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " summary\n";
+    formatSummary(out, name, "", histogram);
+}
+
+std::string Metrics::formatPrometheus() const {
+    std::ostringstream out;
+
+    out << "# HELP simfs_fuse_calls_total FUSE operations handled.\n"
+        << "# TYPE simfs_fuse_calls_total counter\n";
+    for (size_t i = 0; i < FUSE_OP_COUNT; i++) {
+        out << "simfs_fuse_calls_total{op=\"" << opName(static_cast<FuseOp>(i)) << "\"} " << ops_[i].calls.value() << "\n";
+    }
+    out << "# HELP simfs_fuse_errors_total FUSE operations that returned an error.\n"
+        << "# TYPE simfs_fuse_errors_total counter\n";
+    for (size_t i = 0; i < FUSE_OP_COUNT; i++) {
+        out << "simfs_fuse_errors_total{op=\"" << opName(static_cast<FuseOp>(i)) << "\"} " << ops_[i].errors.value() << "\n";
+    }
+    out << "# HELP simfs_fuse_latency_microseconds FUSE operation latency.\n"
+        << "# TYPE simfs_fuse_latency_microseconds summary\n";
+    for (size_t i = 0; i < FUSE_OP_COUNT; i++) {
+        formatSummary(out, "simfs_fuse_latency_microseconds",
+                      std::string("op=\"") + opName(static_cast<FuseOp>(i)) + "\"", ops_[i].latency_us);
+    }
+
+    formatSummaryFamily(out, "simfs_db_get_microseconds", "Database read latency.", db_get_us);
+    formatSummaryFamily(out, "simfs_db_write_microseconds", "Database write latency.", db_write_us);
+
+    formatCounter(out, "simfs_generations_total", "Streaming generation requests.", generations);
+    formatCounter(out, "simfs_generation_failures_total", "Generations that ended in an error.", generation_failures);
+    formatCounter(out, "simfs_cancelled_attempts_total", "Hedged attempts cancelled after losing the race.",
+                  cancelled_attempts);
+    formatSummaryFamily(out, "simfs_queue_wait_microseconds", "Time waiting for admission.", queue_wait_us);
+    formatSummaryFamily(out, "simfs_ttft_microseconds", "Time to first token.", ttft_us);
+    formatSummaryFamily(out, "simfs_generation_microseconds", "Time from request to end of stream.", generation_us);
+    formatSummaryFamily(out, "simfs_chunks_per_second", "Content chunks streamed per second after the first.", chunks_per_second);
+
+    formatCounter(out, "simfs_cache_hits_total", "First reads served from the database.", cache_hits);
+    formatCounter(out, "simfs_cache_misses_total", "First reads that started a generation.", cache_misses);
+    formatCounter(out, "simfs_stream_joins_total", "First reads that joined a generation in progress.", stream_joins);
+    formatCounter(out, "simfs_read_db_bytes_total", "Bytes read from stored content.", bytes_from_db);
+    formatCounter(out, "simfs_read_stream_bytes_total", "Bytes read from generation streams.", bytes_from_stream);
+    return out.str();
+}
+
+MetricsServer::MetricsServer(const std::string& socket_path, Metrics& metrics)
+    : socket_path_(socket_path), metrics_(metrics) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Metrics socket path too long: " + socket_path);
+    }
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    // A socket left over from an earlier mount is replaced; anything else
+    // at the path is someone's file
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            throw std::runtime_error("Metrics socket path exists and is not a socket: " + socket_path);
+        }
+        ::unlink(socket_path.c_str());
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Failed to create metrics socket: " + std::string(strerror(errno)));
+    }
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd_, 8) < 0) {
+        std::string error = strerror(errno);
+        close(listen_fd_);
+        throw std::runtime_error("Failed to listen on " + socket_path + ": " + error);
+    }
+    thread_ = std::thread([this]() { run(); });
+}
+
+MetricsServer::~MetricsServer() {
+    stopping_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);  // Wakes accept()
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(listen_fd_);
+    ::unlink(socket_path_.c_str());
+}
+
+void MetricsServer::run() {
+    while (!stopping_) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!stopping_) {
+                LOG_WARNING << "Metrics socket stopped accepting: " << strerror(errno);
+            }
+            return;
+        }
+
+        // The request doesn't matter: every path gets the metrics. Read what
+        // the client sent so closing doesn't reset the connection.
+        timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        ssize_t received = recv(fd, request, sizeof(request), 0);
+        (void) received;
+
+        std::string body = metrics_.formatPrometheus();
+        std::string response = "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+        close(fd);
+    }
+}
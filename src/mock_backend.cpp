@@ -0,0 +1,478 @@
+#include "mock_backend.h"
+#include "llm_client.h"  // For the batch markers
+#include "fnv1a.h"
+#include "logger.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <netinet/in.h>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+LatencyDistribution LatencyDistribution::parse(const std::string& spec) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    size_t colon;
+    while ((colon = spec.find(':', start)) != std::string::npos) {
+        parts.push_back(spec.substr(start, colon - start));
+        start = colon + 1;
+    }
+    parts.push_back(spec.substr(start));
+
+    LatencyDistribution distribution;
+    size_t first_number = 1;
+    if (parts[0] == "fixed") {
+        distribution.kind = Kind::Fixed;
+    } else if (parts[0] == "uniform") {
+        distribution.kind = Kind::Uniform;
+    } else if (parts[0] == "normal") {
+        distribution.kind = Kind::Normal;
+    } else if (parts[0] == "lognormal") {
+        distribution.kind = Kind::LogNormal;
+    } else {
+        first_number = 0;  // A bare number
+    }
+    if (parts.size() <= first_number || parts.size() > first_number + 2) {
+        throw std::invalid_argument("Bad latency distribution '" + spec + "'");
+    }
+    try {
+        distribution.mean_ms = std::stod(parts[first_number]);
+        if (parts.size() > first_number + 1) {
+            distribution.spread_ms = std::stod(parts[first_number + 1]);
+        }
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Bad latency distribution '" + spec + "'");
+    }
+    if (distribution.mean_ms < 0 || distribution.spread_ms < 0) {
+        throw std::invalid_argument("Latency distribution '" + spec + "' has a negative value");
+    }
+    return distribution;
+}
+
+double LatencyDistribution::sample(std::mt19937_64& random) const {
+    double value = mean_ms;
+    switch (kind) {
+        case Kind::Fixed:
+            break;
+        case Kind::Uniform:
+            value = std::uniform_real_distribution<double>(mean_ms - spread_ms, mean_ms + spread_ms)(random);
+            break;
+        case Kind::Normal:
+            value = std::normal_distribution<double>(mean_ms, spread_ms)(random);
+            break;
+        case Kind::LogNormal:
+            // Parameterized so the delays themselves have this mean and
+            // deviation: a long right tail, like real TTFTs
+            if (mean_ms > 0) {
+                double sigma2 = std::log(1 + (spread_ms * spread_ms) / (mean_ms * mean_ms));
+                value = std::lognormal_distribution<double>(std::log(mean_ms) - sigma2 / 2, std::sqrt(sigma2))(random);
+            }
+            break;
+    }
+    return std::max(0.0, value);
+}
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+static void sendResponse(int fd, int status, const char* reason, const std::string& content_type,
+                         const std::string& body, const std::string& extra_headers = "") {
+    sendAll(fd, "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+                "Content-Type: " + content_type + "\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n" + extra_headers +
+                "Connection: close\r\n\r\n" + body);
+}
+
+static void sendError(int fd, int status, const char* reason, const std::string& message,
+                      const std::string& extra_headers = "") {
+    json error = {{"error", {{"message", message}, {"type", "mock_error"}, {"code", status}}}};
+    sendResponse(fd, status, reason, "application/json", error.dump(), extra_headers);
+}
+
+MockBackend::MockBackend(const MockBackendConfig& config) : config_(config), random_(config.seed) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.address.c_str(), &address.sin_addr) != 1) {
+        throw std::runtime_error("Bad mock backend address: " + config.address);
+    }
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Failed to create mock backend socket: " + std::string(strerror(errno)));
+    }
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd_, 128) < 0) {
+        std::string error = strerror(errno);
+        close(listen_fd_);
+        throw std::runtime_error("Failed to listen on " + config.address + ":" + std::to_string(config.port) +
+                                 ": " + error);
+    }
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+    thread_ = std::thread([this]() { run(); });
+}
+
+MockBackend::~MockBackend() {
+    stopping_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);  // Wakes accept()
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(listen_fd_);
+
+    // Streams in progress notice stopping_ between tokens
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return connections_ == 0; });
+}
+
+std::string MockBackend::url() const {
+    return "http://" + config_.address + ":" + std::to_string(port_) + "/v1/chat/completions";
+}
+
+MockBackendStats MockBackend::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::string MockBackend::formatStats() const {
+    MockBackendStats stats = this->stats();
+    json result = {{"requests", stats.requests}, {"completed", stats.completed}, {"streamed", stats.streamed},
+                   {"throttled", stats.throttled}, {"errors", stats.errors},
+                   {"disconnected", stats.disconnected}, {"tokens", stats.tokens},
+                   {"peak_in_flight", stats.peak_in_flight}};
+    return result.dump();
+}
+
+void MockBackend::run() {
+    while (!stopping_) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (!stopping_) {
+                LOG_WARNING << "Mock backend stopped accepting: " << strerror(errno);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_++;
+        }
+        std::thread([this, fd]() {
+            serve(fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--connections_ == 0) {
+                idle_.notify_all();
+            }
+        }).detach();
+    }
+}
+
+// One request per connection, as LLMClient and the pool's probes send them
+void MockBackend::serve(int fd) {
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    size_t header_end;
+    char chunk[8192];
+    while ((header_end = request.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0 || request.size() > 64 * 1024) {
+            return;
+        }
+        request.append(chunk, n);
+    }
+
+    size_t line_end = request.find("\r\n");
+    std::string request_line = request.substr(0, line_end);
+    size_t method_end = request_line.find(' ');
+    size_t target_end = request_line.find(' ', method_end + 1);
+    if (method_end == std::string::npos || target_end == std::string::npos) {
+        sendError(fd, 400, "Bad Request", "Malformed request line");
+        return;
+    }
+    std::string method = request_line.substr(0, method_end);
+    std::string target = request_line.substr(method_end + 1, target_end - method_end - 1);
+
+    size_t content_length = 0;
+    bool expect_continue = false;
+    size_t start = line_end + 2;
+    while (start < header_end) {
+        size_t end = request.find("\r\n", start);
+        std::string header = request.substr(start, end - start);
+        start = end + 2;
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = header.substr(0, colon);
+        size_t value_start = header.find_first_not_of(" \t", colon + 1);
+        std::string value = value_start == std::string::npos ? "" : header.substr(value_start);
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+            content_length = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (strcasecmp(name.c_str(), "Expect") == 0 && strcasecmp(value.c_str(), "100-continue") == 0) {
+            expect_continue = true;
+        }
+    }
+    if (expect_continue && !sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+        return;
+    }
+
+    std::string body = request.substr(header_end + 4);
+    while (body.size() < content_length) {
+        ssize_t n = recv(fd, chunk, std::min(sizeof(chunk), content_length - body.size()), 0);
+        if (n <= 0) {
+            return;
+        }
+        body.append(chunk, n);
+    }
+    respond(fd, method, target, body);
+}
+
+void MockBackend::respond(int fd, const std::string& method, const std::string& target, const std::string& body) {
+    std::string path = target.substr(0, target.find('?'));
+    if (method == "GET" && path == "/health") {
+        sendResponse(fd, 200, "OK", "text/plain", "ok\n");
+    } else if (method == "GET" && path == "/stats") {
+        sendResponse(fd, 200, "OK", "application/json", formatStats());
+    } else if (method == "POST" && path == "/v1/chat/completions") {
+        complete(fd, body);
+    } else {
+        sendError(fd, 404, "Not Found", "No route for " + method + " " + path);
+    }
+}
+
+double MockBackend::draw(const LatencyDistribution& distribution) {
+    std::lock_guard<std::mutex> lock(random_mutex_);
+    return distribution.sample(random_);
+}
+
+bool MockBackend::chance(double probability) {
+    if (probability <= 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(random_mutex_);
+    return std::uniform_real_distribution<double>(0, 1)(random_) < probability;
+}
+
+double MockBackend::tokenGapMs() {
+    if (config_.tokens_per_second <= 0) {
+        return 0;
+    }
+    double mean = 1000.0 / config_.tokens_per_second;
+    return draw({LatencyDistribution::Kind::Normal, mean, mean * config_.token_jitter});
+}
+
+static uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void appendFiller(uint64_t seed, size_t count, std::vector<std::string>& tokens) {
+    static const char* words[] = {"alpha", "bravo", "cache", "delta", "echo", "field", "graph", "index",
+                                  "kernel", "layer", "mount", "node", "offset", "page", "query", "record",
+                                  "stream", "token", "value", "write"};
+    uint64_t state = seed;
+    size_t line_length = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t r = splitmix64(state);
+        if (line_length >= 8 && r % 4 == 0) {
+            tokens.push_back("\n");
+            line_length = 0;
+            continue;
+        }
+        std::string word = words[r % (sizeof(words) / sizeof(words[0]))];
+        tokens.push_back(line_length == 0 ? word : " " + word);
+        line_length++;
+    }
+    tokens.push_back("\n");
+}
+
+std::vector<std::string> MockBackend::completionTokens(const std::string& prompt, size_t max_tokens) const {
+    // Deterministic filler: the same prompt always gives the same words
+    uint64_t seed = fnv1a(prompt);
+    std::vector<std::string> tokens;
+
+    // Batch prompts list their files after this line, one "- path" each
+    static const std::string BATCH_HEADER = "\nGenerate content for each of these files";
+    size_t batch = prompt.find(BATCH_HEADER);
+    if (batch == std::string::npos) {
+        appendFiller(seed, max_tokens ? std::min(max_tokens, config_.response_tokens) : config_.response_tokens,
+                     tokens);
+        return tokens;
+    }
+    std::vector<std::string> paths;
+    size_t line = prompt.find('\n', batch + 1);
+    while (line != std::string::npos && prompt.compare(line + 1, 2, "- ") == 0) {
+        size_t end = prompt.find('\n', line + 1);
+        paths.push_back(prompt.substr(line + 3, end - line - 3));
+        line = end;
+    }
+    // A batch's max_tokens covers all of its files
+    size_t per_file = config_.response_tokens;
+    if (max_tokens && !paths.empty()) {
+        per_file = std::min(per_file, std::max<size_t>(1, max_tokens / paths.size()));
+    }
+    for (const auto& path : paths) {
+        tokens.push_back(std::string(BatchDemultiplexer::FILE_MARKER) + path + BatchDemultiplexer::MARKER_END + "\n");
+        appendFiller(fnv1a(path, seed), per_file, tokens);
+        tokens.push_back(std::string(BatchDemultiplexer::END_MARKER) + "\n");
+    }
+    return tokens;
+}
+
+// Sleeps until deadline unless the server stops first
+static bool waitUntil(std::chrono::steady_clock::time_point deadline, const std::atomic<bool>& stopping) {
+    while (!stopping) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now,
+                                                                                   std::chrono::milliseconds(50)));
+    }
+    return false;
+}
+
+void MockBackend::complete(int fd, const std::string& body) {
+    json request = json::parse(body, nullptr, false);
+    if (request.is_discarded() || !request.is_object() || !request.contains("messages")) {
+        sendError(fd, 400, "Bad Request", "Expected a chat completion request");
+        return;
+    }
+    std::string retry_after = "Retry-After: " + std::to_string(config_.retry_after_seconds) + "\r\n";
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.requests++;
+        if (config_.max_concurrency && in_flight_ >= config_.max_concurrency) {
+            stats_.throttled++;
+            sendError(fd, 429, "Too Many Requests", "Too many concurrent requests", retry_after);
+            return;
+        }
+        in_flight_++;
+        stats_.peak_in_flight = std::max<uint64_t>(stats_.peak_in_flight, in_flight_);
+    }
+    struct InFlight {
+        MockBackend& backend;
+        ~InFlight() {
+            std::lock_guard<std::mutex> lock(backend.mutex_);
+            backend.in_flight_--;
+        }
+    } in_flight{*this};
+
+    if (chance(config_.throttle_rate)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.throttled++;
+        sendError(fd, 429, "Too Many Requests", "Rate limit reached (injected)", retry_after);
+        return;
+    }
+    if (chance(config_.error_rate)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.errors++;
+        sendError(fd, 500, "Internal Server Error", "Server error (injected)");
+        return;
+    }
+
+    std::string prompt;
+    for (const auto& message : request["messages"]) {
+        if (message.is_object() && message.value("role", "") == "user" && message.contains("content") &&
+            message["content"].is_string()) {
+            prompt = message["content"].get<std::string>();
+        }
+    }
+    size_t max_tokens = request.value("max_tokens", 0);
+    std::string model = request.value("model", "mock");
+    bool stream = request.value("stream", false);
+    std::vector<std::string> tokens = completionTokens(prompt, max_tokens);
+    size_t cut_at = chance(config_.disconnect_rate) ? tokens.size() / 2 : tokens.size();
+
+    auto next = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(
+                                                       draw(config_.ttft) * 1000));
+    if (!stream) {
+        std::string content;
+        for (const auto& token : tokens) {
+            content += token;
+            next += std::chrono::microseconds(static_cast<int64_t>(tokenGapMs() * 1000));
+        }
+        if (!waitUntil(next, stopping_)) {
+            return;
+        }
+        json response = {{"id", "chatcmpl-mock"}, {"object", "chat.completion"}, {"model", model},
+                         {"choices", {{{"index", 0},
+                                       {"message", {{"role", "assistant"}, {"content", content}}},
+                                       {"finish_reason", "stop"}}}},
+                         {"usage", {{"completion_tokens", tokens.size()}}}};
+        sendResponse(fd, 200, "OK", "application/json", response.dump());
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.completed++;
+        stats_.tokens += tokens.size();
+        return;
+    }
+
+    if (!waitUntil(next, stopping_) ||
+        !sendAll(fd, "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/event-stream\r\n"
+                     "Cache-Control: no-cache\r\n"
+                     "Connection: close\r\n\r\n")) {
+        return;
+    }
+    auto event = [&model](const json& delta, const char* finish_reason) {
+        json chunk = {{"id", "chatcmpl-mock"}, {"object", "chat.completion.chunk"}, {"model", model},
+                      {"choices", {{{"index", 0}, {"delta", delta},
+                                    {"finish_reason", finish_reason ? json(finish_reason) : json(nullptr)}}}}};
+        return "data: " + chunk.dump() + "\n\n";
+    };
+    if (!sendAll(fd, event({{"role", "assistant"}}, nullptr))) {
+        return;
+    }
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (i == cut_at) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.disconnected++;
+            stats_.tokens += i;
+            return;
+        }
+        if (i > 0) {
+            next += std::chrono::microseconds(static_cast<int64_t>(tokenGapMs() * 1000));
+        }
+        if (!waitUntil(next, stopping_) || !sendAll(fd, event({{"content", tokens[i]}}, nullptr))) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.tokens += i;
+            return;
+        }
+    }
+    if (sendAll(fd, event(json::object(), "stop") + "data: [DONE]\n\n")) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.completed++;
+        stats_.streamed++;
+        stats_.tokens += tokens.size();
+    }
+}
@@ -0,0 +1,94 @@
+#include "model_router.h"
+#include "local_generator.h"
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+static std::string extensionOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) {
+        return "";
+    }
+    std::string extension = name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+SizeClass ModelRouter::classify(uint64_t bytes) {
+    if (bytes < SMALL_BYTES) {
+        return SizeClass::Small;
+    }
+    return bytes < LARGE_BYTES ? SizeClass::Medium : SizeClass::Large;
+}
+
+std::optional<SizeClass> ModelRouter::parseSizeClass(const std::string& name) {
+    if (name == "small") {
+        return SizeClass::Small;
+    } else if (name == "medium") {
+        return SizeClass::Medium;
+    } else if (name == "large") {
+        return SizeClass::Large;
+    }
+    return std::nullopt;
+}
+
+const char* ModelRouter::sizeClassName(SizeClass size) {
+    switch (size) {
+        case SizeClass::Small:
+            return "small";
+        case SizeClass::Medium:
+            return "medium";
+        case SizeClass::Large:
+            return "large";
+    }
+    return "medium";
+}
+
+SizeClass ModelRouter::expectedSize(const std::string& path, const std::map<std::string, uint64_t>& sibling_sizes) {
+    std::string extension = extensionOf(path);
+
+    std::vector<uint64_t> sizes;
+    for (const auto& sibling : sibling_sizes) {
+        if (sibling.first != path && extensionOf(sibling.first) == extension) {
+            sizes.push_back(sibling.second);
+        }
+    }
+    if (!sizes.empty()) {
+        std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+        return classify(sizes[sizes.size() / 2]);
+    }
+
+    static const std::unordered_set<std::string> small = {
+        ".json", ".toml", ".yaml", ".yml", ".ini", ".cfg", ".conf", ".env", ".properties",
+        ".gitignore", ".gitattributes", ".dockerignore", ".editorconfig", ".npmrc", ".nvmrc",
+    };
+    static const std::unordered_set<std::string> large = {
+        ".html", ".csv", ".tsv", ".svg", ".sql", ".ipynb", ".lock",
+    };
+    if (small.count(extension)) {
+        return SizeClass::Small;
+    }
+    return large.count(extension) ? SizeClass::Large : SizeClass::Medium;
+}
+
+ModelChoice ModelRouter::route(const std::string& path, SizeClass size, const std::vector<ModelRoute>& routes,
+                               const ModelChoice& defaults) {
+    for (const auto& route : routes) {
+        if (!route.pattern.empty() && !GeneratorRegistry::matches(route.pattern, path)) {
+            continue;
+        }
+        if (route.size && *route.size != size) {
+            continue;
+        }
+        ModelChoice choice = defaults;
+        choice.model = route.model.value_or(defaults.model);
+        choice.max_tokens = route.max_tokens.value_or(defaults.max_tokens);
+        choice.temperature = route.temperature.value_or(defaults.temperature);
+        choice.draft_model = route.draft_model.value_or(defaults.draft_model);
+        return choice;
+    }
+    return defaults;
+}
@@ -0,0 +1,236 @@
+#include "mount_config.h"
+#include "logger.h"
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <toml++/toml.hpp>
+
+static GenerationClass parseGenerationClass(const std::string& action) {
+    if (action == "deny") {
+        return GenerationClass::Denied;
+    }
+    if (action == "background") {
+        return GenerationClass::Background;
+    }
+    if (action == "foreground") {
+        return GenerationClass::Foreground;
+    }
+    throw std::runtime_error("Unknown policy action: " + action);
+}
+
+// Integer settings all go into unsigned fields: values those can't hold
+// are rejected rather than wrapped around
+template <typename T>
+static void readUnsigned(const toml::table& table, const std::string& section, const std::string& key, T& field) {
+    int64_t value = table[key].value_or(static_cast<int64_t>(field));
+    if (value < 0 || static_cast<uint64_t>(value) > std::numeric_limits<T>::max()) {
+        throw std::runtime_error(section + "." + key + " must be between 0 and " +
+                                 std::to_string(std::numeric_limits<T>::max()));
+    }
+    field = static_cast<T>(value);
+}
+
+static void parsePolicy(const toml::table& table, PolicyConfig& policy) {
+    policy.use_default_rules = table["use_default_rules"].value_or(policy.use_default_rules);
+    readUnsigned(table, "policy", "max_concurrent_generations", policy.max_concurrent_generations);
+    readUnsigned(table, "policy", "background_max_concurrent", policy.background_max_concurrent);
+    readUnsigned(table, "policy", "default_max_concurrent", policy.default_max_concurrent);
+    readUnsigned(table, "policy", "default_tokens_per_window", policy.default_tokens_per_window);
+    readUnsigned(table, "policy", "quota_window_seconds", policy.quota_window_seconds);
+
+    if (auto rules = table["rules"].as_array()) {
+        for (auto& node : *rules) {
+            auto rule_table = node.as_table();
+            if (!rule_table) {
+                throw std::runtime_error("policy.rules entries must be tables");
+            }
+            PolicyRule rule;
+            rule.process = (*rule_table)["process"].value_or(std::string());
+            if (auto uid = (*rule_table)["uid"].value<int64_t>()) {
+                if (*uid < 0) {
+                    throw std::runtime_error("policy.rules.uid must not be negative");
+                }
+                rule.uid = static_cast<uid_t>(*uid);
+            }
+            if (auto pid = (*rule_table)["pid"].value<int64_t>()) {
+                if (*pid < 0) {
+                    throw std::runtime_error("policy.rules.pid must not be negative");
+                }
+                rule.pid = static_cast<pid_t>(*pid);
+            }
+            rule.action = parseGenerationClass((*rule_table)["action"].value_or(std::string("background")));
+            policy.rules.push_back(rule);
+        }
+    }
+
+    if (auto quotas = table["quotas"].as_array()) {
+        for (auto& node : *quotas) {
+            auto quota_table = node.as_table();
+            if (!quota_table || !(*quota_table)["uid"].value<int64_t>()) {
+                throw std::runtime_error("policy.quotas entries must be tables with a uid");
+            }
+            UidQuota quota;
+            int64_t uid = *(*quota_table)["uid"].value<int64_t>();
+            if (uid < 0) {
+                throw std::runtime_error("policy.quotas.uid must not be negative");
+            }
+            quota.uid = static_cast<uid_t>(uid);
+            readUnsigned(*quota_table, "policy.quotas", "max_concurrent", quota.max_concurrent);
+            readUnsigned(*quota_table, "policy.quotas", "tokens_per_window", quota.tokens_per_window);
+            policy.quotas.push_back(quota);
+        }
+    }
+}
+
+static void parsePrefetch(const toml::table& table, PrefetchConfig& prefetch) {
+    prefetch.enabled = table["enabled"].value_or(prefetch.enabled);
+    readUnsigned(table, "prefetch", "token_budget", prefetch.token_budget);
+    readUnsigned(table, "prefetch", "budget_window_seconds", prefetch.budget_window_seconds);
+    readUnsigned(table, "prefetch", "max_predictions", prefetch.max_predictions);
+    prefetch.min_probability = table["min_probability"].value_or(prefetch.min_probability);
+    prefetch.follow_references = table["follow_references"].value_or(prefetch.follow_references);
+}
+
+static void parseBackend(const toml::table& table, const std::string& section, BackendConfig& backend) {
+    backend.url = table["url"].value_or(backend.url);
+    readUnsigned(table, section, "weight", backend.weight);
+    readUnsigned(table, section, "max_concurrent", backend.max_concurrent);
+    backend.requests_per_second = table["requests_per_second"].value_or(backend.requests_per_second);
+    readUnsigned(table, section, "burst", backend.burst);
+    backend.health_url = table["health_url"].value_or(backend.health_url);
+    if (auto models = table["models"].as_array()) {
+        for (auto& node : *models) {
+            auto model = node.value<std::string>();
+            if (!model) {
+                throw std::runtime_error("backends.models entries must be strings");
+            }
+            backend.models.push_back(*model);
+        }
+    }
+    backend.cache_prompt = table["cache_prompt"].value_or(backend.cache_prompt);
+    readUnsigned(table, section, "slots", backend.slots);
+    backend.slot_field = table["slot_field"].value_or(backend.slot_field);
+}
+
+static void parsePool(const toml::table& table, PoolConfig& pool) {
+    readUnsigned(table, "pool", "failure_threshold", pool.failure_threshold);
+    readUnsigned(table, "pool", "open_seconds", pool.open_seconds);
+    readUnsigned(table, "pool", "health_check_seconds", pool.health_check_seconds);
+    pool.adaptive_concurrency = table["adaptive_concurrency"].value_or(pool.adaptive_concurrency);
+    readUnsigned(table, "pool", "initial_concurrency", pool.initial_concurrency);
+    readUnsigned(table, "pool", "max_adaptive_concurrency", pool.max_adaptive_concurrency);
+    readUnsigned(table, "pool", "latency_target_ms", pool.latency_target_ms);
+    readUnsigned(table, "pool", "max_retries", pool.max_retries);
+    readUnsigned(table, "pool", "retry_base_ms", pool.retry_base_ms);
+    readUnsigned(table, "pool", "retry_max_ms", pool.retry_max_ms);
+}
+
+static void parseHedging(const toml::table& table, HedgeConfig& hedging) {
+    hedging.enabled = table["enabled"].value_or(hedging.enabled);
+    hedging.percentile = table["percentile"].value_or(hedging.percentile);
+    readUnsigned(table, "hedging", "min_delay_ms", hedging.min_delay_ms);
+    readUnsigned(table, "hedging", "min_samples", hedging.min_samples);
+    hedging.max_fraction = table["max_fraction"].value_or(hedging.max_fraction);
+    if (hedging.percentile <= 0.0 || hedging.percentile > 1.0) {
+        throw std::runtime_error("hedging.percentile must be in (0, 1]");
+    }
+}
+
+static void parseTracing(const toml::table& table, TracingConfig& tracing) {
+    tracing.enabled = table["enabled"].value_or(tracing.enabled);
+    readUnsigned(table, "tracing", "buffer_events", tracing.buffer_events);
+    tracing.dump_path = table["dump_path"].value_or(tracing.dump_path);
+    tracing.access_trace = table["access_trace"].value_or(tracing.access_trace);
+    if (tracing.buffer_events == 0) {
+        throw std::runtime_error("tracing.buffer_events must be positive");
+    }
+}
+
+static void parseLogging(const toml::table& table, LoggingConfig& logging) {
+    logging.level = table["level"].value_or(logging.level);
+    readUnsigned(table, "logging", "rate_limit", logging.rate_limit);
+    if (!Logger::parseLevel(logging.level)) {
+        throw std::runtime_error("Unknown logging.level: " + logging.level);
+    }
+}
+
+static void parseCapacity(const toml::table& table, CapacityConfig& capacity) {
+    capacity.enabled = table["enabled"].value_or(capacity.enabled);
+    readUnsigned(table, "capacity", "budget_bytes", capacity.budget_bytes);
+    capacity.low_watermark = table["low_watermark"].value_or(capacity.low_watermark);
+    readUnsigned(table, "capacity", "frequency_half_life_seconds", capacity.frequency_half_life_seconds);
+    capacity.pin_seeds = table["pin_seeds"].value_or(capacity.pin_seeds);
+
+    if (capacity.enabled && capacity.budget_bytes == 0) {
+        throw std::runtime_error("capacity.budget_bytes must be set when capacity is enabled");
+    }
+    if (capacity.low_watermark <= 0.0 || capacity.low_watermark > 1.0) {
+        throw std::runtime_error("capacity.low_watermark must be in (0, 1]");
+    }
+}
+
+MountConfig MountConfig::parse(const std::string& toml_text) {
+    MountConfig config;
+
+    toml::table table;
+    try {
+        table = toml::parse(toml_text);
+    } catch (const toml::parse_error& e) {
+        throw std::runtime_error("Failed to parse mount config: " + std::string(e.what()));
+    }
+
+    if (auto policy = table["policy"].as_table()) {
+        parsePolicy(*policy, config.policy);
+    }
+    if (auto prefetch = table["prefetch"].as_table()) {
+        parsePrefetch(*prefetch, config.prefetch);
+    }
+    if (auto capacity = table["capacity"].as_table()) {
+        parseCapacity(*capacity, config.capacity);
+    }
+    if (auto backend = table["backend"].as_table()) {
+        parseBackend(*backend, "backend", config.backend);
+    }
+    if (auto backends = table["backends"].as_array()) {
+        for (auto& node : *backends) {
+            auto backend_table = node.as_table();
+            if (!backend_table || !(*backend_table)["url"].value<std::string>()) {
+                throw std::runtime_error("backends entries must be tables with a url");
+            }
+            BackendConfig backend;
+            parseBackend(*backend_table, "backends", backend);
+            if (backend.weight == 0) {
+                throw std::runtime_error("backends.weight must be positive");
+            }
+            config.backends.push_back(backend);
+        }
+    }
+    if (auto pool = table["pool"].as_table()) {
+        parsePool(*pool, config.pool);
+    }
+    if (auto hedging = table["hedging"].as_table()) {
+        parseHedging(*hedging, config.hedging);
+    }
+    if (auto metrics = table["metrics"].as_table()) {
+        config.metrics.prometheus_socket = (*metrics)["prometheus_socket"].value_or(std::string());
+    }
+    if (auto tracing = table["tracing"].as_table()) {
+        parseTracing(*tracing, config.tracing);
+    }
+    if (auto logging = table["logging"].as_table()) {
+        parseLogging(*logging, config.logging);
+    }
+
+    return config;
+}
+
+MountConfig MountConfig::loadFromFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open mount config: " + path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return parse(contents.str());
+}
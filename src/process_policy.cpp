@@ -0,0 +1,206 @@
+#ifndef FUSE_USE_VERSION
+#define FUSE_USE_VERSION 31
+#endif
+
+#include "process_policy.h"
+#include <fuse3/fuse.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+ProcessPolicy::ProcessPolicy(const PolicyConfig& config)
+    : config_(config), rules_(config.rules) {
+    if (config_.use_default_rules) {
+        auto defaults = defaultRules();
+        rules_.insert(rules_.end(), defaults.begin(), defaults.end());
+    }
+}
+
+std::vector<PolicyRule> ProcessPolicy::defaultRules() {
+    // Note: /proc/<pid>/comm is truncated to 15 characters, hence the globs
+    static const char* denied[] = {
+        "updatedb*",         // mlocate / plocate indexers
+        "plocate*",
+        "tracker-miner-f*",  // GNOME tracker
+        "tracker-extract*",
+        "localsearch*",
+        "baloo_file*",       // KDE baloo
+        "clamd",             // Antivirus scanners
+        "clamscan",
+        "clamdscan",
+        "freshclam",
+    };
+    static const char* background[] = {
+        "rsync",             // Backup agents
+        "restic",
+        "borg",
+        "duplicity",
+        "deja-dup*",
+        "rclone",
+    };
+
+    std::vector<PolicyRule> rules;
+    for (const char* process : denied) {
+        PolicyRule rule;
+        rule.process = process;
+        rule.action = GenerationClass::Denied;
+        rules.push_back(rule);
+    }
+    for (const char* process : background) {
+        PolicyRule rule;
+        rule.process = process;
+        rule.action = GenerationClass::Background;
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+CallerInfo ProcessPolicy::currentCaller() {
+    CallerInfo caller = currentCallerIds();
+    resolveComm(caller);
+    return caller;
+}
+
+CallerInfo ProcessPolicy::currentCallerIds() {
+    CallerInfo caller;
+
+    struct fuse_context* context = fuse_get_context();
+    if (context && context->pid > 0) {
+        caller.pid = context->pid;
+        caller.uid = context->uid;
+        caller.gid = context->gid;
+    } else {
+        caller.pid = getpid();
+        caller.uid = getuid();
+        caller.gid = getgid();
+    }
+    return caller;
+}
+
+void ProcessPolicy::resolveComm(CallerInfo& caller) {
+    std::ifstream comm_file("/proc/" + std::to_string(caller.pid) + "/comm");
+    if (comm_file) {
+        std::getline(comm_file, caller.comm);
+    }
+}
+
+GenerationClass ProcessPolicy::classify(const CallerInfo& caller) const {
+    for (const auto& rule : rules_) {
+        if (rule.uid && *rule.uid != caller.uid) {
+            continue;
+        }
+        if (rule.pid && *rule.pid != caller.pid) {
+            continue;
+        }
+        if (!rule.process.empty() &&
+            fnmatch(rule.process.c_str(), caller.comm.c_str(), 0) != 0) {
+            continue;
+        }
+        return rule.action;
+    }
+    return GenerationClass::Foreground;
+}
+
+UidQuota ProcessPolicy::quotaFor(uid_t uid) const {
+    for (const auto& quota : config_.quotas) {
+        if (quota.uid == uid) {
+            return quota;
+        }
+    }
+    UidQuota quota;
+    quota.uid = uid;
+    quota.max_concurrent = config_.default_max_concurrent;
+    quota.tokens_per_window = config_.default_tokens_per_window;
+    return quota;
+}
+
+ProcessPolicy::UidState& ProcessPolicy::stateFor(uid_t uid) {
+    auto now = std::chrono::steady_clock::now();
+    auto it = uid_state_.find(uid);
+    if (it == uid_state_.end()) {
+        it = uid_state_.emplace(uid, UidState()).first;
+        it->second.window_start = now;
+    }
+
+    // Start a new quota window once the current one has elapsed
+    if (now - it->second.window_start >= std::chrono::seconds(config_.quota_window_seconds)) {
+        it->second.window_start = now;
+        it->second.tokens_used = 0;
+    }
+    return it->second;
+}
+
+bool ProcessPolicy::hasTokenBudget(uid_t uid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    UidQuota quota = quotaFor(uid);
+    if (quota.tokens_per_window == 0) {
+        return true;
+    }
+    return stateFor(uid).tokens_used < quota.tokens_per_window;
+}
+
+bool ProcessPolicy::uidHasSlot(uid_t uid) {
+    UidQuota quota = quotaFor(uid);
+    return quota.max_concurrent == 0 || stateFor(uid).active < quota.max_concurrent;
+}
+
+bool ProcessPolicy::hasCapacity() const {
+    return config_.max_concurrent_generations == 0 ||
+           active_total_ < config_.max_concurrent_generations;
+}
+
+void ProcessPolicy::admit(uid_t uid, GenerationClass generation_class) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (generation_class == GenerationClass::Foreground) {
+        // Only count as waiting while blocked on shared capacity, so a uid
+        // stuck on its own quota does not hold back background work
+        bool counted = false;
+        while (!(uidHasSlot(uid) && hasCapacity())) {
+            bool waiting_for_capacity = uidHasSlot(uid);
+            if (waiting_for_capacity && !counted) {
+                waiting_foreground_++;
+                counted = true;
+            } else if (!waiting_for_capacity && counted) {
+                waiting_foreground_--;
+                counted = false;
+                cv_.notify_all();
+            }
+            cv_.wait(lock);
+        }
+        if (counted) {
+            waiting_foreground_--;
+            cv_.notify_all();
+        }
+    } else {
+        cv_.wait(lock, [this, uid]() {
+            return waiting_foreground_ == 0 && hasCapacity() &&
+                   active_background_ < config_.background_max_concurrent &&
+                   uidHasSlot(uid);
+        });
+        active_background_++;
+    }
+
+    active_total_++;
+    stateFor(uid).active++;
+}
+
+void ProcessPolicy::release(uid_t uid, GenerationClass generation_class, size_t generated_tokens) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        UidState& state = stateFor(uid);
+        if (state.active > 0) {
+            state.active--;
+        }
+        state.tokens_used += generated_tokens;
+
+        if (active_total_ > 0) {
+            active_total_--;
+        }
+        if (generation_class != GenerationClass::Foreground && active_background_ > 0) {
+            active_background_--;
+        }
+    }
+    cv_.notify_all();
+}
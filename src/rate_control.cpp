@@ -0,0 +1,57 @@
+#include "rate_control.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate), burst_(std::max(1.0, burst)), tokens_(std::max(1.0, burst)) {
+}
+
+double TokenBucket::available(Clock::time_point now) const {
+    if (last_ == Clock::time_point() || now <= last_) {
+        return tokens_;
+    }
+    double elapsed = std::chrono::duration<double>(now - last_).count();
+    return std::min(burst_, tokens_ + elapsed * rate_);
+}
+
+bool TokenBucket::take(Clock::time_point now) {
+    if (rate_ <= 0) {
+        return true;
+    }
+    tokens_ = available(now);
+    last_ = std::max(last_, now);
+    if (tokens_ < 1.0) {
+        return false;
+    }
+    tokens_ -= 1.0;
+    return true;
+}
+
+TokenBucket::Clock::time_point TokenBucket::nextAvailable(Clock::time_point now) const {
+    double tokens = available(now);
+    if (rate_ <= 0 || tokens >= 1.0) {
+        return now;
+    }
+    return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1.0 - tokens) / rate_));
+}
+
+AimdLimit::AimdLimit(size_t initial, size_t max, double factor, std::chrono::milliseconds cooldown)
+    : limit_(static_cast<double>(std::max<size_t>(1, std::min(initial, max)))),
+      max_(static_cast<double>(std::max<size_t>(1, max))),
+      factor_(factor),
+      cooldown_(cooldown) {
+}
+
+void AimdLimit::onSuccess() {
+    limit_ = std::min(max_, limit_ + 1.0 / limit_);
+}
+
+void AimdLimit::onOverload(Clock::time_point now) {
+    // Requests already in flight when the limit was cut report overload
+    // too; one cut per cooldown answers them all
+    if (decreased_ && now - last_decrease_ < cooldown_) {
+        return;
+    }
+    limit_ = std::max(1.0, limit_ * factor_);
+    last_decrease_ = now;
+    decreased_ = true;
+}
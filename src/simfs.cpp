@@ -1,51 +1,228 @@
 #include "simfs.h"
+#include "logger.h"
 #include "db_manager.h"
 #include "llm_client.h"
+#include "process_policy.h"
+#include "access_predictor.h"
+#include "capacity_manager.h"
+#include "content_store.h"
+#include "generation_batcher.h"
+#include "metrics.h"
+#include "tracer.h"
 #include <cstring>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <poll.h>
 #include <sstream>
 #include <algorithm>
 #include <chrono>
 #include <deque>
-#include <iostream>
 #include <fstream>
 #include <toml++/toml.hpp>
 #include <unordered_set>
 
 SimFS* SimFS::instance_ = nullptr;
 
+// The path of a FUSE operation, for its trace span
+template <typename First, typename... Rest>
+static std::string_view tracedPath(First first, Rest...) {
+    if constexpr (std::is_same<First, const char*>::value) {
+        return first;
+    } else {
+        return {};
+    }
+}
+
+// The arguments of a FUSE operation worth replaying, picked by type
+static void collectAccess(AccessRecord& record, struct fuse_file_info* fi) {
+    if (fi) {
+        record.fh = fi->fh;
+        record.flags = fi->flags;
+    }
+}
+static void collectAccess(AccessRecord& record, size_t size) { record.size = size; }
+static void collectAccess(AccessRecord& record, off_t offset) { record.offset = offset; }
+template <typename T>
+static void collectAccess(AccessRecord&, T) {}
+
+// Counts calls, errors and latency of a FUSE operation, and records it
+// when an access trace is on
+template <FuseOp op, auto handler>
+struct Timed;
+
+template <FuseOp op, typename Result, typename... Args, Result (*handler)(Args...)>
+struct Timed<op, handler> {
+    static Result call(Args... args) {
+        Metrics::Op& metrics = Metrics::global().op(op);
+        LatencyTimer timer(metrics.latency_us);
+        TraceSpan span(Metrics::opName(op), "fuse", tracedPath(args...));
+        AccessRecorder* recorder = AccessRecorder::active();
+        Tracer::Clock::time_point start = recorder ? Tracer::Clock::now() : Tracer::Clock::time_point();
+        Result result = handler(args...);
+        if (recorder) {
+            AccessRecord record;
+            record.op = Metrics::opName(op);
+            record.result = result;
+            record.path = tracedPath(args...);
+            (collectAccess(record, args), ...);  // After the handler, which sets fh on open
+            recorder->record(start, std::move(record));
+        }
+        metrics.calls.add();
+        if (result < 0) {
+            metrics.errors.add();
+        }
+        LOG_DEBUG.field("op", Metrics::opName(op)).field("path", tracedPath(args...))
+                 .field("result", result).field("latency_us", timer.elapsedMicroseconds());
+        return result;
+    }
+};
+
 struct fuse_operations SimFS::operations_ = {
-    .getattr = SimFS::getattr,
-    .mkdir = SimFS::mkdir,
-    .unlink = SimFS::unlink,
-    .rmdir = SimFS::rmdir,
-    .open = SimFS::open,
-    .read = SimFS::read,
-    .write = SimFS::write,
-    .readdir = SimFS::readdir,
-    .create = SimFS::create,
+    .getattr = Timed<FuseOp::Getattr, SimFS::getattr>::call,
+    .mkdir = Timed<FuseOp::Mkdir, SimFS::mkdir>::call,
+    .unlink = Timed<FuseOp::Unlink, SimFS::unlink>::call,
+    .rmdir = Timed<FuseOp::Rmdir, SimFS::rmdir>::call,
+    .open = Timed<FuseOp::Open, SimFS::open>::call,
+    .read = Timed<FuseOp::Read, SimFS::read>::call,
+    .write = Timed<FuseOp::Write, SimFS::write>::call,
+    .release = Timed<FuseOp::Release, SimFS::release>::call,
+    .setxattr = Timed<FuseOp::Setxattr, SimFS::setxattr>::call,
+    .getxattr = Timed<FuseOp::Getxattr, SimFS::getxattr>::call,
+    .readdir = Timed<FuseOp::Readdir, SimFS::readdir>::call,
+    .create = Timed<FuseOp::Create, SimFS::create>::call,
+    .poll = Timed<FuseOp::Poll, SimFS::poll>::call,
+    .copy_file_range = Timed<FuseOp::CopyFileRange, SimFS::copy_file_range>::call,
 };
 
+// Read-only view of Metrics::global, never stored or generated
+static const std::string STATS_DIR = "/.simfs";
+static const std::string STATS_FILE = "/.simfs/stats";
+static const std::string TRACE_FILE = "/.simfs/trace";
+
+static bool isStatsPath(const std::string& path) {
+    return path == STATS_DIR || path.compare(0, STATS_DIR.size() + 1, STATS_DIR + "/") == 0;
+}
+
+// Upper bound for batch_window_ms in .simfs_config.toml
+static const int64_t MAX_BATCH_WINDOW_MS = 2000;
+
 static std::deque<std::string> recent_access_queue;
 static std::mutex recent_access_mutex;
 static const size_t MAX_RECENT_FILES = 10;
 
-SimFS::SimFS(const std::string& db_path, const std::string& llm_endpoint) 
-    : db_(std::make_unique<DBManager>(db_path)),
-      llm_client_(std::make_unique<LLMClient>(llm_endpoint)) {
+static void recordRecentAccess(const std::string& path) {
+    std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
+    recent_access_queue.push_back(path);
+    if (recent_access_queue.size() > MAX_RECENT_FILES) {
+        recent_access_queue.pop_front();
+    }
+}
+
+// Each generated version of a file has its own pinned seed; the first is
+// the one derived from the path
+static uint64_t versionSeed(const std::string& path, uint64_t version) {
+    return FileMetadata::pinnedSeed(version > 1 ? path + "#" + std::to_string(version) : path, "");
 }
 
-SimFS::~SimFS() = default;
+// [[backends]] when given, otherwise the --llm-endpoint server with the
+// [backend] settings
+static std::vector<BackendConfig> mountBackends(const std::string& llm_endpoint, const MountConfig& mount_config) {
+    if (!mount_config.backends.empty()) {
+        return mount_config.backends;
+    }
+    BackendConfig backend = mount_config.backend;
+    backend.url = llm_endpoint;
+    return {backend};
+}
+
+SimFS::SimFS(const std::string& db_path, const std::string& llm_endpoint,
+             const MountConfig& mount_config, const std::string& base_db_path) 
+    : db_(std::make_unique<DBManager>(db_path, base_db_path)),
+      llm_client_(std::make_unique<LLMClient>(mountBackends(llm_endpoint, mount_config), mount_config.pool,
+                                              mount_config.hedging)),
+      policy_(std::make_unique<ProcessPolicy>(mount_config.policy)),
+      prefetch_config_(mount_config.prefetch) {
+    Logger::setLevel(Logger::parseLevel(mount_config.logging.level).value_or(LogLevel::Info));
+    Logger::setRateLimit(mount_config.logging.rate_limit);
+    predictor_ = std::make_unique<AccessPredictor>(*db_, prefetch_config_);
+    content_ = std::make_unique<ContentStore>(*db_);
+    
+    // Databases written before previews or the context index existed get
+    // them once
+    if (!db_->exists("state:previews") || !db_->exists("state:index")) {
+        size_t files = content_->rebuildPreviews();
+        db_->put("state:previews", "1");
+        LOG_INFO << "Built previews and index for " << files << " files";
+    }
+    capacity_ = std::make_unique<CapacityManager>(*db_, *content_, mount_config.capacity);
+    generators_ = std::make_unique<GeneratorRegistry>();
+    batcher_ = std::make_unique<GenerationBatcher>();
+    
+    if (!mount_config.metrics.prometheus_socket.empty()) {
+        try {
+            metrics_server_ = std::make_unique<MetricsServer>(mount_config.metrics.prometheus_socket);
+            LOG_INFO << "Serving metrics on " << mount_config.metrics.prometheus_socket;
+        } catch (const std::exception& e) {
+            LOG_WARNING << e.what() << "; metrics are only in " << STATS_FILE;
+        }
+    }
+    
+    Tracer::global().setBufferEvents(mount_config.tracing.buffer_events);
+    Tracer::setEnabled(mount_config.tracing.enabled);
+    if (!mount_config.tracing.dump_path.empty()) {
+        try {
+            trace_dumper_ = std::make_unique<TraceDumper>(mount_config.tracing.dump_path);
+        } catch (const std::exception& e) {
+            LOG_WARNING << e.what() << "; traces are only in " << TRACE_FILE;
+        }
+    }
+    if (!mount_config.tracing.access_trace.empty()) {
+        try {
+            access_recorder_ = std::make_unique<AccessRecorder>(mount_config.tracing.access_trace);
+            LOG_INFO << "Recording accesses to " << mount_config.tracing.access_trace;
+        } catch (const std::exception& e) {
+            LOG_WARNING << e.what() << "; accesses are not recorded";
+        }
+    }
+    if (prefetch_config_.enabled) {
+        prefetch_worker_ = std::thread([this]() { runPrefetchWorker(); });
+    }
+    if (capacity_->enabled()) {
+        eviction_worker_ = std::thread([this]() { runEvictionWorker(); });
+    }
+}
+
+SimFS::~SimFS() {
+    if (prefetch_worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(prefetch_mutex_);
+            prefetch_stopping_ = true;
+        }
+        prefetch_cv_.notify_all();
+        prefetch_worker_.join();
+    }
+    if (eviction_worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(eviction_mutex_);
+            eviction_stopping_ = true;
+        }
+        eviction_cv_.notify_all();
+        eviction_worker_.join();
+    }
+    // Generations still in flight commit through the members below and
+    // release their admission with policy_, so they finish before any of
+    // them is destroyed: pending batches go out, then the client waits for
+    // its workers
+    batcher_.reset();
+    llm_client_.reset();
+}
 
 struct fuse_operations* SimFS::getOperations() {
     return &operations_;
 }
 
 int SimFS::getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
-    (void) fi;
-    
     memset(stbuf, 0, sizeof(struct stat));
     
     if (strcmp(path, "/") == 0) {
@@ -54,6 +231,27 @@ int SimFS::getattr(const char *path, struct stat *stbuf, struct fuse_file_info *
         return 0;
     }
     
+    if (isStatsPath(path)) {
+        if (path == STATS_DIR) {
+            stbuf->st_mode = S_IFDIR | 0555;
+            stbuf->st_nlink = 2;
+        } else if (path == STATS_FILE) {
+            stbuf->st_mode = S_IFREG | 0444;
+            stbuf->st_nlink = 1;
+            stbuf->st_size = Metrics::global().formatText().size();
+        } else if (path == TRACE_FILE) {
+            // Exported at open; like files still to be generated, its size is unknown
+            stbuf->st_mode = S_IFREG | 0444;
+            stbuf->st_nlink = 1;
+        } else {
+            return -ENOENT;
+        }
+        stbuf->st_uid = getuid();
+        stbuf->st_gid = getgid();
+        stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+        return 0;
+    }
+    
     SimFS* self = getInstance();
     std::lock_guard<std::mutex> lock(self->mutex_);
     
@@ -65,10 +263,9 @@ int SimFS::getattr(const char *path, struct stat *stbuf, struct fuse_file_info *
         size_t size = 0;
         
         if (!is_dir) {
-            std::string content_key = std::string("content:") + path;
-            std::string content;
-            if (self->db_->get(content_key, content)) {
-                size = content.length();
+            uint64_t content_size;
+            if (self->content_->size(path, content_size, self->openFileSnapshot(fi))) {
+                size = content_size;
             }
         }
         
@@ -118,6 +315,15 @@ int SimFS::readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     filler(buf, ".", NULL, 0, static_cast<fuse_fill_dir_flags>(0));
     filler(buf, "..", NULL, 0, static_cast<fuse_fill_dir_flags>(0));
     
+    if (isStatsPath(path)) {
+        if (path != STATS_DIR) {
+            return -ENOTDIR;
+        }
+        filler(buf, STATS_FILE.substr(STATS_DIR.size() + 1).c_str(), NULL, 0, static_cast<fuse_fill_dir_flags>(0));
+        filler(buf, TRACE_FILE.substr(STATS_DIR.size() + 1).c_str(), NULL, 0, static_cast<fuse_fill_dir_flags>(0));
+        return 0;
+    }
+    
     SimFS* self = getInstance();
     std::lock_guard<std::mutex> lock(self->mutex_);
     
@@ -144,20 +350,54 @@ int SimFS::open(const char *path, struct fuse_file_info *fi) {
     // Use direct I/O to prevent caching for streaming behavior
     fi->direct_io = 1;
     fi->nonseekable = 1;
+    
+    SimFS* self = getInstance();
+    if (isStatsPath(path)) {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+            return -EACCES;
+        }
+        std::shared_ptr<const std::string> contents;
+        if (path == TRACE_FILE) {
+            contents = std::make_shared<const std::string>(Tracer::global().exportChromeJson());
+        }
+        fi->fh = self->registerOpenFile(path, false, contents);
+        return 0;
+    }
+    fi->fh = self->registerOpenFile(path, (fi->flags & O_ACCMODE) == O_RDONLY);
+    
+    // Overlap generation with the caller's startup instead of waiting for read()
+    if ((fi->flags & O_ACCMODE) != O_WRONLY) {
+        self->kickoffGeneration(path);
+        self->recordAccessAndPrefetch(path);
+    }
+    
     return 0;
 }
 
 int SimFS::read(const char *path, char *buf, size_t size, off_t offset,
                 struct fuse_file_info *fi) {
-    (void) fi;
-    
-    std::cerr << "[DEBUG] read() called for: " << path << " offset: " << offset << " size: " << size << std::endl;
-    
     SimFS* self = getInstance();
+    Metrics& metrics = Metrics::global();
+    
+    if (isStatsPath(path)) {
+        // The trace is fixed at open; stats are formatted per read, as the
+        // file is small enough for one read
+        std::shared_ptr<const std::string> contents = self->openFileContents(fi);
+        if (!contents) {
+            contents = std::make_shared<const std::string>(metrics.formatText());
+        }
+        size_t len = offset < static_cast<off_t>(contents->size()) ? std::min(size, contents->size() - offset) : 0;
+        memcpy(buf, contents->data() + offset, len);
+        return len;
+    }
+    
+    // Readers that opened a stored version keep reading it, whatever
+    // regenerations commit in the meantime
+    DBManager::Snapshot snapshot = self->openFileSnapshot(fi);
     
     // Check if we have a streaming buffer for this file
     std::shared_ptr<StreamingBuffer> stream_buffer;
-    {
+    if (!snapshot) {
         std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
         auto it = self->streaming_buffers_.find(path);
         if (it != self->streaming_buffers_.end()) {
@@ -165,187 +405,1130 @@ int SimFS::read(const char *path, char *buf, size_t size, off_t offset,
         }
     }
     
+    if (self->prefetch_config_.enabled && offset == 0) {
+        self->predictor_->recordHit(path);
+    }
+    
     if (stream_buffer) {
-        // Use streaming buffer
-        std::cerr << "[DEBUG] Using streaming buffer for: " << path << std::endl;
+        // Use streaming buffer; the content is persisted when the stream completes
+        LOG_DEBUG.field("path", path).field("offset", offset) << "Reading from stream";
+        if (offset == 0) {
+            metrics.stream_joins.add();
+        }
+        TraceSpan stream_wait("stream_wait", "read", path);
         size_t bytes_read = stream_buffer->readData(buf, size, offset);
+        metrics.bytes_from_stream.add(bytes_read);
+        self->advanceOpenFile(fi, offset + bytes_read);
+        return bytes_read;
+    }
+    
+    // Check if content exists in database
+    std::string content;
+    
+    TraceSpan lock_wait("mutex_wait", "lock", path);
+    std::unique_lock<std::mutex> lock(self->mutex_);
+    lock_wait.end();
+    
+    TraceSpan db_read("content_get", "db", path);
+    bool stored = self->content_->get(path, content, snapshot);
+    db_read.end();
+    if (stored) {
+        // Content exists in database
+        LOG_DEBUG.field("path", path).field("bytes", content.length()) << "Content found in DB";
+    } else {
+        // Special handling for special files - never generate them
+        if (isSpecialFile(path)) {
+            LOG_DEBUG.field("path", path) << "Special file not found, returning empty";
+            return 0;  // EOF for non-existent special files
+        }
         
-        // If streaming is complete, save to database and cleanup
-        if (stream_buffer->isComplete() && offset >= static_cast<off_t>(stream_buffer->getTotalSize())) {
-            // Get full content from buffer
-            size_t total_size = stream_buffer->getTotalSize();
-            if (total_size > 0) {
-                std::vector<char> full_content(total_size);
-                stream_buffer->readData(full_content.data(), total_size, 0);
-                
-                std::string content_key = std::string("content:") + path;
-                self->db_->put(content_key, std::string(full_content.data(), total_size));
-                
-                std::string metadata_key = std::string("meta:") + path;
-                self->db_->put(metadata_key, "type:file");
-                
-                // Add to recent access queue since we just generated it
-                {
-                    std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
-                    recent_access_queue.push_back(path);
-                    if (recent_access_queue.size() > MAX_RECENT_FILES) {
-                        recent_access_queue.pop_front();
-                    }
+        // Check if someone else is already streaming this file
+        {
+            std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
+            auto it = self->streaming_buffers_.find(path);
+            if (it != self->streaming_buffers_.end()) {
+                // Another reader is streaming this file - use their buffer
+                LOG_DEBUG.field("path", path) << "Joining existing stream";
+                stream_buffer = it->second;
+                if (offset == 0) {
+                    metrics.stream_joins.add();
                 }
             }
-            
-            // Remove streaming buffer
-            std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
-            self->streaming_buffers_.erase(path);
         }
         
+        if (!stream_buffer) {
+            int result = self->startGeneration(path, stream_buffer);
+            if (result < 0) {
+                return result;
+            }
+            if (!stream_buffer) {
+                return 0;  // Caller may not trigger generation
+            }
+            if (offset == 0) {
+                metrics.cache_misses.add();
+            }
+        }
+        
+        // Release main lock before blocking read
+        lock.unlock();
+        self->registerPendingCommits();
+        TraceSpan stream_wait("stream_wait", "read", path);
+        size_t bytes_read = stream_buffer->readData(buf, size, offset);
+        metrics.bytes_from_stream.add(bytes_read);
+        self->advanceOpenFile(fi, offset + bytes_read);
         return bytes_read;
     }
     
-    // Check if content exists in database
-    std::string content_key = std::string("content:") + path;
-    std::string content;
+    lock.unlock();
+    
+    // Update recent access
+    recordRecentAccess(path);
+    if (offset == 0) {
+        self->capacity_->recordAccess(path);
+        metrics.cache_hits.add();
+    }
+    
+    // Return data from database content
+    size_t len = content.length();
+    if (offset < static_cast<off_t>(len)) {
+        if (offset + size > len) {
+            size = len - offset;
+        }
+        memcpy(buf, content.c_str() + offset, size);
+    } else {
+        size = 0;
+    }
+    metrics.bytes_from_db.add(size);
+    
+    self->advanceOpenFile(fi, offset + size);
+    return size;
+}
+
+int SimFS::poll(const char *path, struct fuse_file_info *fi,
+                struct fuse_pollhandle *ph, unsigned *reventsp) {
+    SimFS* self = getInstance();
+    
+    // A poll for readability is an intent to read, so make sure generation runs
+    self->kickoffGeneration(path, true);
+    
+    std::shared_ptr<StreamingBuffer> stream_buffer;
+    {
+        std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
+        auto it = self->streaming_buffers_.find(path);
+        if (it != self->streaming_buffers_.end()) {
+            stream_buffer = it->second;
+        }
+    }
+    
+    // Persisted (or never generated) files are always readable
+    off_t offset = self->openFileOffset(fi);
+    if (stream_buffer && ph &&
+        stream_buffer->notifyWhenReadable(offset, [ph]() {
+            fuse_notify_poll(ph);
+            fuse_pollhandle_destroy(ph);
+        })) {
+        *reventsp = 0;
+        return 0;
+    }
+    
+    if (ph) {
+        fuse_pollhandle_destroy(ph);
+    }
+    if (!stream_buffer || stream_buffer->isComplete() ||
+        static_cast<off_t>(stream_buffer->getTotalSize()) > offset) {
+        *reventsp |= POLLIN | POLLRDNORM;
+    }
+    return 0;
+}
+
+int SimFS::release(const char *path, struct fuse_file_info *fi) {
+    (void) path;
+    
+    SimFS* self = getInstance();
+    std::string written;
+    {
+        std::lock_guard<std::mutex> lock(self->open_files_mutex_);
+        auto it = self->open_files_.find(fi->fh);
+        if (it != self->open_files_.end() && it->second.written) {
+            written = it->second.path;
+        }
+        self->open_files_.erase(fi->fh);
+    }
+    
+    // Writes through a handle leave the preview, digest and index to its
+    // release
+    if (!written.empty()) {
+        self->content_->refreshDerived(written);
+    }
+    
+    return 0;
+}
+
+int SimFS::startGeneration(const std::string& path, std::shared_ptr<StreamingBuffer>& buffer,
+                           GenerationSource source, bool* stored) {
+    CallerInfo caller;
+    GenerationClass generation_class = GenerationClass::Background;
+    
+    if (source != GenerationSource::Caller && source != GenerationSource::Regenerate) {
+        // Prefetch and offline generation run on behalf of SimFS itself
+        caller.pid = getpid();
+        caller.uid = getuid();
+        if (source == GenerationSource::Offline) {
+            generation_class = GenerationClass::Foreground;
+        }
+    } else {
+        // Crawlers and other denied callers never trigger generation
+        caller = ProcessPolicy::currentCaller();
+        generation_class = policy_->classify(caller);
+        if (generation_class == GenerationClass::Denied) {
+            LOG_INFO << "Generation denied for " << caller.comm << " (pid " << caller.pid
+                      << ", uid " << caller.uid << "): " << path;
+            return source == GenerationSource::Regenerate ? -EACCES : 0;
+        }
+        if (source == GenerationSource::Regenerate) {
+            // Nobody waits for it, so it never competes with reads
+            generation_class = GenerationClass::Background;
+        }
+    }
+    
+    // Spans of this generation on every thread it touches
+    TraceFlow flow(TraceFlow::next());
+    
+    // Get the configuration for this path
+    TraceSpan config_span("resolve_config", "generation", path);
+    DirectoryConfig config = getConfigForPath(path);
+    config_span.end();
+    
+    // Trivial and binary files never reach the LLM, so they cost no tokens
+    TraceSpan local_span("generate_locally", "generation", path);
+    bool local = generateLocally(path, config, buffer);
+    local_span.end();
+    if (local) {
+        if (stored) {
+            *stored = true;
+        }
+        if (source == GenerationSource::Caller) {
+            recordRecentAccess(path);
+        } else if (source == GenerationSource::Regenerate) {
+            buffer.reset();  // Already stored
+        }
+        return 0;
+    }
+    
+    if (source == GenerationSource::Caller || source == GenerationSource::Regenerate) {
+        if (!policy_->hasTokenBudget(caller.uid)) {
+            LOG_INFO << "Token quota exhausted for uid " << caller.uid << ": " << path;
+            return -EDQUOT;
+        }
+    }
+    
+    // Start streaming generation
+    LOG_DEBUG.field("path", path) << "Starting streaming generation";
+    
+    TraceSpan context_span("build_context", "generation", path);
+    std::string dir_path = path.substr(0, path.find_last_of('/'));
+    std::vector<FileContext> context_files = getFolderContext(dir_path);
+    
+    std::vector<std::string> recent_paths;
+    {
+        std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
+        recent_paths.assign(recent_access_queue.begin(), recent_access_queue.end());
+    }
+    
+    // Build exclusion list from folder context files and the file being generated
+    std::vector<std::string> exclude_paths;
+    exclude_paths.push_back(path);  // Exclude the file being generated
+    for (const auto& ctx : context_files) {
+        exclude_paths.push_back(ctx.path);
+    }
+    
+    // Get recent files with content, excluding folder context files
+    std::vector<FileContext> recent_files = getRecentFilesWithContent(recent_paths, exclude_paths);
+    context_span.end();
+    
+    // Queue behind foreground work and per-uid limits on the worker thread,
+    // so the FUSE thread never blocks while holding the main lock
+    ProcessPolicy* policy = policy_.get();
+    uid_t uid = caller.uid;
+    GenerationOptions options;
+    options.wait_for_admission = [policy, uid, generation_class]() {
+        policy->admit(uid, generation_class);
+    };
+    options.related_files = relatedFilesProvider(path, config.related_files, exclude_paths, recent_files);
+    options.prompt_token_budget = config.prompt_token_budget;
+    options.tokenizer = tokenizerFor(config);
+    options.affinity_key = dir_path;
+    options.trace_id = TraceFlow::current();
+    TraceSpan route_span("route_model", "generation", path);
+    ModelChoice choice = chooseModel(path, config);
+    route_span.end();
+    options.max_tokens = choice.max_tokens;
+    options.temperature = choice.temperature;
+    
+    // Evicted files come back with the seed they were first generated with
+    std::string metadata;
+    db_->get(std::string("meta:") + path, metadata);
+    if (capacity_->pinSeeds()) {
+        options.seed = source == GenerationSource::Regenerate
+                           ? versionSeed(path, FileMetadata::version(metadata) + 1)
+                           : FileMetadata::pinnedSeed(path, metadata);
+    }
+    bool evicted = FileMetadata::hasFlag(metadata, "evicted");
+    if (evicted) {
+        capacity_->recordRegeneration(path);
+    }
+    
+    // Regenerations stay single so they keep their pinned seed
+    bool batched = config.batch_generation && config.batch_max_files > 1 && source != GenerationSource::Offline &&
+                   source != GenerationSource::Regenerate && !evicted;
+    
+    // Quotas are charged in the directory's tokens, like its prompts
+    std::shared_ptr<const Tokenizer> counter = options.tokenizer ? options.tokenizer : std::make_shared<const Tokenizer>();
+    if (batched) {
+        // The first file's context and admission stand for the whole batch
+        std::string key = dir_path + "\n" + std::to_string(uid) + "\n" + std::to_string(static_cast<int>(generation_class)) +
+                          "\n" + choice.model;
+        LLMClient* client = llm_client_.get();
+        std::string model_name = choice.model;
+        buffer = batcher_->add(key, path, std::chrono::milliseconds(config.batch_window_ms), config.batch_max_files,
+            [client, context_files, recent_files, model_name, options, policy, uid, generation_class, counter](
+                const std::vector<std::string>& paths, const std::vector<std::shared_ptr<StreamingBuffer>>& buffers) {
+                // Released once, when the last file of the batch finishes
+                auto remaining = std::make_shared<std::atomic<size_t>>(buffers.size());
+                auto generated_tokens = std::make_shared<std::atomic<size_t>>(0);
+                for (const auto& file_buffer : buffers) {
+                    file_buffer->onComplete([=](const StreamingBuffer& completed) {
+                        *generated_tokens += counter->count(completed.getContent());
+                        if (--*remaining == 0) {
+                            policy->release(uid, generation_class, *generated_tokens);
+                        }
+                    });
+                }
+                if (paths.size() > 1) {
+                    LOG_DEBUG << "Generating " << paths.size() << " files in one request";
+                }
+                client->generateFilesStream(paths, buffers, context_files, recent_files, model_name, options);
+            });
+    } else {
+        buffer = llm_client_->generateFileContentStream(path, context_files, recent_files, choice.model, options);
+        
+        buffer->onComplete([policy, uid, generation_class, counter](const StreamingBuffer& completed) {
+            policy->release(uid, generation_class, counter->count(completed.getContent()));
+        });
+    }
+    if (source == GenerationSource::Offline || source == GenerationSource::Regenerate) {
+        return 0;
+    }
+    
+    // Draft first: readers get the fast model's output while the routed
+    // model writes the version that is stored. Both run to completion so a
+    // reader never mixes the two; the draft is kept if the final fails.
+    std::shared_ptr<StreamingBuffer> final_buffer;
+    if (!choice.draft_model.empty() && choice.draft_model != choice.model && !batched) {
+        LOG_DEBUG << "Drafting " << path << " with " << choice.draft_model;
+        final_buffer = buffer;
+        GenerationOptions draft_options = options;
+        draft_options.seed.reset();
+        buffer = llm_client_->generateFileContentStream(path, context_files, recent_files, choice.draft_model,
+                                                        draft_options);
+        buffer->onComplete([policy, uid, generation_class, counter](const StreamingBuffer& completed) {
+            policy->release(uid, generation_class, counter->count(completed.getContent()));
+        });
+    }
+    
+    {
+        std::lock_guard<std::mutex> stream_lock(streaming_mutex_);
+        streaming_buffers_[path] = buffer;
+    }
+    
+    // A write or create while the file streams makes it the user's; the
+    // commit checks against what was stored now
+    std::string base;
+    db_->get(std::string("content:") + path, base);
+    if (final_buffer) {
+        auto remaining = std::make_shared<std::atomic<int>>(2);
+        std::shared_ptr<StreamingBuffer> draft = buffer;
+        auto finish = [this, path, base, draft, final_buffer, remaining](const StreamingBuffer&) {
+            if (--*remaining == 0) {
+                commitGeneratedContent(path, final_buffer->hasError() ? *draft : *final_buffer, base, draft.get());
+            }
+        };
+        pending_commits_.push_back([draft, final_buffer, finish]() {
+            draft->onComplete(finish);
+            final_buffer->onComplete(finish);
+        });
+    } else {
+        pending_commits_.push_back([this, path, base, buffer]() {
+            buffer->onComplete([this, path, base](const StreamingBuffer& completed) {
+                commitGeneratedContent(path, completed, base);
+            });
+        });
+    }
+    
+    // Add to recent access queue since we're generating it. Prefetched files
+    // only count once somebody actually opens them.
+    if (source == GenerationSource::Caller) {
+        recordRecentAccess(path);
+    }
+    
+    return 0;
+}
+
+bool SimFS::generateLocally(const std::string& path, const DirectoryConfig& config,
+                            std::shared_ptr<StreamingBuffer>& buffer) {
+    std::vector<GeneratorRule> rules = config.generators;
+    if (config.use_default_generators) {
+        const auto& defaults = GeneratorRegistry::defaultRules();
+        rules.insert(rules.end(), defaults.begin(), defaults.end());
+    }
+    
+    std::string content;
+    std::string generator;
+    if (!generators_->generate(path, rules, content, &generator)) {
+        return false;
+    }
+    LOG_DEBUG << "Generated " << path << " locally (" << generator << ", "
+              << content.size() << " bytes)";
+    
+    // Stored right away: there is nothing to stream, and empty results must
+    // persist too or they would be regenerated on every read
+    if (!persistGeneratedFiles({{path, content}})) {
+        return false;
+    }
+    buffer = std::make_shared<StreamingBuffer>();
+    buffer->appendData(content);
+    buffer->markComplete();
+    return true;
+}
+
+bool SimFS::kickoffGeneration(const std::string& path, bool ignore_config) {
+    if (isSpecialFile(path)) {
+        return false;
+    }
+    
+    std::shared_ptr<StreamingBuffer> buffer;
+    {
+        TraceSpan lock_wait("mutex_wait", "lock", path);
+        std::lock_guard<std::mutex> lock(mutex_);
+        lock_wait.end();
+        
+        if (content_->exists(path)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> stream_lock(streaming_mutex_);
+            if (streaming_buffers_.count(path)) {
+                return true;
+            }
+        }
+        if (!ignore_config && !getConfigForPath(path).generate_on_open) {
+            return false;
+        }
+        
+        if (startGeneration(path, buffer) != 0) {
+            return false;
+        }
+    }
+    registerPendingCommits();
+    return buffer != nullptr;
+}
+
+void SimFS::commitGeneratedContent(const std::string& path, const StreamingBuffer& completed,
+                                   const std::string& base, const StreamingBuffer* streamed) {
+    TraceSpan span("commit", "generation", path);
+    
+    // Failed streams are not persisted so the next read retries generation
+    if (completed.hasError()) {
+        LOG_WARNING << "Generation failed for " << path << ": " << completed.getError();
+    } else if (completed.getTotalSize() > 0) {
+        // Writes and creates take mutex_ too, so nothing lands between the
+        // check and the commit
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string current;
+        db_->get(std::string("content:") + path, current);
+        if (current != base) {
+            LOG_INFO << path << " was written while it was generated, discarding the generated version";
+        } else {
+            persistGeneratedFiles({{path, completed.getContent()}});
+        }
+    }
+    
+    // Later reads are served from the database
+    std::lock_guard<std::mutex> stream_lock(streaming_mutex_);
+    auto it = streaming_buffers_.find(path);
+    if (it != streaming_buffers_.end() && it->second.get() == (streamed ? streamed : &completed)) {
+        streaming_buffers_.erase(it);
+        streaming_retired_.notify_all();
+    }
+}
+
+int SimFS::regenerate(const std::string& path) {
+    // Config files are never generated
+    if (isSpecialFile(path)) {
+        return -EINVAL;
+    }
+    {
+        std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+        if (!regenerating_.insert(path).second) {
+            return 0;  // Already under way
+        }
+    }
+    
+    std::shared_ptr<StreamingBuffer> buffer;
+    std::string base;
+    int result = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string metadata;
+        if (!db_->get(std::string("content:") + path, base)) {
+            result = -ENOENT;
+        } else if (!db_->get(std::string("meta:") + path, metadata) ||
+                   !FileMetadata::hasFlag(metadata, "generated")) {
+            result = -EPERM;  // Written by the user: never replaced by a generation
+        } else {
+            LOG_INFO << "Regenerating " << path << " in the background";
+            result = startGeneration(path, buffer, GenerationSource::Regenerate);
+        }
+    }
+    if (result < 0) {
+        std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+        regenerating_.erase(path);
+        return result;
+    }
+    {
+        std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+        regeneration_stats_.requested++;
+    }
+    
+    if (!buffer) {
+        endRegeneration(path, true);  // Generated locally, and stored already
+        return 0;
+    }
+    // Registered without mutex_ held, so the commit may take it even if
+    // the buffer has already completed
+    buffer->onComplete([this, path, base](const StreamingBuffer& completed) {
+        commitRegeneration(path, completed, base);
+    });
+    return 0;
+}
+
+void SimFS::registerPendingCommits() {
+    std::vector<std::function<void()>> commits;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commits.swap(pending_commits_);
+    }
+    for (const auto& commit : commits) {
+        commit();
+    }
+}
+
+void SimFS::commitRegeneration(const std::string& path, const StreamingBuffer& completed, const std::string& base) {
+    if (completed.hasError() || completed.getTotalSize() == 0) {
+        LOG_WARNING << "Regeneration failed for " << path << ", keeping the stored version: "
+                  << (completed.hasError() ? completed.getError() : "empty response");
+        endRegeneration(path, false);
+        return;
+    }
+    
+    // Writes and unlinks take mutex_ too, so nothing lands between the
+    // check and the commit
+    bool committed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string current;
+        if (!db_->get(std::string("content:") + path, current) || current != base) {
+            LOG_INFO << path << " changed while it was regenerated, discarding the new version";
+        } else {
+            committed = persistGeneratedFiles({{path, completed.getContent()}});
+        }
+    }
+    endRegeneration(path, committed);
+}
+
+void SimFS::endRegeneration(const std::string& path, bool committed) {
+    std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+    regenerating_.erase(path);
+    if (committed) {
+        regeneration_stats_.committed++;
+    } else {
+        regeneration_stats_.discarded++;
+    }
+}
+
+std::string SimFS::formatVersionStats(const std::string& path) {
+    std::string metadata;
+    if (!db_->get(std::string("meta:") + path, metadata) || metadata.find("type:dir") != std::string::npos) {
+        return "";
+    }
+    bool regenerating;
+    {
+        std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+        regenerating = regenerating_.count(path) > 0;
+    }
+    
+    std::ostringstream out;
+    out << "version=" << FileMetadata::version(metadata) << "\n"
+        << "generated=" << (FileMetadata::hasFlag(metadata, "generated") ? 1 : 0) << "\n"
+        << "evicted=" << (FileMetadata::hasFlag(metadata, "evicted") ? 1 : 0) << "\n"
+        << "regenerating=" << (regenerating ? 1 : 0) << "\n";
+    return out.str();
+}
+
+std::string SimFS::formatRegenerationStats() const {
+    size_t pinned_readers = 0;
+    {
+        std::lock_guard<std::mutex> open_lock(open_files_mutex_);
+        for (const auto& entry : open_files_) {
+            if (entry.second.snapshot) {
+                pinned_readers++;
+            }
+        }
+    }
+    
+    std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+    std::ostringstream out;
+    out << "requested=" << regeneration_stats_.requested << "\n"
+        << "committed=" << regeneration_stats_.committed << "\n"
+        << "discarded=" << regeneration_stats_.discarded << "\n"
+        << "in_progress=" << regenerating_.size() << "\n"
+        << "pinned_readers=" << pinned_readers << "\n";
+    return out.str();
+}
+
+bool SimFS::persistGeneratedFiles(const std::vector<std::pair<std::string, std::string>>& files) {
+    TraceSpan span("persist", "db", files.size() == 1 ? files[0].first : std::string());
+    std::vector<std::pair<std::string, std::string>> puts;
+    std::unordered_set<std::string> parents;
+    
+    for (const auto& file : files) {
+        // Evicted files come back as the version they were; anything else
+        // stored here is a new one
+        std::string previous;
+        db_->get(std::string("meta:") + file.first, previous);
+        uint64_t version = FileMetadata::version(previous);
+        if (version == 0 || !FileMetadata::hasFlag(previous, "evicted")) {
+            version++;
+        }
+        
+        // Only unmodified generated content may be evicted later
+        std::string metadata = "type:file;generated;version=" + std::to_string(version);
+        if (capacity_->pinSeeds()) {
+            metadata += ";seed=" + std::to_string(versionSeed(file.first, version));
+        }
+        puts.emplace_back(std::string("meta:") + file.first, metadata);
+        
+        // Make sure the tree is listable down to the file
+        std::string dir = file.first.substr(0, file.first.find_last_of('/'));
+        while (!dir.empty() && parents.insert(dir).second) {
+            if (!db_->exists(std::string("meta:") + dir)) {
+                puts.emplace_back(std::string("meta:") + dir, "type:dir");
+            }
+            dir = dir.substr(0, dir.find_last_of('/'));
+        }
+    }
+    
+    if (!content_->write(files, {}, puts)) {
+        return false;
+    }
+    
+    for (const auto& file : files) {
+        capacity_->recordStore(file.first, file.second.size(), true);
+    }
+    
+    // References are scanned on the prefetch worker, outside mutex_, and
+    // only in the start of text files
+    if (prefetch_config_.enabled && prefetch_config_.follow_references) {
+        std::vector<std::pair<std::string, std::string>> scans;
+        for (const auto& file : files) {
+            if (FilePreview::detectType(file.second) == "text") {
+                scans.emplace_back(file.first, file.second.substr(0, AccessPredictor::MAX_SCANNED_BYTES));
+            }
+        }
+        if (!scans.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(prefetch_mutex_);
+                for (auto& scan : scans) {
+                    if (reference_queue_.size() < MAX_QUEUED_OPENS) {
+                        reference_queue_.push_back(std::move(scan));
+                    }
+                }
+            }
+            prefetch_cv_.notify_one();
+        }
+    }
+    
+    enforceCapacity();
+    return true;
+}
+
+void SimFS::enforceCapacity() {
+    if (!capacity_->enabled()) {
+        return;
+    }
+    
+    // Completion callbacks may already hold mutex_, so hand the pass off
+    // rather than taking it here
+    {
+        std::lock_guard<std::mutex> lock(eviction_mutex_);
+        eviction_requested_ = true;
+    }
+    eviction_cv_.notify_one();
+}
+
+void SimFS::runEvictionWorker() {
+    std::unique_lock<std::mutex> lock(eviction_mutex_);
+    while (true) {
+        eviction_cv_.wait(lock, [this]() { return eviction_stopping_ || eviction_requested_; });
+        if (eviction_stopping_) {
+            return;
+        }
+        eviction_requested_ = false;
+        lock.unlock();
+        
+        evictColdFiles();
+        
+        lock.lock();
+    }
+}
+
+void SimFS::evictColdFiles() {
+    // Holding mutex_ keeps writes out between enforce() checking a file's
+    // generated flag and dropping its content
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Files being read or generated keep their content
+    std::unordered_set<std::string> busy;
+    {
+        std::lock_guard<std::mutex> open_lock(open_files_mutex_);
+        for (const auto& entry : open_files_) {
+            busy.insert(entry.second.path);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> stream_lock(streaming_mutex_);
+        for (const auto& entry : streaming_buffers_) {
+            busy.insert(entry.first);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> regeneration_lock(regeneration_mutex_);
+        busy.insert(regenerating_.begin(), regenerating_.end());
+    }
+    
+    capacity_->enforce([&busy](const std::string& path) {
+        return !busy.count(path) && !isSpecialFile(path);
+    });
+}
+
+int SimFS::restoreEvicted(const std::string& path) {
+    std::string metadata;
+    if (!db_->get(std::string("meta:") + path, metadata) || !FileMetadata::hasFlag(metadata, "evicted")) {
+        return 0;
+    }
+    LOG_INFO << "Regenerating evicted " << path << " before writing to it";
+    
+    // Stored, or dropped if it failed, once its buffer is retired
+    if (kickoffGeneration(path, true)) {
+        waitForStream(path);
+    }
+    return content_->exists(path) ? 0 : -EIO;
+}
+
+void SimFS::waitForStream(const std::string& path) {
+    std::unique_lock<std::mutex> stream_lock(streaming_mutex_);
+    auto it = streaming_buffers_.find(path);
+    if (it == streaming_buffers_.end()) {
+        return;
+    }
+    std::shared_ptr<StreamingBuffer> buffer = it->second;
+    streaming_retired_.wait(stream_lock, [this, &path, &buffer]() {
+        auto current = streaming_buffers_.find(path);
+        return current == streaming_buffers_.end() || current->second != buffer;
+    });
+}
+
+void SimFS::clearConfigCache() {
+    std::lock_guard<std::mutex> config_lock(config_mutex_);
+    config_cache_.clear();
+}
+
+std::string SimFS::formatCapacityStats() const {
+    CapacityStats stats = capacity_->getStats();
+    
+    std::ostringstream out;
+    out << "enabled=" << (capacity_->enabled() ? 1 : 0) << "\n"
+        << "budget_bytes=" << stats.budget_bytes << "\n"
+        << "usage_bytes=" << stats.usage_bytes << "\n"
+        << "files=" << stats.files << "\n"
+        << "blobs=" << stats.blobs << "\n"
+        << "evictions=" << stats.evictions << "\n"
+        << "evicted_bytes=" << stats.evicted_bytes << "\n"
+        << "regenerations=" << stats.regenerations << "\n";
+    return out.str();
+}
+
+std::string SimFS::formatBackendStats() const {
+    std::ostringstream out;
+    auto stats = llm_client_->pool().stats();
+    for (size_t i = 0; i < stats.size(); i++) {
+        std::string prefix = "backend." + std::to_string(i) + ".";
+        out << prefix << "url=" << stats[i].url << "\n"
+            << prefix << "circuit=" << BackendPool::circuitName(stats[i].circuit) << "\n"
+            << prefix << "in_flight=" << stats[i].in_flight << "\n"
+            << prefix << "in_flight_tokens=" << stats[i].in_flight_tokens << "\n"
+            << prefix << "requests=" << stats[i].requests << "\n"
+            << prefix << "failures=" << stats[i].failures << "\n"
+            << prefix << "throttled=" << stats[i].throttled << "\n"
+            << prefix << "concurrency_limit=" << stats[i].concurrency_limit << "\n";
+    }
+    
+    HedgePolicy::Stats hedging = llm_client_->hedging().stats();
+    out << "hedge.requests=" << hedging.requests << "\n"
+        << "hedge.hedged=" << hedging.hedged << "\n"
+        << "hedge.wins=" << hedging.hedge_wins << "\n"
+        << "hedge.delay_ms=" << (hedging.delay ? hedging.delay->count() : 0) << "\n";
+    return out.str();
+}
+
+bool SimFS::hasContent(const std::string& path) {
+    return content_->exists(path);
+}
+
+std::shared_ptr<StreamingBuffer> SimFS::startOfflineGeneration(const std::string& path, bool* stored) {
+    std::shared_ptr<StreamingBuffer> buffer;
+    if (stored) {
+        *stored = false;
+    }
+    if (isSpecialFile(path)) {
+        buffer = std::make_shared<StreamingBuffer>();
+        buffer->markError("special files are never generated");
+        return buffer;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    startGeneration(path, buffer, GenerationSource::Offline, stored);
+    return buffer;
+}
+
+bool SimFS::storeGeneratedFiles(const std::vector<std::pair<std::string, std::string>>& files) {
+    if (!persistGeneratedFiles(files)) {
+        return false;
+    }
     
-    std::unique_lock<std::mutex> lock(self->mutex_);
+    // Later generations see these files as recent context, as in the mount
+    for (const auto& file : files) {
+        recordRecentAccess(file.first);
+    }
+    return true;
+}
+
+std::vector<std::string> SimFS::listUngeneratedFiles() {
+    std::vector<std::string> paths;
+    for (const auto& key : db_->listKeys("meta:")) {
+        std::string path = key.substr(5);
+        std::string metadata;
+        if (!isSpecialFile(path) && db_->get(key, metadata) && metadata.find("type:file") != std::string::npos &&
+            !hasContent(path)) {
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
+
+void SimFS::recordAccessAndPrefetch(const std::string& path) {
+    if (!prefetch_config_.enabled || isSpecialFile(path)) {
+        return;
+    }
     
-    if (self->db_->get(content_key, content)) {
-        // Content exists in database
-        std::cerr << "[DEBUG] Content found in DB, length: " << content.length() << std::endl;
-    } else {
-        // Special handling for special files - never generate them
-        if (isSpecialFile(path)) {
-            std::cerr << "[DEBUG] Special file not found, returning empty: " << path << std::endl;
-            return 0;  // EOF for non-existent special files
+    predictor_->recordHit(path);
+    
+    // The caller's ids are only available on the request thread
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mutex_);
+        if (prefetch_queue_.size() >= MAX_QUEUED_OPENS) {
+            return;
         }
-        
-        // Check if someone else is already streaming this file
-        {
-            std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
-            auto it = self->streaming_buffers_.find(path);
-            if (it != self->streaming_buffers_.end()) {
-                // Another reader is streaming this file - use their buffer
-                std::cerr << "[DEBUG] Joining existing stream for: " << path << std::endl;
-                stream_buffer = it->second;
-                lock.unlock();  // Release main lock before blocking read
-                return stream_buffer->readData(buf, size, offset);
-            }
+        prefetch_queue_.emplace_back(path, ProcessPolicy::currentCallerIds());
+    }
+    prefetch_cv_.notify_one();
+}
+
+void SimFS::runPrefetchWorker() {
+    std::unique_lock<std::mutex> lock(prefetch_mutex_);
+    while (true) {
+        prefetch_cv_.wait(lock, [this]() {
+            return prefetch_stopping_ || !prefetch_queue_.empty() || !reference_queue_.empty();
+        });
+        if (prefetch_stopping_) {
+            return;
         }
+        std::deque<std::pair<std::string, CallerInfo>> opens;
+        opens.swap(prefetch_queue_);
+        std::deque<std::pair<std::string, std::string>> generated;
+        generated.swap(reference_queue_);
+        lock.unlock();
         
-        // Start streaming generation
-        std::cerr << "[DEBUG] Starting streaming generation for: " << path << std::endl;
-        
-        std::string dir_path = std::string(path).substr(0, std::string(path).find_last_of('/'));
-        auto files = self->getDirectoryContents(dir_path);
-        
-        std::vector<FileContext> context_files;
-        for (const auto& file : files) {
-            std::string metadata_key = std::string("meta:") + file;
-            std::string metadata;
-            
-            if (self->db_->get(metadata_key, metadata) && metadata.find("type:file") != std::string::npos) {
-                std::string content_key = std::string("content:") + file;
-                std::string file_content;
-                
-                if (self->db_->get(content_key, file_content)) {
-                    FileContext fc;
-                    fc.path = file;
-                    fc.content = file_content.substr(0, 200) + "...";
-                    context_files.push_back(fc);
-                }
-            }
+        for (const auto& file : generated) {
+            predictor_->recordReferences(file.first, file.second);
         }
         
-        std::vector<std::string> recent_paths;
-        {
-            std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
-            recent_paths.assign(recent_access_queue.begin(), recent_access_queue.end());
+        // Only foreground access patterns are worth learning from
+        std::vector<std::string> learned;
+        for (auto& open : opens) {
+            ProcessPolicy::resolveComm(open.second);
+            if (policy_->classify(open.second) == GenerationClass::Foreground) {
+                learned.push_back(open.first);
+            }
         }
-        
-        // Build exclusion list from folder context files and the file being generated
-        std::vector<std::string> exclude_paths;
-        exclude_paths.push_back(path);  // Exclude the file being generated
-        for (const auto& ctx : context_files) {
-            exclude_paths.push_back(ctx.path);
+        predictor_->recordOpens(learned);
+        for (const auto& path : learned) {
+            for (const auto& candidate : predictor_->predict(path)) {
+                prefetch(candidate);
+            }
         }
         
-        // Get recent files with content, excluding folder context files
-        std::vector<FileContext> recent_files = self->getRecentFilesWithContent(recent_paths, exclude_paths);
-        
-        // Get the configuration for this path
-        DirectoryConfig config = self->getConfigForPath(path);
-        
-        auto buffer = self->llm_client_->generateFileContentStream(path, context_files, recent_files, config.model_name);
+        lock.lock();
+    }
+}
+
+void SimFS::prefetch(const std::string& path) {
+    if (isSpecialFile(path)) {
+        return;
+    }
+    
+    std::shared_ptr<StreamingBuffer> buffer;
+    std::shared_ptr<const Tokenizer> counter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
         
-        {
-            std::lock_guard<std::mutex> stream_lock(self->streaming_mutex_);
-            self->streaming_buffers_[path] = buffer;
+        if (content_->exists(path)) {
+            return;
         }
-        
-        // Add to recent access queue since we're generating it
         {
-            std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
-            recent_access_queue.push_back(path);
-            if (recent_access_queue.size() > MAX_RECENT_FILES) {
-                recent_access_queue.pop_front();
+            std::lock_guard<std::mutex> stream_lock(streaming_mutex_);
+            if (streaming_buffers_.count(path)) {
+                return;
             }
         }
+        // Charged at the route's response limit until it completes
+        DirectoryConfig config = getConfigForPath(path);
+        if (!predictor_->reservePrefetch(path, chooseModel(path, config).max_tokens)) {
+            return;
+        }
+        counter = tokenizerFor(config);
         
-        // Return data from the new streaming buffer
-        return buffer->readData(buf, size, offset);
+        LOG_INFO << "Prefetching predicted file: " << path;
+        
+        startGeneration(path, buffer, GenerationSource::Prefetch);
+    }
+    registerPendingCommits();
+    if (!buffer) {
+        predictor_->completePrefetch(path, 0, false);
+        return;
     }
     
-    // Update recent access
-    {
-        std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
-        recent_access_queue.push_back(path);
-        if (recent_access_queue.size() > MAX_RECENT_FILES) {
-            recent_access_queue.pop_front();
+    AccessPredictor* predictor = predictor_.get();
+    if (!counter) {
+        counter = std::make_shared<const Tokenizer>();
+    }
+    buffer->onComplete([predictor, path, counter](const StreamingBuffer& completed) {
+        predictor->completePrefetch(path, counter->count(completed.getContent()), !completed.hasError());
+    });
+}
+
+std::string SimFS::formatPrefetchStats() const {
+    PrefetchStats stats = predictor_->getStats();
+    double hit_rate = stats.completed > 0 ? static_cast<double>(stats.hits) / stats.completed : 0.0;
+    
+    std::ostringstream out;
+    out << "issued=" << stats.issued << "\n"
+        << "completed=" << stats.completed << "\n"
+        << "hits=" << stats.hits << "\n"
+        << "hit_rate=" << hit_rate << "\n"
+        << "tokens_spent=" << stats.tokens_spent << "\n"
+        << "tokens_wasted=" << stats.tokens_wasted << "\n";
+    return out.str();
+}
+
+int SimFS::setxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
+    (void) flags;
+    
+    // "1" or "0" on the mount root starts or stops recording spans
+    if (strcmp(name, "user.simfs.tracing") == 0) {
+        if (strcmp(path, "/") != 0) {
+            return -ENOTSUP;
         }
+        std::string setting(value, size);
+        if (setting != "1" && setting != "0") {
+            return -EINVAL;
+        }
+        Tracer::setEnabled(setting == "1");
+        return 0;
     }
     
-    // Return data from database content
-    size_t len = content.length();
-    if (offset < static_cast<off_t>(len)) {
-        if (offset + size > len) {
-            size = len - offset;
+    // Setting the attribute, to any value, asks for a new version
+    if (strcmp(name, "user.simfs.regenerate") != 0) {
+        return -ENOTSUP;
+    }
+    return getInstance()->regenerate(path);
+}
+
+int SimFS::getxattr(const char *path, const char *name, char *value, size_t size) {
+    SimFS* self = getInstance();
+    
+    std::string attribute;
+    if (strcmp(path, "/") == 0 && strcmp(name, "user.simfs.prefetch_stats") == 0) {
+        attribute = self->formatPrefetchStats();
+    } else if (strcmp(path, "/") == 0 && strcmp(name, "user.simfs.capacity_stats") == 0) {
+        attribute = self->formatCapacityStats();
+    } else if (strcmp(path, "/") == 0 && strcmp(name, "user.simfs.backend_stats") == 0) {
+        attribute = self->formatBackendStats();
+    } else if (strcmp(path, "/") == 0 && strcmp(name, "user.simfs.regeneration_stats") == 0) {
+        attribute = self->formatRegenerationStats();
+    } else if (strcmp(name, "user.simfs.version") == 0) {
+        attribute = self->formatVersionStats(path);
+        if (attribute.empty()) {
+            return -ENODATA;
         }
-        memcpy(buf, content.c_str() + offset, size);
     } else {
-        size = 0;
+        return -ENODATA;
     }
     
-    return size;
+    // A zero size asks for the length of the value
+    if (size == 0) {
+        return attribute.size();
+    }
+    if (size < attribute.size()) {
+        return -ERANGE;
+    }
+    memcpy(value, attribute.data(), attribute.size());
+    return attribute.size();
+}
+
+uint64_t SimFS::registerOpenFile(const std::string& path, bool pin_version,
+                                 std::shared_ptr<const std::string> contents) {
+    // Files still to be generated have no version to pin yet
+    DBManager::Snapshot snapshot;
+    if (pin_version && !isSpecialFile(path) && content_->exists(path)) {
+        snapshot = db_->snapshot();
+    }
+    
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    uint64_t handle = next_file_handle_++;
+    open_files_[handle] = OpenFile{path, 0, snapshot, contents};
+    return handle;
+}
+
+void SimFS::advanceOpenFile(struct fuse_file_info *fi, off_t offset) {
+    if (!fi) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    auto it = open_files_.find(fi->fh);
+    if (it != open_files_.end()) {
+        it->second.offset = offset;
+    }
+}
+
+off_t SimFS::openFileOffset(struct fuse_file_info *fi) {
+    if (!fi) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    auto it = open_files_.find(fi->fh);
+    return it != open_files_.end() ? it->second.offset : 0;
+}
+
+DBManager::Snapshot SimFS::openFileSnapshot(struct fuse_file_info *fi) {
+    if (!fi) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    auto it = open_files_.find(fi->fh);
+    return it != open_files_.end() ? it->second.snapshot : nullptr;
+}
+
+std::shared_ptr<const std::string> SimFS::openFileContents(struct fuse_file_info *fi) {
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    auto it = open_files_.find(fi->fh);
+    return it != open_files_.end() ? it->second.contents : nullptr;
 }
 
 int SimFS::write(const char *path, const char *buf, size_t size, off_t offset,
                  struct fuse_file_info *fi) {
-    (void) fi;
+    if (isStatsPath(path)) {
+        return -EACCES;
+    }
+    
     
     SimFS* self = getInstance();
+    
+    // Only the body of an evicted file is gone; it comes back before the
+    // write applies, or the file would be replaced by the written bytes
+    int restored = self->restoreEvicted(path);
+    if (restored < 0) {
+        return restored;
+    }
+    
+    // Files written through an open handle update their preview, directory
+    // digest and index once, on release, not on every chunk
+    bool deferred = false;
+    if (fi) {
+        std::lock_guard<std::mutex> open_lock(self->open_files_mutex_);
+        auto it = self->open_files_.find(fi->fh);
+        if (it != self->open_files_.end()) {
+            it->second.written = true;
+            deferred = true;
+        }
+    }
+    
     std::lock_guard<std::mutex> lock(self->mutex_);
     
-    std::string content_key = std::string("content:") + path;
+    std::string metadata_key = std::string("meta:") + path;
+    std::string metadata;
+    bool has_metadata = self->db_->get(metadata_key, metadata);
+    if (has_metadata && FileMetadata::hasFlag(metadata, "evicted")) {
+        return -EAGAIN;  // Evicted again before the write got the lock
+    }
+    
     std::string content;
     
-    if (!self->db_->get(content_key, content)) {
+    if (!self->content_->get(path, content)) {
         content = "";
     }
     
+    // Appends go to the end of the stored body. The kernel's offset comes
+    // from getattr, which reports 0 for files whose body was missing.
+    if (fi && (fi->flags & O_APPEND)) {
+        offset = content.size();
+    }
+    
     if (offset + size > content.length()) {
         content.resize(offset + size, '\0');
     }
     
     memcpy(&content[offset], buf, size);
     
-    self->db_->put(content_key, content);
+    // Modified content is the user's now and must never be evicted
+    std::vector<std::pair<std::string, std::string>> puts;
+    if (has_metadata && FileMetadata::hasFlag(metadata, "generated")) {
+        puts.emplace_back(metadata_key, FileMetadata::withoutFlag(metadata, "generated"));
+    }
+    
+    // Stored as a new blob, in the same batch as the flags; other paths
+    // sharing the old body keep it
+    if (!self->content_->write({{path, content}}, {}, puts, {}, !deferred)) {
+        return -EIO;
+    }
+    self->capacity_->recordStore(path, content.size(), false);
     
     // If this is a config file, clear the config cache
     if (isSpecialFile(path)) {
         std::string path_str(path);
         if (path_str.find(".simfs_config.toml") != std::string::npos) {
-            std::lock_guard<std::mutex> config_lock(self->config_mutex_);
-            self->config_cache_.clear();
-            std::cerr << "[INFO] Config cache cleared due to config file update: " << path << std::endl;
+            self->clearConfigCache();
+            LOG_INFO << "Config cache cleared due to config file update: " << path;
         }
     }
     
@@ -354,37 +1537,102 @@ int SimFS::write(const char *path, const char *buf, size_t size, off_t offset,
 
 int SimFS::create(const char *path, mode_t mode, struct fuse_file_info *fi) {
     (void) mode;
-    (void) fi;
+    
+    if (isStatsPath(path)) {
+        return -EACCES;
+    }
     
     SimFS* self = getInstance();
+    fi->fh = self->registerOpenFile(path, (fi->flags & O_ACCMODE) == O_RDONLY);
+    
+    // A read-only create of a missing file is a request for its content,
+    // not for an empty file
+    if ((fi->flags & O_ACCMODE) == O_RDONLY && !(fi->flags & O_TRUNC) &&
+        self->kickoffGeneration(path)) {
+        fi->direct_io = 1;
+        fi->nonseekable = 1;
+        return 0;
+    }
+    
     std::lock_guard<std::mutex> lock(self->mutex_);
     
     std::string metadata_key = std::string("meta:") + path;
-    std::string content_key = std::string("content:") + path;
     
     self->db_->put(metadata_key, "type:file");
-    self->db_->put(content_key, "");
+    self->content_->put(path, "");
+    self->capacity_->recordStore(path, 0, false);
     
     return 0;
 }
 
+ssize_t SimFS::copy_file_range(const char *path_in, struct fuse_file_info *fi_in, off_t offset_in,
+                               const char *path_out, struct fuse_file_info *fi_out, off_t offset_out,
+                               size_t size, int flags) {
+    (void) fi_in;
+    (void) fi_out;
+    (void) flags;
+    
+    if (isStatsPath(path_out)) {
+        return -EACCES;
+    }
+    
+    SimFS* self = getInstance();
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    
+    // Files that were never generated go through the regular read path
+    uint64_t size_in;
+    if (!self->content_->size(path_in, size_in)) {
+        return -EOPNOTSUPP;
+    }
+    if (offset_in >= static_cast<off_t>(size_in)) {
+        return 0;
+    }
+    
+    // Whole-file copies (what cp does) share the source body. Anything
+    // else falls back to the kernel's read/write copy.
+    uint64_t size_out = 0;
+    self->content_->size(path_out, size_out);
+    if (offset_in != 0 || offset_out != 0 || size < size_in || size_out > size_in) {
+        return -EOPNOTSUPP;
+    }
+    
+    // The copy is the user's content, so like write() it drops any
+    // generated or evicted flags in the same batch as the body
+    std::string metadata_key = std::string("meta:") + path_out;
+    std::string metadata;
+    if (self->db_->get(metadata_key, metadata)) {
+        metadata = FileMetadata::withoutFlag(FileMetadata::withoutFlag(metadata, "generated"), "evicted");
+    } else {
+        metadata = "type:file";
+    }
+    if (!self->content_->copy(path_in, path_out, {{metadata_key, metadata}})) {
+        return -EIO;
+    }
+    self->capacity_->recordStore(path_out, size_in, false);
+    
+    return size_in;
+}
+
 int SimFS::unlink(const char *path) {
+    if (isStatsPath(path)) {
+        return -EACCES;
+    }
+    
     SimFS* self = getInstance();
     std::lock_guard<std::mutex> lock(self->mutex_);
     
     std::string metadata_key = std::string("meta:") + path;
-    std::string content_key = std::string("content:") + path;
     
     self->db_->remove(metadata_key);
-    self->db_->remove(content_key);
+    self->content_->remove(path);
+    self->capacity_->recordRemove(path);
     
     // If this is a config file, clear the config cache
     if (isSpecialFile(path)) {
         std::string path_str(path);
         if (path_str.find(".simfs_config.toml") != std::string::npos) {
-            std::lock_guard<std::mutex> config_lock(self->config_mutex_);
-            self->config_cache_.clear();
-            std::cerr << "[INFO] Config cache cleared due to config file deletion: " << path << std::endl;
+            self->clearConfigCache();
+            LOG_INFO << "Config cache cleared due to config file deletion: " << path;
         }
     }
     
@@ -394,6 +1642,10 @@ int SimFS::unlink(const char *path) {
 int SimFS::mkdir(const char *path, mode_t mode) {
     (void) mode;
     
+    if (isStatsPath(path)) {
+        return -EACCES;
+    }
+    
     SimFS* self = getInstance();
     std::lock_guard<std::mutex> lock(self->mutex_);
     
@@ -404,6 +1656,10 @@ int SimFS::mkdir(const char *path, mode_t mode) {
 }
 
 int SimFS::rmdir(const char *path) {
+    if (isStatsPath(path)) {
+        return -EACCES;
+    }
+    
     SimFS* self = getInstance();
     std::lock_guard<std::mutex> lock(self->mutex_);
     
@@ -420,25 +1676,7 @@ std::string SimFS::generateContent(const std::string& path) {
     }
     
     std::string dir_path = path.substr(0, path.find_last_of('/'));
-    auto files = getDirectoryContents(dir_path);
-    
-    std::vector<FileContext> context_files;
-    for (const auto& file : files) {
-        std::string metadata_key = std::string("meta:") + file;
-        std::string metadata;
-        
-        if (db_->get(metadata_key, metadata) && metadata.find("type:file") != std::string::npos) {
-            std::string content_key = std::string("content:") + file;
-            std::string content;
-            
-            if (db_->get(content_key, content)) {
-                FileContext fc;
-                fc.path = file;
-                fc.content = content.substr(0, 200) + "...";
-                context_files.push_back(fc);
-            }
-        }
-    }
+    std::vector<FileContext> context_files = getFolderContext(dir_path);
     
     std::vector<std::string> recent_paths;
     {
@@ -460,7 +1698,15 @@ std::string SimFS::generateContent(const std::string& path) {
     DirectoryConfig config = getConfigForPath(path);
     
     try {
-        return llm_client_->generateFileContent(path, context_files, recent_files, config.model_name);
+        GenerationOptions options;
+        options.related_files = relatedFilesProvider(path, config.related_files, exclude_paths, recent_files);
+        options.prompt_token_budget = config.prompt_token_budget;
+        options.tokenizer = tokenizerFor(config);
+        options.affinity_key = dir_path;
+        ModelChoice choice = chooseModel(path, config);
+        options.max_tokens = choice.max_tokens;
+        options.temperature = choice.temperature;
+        return llm_client_->generateFileContent(path, context_files, recent_files, choice.model, options);
     } catch (const std::exception& e) {
         // If LLM generation fails, return a placeholder message
         return "Error generating content: " + std::string(e.what()) + "\n";
@@ -468,35 +1714,28 @@ std::string SimFS::generateContent(const std::string& path) {
 }
 
 std::string SimFS::getFileContent(const std::string& path) {
-    std::cerr << "[DEBUG] getFileContent called for: " << path << std::endl;
-    std::string content_key = std::string("content:") + path;
+    LOG_DEBUG.field("path", path) << "getFileContent";
     std::string content;
     
-    if (!db_->get(content_key, content)) {
+    if (!content_->get(path, content)) {
         // Never generate special files
         if (isSpecialFile(path)) {
-            std::cerr << "[DEBUG] Special file requested but not found: " << path << std::endl;
+            LOG_DEBUG << "Special file requested but not found: " << path;
             return "";
         }
         
-        std::cerr << "[DEBUG] Content not in DB, generating..." << std::endl;
+        LOG_DEBUG << "Content not in DB, generating...";
         content = generateContent(path);
-        std::cerr << "[DEBUG] Generated content length: " << content.length() << std::endl;
-        db_->put(content_key, content);
+        LOG_DEBUG << "Generated content length: " << content.length();
+        content_->put(path, content);
         
         std::string metadata_key = std::string("meta:") + path;
         db_->put(metadata_key, "type:file");
         
         // Add to recent access queue since we just generated it
-        {
-            std::lock_guard<std::mutex> recent_lock(recent_access_mutex);
-            recent_access_queue.push_back(path);
-            if (recent_access_queue.size() > MAX_RECENT_FILES) {
-                recent_access_queue.pop_front();
-            }
-        }
+        recordRecentAccess(path);
     } else {
-        std::cerr << "[DEBUG] Content found in DB, length: " << content.length() << std::endl;
+        LOG_DEBUG.field("path", path).field("bytes", content.length()) << "Content found in DB";
     }
     
     return content;
@@ -529,32 +1768,54 @@ std::vector<std::string> SimFS::getDirectoryContents(const std::string& path) {
     return contents;
 }
 
-std::string SimFS::getFolderContext(const std::string& path) {
-    std::stringstream context;
-    auto files = getDirectoryContents(path);
-    
-    std::vector<std::pair<std::string, std::string>> file_contents;
+std::vector<FileContext> SimFS::getFolderContext(const std::string& path) {
+    // A single lookup of the directory digest, however many and however
+    // large the sibling files are
+    DirectoryDigest digest;
+    content_->directoryDigest(path, digest);
     
-    for (const auto& file : files) {
-        std::string metadata_key = std::string("meta:") + file;
-        std::string metadata;
-        
-        if (db_->get(metadata_key, metadata) && metadata.find("type:file") != std::string::npos) {
-            std::string content_key = std::string("content:") + file;
-            std::string content;
-            
-            if (db_->get(content_key, content)) {
-                file_contents.push_back(std::make_pair(file, content));
-            }
+    std::vector<FileContext> context_files;
+    for (const auto& file : digest.files) {
+        if (isSpecialFile(file.first)) {
+            continue;
+        }
+        FileContext fc;
+        fc.path = file.first;
+        if (file.second.isText()) {
+            fc.content = file.second.head;  // LLMClient marks the cut
+        } else if (file.second.type != "empty") {
+            fc.content = "[" + file.second.type + " file, " + std::to_string(file.second.size) + " bytes]";
         }
+        context_files.push_back(fc);
     }
-    
-    return context.str();
+    return context_files;
 }
 
-DirectoryConfig SimFS::loadConfigFromDirectory(const std::string& dir_path) {
-    DirectoryConfig config;
+ModelChoice SimFS::chooseModel(const std::string& path, const DirectoryConfig& config) {
+    ModelChoice defaults;
+    defaults.model = config.model_name;
+    defaults.max_tokens = config.max_tokens;
+    defaults.temperature = config.temperature;
+    defaults.draft_model = config.draft_model;
+    if (config.routes.empty()) {
+        return defaults;
+    }
     
+    // Siblings of the same type are the best guess at how long the file gets
+    DirectoryDigest digest;
+    content_->directoryDigest(path.substr(0, path.find_last_of('/')), digest);
+    std::map<std::string, uint64_t> sibling_sizes;
+    for (const auto& file : digest.files) {
+        sibling_sizes[file.first] = file.second.size;
+    }
+    SizeClass size = ModelRouter::expectedSize(path, sibling_sizes);
+    ModelChoice choice = ModelRouter::route(path, size, config.routes, defaults);
+    LOG_DEBUG << "Routing " << path << " (" << ModelRouter::sizeClassName(size) << ") to "
+              << choice.model;
+    return choice;
+}
+
+void SimFS::loadConfigFromDirectory(const std::string& dir_path, DirectoryConfig& config) {
     // Construct the config file path
     std::string config_path;
     if (dir_path.empty() || dir_path == "/") {
@@ -567,55 +1828,153 @@ DirectoryConfig SimFS::loadConfigFromDirectory(const std::string& dir_path) {
         config_path += ".simfs_config.toml";
     }
     
-    std::cerr << "[DEBUG] Looking for config file: " << config_path << std::endl;
-    
     // Check if the config file exists in the virtual filesystem
-    std::string content_key = std::string("content:") + config_path;
     std::string config_content;
     
-    if (db_->get(content_key, config_content)) {
-        std::cerr << "[INFO] Found config file: " << config_path << " with content: " << config_content << std::endl;
-        // Parse the TOML content
+    if (content_->get(config_path, config_content)) {
+        LOG_DEBUG.field("path", config_path).field("bytes", config_content.size()) << "Found config file";
+        // Parse the TOML content; only settings present in the file override
+        // those inherited from parent directories
         try {
             auto table = toml::parse(config_content);
             
             // Read model name if present
             if (table.contains("model")) {
                 config.model_name = table["model"].value_or(config.model_name);
-                std::cerr << "[INFO] Loaded model from config: " << config.model_name << std::endl;
+                LOG_DEBUG.field("path", config_path) << "Loaded model from config: " << config.model_name;
+            }
+            
+            if (table.contains("max_tokens")) {
+                int64_t tokens = table["max_tokens"].value_or(int64_t(config.max_tokens));
+                config.max_tokens = tokens > 0 ? static_cast<size_t>(tokens) : config.max_tokens;
+            }
+            
+            if (table.contains("temperature")) {
+                config.temperature = table["temperature"].value_or(config.temperature);
+            }
+            
+            if (table.contains("draft_model")) {
+                config.draft_model = table["draft_model"].value_or(config.draft_model);
+            }
+            
+            if (table.contains("generate_on_open")) {
+                config.generate_on_open = table["generate_on_open"].value_or(config.generate_on_open);
+            }
+            
+            if (table.contains("related_files")) {
+                int64_t count = table["related_files"].value_or(int64_t(config.related_files));
+                config.related_files = count > 0 ? static_cast<size_t>(count) : 0;
             }
             
-            // Future: read other settings
-            // if (table.contains("temperature")) {
-            //     config.temperature = table["temperature"].value_or(config.temperature);
-            // }
+            if (table.contains("batch_generation")) {
+                config.batch_generation = table["batch_generation"].value_or(config.batch_generation);
+            }
+            
+            if (table.contains("batch_window_ms")) {
+                // The first file of a batch waits this long before anything is sent
+                int64_t window = table["batch_window_ms"].value_or(int64_t(config.batch_window_ms));
+                config.batch_window_ms = static_cast<unsigned>(std::clamp<int64_t>(window, 0, MAX_BATCH_WINDOW_MS));
+            }
+            
+            if (table.contains("batch_max_files")) {
+                int64_t files = table["batch_max_files"].value_or(int64_t(config.batch_max_files));
+                config.batch_max_files = files > 0 ? static_cast<size_t>(files) : 1;
+            }
+            
+            if (table.contains("tokenizer")) {
+                config.tokenizer = table["tokenizer"].value_or(config.tokenizer);
+            }
+            
+            if (table.contains("prompt_token_budget")) {
+                int64_t budget = table["prompt_token_budget"].value_or(int64_t(config.prompt_token_budget));
+                config.prompt_token_budget = budget > 0 ? static_cast<size_t>(budget) : 0;
+            }
+            
+            if (table.contains("use_default_generators")) {
+                config.use_default_generators = table["use_default_generators"].value_or(config.use_default_generators);
+            }
+            
+            // Rules closer to the file take precedence over inherited ones
+            if (auto rules = table["generators"].as_array()) {
+                std::vector<GeneratorRule> directory_rules;
+                for (auto& node : *rules) {
+                    auto rule_table = node.as_table();
+                    if (!rule_table) {
+                        continue;
+                    }
+                    GeneratorRule rule;
+                    rule.pattern = (*rule_table)["match"].value_or(std::string());
+                    rule.generator = (*rule_table)["generator"].value_or(std::string());
+                    if (rule.pattern.empty() || rule.generator.empty()) {
+                        LOG_WARNING << "Ignoring generator rule without match or generator in "
+                                  << config_path;
+                        continue;
+                    }
+                    for (auto&& [key, value] : *rule_table) {
+                        std::string name(key.str());
+                        if (name == "match" || name == "generator") {
+                            continue;
+                        }
+                        if (auto text = value.value<std::string>()) {
+                            rule.params[name] = *text;
+                        } else if (auto number = value.value<int64_t>()) {
+                            rule.params[name] = std::to_string(*number);
+                        }
+                    }
+                    directory_rules.push_back(rule);
+                }
+                config.generators.insert(config.generators.begin(), directory_rules.begin(), directory_rules.end());
+            }
+            
+            // Routes closer to the file take precedence too
+            if (auto routes = table["routes"].as_array()) {
+                std::vector<ModelRoute> directory_routes;
+                for (auto& node : *routes) {
+                    auto route_table = node.as_table();
+                    if (!route_table) {
+                        continue;
+                    }
+                    ModelRoute route;
+                    route.pattern = (*route_table)["match"].value_or(std::string());
+                    if (auto size = (*route_table)["size"].value<std::string>()) {
+                        route.size = ModelRouter::parseSizeClass(*size);
+                        if (!route.size) {
+                            LOG_WARNING << "Ignoring route with unknown size class '" << *size << "' in "
+                                      << config_path;
+                            continue;
+                        }
+                    }
+                    route.model = (*route_table)["model"].value<std::string>();
+                    if (auto tokens = (*route_table)["max_tokens"].value<int64_t>(); tokens && *tokens > 0) {
+                        route.max_tokens = static_cast<size_t>(*tokens);
+                    }
+                    route.temperature = (*route_table)["temperature"].value<double>();
+                    route.draft_model = (*route_table)["draft_model"].value<std::string>();
+                    directory_routes.push_back(route);
+                }
+                config.routes.insert(config.routes.begin(), directory_routes.begin(), directory_routes.end());
+            }
             
         } catch (const toml::parse_error& e) {
-            std::cerr << "[WARNING] Failed to parse config file " << config_path 
-                      << ": " << e.what() << std::endl;
+            LOG_WARNING << "Failed to parse config file " << config_path 
+                      << ": " << e.what();
         }
     } else {
-        std::cerr << "[DEBUG] No config file found at: " << config_path << std::endl;
+        LOG_DEBUG.field("path", config_path) << "No config file";
     }
-    
-    return config;
 }
 
 DirectoryConfig SimFS::getConfigForPath(const std::string& path) {
-    std::cerr << "[DEBUG] getConfigForPath called for: " << path << std::endl;
-    
     // Extract the directory from the path
     size_t last_slash = path.find_last_of('/');
     std::string dir_path = (last_slash != std::string::npos) ? path.substr(0, last_slash) : "";
     
-    std::cerr << "[DEBUG] Extracted directory path: " << dir_path << std::endl;
-    
     // Check cache first
     {
         std::lock_guard<std::mutex> lock(config_mutex_);
         auto it = config_cache_.find(dir_path);
         if (it != config_cache_.end()) {
-            std::cerr << "[DEBUG] Found config in cache for: " << dir_path << " with model: " << it->second.model_name << std::endl;
+            LOG_DEBUG.field("path", path).field("model", it->second.model_name) << "Config cache hit";
             return it->second;
         }
     }
@@ -642,23 +2001,14 @@ DirectoryConfig SimFS::getConfigForPath(const std::string& path) {
         }
     }
     
-    // Check each directory level for config, from root to target
+    // Apply each directory level from root to target, so the most specific
+    // config wins for every setting it defines
+    loadConfigFromDirectory("/", merged_config);
+    
     std::string current_path;
     for (const auto& component : dir_components) {
         current_path += "/" + component;
-        
-        DirectoryConfig dir_config = loadConfigFromDirectory(current_path);
-        // For now, just override with the most specific config
-        // In the future, we could merge settings more intelligently
-        if (dir_config.model_name != "meta-llama/Llama-3.2-3B-Instruct") {
-            merged_config = dir_config;
-        }
-    }
-    
-    // Also check the root directory
-    DirectoryConfig root_config = loadConfigFromDirectory("/");
-    if (merged_config.model_name == "meta-llama/Llama-3.2-3B-Instruct" && root_config.model_name != "meta-llama/Llama-3.2-3B-Instruct") {
-        merged_config = root_config;
+        loadConfigFromDirectory(current_path, merged_config);
     }
     
     // Cache the result
@@ -667,12 +2017,16 @@ DirectoryConfig SimFS::getConfigForPath(const std::string& path) {
         config_cache_[dir_path] = merged_config;
     }
     
-    std::cerr << "[DEBUG] Final config for path " << path << ": model=" << merged_config.model_name << std::endl;
+    LOG_DEBUG.field("path", path).field("model", merged_config.model_name) << "Resolved config";
     
     return merged_config;
 }
 
 bool SimFS::isSpecialFile(const std::string& path) {
+    if (isStatsPath(path)) {
+        return true;
+    }
+    
     // Extract filename from path
     size_t last_slash = path.find_last_of('/');
     std::string filename = (last_slash != std::string::npos) ? path.substr(last_slash + 1) : path;
@@ -702,14 +2056,6 @@ bool SimFS::isSpecialFile(const std::string& path) {
     return false;
 }
 
-std::string SimFS::getTailContent(const std::string& content, size_t max_chars) {
-    if (content.length() <= max_chars) {
-        return content;
-    }
-    // Return the last max_chars characters
-    return content.substr(content.length() - max_chars);
-}
-
 std::vector<FileContext> SimFS::getRecentFilesWithContent(
     const std::vector<std::string>& recent_paths,
     const std::vector<std::string>& exclude_paths) {
@@ -718,21 +2064,13 @@ std::vector<FileContext> SimFS::getRecentFilesWithContent(
     // Create a set for faster exclusion checking
     std::unordered_set<std::string> exclude_set(exclude_paths.begin(), exclude_paths.end());
     
-    // Constants for token management
-    const size_t CHARS_PER_TOKEN = 3;
-    const size_t MAX_TOKENS_PER_FILE = 1200;
-    const size_t MAX_CHARS_PER_FILE = MAX_TOKENS_PER_FILE * CHARS_PER_TOKEN; // 3600 chars
     const size_t MAX_RECENT_FILES = 6;
-    const size_t MAX_TOTAL_TOKENS = 8000;
-    const size_t MAX_TOTAL_CHARS = MAX_TOTAL_TOKENS * CHARS_PER_TOKEN; // 24000 chars
     
-    // Take up to the last 6 files
+    // Take up to the last 6 files; LLMClient trims them to the prompt budget
     size_t start_idx = (recent_paths.size() > MAX_RECENT_FILES) 
         ? recent_paths.size() - MAX_RECENT_FILES 
         : 0;
     
-    size_t total_chars = 0;
-    
     for (size_t i = start_idx; i < recent_paths.size(); ++i) {
         const std::string& path = recent_paths[i];
         
@@ -746,37 +2084,78 @@ std::vector<FileContext> SimFS::getRecentFilesWithContent(
             continue;
         }
         
-        std::string content_key = std::string("content:") + path;
-        std::string content;
+        // Previews keep the last FilePreview::TAIL_BYTES of every text file,
+        // so the full body is never loaded here
+        FilePreview preview;
         
-        if (db_->get(content_key, content)) {
-            // Get the tail of the content, up to max chars per file
-            std::string tail_content = getTailContent(content, MAX_CHARS_PER_FILE);
-            
-            // Check if adding this would exceed total limit
-            if (total_chars + tail_content.length() > MAX_TOTAL_CHARS) {
-                // Truncate to fit within total limit
-                size_t remaining_chars = MAX_TOTAL_CHARS - total_chars;
-                if (remaining_chars > 0) {
-                    tail_content = tail_content.substr(0, remaining_chars);
-                } else {
-                    break; // No more room
-                }
-            }
-            
+        if (content_->preview(path, preview) && preview.isText()) {
             FileContext fc;
             fc.path = path;
-            fc.content = tail_content;
+            fc.content = preview.tail;
             result.push_back(fc);
-            
-            total_chars += tail_content.length();
-            
-            // Stop if we've reached the total limit
-            if (total_chars >= MAX_TOTAL_CHARS) {
-                break;
-            }
         }
     }
     
     return result;
+}
+
+std::vector<FileContext> SimFS::getRelatedFiles(const std::string& path, size_t count,
+                                                const std::unordered_set<std::string>& exclude) {
+    // Best match last: LLMClient keeps the end of the list when the
+    // budget runs short. Snippets come from the previews, so no body is
+    // loaded; the index only holds text files.
+    std::vector<FileContext> files;
+    std::vector<ContextIndex::Hit> hits = content_->index().search(path, count, exclude);
+    for (auto it = hits.rbegin(); it != hits.rend(); ++it) {
+        FilePreview preview;
+        if (isSpecialFile(it->path) || !content_->preview(it->path, preview) || !preview.isText()) {
+            continue;
+        }
+        FileContext fc;
+        fc.path = it->path;
+        fc.content = ContextIndex::snippet(preview.tail, path, FilePreview::TAIL_BYTES);
+        files.push_back(fc);
+    }
+    return files;
+}
+
+std::function<std::vector<FileContext>()> SimFS::relatedFilesProvider(
+    const std::string& path, size_t count, const std::vector<std::string>& exclude_paths,
+    const std::vector<FileContext>& files) {
+    if (count == 0) {
+        return nullptr;
+    }
+    std::unordered_set<std::string> exclude(exclude_paths.begin(), exclude_paths.end());
+    for (const auto& file : files) {
+        exclude.insert(file.path);
+    }
+    // Searched on the LLMClient worker, outside mutex_; ~SimFS waits for
+    // the workers before content_ goes away
+    return [this, path, count, exclude]() {
+        return getRelatedFiles(path, count, exclude);
+    };
+}
+
+std::shared_ptr<const Tokenizer> SimFS::tokenizerFor(const DirectoryConfig& config) {
+    if (config.tokenizer.empty()) {
+        return nullptr;
+    }
+    
+    std::lock_guard<std::mutex> lock(tokenizers_mutex_);
+    auto it = tokenizers_.find(config.tokenizer);
+    if (it != tokenizers_.end()) {
+        return it->second;
+    }
+    
+    // Failures are cached too, so a bad path is reported once and prompts
+    // fall back to estimated counts
+    std::shared_ptr<const Tokenizer> tokenizer;
+    try {
+        tokenizer = Tokenizer::load(config.tokenizer);
+        LOG_INFO << "Loaded tokenizer: " << config.tokenizer;
+    } catch (const std::exception& e) {
+        LOG_WARNING << e.what() << "; estimating prompt tokens";
+    }
+    tokenizers_[config.tokenizer] = tokenizer;
+    return tokenizer;
 }
\ No newline at end of file
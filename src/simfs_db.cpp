@@ -0,0 +1,127 @@
+// simfs-db: database maintenance for SimFS worlds.
+//
+//   simfs-db export --db-path=DB --subtree=/path --output=DIR [--rebase=/new]
+//   simfs-db import --db-path=DB --input=DIR [--move]
+//   simfs-db checkpoint --db-path=DB --output=DIR
+//   simfs-db dedup --db-path=DB
+
+#include "db_manager.h"
+#include "world_archive.h"
+#include "content_store.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " <command> [options]\n";
+    std::cerr << "\nCommands:\n";
+    std::cerr << "  export               Write a subtree to sorted SST files\n";
+    std::cerr << "  import               Ingest an exported subtree\n";
+    std::cerr << "  checkpoint           Hard-link a consistent copy, e.g. as a base for --base-db\n";
+    std::cerr << "  dedup                Move file bodies stored inline (older or imported data) into shared blobs\n";
+    std::cerr << "\nOptions:\n";
+    std::cerr << "  --db-path=PATH       Path to RocksDB database (default: ./simfs.db)\n";
+    std::cerr << "  --base-db=PATH       Read-only baseline layered under --db-path\n";
+    std::cerr << "  --subtree=PATH       export: subtree to export (default: /)\n";
+    std::cerr << "  --output=DIR         export: new or empty archive directory; checkpoint: new directory\n";
+    std::cerr << "  --rebase=PATH        export: store the subtree under PATH instead\n";
+    std::cerr << "  --max-file-size=MB   export: size of each SST file (default: 256)\n";
+    std::cerr << "  --input=DIR          import: archive directory\n";
+    std::cerr << "  --move               import: move SST files into the database instead of copying\n";
+    std::cerr << "  -h                   Print this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string command(argv[1]);
+    std::string db_path = "./simfs.db";
+    std::string base_db_path;
+    std::string subtree = "/";
+    std::string output_dir;
+    std::string rebase_to;
+    std::string input_dir;
+    uint64_t max_file_size = WorldArchive::DEFAULT_MAX_FILE_SIZE;
+    bool move_files = false;
+
+    if (command == "-h" || command == "--help") {
+        print_usage(argv[0]);
+        return 0;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if (arg.find("--db-path=") == 0) {
+            db_path = arg.substr(10);
+        } else if (arg.find("--base-db=") == 0) {
+            base_db_path = arg.substr(10);
+        } else if (arg.find("--subtree=") == 0) {
+            subtree = arg.substr(10);
+        } else if (arg.find("--output=") == 0) {
+            output_dir = arg.substr(9);
+        } else if (arg.find("--rebase=") == 0) {
+            rebase_to = arg.substr(9);
+        } else if (arg.find("--max-file-size=") == 0) {
+            max_file_size = std::strtoull(arg.substr(16).c_str(), nullptr, 10) << 20;
+        } else if (arg.find("--input=") == 0) {
+            input_dir = arg.substr(8);
+        } else if (arg == "--move") {
+            move_files = true;
+        } else {
+            std::cerr << "Error: Unknown option " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    try {
+        if (command == "export") {
+            if (output_dir.empty() || max_file_size == 0) {
+                std::cerr << "Error: export requires --output and a non-zero --max-file-size\n";
+                return 1;
+            }
+            DBManager db(db_path, base_db_path);
+            ArchiveStats stats = WorldArchive::exportSubtree(db, subtree, output_dir, rebase_to, max_file_size);
+            std::cout << "Exported " << stats.entries << " keys (" << stats.bytes << " bytes) in "
+                      << stats.sst_files << " SST files as " << stats.root << "\n";
+        } else if (command == "import") {
+            if (input_dir.empty()) {
+                std::cerr << "Error: import requires --input\n";
+                return 1;
+            }
+            DBManager db(db_path, base_db_path);
+            ArchiveStats stats = WorldArchive::importArchive(db, input_dir, move_files);
+            std::cout << "Imported " << stats.entries << " keys from " << stats.sst_files
+                      << " SST files into " << stats.root << "\n";
+        } else if (command == "checkpoint") {
+            if (output_dir.empty()) {
+                std::cerr << "Error: checkpoint requires --output\n";
+                return 1;
+            }
+            DBManager db(db_path, base_db_path);
+            if (!db.createCheckpoint(output_dir)) {
+                std::cerr << "Error: Failed to create checkpoint in " << output_dir << "\n";
+                return 1;
+            }
+            std::cout << "Checkpoint created in " << output_dir << "\n";
+        } else if (command == "dedup") {
+            DBManager db(db_path, base_db_path);
+            ContentStore content(db);
+            size_t converted = content.deduplicate();
+            std::cout << "Converted " << converted << " files to shared blobs\n";
+        } else {
+            std::cerr << "Error: Unknown command " << command << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
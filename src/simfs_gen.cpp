@@ -0,0 +1,315 @@
+// simfs-gen: fills a SimFS database offline, without mounting.
+//
+// Paths come from a manifest (one path per line), tree patterns with brace
+// expansion, or a glob over files whose metadata exists but whose content
+// has not been generated yet. Already generated paths are skipped, so an
+// interrupted run can simply be restarted.
+
+#include "simfs.h"
+#include "mount_config.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <fnmatch.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static std::atomic<bool> interrupted{false};
+
+static void handleSignal(int) {
+    interrupted = true;
+}
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [options]\n";
+    std::cerr << "\nPath sources (at least one required):\n";
+    std::cerr << "  --manifest=FILE      File with one path or tree pattern per line\n";
+    std::cerr << "  --tree=PATTERN       Tree pattern with brace expansion, e.g. /src/{core,net}/file{1..3}.c\n";
+    std::cerr << "  --glob=PATTERN       Existing files without generated content matching PATTERN\n";
+    std::cerr << "\nOptions:\n";
+    std::cerr << "  --db-path=PATH       Path to RocksDB database (default: ./simfs.db)\n";
+    std::cerr << "  --base-db=PATH       Read-only baseline layered under --db-path\n";
+    std::cerr << "  --llm-endpoint=URL   LLM API endpoint (default: https://api.openai.com/v1/chat/completions)\n";
+    std::cerr << "  --config=PATH        Mount-wide TOML config\n";
+    std::cerr << "  --concurrency=N      Generations in flight (default: 4)\n";
+    std::cerr << "  --batch-size=N       Files per database write batch (default: 32)\n";
+    std::cerr << "  -h                   Print this help message\n";
+}
+
+// Expands {a,b,c} alternatives and {1..10} ranges (zero padded if the
+// start is, e.g. {01..10}). Nested braces are supported.
+static void expandBraces(const std::string& pattern, std::vector<std::string>& out) {
+    size_t open = pattern.find('{');
+    if (open == std::string::npos) {
+        out.push_back(pattern);
+        return;
+    }
+
+    int depth = 0;
+    size_t close = std::string::npos;
+    std::vector<size_t> commas;
+    for (size_t i = open; i < pattern.size(); i++) {
+        if (pattern[i] == '{') {
+            depth++;
+        } else if (pattern[i] == '}') {
+            if (--depth == 0) {
+                close = i;
+                break;
+            }
+        } else if (pattern[i] == ',' && depth == 1) {
+            commas.push_back(i);
+        }
+    }
+    if (close == std::string::npos) {
+        out.push_back(pattern);
+        return;
+    }
+
+    std::string prefix = pattern.substr(0, open);
+    std::string suffix = pattern.substr(close + 1);
+    std::string body = pattern.substr(open + 1, close - open - 1);
+
+    std::vector<std::string> alternatives;
+    size_t range = body.find("..");
+    if (commas.empty() && range != std::string::npos) {
+        std::string first = body.substr(0, range);
+        std::string last = body.substr(range + 2);
+        try {
+            long from = std::stol(first);
+            long to = std::stol(last);
+            size_t width = (first.size() > 1 && first[0] == '0') ? first.size() : 0;
+            for (long n = from; from <= to ? n <= to : n >= to; n += (from <= to ? 1 : -1)) {
+                std::string number = std::to_string(n);
+                if (number.size() < width) {
+                    number.insert(0, width - number.size(), '0');
+                }
+                alternatives.push_back(number);
+            }
+        } catch (const std::exception&) {
+            alternatives.push_back(body);
+        }
+    } else {
+        size_t start = 0;
+        for (size_t comma : commas) {
+            alternatives.push_back(pattern.substr(open + 1 + start, comma - open - 1 - start));
+            start = comma - open;
+        }
+        alternatives.push_back(body.substr(start));
+    }
+
+    for (const auto& alternative : alternatives) {
+        expandBraces(prefix + alternative + suffix, out);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string db_path = "./simfs.db";
+    std::string llm_endpoint = "https://api.openai.com/v1/chat/completions";
+    std::string config_path;
+    std::string base_db_path;
+    std::vector<std::string> manifests;
+    std::vector<std::string> trees;
+    std::vector<std::string> globs;
+    size_t concurrency = 4;
+    size_t batch_size = 32;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if (arg.find("--db-path=") == 0) {
+            db_path = arg.substr(10);
+        } else if (arg.find("--llm-endpoint=") == 0) {
+            llm_endpoint = arg.substr(15);
+        } else if (arg.find("--config=") == 0) {
+            config_path = arg.substr(9);
+        } else if (arg.find("--base-db=") == 0) {
+            base_db_path = arg.substr(10);
+        } else if (arg.find("--manifest=") == 0) {
+            manifests.push_back(arg.substr(11));
+        } else if (arg.find("--tree=") == 0) {
+            trees.push_back(arg.substr(7));
+        } else if (arg.find("--glob=") == 0) {
+            globs.push_back(arg.substr(7));
+        } else if (arg.find("--concurrency=") == 0) {
+            concurrency = std::max(1, std::atoi(arg.substr(14).c_str()));
+        } else if (arg.find("--batch-size=") == 0) {
+            batch_size = std::max(1, std::atoi(arg.substr(13).c_str()));
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Error: Unknown option " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (manifests.empty() && trees.empty() && globs.empty()) {
+        std::cerr << "Error: No paths specified\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (llm_endpoint.find("openai.com") != std::string::npos && !std::getenv("OPENAI_API_KEY")) {
+        std::cerr << "Error: OPENAI_API_KEY environment variable not set\n";
+        return 1;
+    }
+
+    try {
+        MountConfig mount_config;
+        if (!config_path.empty()) {
+            mount_config = MountConfig::loadFromFile(config_path);
+        }
+
+        SimFS simfs(db_path, llm_endpoint, mount_config, base_db_path);
+        SimFS::setInstance(&simfs);
+
+        // Collect paths in manifest order, skipping duplicates
+        std::vector<std::string> patterns = trees;
+        for (const auto& manifest : manifests) {
+            std::ifstream file(manifest);
+            if (!file) {
+                std::cerr << "Error: Cannot open manifest " << manifest << "\n";
+                return 1;
+            }
+            std::string line;
+            while (std::getline(file, line)) {
+                line.erase(0, line.find_first_not_of(" \t"));
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if (!line.empty() && line[0] != '#') {
+                    patterns.push_back(line);
+                }
+            }
+        }
+
+        std::vector<std::string> paths;
+        for (const auto& pattern : patterns) {
+            expandBraces(pattern, paths);
+        }
+        if (!globs.empty()) {
+            for (const auto& path : simfs.listUngeneratedFiles()) {
+                for (const auto& glob : globs) {
+                    if (fnmatch(glob.c_str(), path.c_str(), 0) == 0) {
+                        paths.push_back(path);
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::deque<std::string> pending;
+        std::unordered_set<std::string> seen;
+        size_t skipped = 0;
+        for (const auto& path : paths) {
+            if (path.empty() || path[0] != '/' || !seen.insert(path).second) {
+                continue;
+            }
+            if (SimFS::isSpecialFile(path)) {
+                std::cerr << "Skipping " << path << ": config and /.simfs files are never generated\n";
+                continue;
+            }
+            if (simfs.hasContent(path)) {
+                skipped++;  // Generated by an earlier run
+                continue;
+            }
+            pending.push_back(path);
+        }
+
+        std::cout << "simfs-gen: " << pending.size() << " files to generate, "
+                  << skipped << " already present\n";
+
+        std::signal(SIGINT, handleSignal);
+        std::signal(SIGTERM, handleSignal);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::pair<std::string, std::string>> completed;
+        std::vector<std::string> failed_paths;
+        size_t in_flight = 0;
+        size_t stored_locally = 0;  // Not yet counted in generated
+        size_t generated = 0;
+        size_t failed = 0;
+        size_t total = pending.size();
+
+        auto flush = [&](std::vector<std::pair<std::string, std::string>>& batch) {
+            if (batch.empty()) {
+                return;
+            }
+            if (!simfs.storeGeneratedFiles(batch)) {
+                std::cerr << "Error: Failed to write batch of " << batch.size() << " files\n";
+                failed += batch.size();
+            } else {
+                generated += batch.size();
+            }
+            batch.clear();
+            std::cerr << "[simfs-gen] " << generated << "/" << total << " generated, "
+                      << failed << " failed\n";
+        };
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while ((!pending.empty() && !interrupted) || in_flight > 0) {
+            // Keep up to `concurrency` generations running
+            while (!interrupted && !pending.empty() && in_flight < concurrency) {
+                std::string path = pending.front();
+                pending.pop_front();
+                in_flight++;
+
+                lock.unlock();
+                bool stored = false;
+                auto buffer = simfs.startOfflineGeneration(path, &stored);
+                buffer->onComplete([&, path, stored](const StreamingBuffer& result) {
+                    std::lock_guard<std::mutex> done_lock(mutex);
+                    // Locally generated files are already stored (and may
+                    // legitimately be empty)
+                    if (stored) {
+                        stored_locally++;
+                    } else if (result.hasError() || result.getTotalSize() == 0) {
+                        failed_paths.push_back(path + ": " + (result.hasError() ? result.getError() : "empty response"));
+                    } else {
+                        completed.emplace_back(path, result.getContent());
+                    }
+                    in_flight--;
+                    cv.notify_all();
+                });
+                lock.lock();
+            }
+
+            cv.wait_for(lock, std::chrono::milliseconds(500));
+
+            for (const auto& failure : failed_paths) {
+                std::cerr << "Error: Generation failed for " << failure << "\n";
+            }
+            failed += failed_paths.size();
+            failed_paths.clear();
+            generated += stored_locally;
+            stored_locally = 0;
+
+            if (completed.size() >= batch_size || (in_flight == 0 && !completed.empty())) {
+                std::vector<std::pair<std::string, std::string>> batch;
+                batch.swap(completed);
+                lock.unlock();
+                flush(batch);
+                lock.lock();
+            }
+        }
+
+        std::cout << "simfs-gen: generated " << generated << ", failed " << failed
+                  << ", remaining " << pending.size() << "\n";
+        if (interrupted) {
+            std::cout << "Interrupted; rerun the same command to resume\n";
+        }
+
+        return (failed > 0 || interrupted) ? 1 : 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
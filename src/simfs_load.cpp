@@ -0,0 +1,330 @@
+// simfs-load: end-to-end load generator. Mounts SimFS against an in-process
+// mock backend (or attaches to an existing mount), runs a synthetic workload
+// or replays a recorded access trace, and prints ops/sec, p50/p99/p999
+// latencies and generation counts as JSON.
+//
+//   simfs-load --workload=herd --threads=32 --ops=20
+//   simfs-load --replay=access.trace --speed=2 --output=replay.json
+//   simfs-load --workload=ls-storm --mountpoint=/mnt/sim --dir=/
+#include "load_generator.h"
+#include "mock_backend.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::json;
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [options]\n";
+    std::cerr << "\nWorkload:\n";
+    std::cerr << "  --workload=NAME         ls-storm, herd, distinct, writes or mixed\n";
+    std::cerr << "  --replay=TRACE          Replay an access trace recorded with [tracing] access_trace\n";
+    std::cerr << "  --speed=F               Replay time scale; 2 is twice as fast (default: 1)\n";
+    std::cerr << "  --threads=N             Concurrent clients (default: 8)\n";
+    std::cerr << "  --ops=N                 Walks, rounds, files or visits, per workload (default: 100)\n";
+    std::cerr << "  --dir=PATH              Directory in the mount to work in (default: /load)\n";
+    std::cerr << "  --file-size=BYTES       writes: size of each file (default: 1048576)\n";
+    std::cerr << "  --block-size=BYTES      writes: size of each write (default: 131072)\n";
+    std::cerr << "  --dirs=N                mixed: directories (default: 16)\n";
+    std::cerr << "  --files-per-dir=N       mixed: files in each (default: 32)\n";
+    std::cerr << "  --fanout=N              mixed: stats per directory visit (default: 8)\n";
+    std::cerr << "  --populated=F           mixed: fraction of files stored up front (default: 0.5)\n";
+    std::cerr << "  --seed=N                Seed for file choices and the backend (default: 1)\n";
+    std::cerr << "\nMount:\n";
+    std::cerr << "  --mountpoint=PATH       Use an existing mount instead of starting SimFS\n";
+    std::cerr << "  --simfs=PATH            SimFS binary to mount (default: ./simfs)\n";
+    std::cerr << "  --db-path=PATH          Database for the mount (default: a fresh temporary one)\n";
+    std::cerr << "  --config=PATH           Mount configuration file\n";
+    std::cerr << "\nBackend (when mounting):\n";
+    std::cerr << "  --ttft=DIST             Time to first token in ms (default: fixed:200)\n";
+    std::cerr << "  --tokens-per-second=N   Token rate of each stream (default: 50)\n";
+    std::cerr << "  --tokens=N              Completion length in tokens (default: 200)\n";
+    std::cerr << "  --error-rate=F          Fraction of requests failed with a 500\n";
+    std::cerr << "  --throttle-rate=F       Fraction of requests refused with a 429\n";
+    std::cerr << "  --max-concurrency=N     Completions served at once, 429 beyond\n";
+    std::cerr << "\nOutput:\n";
+    std::cerr << "  --output=PATH           Write the JSON report here instead of stdout\n";
+    std::cerr << "  -h                      Print this help message\n";
+}
+
+// Key/value lines of /.simfs/stats; empty if the mount has none
+static std::map<std::string, double> readStats(const std::string& mountpoint) {
+    std::map<std::string, double> stats;
+    std::ifstream file(mountpoint + "/.simfs/stats");
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        try {
+            stats[line.substr(0, eq)] = std::stod(line.substr(eq + 1));
+        } catch (const std::exception&) {
+        }
+    }
+    return stats;
+}
+
+static std::vector<AccessRecord> loadTrace(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open trace " + path);
+    }
+    std::vector<AccessRecord> records;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        AccessRecord record;
+        if (!AccessRecord::parse(line, record)) {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": not an access record");
+        }
+        records.push_back(std::move(record));
+    }
+    return records;
+}
+
+// A SimFS process mounted in the foreground on a temporary directory
+class Mount {
+public:
+    Mount(const std::string& simfs, const std::string& endpoint, std::string db_path, const std::string& config) {
+        char dir_template[] = "/tmp/simfs-load-XXXXXX";
+        if (!mkdtemp(dir_template)) {
+            throw std::runtime_error("Cannot create a temporary directory");
+        }
+        work_dir_ = dir_template;
+        mountpoint_ = work_dir_ + "/mnt";
+        mkdir(mountpoint_.c_str(), 0755);
+        if (db_path.empty()) {
+            db_path = work_dir_ + "/simfs.db";
+            temp_db_ = db_path;
+        }
+
+        struct stat before;
+        stat(mountpoint_.c_str(), &before);
+
+        std::vector<std::string> args = {simfs, "-f", mountpoint_, "--db-path=" + db_path,
+                                         "--llm-endpoint=" + endpoint};
+        if (!config.empty()) {
+            args.push_back("--config=" + config);
+        }
+        pid_ = fork();
+        if (pid_ == 0) {
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            std::cerr << "Error: cannot run " << simfs << ": " << strerror(errno) << "\n";
+            _exit(127);
+        }
+        if (pid_ < 0) {
+            throw std::runtime_error("fork failed");
+        }
+
+        // Mounted once the mountpoint reports another device
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (std::chrono::steady_clock::now() < deadline) {
+            struct stat st;
+            if (stat(mountpoint_.c_str(), &st) == 0 && st.st_dev != before.st_dev) {
+                return;
+            }
+            int status;
+            if (waitpid(pid_, &status, WNOHANG) == pid_) {
+                pid_ = -1;
+                unmount();
+                throw std::runtime_error(simfs + " exited before mounting");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        unmount();
+        throw std::runtime_error("Timed out waiting for " + mountpoint_ + " to mount");
+    }
+
+    ~Mount() { unmount(); }
+
+    const std::string& mountpoint() const { return mountpoint_; }
+
+private:
+    void unmount() {
+        if (pid_ > 0) {
+            std::string command = "fusermount3 -u " + mountpoint_ + " 2>/dev/null";
+            if (std::system(command.c_str()) != 0) {
+                kill(pid_, SIGTERM);
+            }
+            int status;
+            waitpid(pid_, &status, 0);
+            pid_ = -1;
+        }
+        rmdir(mountpoint_.c_str());
+        if (!temp_db_.empty()) {
+            std::error_code ec;
+            std::filesystem::remove_all(temp_db_, ec);
+        }
+        rmdir(work_dir_.c_str());
+    }
+
+    std::string work_dir_;
+    std::string mountpoint_;
+    std::string temp_db_;  // Set when no --db-path was given
+    pid_t pid_ = -1;
+};
+
+int main(int argc, char *argv[]) {
+    LoadConfig config;
+    MockBackendConfig backend_config;
+    std::string trace_path;
+    std::string mountpoint;
+    std::string simfs = "./simfs";
+    std::string db_path;
+    std::string config_path;
+    std::string output_path;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+
+            if (arg.find("--workload=") == 0) {
+                config.workload = arg.substr(11);
+            } else if (arg.find("--replay=") == 0) {
+                config.workload = "replay";
+                trace_path = arg.substr(9);
+            } else if (arg.find("--speed=") == 0) {
+                config.speed = std::stod(arg.substr(8));
+            } else if (arg.find("--threads=") == 0) {
+                config.threads = std::stoul(arg.substr(10));
+            } else if (arg.find("--ops=") == 0) {
+                config.ops = std::stoul(arg.substr(6));
+            } else if (arg.find("--dir=") == 0) {
+                config.dir = arg.substr(6);
+            } else if (arg.find("--file-size=") == 0) {
+                config.file_size = std::stoul(arg.substr(12));
+            } else if (arg.find("--block-size=") == 0) {
+                config.block_size = std::stoul(arg.substr(13));
+            } else if (arg.find("--dirs=") == 0) {
+                config.dirs = std::stoul(arg.substr(7));
+            } else if (arg.find("--files-per-dir=") == 0) {
+                config.files_per_dir = std::stoul(arg.substr(16));
+            } else if (arg.find("--fanout=") == 0) {
+                config.fanout = std::stoul(arg.substr(9));
+            } else if (arg.find("--populated=") == 0) {
+                config.populated = std::stod(arg.substr(12));
+            } else if (arg.find("--seed=") == 0) {
+                config.seed = std::stoull(arg.substr(7));
+                backend_config.seed = config.seed;
+            } else if (arg.find("--mountpoint=") == 0) {
+                mountpoint = arg.substr(13);
+            } else if (arg.find("--simfs=") == 0) {
+                simfs = arg.substr(8);
+            } else if (arg.find("--db-path=") == 0) {
+                db_path = arg.substr(10);
+            } else if (arg.find("--config=") == 0) {
+                config_path = arg.substr(9);
+            } else if (arg.find("--ttft=") == 0) {
+                backend_config.ttft = LatencyDistribution::parse(arg.substr(7));
+            } else if (arg.find("--tokens-per-second=") == 0) {
+                backend_config.tokens_per_second = std::stod(arg.substr(20));
+            } else if (arg.find("--tokens=") == 0) {
+                backend_config.response_tokens = std::stoul(arg.substr(9));
+            } else if (arg.find("--error-rate=") == 0) {
+                backend_config.error_rate = std::stod(arg.substr(13));
+            } else if (arg.find("--throttle-rate=") == 0) {
+                backend_config.throttle_rate = std::stod(arg.substr(16));
+            } else if (arg.find("--max-concurrency=") == 0) {
+                backend_config.max_concurrency = std::stoul(arg.substr(18));
+            } else if (arg.find("--output=") == 0) {
+                output_path = arg.substr(9);
+            } else if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Error: Unknown option " << arg << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (config.workload.empty()) {
+        std::cerr << "Error: --workload or --replay is required\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        if (!trace_path.empty()) {
+            config.trace = loadTrace(trace_path);
+        }
+
+        // Only started when mounting; an existing mount has its own backend
+        std::unique_ptr<MockBackend> backend;
+        std::unique_ptr<Mount> mount;
+        if (mountpoint.empty()) {
+            backend.reset(new MockBackend(backend_config));
+            mount.reset(new Mount(simfs, backend->url(), db_path, config_path));
+            mountpoint = mount->mountpoint();
+            std::cerr << "Mounted " << simfs << " at " << mountpoint << " against " << backend->url() << "\n";
+        }
+
+        LoadGenerator generator(mountpoint, config);
+        generator.setup();
+        std::map<std::string, double> before = readStats(mountpoint);
+        LoadResult result = generator.run();
+        std::map<std::string, double> after = readStats(mountpoint);
+
+        json report = json::parse(result.toJson(config));
+        json simfs_stats = json::object();
+        for (const char* key : {"generation.requests", "generation.failures", "read.cache_hits",
+                                "read.cache_misses", "read.stream_joins"}) {
+            if (after.count(key)) {
+                simfs_stats[key] = after[key] - before[key];
+            }
+        }
+        report["simfs"] = simfs_stats;
+        if (backend) {
+            MockBackendStats stats = backend->stats();
+            report["backend"] = {{"requests", stats.requests},
+                                 {"completed", stats.completed},
+                                 {"throttled", stats.throttled},
+                                 {"errors", stats.errors},
+                                 {"tokens", stats.tokens},
+                                 {"peak_in_flight", stats.peak_in_flight}};
+        }
+        mount.reset();
+
+        if (output_path.empty()) {
+            std::cout << report.dump(2) << std::endl;
+        } else {
+            std::ofstream output(output_path);
+            output << report.dump(2) << "\n";
+            if (!output) {
+                throw std::runtime_error("Cannot write " + output_path);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
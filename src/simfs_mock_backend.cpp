@@ -0,0 +1,102 @@
+// simfs-mock-backend: a local OpenAI-compatible completions server with
+// configurable latency, token rate and failures, so SimFS can be tested
+// and load tested without a network or an API key.
+//
+//   simfs-mock-backend --port=8000 --ttft=lognormal:300:150 --tokens-per-second=40 &
+//   simfs /mnt/sim --llm-endpoint=http://127.0.0.1:8000/v1/chat/completions
+
+#include "mock_backend.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [options]\n";
+    std::cerr << "\nOptions:\n";
+    std::cerr << "  --address=ADDR          Address to listen on (default: 127.0.0.1)\n";
+    std::cerr << "  --port=N                Port to listen on; 0 picks one (default: 8000)\n";
+    std::cerr << "  --ttft=DIST             Time to first token in ms (default: fixed:200)\n";
+    std::cerr << "  --tokens-per-second=N   Token rate of each stream (default: 50)\n";
+    std::cerr << "  --token-jitter=F        Relative deviation of the gaps between tokens (default: 0)\n";
+    std::cerr << "  --tokens=N              Completion length in tokens (default: 200)\n";
+    std::cerr << "  --error-rate=F          Fraction of requests failed with a 500\n";
+    std::cerr << "  --throttle-rate=F       Fraction of requests refused with a 429\n";
+    std::cerr << "  --disconnect-rate=F     Fraction of streams cut halfway\n";
+    std::cerr << "  --retry-after=SECONDS   Retry-After sent with 429s (default: 1)\n";
+    std::cerr << "  --max-concurrency=N     Completions served at once, 429 beyond (default: no limit)\n";
+    std::cerr << "  --seed=N                Seed for latency and failure draws (default: 1)\n";
+    std::cerr << "  -h                      Print this help message\n";
+    std::cerr << "\nDIST is fixed:MS, uniform:MEAN:HALF_WIDTH, normal:MEAN:STDDEV or\n";
+    std::cerr << "lognormal:MEAN:STDDEV. Counters are served as JSON at GET /stats and\n";
+    std::cerr << "printed on exit.\n";
+}
+
+int main(int argc, char *argv[]) {
+    MockBackendConfig config;
+    config.port = 8000;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+
+            if (arg.find("--address=") == 0) {
+                config.address = arg.substr(10);
+            } else if (arg.find("--port=") == 0) {
+                config.port = static_cast<uint16_t>(std::stoul(arg.substr(7)));
+            } else if (arg.find("--ttft=") == 0) {
+                config.ttft = LatencyDistribution::parse(arg.substr(7));
+            } else if (arg.find("--tokens-per-second=") == 0) {
+                config.tokens_per_second = std::stod(arg.substr(20));
+            } else if (arg.find("--token-jitter=") == 0) {
+                config.token_jitter = std::stod(arg.substr(15));
+            } else if (arg.find("--tokens=") == 0) {
+                config.response_tokens = std::stoul(arg.substr(9));
+            } else if (arg.find("--error-rate=") == 0) {
+                config.error_rate = std::stod(arg.substr(13));
+            } else if (arg.find("--throttle-rate=") == 0) {
+                config.throttle_rate = std::stod(arg.substr(16));
+            } else if (arg.find("--disconnect-rate=") == 0) {
+                config.disconnect_rate = std::stod(arg.substr(18));
+            } else if (arg.find("--retry-after=") == 0) {
+                config.retry_after_seconds = std::stoul(arg.substr(14));
+            } else if (arg.find("--max-concurrency=") == 0) {
+                config.max_concurrency = std::stoul(arg.substr(18));
+            } else if (arg.find("--seed=") == 0) {
+                config.seed = std::stoull(arg.substr(7));
+            } else if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Error: Unknown option " << arg << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    // Blocked before the server threads start, so they inherit the mask and
+    // only sigwait below sees these
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        MockBackend backend(config);
+        std::cerr << "Serving " << backend.url() << "\n";
+
+        int signum;
+        sigwait(&signals, &signum);
+        std::cout << backend.formatStats() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,334 @@
+#include "tokenizer.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+static const uint32_t NO_RANK = std::numeric_limits<uint32_t>::max();
+
+static bool isLetter(unsigned char c) {
+    // Non-ASCII (every byte of a UTF-8 sequence) counts as a letter
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+static bool isDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool isSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool isNewline(unsigned char c) {
+    return c == '\n' || c == '\r';
+}
+
+static bool isOther(unsigned char c) {
+    return !isSpace(c) && !isLetter(c) && !isDigit(c);
+}
+
+static std::string decodeBase64(const std::string& input) {
+    static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : input) {
+        if (c == '=') {
+            break;
+        }
+        size_t value = alphabet.find(c);
+        if (value == std::string::npos) {
+            throw std::runtime_error("invalid base64 token");
+        }
+        buffer = (buffer << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xff);
+        }
+    }
+    return out;
+}
+
+Tokenizer::Tokenizer() {
+}
+
+std::shared_ptr<const Tokenizer> Tokenizer::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open tokenizer file " + path);
+    }
+    std::stringstream data;
+    data << file.rdbuf();
+
+    auto tokenizer = std::make_shared<Tokenizer>();
+    std::string contents = data.str();
+    size_t first = contents.find_first_not_of(" \t\r\n");
+    try {
+        if (first != std::string::npos && contents[first] == '{') {
+            tokenizer->loadHuggingFace(contents);
+        } else {
+            tokenizer->loadTiktoken(contents);
+        }
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Failed to load tokenizer " + path + ": " + e.what());
+    }
+
+    // Every byte must be encodable on its own
+    for (int byte = 0; byte < 256; byte++) {
+        if (!tokenizer->ranks_.count(std::string(1, static_cast<char>(byte)))) {
+            throw std::runtime_error("Tokenizer " + path + " is not a byte-level BPE vocabulary");
+        }
+    }
+    return tokenizer;
+}
+
+void Tokenizer::addRank(const std::string& token, uint32_t rank) {
+    ranks_.emplace(token, rank);
+}
+
+void Tokenizer::loadTiktoken(const std::string& data) {
+    std::istringstream lines(data);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            throw std::runtime_error("malformed line: " + line);
+        }
+        addRank(decodeBase64(line.substr(0, space)), static_cast<uint32_t>(std::stoul(line.substr(space + 1))));
+    }
+}
+
+void Tokenizer::loadHuggingFace(const std::string& data) {
+    json config = json::parse(data);
+    if (!config.contains("model") || config["model"].value("type", "") != "BPE") {
+        throw std::runtime_error("only BPE models are supported");
+    }
+
+    // GPT-2's byte-to-unicode table: printable bytes map to themselves,
+    // the rest to code points from 256 up
+    std::unordered_map<uint32_t, unsigned char> byte_of;
+    uint32_t next = 256;
+    for (int byte = 0; byte < 256; byte++) {
+        bool printable = (byte >= '!' && byte <= '~') || (byte >= 0xa1 && byte <= 0xac) || (byte >= 0xae);
+        byte_of[printable ? byte : next++] = static_cast<unsigned char>(byte);
+    }
+
+    for (const auto& entry : config["model"]["vocab"].items()) {
+        const std::string& text = entry.key();
+        std::string token;
+        bool valid = true;
+        for (size_t i = 0; i < text.size() && valid;) {
+            // Decode one UTF-8 code point
+            unsigned char lead = text[i];
+            int length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xe ? 3 : 4;
+            uint32_t code_point = length == 1 ? lead : lead & (0x3f >> (length - 1));
+            for (int k = 1; k < length && i + k < text.size(); k++) {
+                code_point = (code_point << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3f);
+            }
+            i += length;
+
+            auto it = byte_of.find(code_point);
+            if (it == byte_of.end()) {
+                valid = false;  // Not byte-level, e.g. a special token
+            } else {
+                token += static_cast<char>(it->second);
+            }
+        }
+        if (valid) {
+            addRank(token, entry.value().get<uint32_t>());
+        }
+    }
+}
+
+std::vector<std::string> Tokenizer::pretokenize(const std::string& text) {
+    // Hand-written equivalent of the cl100k_base pattern:
+    //   '(?i:[sdmt]|ll|ve|re) | [^\r\n\p{L}\p{N}]?\p{L}+ | \p{N}{1,3}
+    //   | ?[^\s\p{L}\p{N}]+[\r\n]* | \s*[\r\n]+ | \s+(?!\S) | \s+
+    std::vector<std::string> pieces;
+    size_t n = text.size();
+    size_t pos = 0;
+    auto at = [&text, n](size_t i) -> unsigned char { return i < n ? text[i] : '\0'; };
+
+    while (pos < n) {
+        unsigned char c = text[pos];
+        size_t end = pos;
+
+        if (c == '\'') {
+            std::string next;
+            for (size_t i = pos + 1; i < std::min(n, pos + 3); i++) {
+                next += static_cast<char>(std::tolower(static_cast<unsigned char>(text[i])));
+            }
+            if (next.compare(0, 2, "ll") == 0 || next.compare(0, 2, "ve") == 0 || next.compare(0, 2, "re") == 0) {
+                end = pos + 3;
+            } else if (!next.empty() && std::string("sdmt").find(next[0]) != std::string::npos) {
+                end = pos + 2;
+            }
+        }
+
+        if (end == pos) {
+            size_t start = pos;
+            if (!isLetter(c) && !isDigit(c) && !isNewline(c) && isLetter(at(pos + 1))) {
+                start++;
+            }
+            if (isLetter(at(start))) {
+                end = start;
+                while (end < n && isLetter(text[end])) {
+                    end++;
+                }
+            }
+        }
+
+        if (end == pos && isDigit(c)) {
+            while (end < n && end < pos + 3 && isDigit(text[end])) {
+                end++;
+            }
+        }
+
+        if (end == pos) {
+            size_t start = c == ' ' ? pos + 1 : pos;
+            if (start < n && isOther(text[start])) {
+                end = start;
+                while (end < n && isOther(text[end])) {
+                    end++;
+                }
+                while (end < n && isNewline(text[end])) {
+                    end++;
+                }
+            }
+        }
+
+        if (end == pos && isSpace(c)) {
+            size_t run_end = pos;
+            size_t last_newline = std::string::npos;
+            while (run_end < n && isSpace(text[run_end])) {
+                if (isNewline(text[run_end])) {
+                    last_newline = run_end;
+                }
+                run_end++;
+            }
+            if (last_newline != std::string::npos) {
+                end = last_newline + 1;
+            } else if (run_end == n || run_end - pos == 1) {
+                end = run_end;
+            } else {
+                end = run_end - 1;  // Leave one space to lead the next word
+            }
+        }
+
+        if (end == pos) {
+            end = pos + 1;
+        }
+        pieces.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    return pieces;
+}
+
+void Tokenizer::encodePiece(const std::string& piece, const std::function<void(uint32_t, size_t)>& visit) const {
+    auto whole = ranks_.find(piece);
+    if (whole != ranks_.end()) {
+        visit(whole->second, piece.size());
+        return;
+    }
+
+    // Merge the adjacent pair with the lowest rank until none is mergeable.
+    // parts[i] is (start, rank of merging part i with part i + 1).
+    std::vector<std::pair<size_t, uint32_t>> parts;
+    auto rankOf = [this, &piece](size_t start, size_t end) {
+        auto it = ranks_.find(piece.substr(start, end - start));
+        return it != ranks_.end() ? it->second : NO_RANK;
+    };
+    for (size_t i = 0; i + 1 < piece.size(); i++) {
+        parts.emplace_back(i, rankOf(i, i + 2));
+    }
+    parts.emplace_back(piece.size() - 1, NO_RANK);
+    parts.emplace_back(piece.size(), NO_RANK);
+
+    auto pairRank = [&parts, &rankOf](size_t i) {
+        return i + 3 < parts.size() ? rankOf(parts[i].first, parts[i + 3].first) : NO_RANK;
+    };
+
+    while (parts.size() > 2) {
+        size_t best = 0;
+        uint32_t best_rank = NO_RANK;
+        for (size_t i = 0; i + 1 < parts.size(); i++) {
+            if (parts[i].second < best_rank) {
+                best_rank = parts[i].second;
+                best = i;
+            }
+        }
+        if (best_rank == NO_RANK) {
+            break;
+        }
+        parts[best].second = pairRank(best);
+        if (best > 0) {
+            parts[best - 1].second = pairRank(best - 1);
+        }
+        parts.erase(parts.begin() + best + 1);
+    }
+
+    for (size_t i = 0; i + 1 < parts.size(); i++) {
+        visit(rankOf(parts[i].first, parts[i + 1].first), parts[i + 1].first - parts[i].first);
+    }
+}
+
+void Tokenizer::forEachToken(const std::string& text, const std::function<void(uint32_t, size_t)>& visit) const {
+    if (!exact()) {
+        // Fixed-size chunks, extended to whole UTF-8 characters
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = std::min(text.size(), pos + APPROXIMATE_BYTES_PER_TOKEN);
+            while (end < text.size() && (static_cast<unsigned char>(text[end]) & 0xc0) == 0x80) {
+                end++;
+            }
+            visit(0, end - pos);
+            pos = end;
+        }
+        return;
+    }
+
+    for (const auto& piece : pretokenize(text)) {
+        encodePiece(piece, visit);
+    }
+}
+
+std::vector<uint32_t> Tokenizer::encode(const std::string& text) const {
+    std::vector<uint32_t> tokens;
+    forEachToken(text, [&tokens](uint32_t rank, size_t) { tokens.push_back(rank); });
+    return tokens;
+}
+
+size_t Tokenizer::count(const std::string& text) const {
+    size_t tokens = 0;
+    forEachToken(text, [&tokens](uint32_t, size_t) { tokens++; });
+    return tokens;
+}
+
+std::string Tokenizer::truncate(const std::string& text, size_t max_tokens) const {
+    std::vector<size_t> lengths;
+    forEachToken(text, [&lengths](uint32_t, size_t length) { lengths.push_back(length); });
+    size_t bytes = 0;
+    for (size_t i = 0; i < std::min(max_tokens, lengths.size()); i++) {
+        bytes += lengths[i];
+    }
+    return text.substr(0, bytes);
+}
+
+std::string Tokenizer::truncateTail(const std::string& text, size_t max_tokens) const {
+    std::vector<size_t> lengths;
+    forEachToken(text, [&lengths](uint32_t, size_t length) { lengths.push_back(length); });
+    size_t bytes = 0;
+    for (size_t i = 0; i < std::min(max_tokens, lengths.size()); i++) {
+        bytes += lengths[lengths.size() - 1 - i];
+    }
+    return text.substr(text.size() - bytes);
+}
@@ -0,0 +1,362 @@
+#include "tracer.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+std::atomic<bool> Tracer::enabled_{false};
+thread_local uint64_t TraceFlow::current_ = 0;
+
+static uint64_t microsecondsOf(Tracer::Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+uint64_t TraceFlow::next() {
+    static std::atomic<uint64_t> next_id{1};
+    return Tracer::enabled() ? next_id.fetch_add(1, std::memory_order_relaxed) : 0;
+}
+
+// Hands a thread's events to the shared ring when the thread exits
+struct ThreadBufferHolder {
+    std::shared_ptr<Tracer::ThreadBuffer> buffer;
+
+    ~ThreadBufferHolder() {
+        if (buffer) {
+            Tracer::global().retire(buffer);
+        }
+    }
+};
+
+Tracer& Tracer::global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::setBufferEvents(size_t events) {
+    buffer_events_ = std::max<size_t>(1, events);
+}
+
+void Tracer::ThreadBuffer::append(TraceEvent event) {
+    if (events.size() < capacity) {
+        events.push_back(std::move(event));
+    } else {
+        events[next] = std::move(event);
+        next = (next + 1) % capacity;
+    }
+}
+
+void Tracer::ThreadBuffer::copyTo(std::vector<TraceEvent>& out, std::vector<uint64_t>* tids) const {
+    for (size_t i = 0; i < events.size(); i++) {
+        out.push_back(events[(next + i) % events.size()]);
+        if (tids) {
+            tids->push_back(tid);
+        }
+    }
+}
+
+Tracer::ThreadBuffer& Tracer::threadBuffer() {
+    thread_local ThreadBufferHolder holder;
+    if (!holder.buffer) {
+        holder.buffer = std::make_shared<ThreadBuffer>();
+        holder.buffer->capacity = buffer_events_;
+        holder.buffer->tid = static_cast<uint64_t>(syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.push_back(holder.buffer);
+    }
+    return *holder.buffer;
+}
+
+void Tracer::record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                    std::string_view detail, uint64_t flow) {
+    if (!enabled()) {
+        return;
+    }
+    uint64_t start_us = microsecondsOf(start);
+    uint64_t end_us = microsecondsOf(end);
+    TraceEvent event{name, category, start_us, end_us > start_us ? end_us - start_us : 0, flow, std::string(detail)};
+
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.append(std::move(event));
+}
+
+void Tracer::retire(const std::shared_ptr<ThreadBuffer>& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.erase(std::remove(buffers_.begin(), buffers_.end(), buffer), buffers_.end());
+
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    std::vector<TraceEvent> events;
+    buffer->copyTo(events, nullptr);
+    for (auto& event : events) {
+        retired_.emplace_back(std::move(event), buffer->tid);
+    }
+    while (retired_.size() > buffer_events_) {
+        retired_.pop_front();
+    }
+}
+
+std::vector<TraceEvent> Tracer::collect(std::vector<uint64_t>& tids) const {
+    std::vector<TraceEvent> events;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& retired : retired_) {
+        events.push_back(retired.first);
+        tids.push_back(retired.second);
+    }
+    for (const auto& buffer : buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->copyTo(events, &tids);
+    }
+    return events;
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+    std::vector<uint64_t> tids;
+    return collect(tids);
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.clear();
+    for (const auto& buffer : buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->events.clear();
+        buffer->next = 0;
+    }
+}
+
+std::string Tracer::exportChromeJson() const {
+    std::vector<uint64_t> tids;
+    std::vector<TraceEvent> events = collect(tids);
+    int pid = getpid();
+
+    json trace_events = json::array();
+    trace_events.push_back({{"ph", "M"}, {"name", "process_name"}, {"pid", pid}, {"args", {{"name", "simfs"}}}});
+
+    // Spans of one generation, in time order, are chained by flow arrows
+    std::map<uint64_t, std::vector<size_t>> flows;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceEvent& event = events[i];
+        json args = json::object();
+        if (!event.detail.empty()) {
+            args["detail"] = event.detail;
+        }
+        if (event.flow) {
+            args["generation"] = event.flow;
+            flows[event.flow].push_back(i);
+        }
+        trace_events.push_back({{"ph", "X"}, {"name", event.name}, {"cat", event.category},
+                                {"ts", event.start_us}, {"dur", event.duration_us},
+                                {"pid", pid}, {"tid", tids[i]}, {"args", args}});
+    }
+    for (auto& flow : flows) {
+        std::vector<size_t>& spans = flow.second;
+        if (spans.size() < 2) {
+            continue;
+        }
+        std::stable_sort(spans.begin(), spans.end(),
+                         [&events](size_t a, size_t b) { return events[a].start_us < events[b].start_us; });
+        for (size_t i = 0; i < spans.size(); i++) {
+            const TraceEvent& event = events[spans[i]];
+            json step = {{"ph", i == 0 ? "s" : (i + 1 == spans.size() ? "f" : "t")},
+                         {"name", "generation"}, {"cat", "flow"}, {"id", flow.first},
+                         {"ts", event.start_us}, {"pid", pid}, {"tid", tids[spans[i]]}};
+            if (i + 1 == spans.size()) {
+                step["bp"] = "e";
+            }
+            trace_events.push_back(step);
+        }
+    }
+
+    json trace = {{"traceEvents", trace_events}, {"displayTimeUnit", "ms"}};
+    return trace.dump();
+}
+
+bool Tracer::dump(const std::string& path) const {
+    // A fresh temp file next to the target: mkstemp never opens an existing
+    // file or follows a planted symlink, even in a shared directory
+    std::string temp_path = path + ".XXXXXX";
+    int fd = mkstemp(&temp_path[0]);
+    if (fd < 0) {
+        return false;
+    }
+    std::string trace = exportChromeJson();
+    size_t written = 0;
+    while (written < trace.size()) {
+        ssize_t n = ::write(fd, trace.data() + written, trace.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    if (close(fd) != 0 || written < trace.size() || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::atomic<AccessRecorder*> AccessRecorder::active_{nullptr};
+
+std::string AccessRecord::format() const {
+    std::string line = std::to_string(time_us) + "\t" + op + "\t" + std::to_string(result) + "\t" +
+                       std::to_string(fh) + "\t" + std::to_string(flags) + "\t" + std::to_string(size) + "\t" +
+                       std::to_string(offset) + "\t";
+    for (char c : path) {
+        switch (c) {
+            case '\\': line += "\\\\"; break;
+            case '\t': line += "\\t"; break;
+            case '\n': line += "\\n"; break;
+            default: line += c;
+        }
+    }
+    return line;
+}
+
+bool AccessRecord::parse(const std::string& line, AccessRecord& record) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (int i = 0; i < 7; i++) {
+        size_t tab = line.find('\t', start);
+        if (tab == std::string::npos) {
+            return false;
+        }
+        fields.push_back(line.substr(start, tab - start));
+        start = tab + 1;
+    }
+    try {
+        record.time_us = std::stoull(fields[0]);
+        record.op = fields[1];
+        record.result = std::stoll(fields[2]);
+        record.fh = std::stoull(fields[3]);
+        record.flags = std::stoi(fields[4]);
+        record.size = std::stoull(fields[5]);
+        record.offset = std::stoll(fields[6]);
+    } catch (const std::exception&) {
+        return false;
+    }
+    record.path.clear();
+    for (size_t i = start; i < line.size(); i++) {
+        if (line[i] == '\\' && i + 1 < line.size()) {
+            char escaped = line[++i];
+            record.path += escaped == 't' ? '\t' : (escaped == 'n' ? '\n' : escaped);
+        } else {
+            record.path += line[i];
+        }
+    }
+    return !record.op.empty() && !record.path.empty();
+}
+
+AccessRecorder::AccessRecorder(const std::string& path)
+    : file_(path, std::ios::trunc), start_(Tracer::Clock::now()), last_write_(start_) {
+    if (!file_) {
+        throw std::runtime_error("Failed to create access trace " + path + ": " + strerror(errno));
+    }
+    AccessRecorder* expected = nullptr;
+    if (!active_.compare_exchange_strong(expected, this)) {
+        throw std::runtime_error("An access recorder is already running");
+    }
+    pending_ = std::string(HEADER) + "\n";
+}
+
+AccessRecorder::~AccessRecorder() {
+    active_.store(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    writePending();
+}
+
+void AccessRecorder::record(Tracer::Clock::time_point start, AccessRecord record) {
+    record.time_us = start > start_ ? std::chrono::duration_cast<std::chrono::microseconds>(start - start_).count() : 0;
+    std::string line = record.format();
+    line += '\n';
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ += line;
+    auto now = Tracer::Clock::now();
+    if (pending_.size() >= 64 * 1024 || now - last_write_ >= std::chrono::seconds(1)) {
+        writePending();
+        last_write_ = now;
+    }
+}
+
+void AccessRecorder::writePending() {
+    file_ << pending_;
+    file_.flush();
+    pending_.clear();
+}
+
+static int dump_pipe[2] = {-1, -1};
+
+static void requestDump(int) {
+    int saved_errno = errno;
+    char request = 1;
+    ssize_t written = write(dump_pipe[1], &request, 1);
+    (void) written;  // A full pipe already has a dump pending
+    errno = saved_errno;
+}
+
+TraceDumper::TraceDumper(const std::string& path, int signum) : path_(path), signum_(signum) {
+    if (dump_pipe[0] >= 0) {
+        throw std::runtime_error("A trace dump handler is already installed");
+    }
+    if (pipe2(dump_pipe, O_CLOEXEC) < 0) {
+        throw std::runtime_error("Failed to create trace dump pipe: " + std::string(strerror(errno)));
+    }
+    fcntl(dump_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action = {};
+    action.sa_handler = requestDump;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signum, &action, &previous_) < 0) {
+        std::string error = strerror(errno);
+        close(dump_pipe[0]);
+        close(dump_pipe[1]);
+        dump_pipe[0] = dump_pipe[1] = -1;
+        throw std::runtime_error("Failed to install trace dump handler: " + error);
+    }
+    thread_ = std::thread([this]() { run(); });
+}
+
+TraceDumper::~TraceDumper() {
+    sigaction(signum_, &previous_, nullptr);
+    char stop = 0;
+    while (write(dump_pipe[1], &stop, 1) < 0 && errno == EAGAIN) {
+        std::this_thread::yield();  // Pipe full of dump requests
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(dump_pipe[0]);
+    close(dump_pipe[1]);
+    dump_pipe[0] = dump_pipe[1] = -1;
+}
+
+void TraceDumper::run() {
+    char request;
+    while (true) {
+        ssize_t n = read(dump_pipe[0], &request, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || request == 0) {
+            return;
+        }
+        if (Tracer::global().dump(path_)) {
+            LOG_INFO << "Wrote trace to " << path_;
+        } else {
+            LOG_WARNING << "Failed to write trace to " << path_;
+        }
+    }
+}
@@ -0,0 +1,206 @@
+#include "world_archive.h"
+#include "db_manager.h"
+#include "content_store.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static const char* MANIFEST_NAME = "MANIFEST.simfs";
+static const char* MANIFEST_HEADER = "simfs-archive 1";
+
+// Path-keyed keyspaces, in key order so SST files are written sorted
+static const std::vector<std::string> KEYSPACES = {
+    "access:", "content:", "meta:", "refs:", "transition:"
+};
+
+static std::string normalizeRoot(const std::string& path) {
+    if (path.empty() || path[0] != '/') {
+        throw std::runtime_error("Subtree paths must be absolute: " + path);
+    }
+    std::string root = path;
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+    return root;
+}
+
+std::string WorldArchive::rebasePath(const std::string& path, const std::string& from, const std::string& to) {
+    std::string relative;
+    if (from == "/") {
+        if (path.empty() || path[0] != '/') {
+            return "";
+        }
+        relative = path == "/" ? "" : path;
+    } else if (path == from) {
+        relative = "";
+    } else if (path.compare(0, from.size(), from) == 0 && path.size() > from.size() && path[from.size()] == '/') {
+        relative = path.substr(from.size());
+    } else {
+        return "";
+    }
+
+    std::string rebased = (to == "/" ? "" : to) + relative;
+    return rebased.empty() ? "/" : rebased;
+}
+
+std::string WorldArchive::rebaseValue(const std::string& keyspace, const std::string& value,
+                                      const std::string& from, const std::string& to) {
+    // transition: and refs: values hold absolute paths, one per line
+    if (from == to || (keyspace != "transition:" && keyspace != "refs:")) {
+        return value;
+    }
+
+    std::ostringstream rebased;
+    std::istringstream lines(value);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t path_start = keyspace == "transition:" ? line.find('\t') + 1 : 0;
+        std::string path = rebasePath(line.substr(path_start), from, to);
+        rebased << (path.empty() ? line : line.substr(0, path_start) + path) << '\n';
+    }
+    return rebased.str();
+}
+
+ArchiveStats WorldArchive::exportSubtree(DBManager& db, const std::string& subtree,
+                                         const std::string& output_dir,
+                                         const std::string& rebase_to,
+                                         uint64_t max_file_size) {
+    std::string from = normalizeRoot(subtree);
+    std::string to = rebase_to.empty() ? from : normalizeRoot(rebase_to);
+
+    std::error_code ec;
+    std::filesystem::create_directories(output_dir, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to create " + output_dir + ": " + ec.message());
+    }
+    if (!std::filesystem::is_empty(output_dir)) {
+        throw std::runtime_error("Archive directory is not empty: " + output_dir);
+    }
+
+    std::vector<std::string> prefixes;
+    for (const auto& keyspace : KEYSPACES) {
+        prefixes.push_back(keyspace + from);
+    }
+
+    // Keys under a subtree share the root as a prefix, so swapping the root
+    // keeps them in order and they can be streamed straight into SST files
+    SstExportWriter writer(output_dir, max_file_size);
+    ContentStore content(db);
+    bool write_failed = false;
+    bool scanned = db.scan(prefixes, [&](const std::string& key, const std::string& value) {
+        size_t colon = key.find(':');
+        std::string keyspace = key.substr(0, colon + 1);
+        std::string path = rebasePath(key.substr(colon + 1), from, to);
+        if (path.empty()) {
+            return true;  // Sibling sharing the prefix, e.g. /a-b for /a
+        }
+
+        // Archives carry bodies inline so they don't depend on the source's blobs
+        std::string exported = value;
+        if (keyspace == "content:" && !content.resolve(value, exported)) {
+            write_failed = true;
+            return false;
+        }
+        if (!writer.put(keyspace + path, rebaseValue(keyspace, exported, from, to))) {
+            write_failed = true;
+            return false;
+        }
+        return true;
+    });
+    if (write_failed || !writer.finish()) {
+        throw std::runtime_error("Failed to write SST files to " + output_dir);
+    }
+    if (!scanned) {
+        throw std::runtime_error("Failed to read subtree " + from);
+    }
+
+    ArchiveStats stats;
+    stats.root = to;
+    stats.sst_files = writer.files().size();
+    stats.entries = writer.entries();
+    stats.bytes = writer.bytes();
+
+    std::ofstream manifest(output_dir + "/" + MANIFEST_NAME);
+    manifest << MANIFEST_HEADER << '\n';
+    manifest << "root " << stats.root << '\n';
+    manifest << "entries " << stats.entries << '\n';
+    manifest << "bytes " << stats.bytes << '\n';
+    for (const auto& file : writer.files()) {
+        manifest << "sst " << std::filesystem::path(file).filename().string() << '\n';
+    }
+    if (!manifest) {
+        throw std::runtime_error("Failed to write archive manifest in " + output_dir);
+    }
+
+    return stats;
+}
+
+ArchiveStats WorldArchive::importArchive(DBManager& db, const std::string& input_dir, bool move_files) {
+    std::ifstream manifest(input_dir + "/" + MANIFEST_NAME);
+    std::string line;
+    if (!manifest || !std::getline(manifest, line) || line != MANIFEST_HEADER) {
+        throw std::runtime_error("Not a SimFS archive: " + input_dir);
+    }
+
+    ArchiveStats stats;
+    std::vector<std::string> files;
+    while (std::getline(manifest, line)) {
+        size_t space = line.find(' ');
+        std::string field = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        if (field == "root") {
+            stats.root = value;
+        } else if (field == "entries") {
+            stats.entries = std::stoull(value);
+        } else if (field == "bytes") {
+            stats.bytes = std::stoull(value);
+        } else if (field == "sst") {
+            files.push_back(input_dir + "/" + value);
+        }
+    }
+    stats.root = normalizeRoot(stats.root);
+    stats.sst_files = files.size();
+
+    // Blob references the archive may overwrite; their counts are dropped
+    // after ingestion. Ingested bodies stay inline until rewritten.
+    std::vector<std::pair<std::string, std::string>> references;
+    db.scan({"content:" + stats.root}, [&references](const std::string& key, const std::string& value) {
+        if (ContentStore::isReference(value)) {
+            references.emplace_back(key, value);
+        }
+        return true;
+    });
+
+    if (!db.ingestFiles(files, move_files)) {
+        throw std::runtime_error("Failed to ingest archive " + input_dir);
+    }
+
+    ContentStore content(db);
+    for (const auto& reference : references) {
+        std::string value;
+        if (!db.get(reference.first, value) || value != reference.second) {
+            content.release(reference.second);
+        }
+    }
+    content.rebuildPreviews(stats.root);
+
+    // A rebased subtree may land under directories the target doesn't have.
+    // Exports of "/" carry no metadata for the root itself either.
+    std::vector<std::pair<std::string, std::string>> parents;
+    for (size_t slash = stats.root.find('/', 1); stats.root != "/";
+         slash = stats.root.find('/', slash + 1)) {
+        std::string parent = stats.root.substr(0, slash);
+        if (!db.exists("meta:" + parent)) {
+            parents.emplace_back("meta:" + parent, "type:dir");
+        }
+        if (slash == std::string::npos) {
+            break;
+        }
+    }
+    if (!parents.empty() && !db.writeBatch(parents)) {
+        throw std::runtime_error("Failed to create parent directories of " + stats.root);
+    }
+
+    return stats;
+}
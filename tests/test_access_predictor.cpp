@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include "access_predictor.h"
+#include "db_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+class AccessPredictorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_db_path_ = "./test_predictor_db_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        db_ = std::make_unique<DBManager>(test_db_path_);
+        config_.enabled = true;
+        config_.max_predictions = 3;
+        config_.min_probability = 0.3;
+    }
+
+    void TearDown() override {
+        db_.reset();
+        std::filesystem::remove_all(test_db_path_);
+    }
+
+    std::string test_db_path_;
+    std::unique_ptr<DBManager> db_;
+    PrefetchConfig config_;
+};
+
+static bool contains(const std::vector<std::string>& values, const std::string& value) {
+    return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+TEST_F(AccessPredictorTest, LearnsSiblingTransitions) {
+    AccessPredictor predictor(*db_, config_);
+    
+    for (int i = 0; i < 3; i++) {
+        predictor.recordOpen("/proj/README.md");
+        predictor.recordOpen("/proj/main.c");
+    }
+    predictor.recordOpen("/proj/README.md");
+    predictor.recordOpen("/proj/Makefile.am");
+    
+    auto predictions = predictor.predict("/proj/README.md");
+    ASSERT_FALSE(predictions.empty());
+    EXPECT_EQ("/proj/main.c", predictions[0]);
+    
+    // A rarely taken transition stays under the probability threshold
+    config_.min_probability = 0.5;
+    AccessPredictor strict(*db_, config_);
+    EXPECT_FALSE(contains(strict.predict("/proj/README.md"), "/proj/Makefile.am"));
+}
+
+TEST_F(AccessPredictorTest, SequencesSurviveRestart) {
+    {
+        AccessPredictor predictor(*db_, config_);
+        predictor.recordOpen("/docs/a.md");
+    }
+    AccessPredictor restarted(*db_, config_);
+    restarted.recordOpen("/docs/b.md");
+    
+    EXPECT_TRUE(contains(restarted.predict("/docs/a.md"), "/docs/b.md"));
+}
+
+TEST_F(AccessPredictorTest, BatchedOpensBuildOnEachOther) {
+    AccessPredictor predictor(*db_, config_);
+    predictor.recordOpens({"/src/a.c", "/src/b.c", "/src/a.c", "/src/b.c", "/src/a.c", "/src/c.c"});
+    
+    auto predictions = predictor.predict("/src/a.c");
+    ASSERT_EQ(2u, predictions.size());
+    EXPECT_EQ("/src/b.c", predictions[0]);
+    EXPECT_EQ("/src/c.c", predictions[1]);
+    EXPECT_EQ((std::vector<std::string>{"/src/a.c"}), predictor.predict("/src/b.c"));
+}
+
+TEST_F(AccessPredictorTest, SkipsCorruptTransitions) {
+    db_->put("transition:/src/a.c", "x\t/src/bad.c\n2\t/src/b.c\n");
+    AccessPredictor predictor(*db_, config_);
+    EXPECT_EQ((std::vector<std::string>{"/src/b.c"}), predictor.predict("/src/a.c"));
+    
+    predictor.recordOpen("/src/a.c");
+    EXPECT_NO_THROW(predictor.recordOpen("/src/b.c"));
+}
+
+TEST_F(AccessPredictorTest, ExtractsReferences) {
+    auto c_refs = AccessPredictor::extractReferences("/src/main.c",
+        "#include <stdio.h>\n#include \"util.h\"\n#include \"../include/config.h\"\n");
+    EXPECT_TRUE(contains(c_refs, "/src/util.h"));
+    EXPECT_TRUE(contains(c_refs, "/include/config.h"));
+    EXPECT_EQ(2u, c_refs.size());
+    
+    auto js_refs = AccessPredictor::extractReferences("/web/app.js",
+        "import x from './lib/x';\nconst y = require('../y.js');\nimport React from 'react';\n");
+    EXPECT_TRUE(contains(js_refs, "/web/lib/x.js"));
+    EXPECT_TRUE(contains(js_refs, "/y.js"));
+    EXPECT_EQ(2u, js_refs.size());
+    
+    auto py_refs = AccessPredictor::extractReferences("/pkg/mod/a.py",
+        "import os\nfrom .b import thing\nfrom ..util.io import read\n");
+    EXPECT_TRUE(contains(py_refs, "/pkg/mod/b.py"));
+    EXPECT_TRUE(contains(py_refs, "/pkg/util/io.py"));
+    EXPECT_EQ(2u, py_refs.size());
+    
+    auto md_refs = AccessPredictor::extractReferences("/docs/index.md",
+        "See [setup](setup.md) and [site](https://example.com/x.html).\n");
+    EXPECT_EQ(std::vector<std::string>{"/docs/setup.md"}, md_refs);
+    
+    auto html_refs = AccessPredictor::extractReferences("/site/index.html",
+        "<a href = \"about.html\">About</a><img src='img/logo.png'><a href=\"#top\">Top</a>\n");
+    EXPECT_EQ((std::vector<std::string>{"/site/about.html", "/site/img/logo.png"}), html_refs);
+}
+
+TEST_F(AccessPredictorTest, ScansOnlyTheStartOfLargeFiles) {
+    // Unterminated targets on one huge line would make a backtracking
+    // matcher quadratic
+    std::string content = "#include \"a.h\"\n" + std::string(AccessPredictor::MAX_SCANNED_BYTES, '"') +
+                          "\n#include \"b.h\"\n";
+    EXPECT_EQ(std::vector<std::string>{"/src/a.h"}, AccessPredictor::extractReferences("/src/main.c", content));
+    
+    std::string links(4 * 1024 * 1024, '(');
+    EXPECT_TRUE(AccessPredictor::extractReferences("/docs/big.md", "](" + links).empty());
+}
+
+TEST_F(AccessPredictorTest, PredictsReferencedFiles) {
+    AccessPredictor predictor(*db_, config_);
+    predictor.recordReferences("/src/main.c", "#include \"util.h\"\n");
+    
+    EXPECT_TRUE(contains(predictor.predict("/src/main.c"), "/src/util.h"));
+}
+
+TEST_F(AccessPredictorTest, ReservationsChargeTheBudget) {
+    config_.token_budget = 10;
+    AccessPredictor predictor(*db_, config_);
+    
+    // In flight prefetches count before any completes
+    EXPECT_TRUE(predictor.reservePrefetch("/a.txt", 6));
+    EXPECT_TRUE(predictor.reservePrefetch("/b.txt", 6));
+    EXPECT_FALSE(predictor.reservePrefetch("/c.txt", 6));
+    
+    // Completion trues the estimate up: /a.txt used 1 token, /b.txt failed
+    predictor.completePrefetch("/a.txt", 1, true);
+    predictor.completePrefetch("/b.txt", 0, false);
+    EXPECT_TRUE(predictor.reservePrefetch("/c.txt", 6));
+    EXPECT_EQ(3u, predictor.getStats().issued);
+}
+
+TEST_F(AccessPredictorTest, ReservationsOnlyRefundTheirOwnWindow) {
+    config_.token_budget = 10;
+    config_.budget_window_seconds = 1;
+    AccessPredictor predictor(*db_, config_);
+    
+    ASSERT_TRUE(predictor.reservePrefetch("/a.txt", 6));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    ASSERT_TRUE(predictor.reservePrefetch("/b.txt", 9));
+    
+    // /a.txt's estimate went with the old window; its tokens count in the new one
+    predictor.completePrefetch("/a.txt", 1, true);
+    EXPECT_FALSE(predictor.reservePrefetch("/c.txt", 1));
+}
+
+TEST_F(AccessPredictorTest, UnusedPrefetchesAgeOut) {
+    config_.budget_window_seconds = 0;  // Every reservation starts a window
+    AccessPredictor predictor(*db_, config_);
+    
+    ASSERT_TRUE(predictor.reservePrefetch("/a.txt", 4));
+    predictor.completePrefetch("/a.txt", 3, true);
+    EXPECT_FALSE(predictor.reservePrefetch("/a.txt", 4));
+    
+    // Unused for a whole window: dropped, counted as wasted, and may be
+    // prefetched again
+    EXPECT_TRUE(predictor.reservePrefetch("/a.txt", 4));
+    EXPECT_EQ(3u, predictor.getStats().tokens_wasted);
+}
+
+TEST_F(AccessPredictorTest, BudgetAndHitAccounting) {
+    config_.token_budget = 10;
+    AccessPredictor predictor(*db_, config_);
+    
+    ASSERT_TRUE(predictor.reservePrefetch("/a.txt", 4));
+    EXPECT_FALSE(predictor.reservePrefetch("/a.txt", 4));
+    predictor.completePrefetch("/a.txt", 10, true);
+    
+    // Budget is spent for this window
+    EXPECT_FALSE(predictor.reservePrefetch("/b.txt", 4));
+    
+    PrefetchStats stats = predictor.getStats();
+    EXPECT_EQ(1u, stats.issued);
+    EXPECT_EQ(1u, stats.completed);
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(10u, stats.tokens_wasted);
+    
+    EXPECT_TRUE(predictor.recordHit("/a.txt"));
+    EXPECT_FALSE(predictor.recordHit("/a.txt"));
+    stats = predictor.getStats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(0u, stats.tokens_wasted);
+    EXPECT_EQ(10u, stats.tokens_spent);
+}
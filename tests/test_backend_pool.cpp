@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include "backend_pool.h"
+#include <atomic>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static BackendConfig makeBackend(const std::string& url, unsigned weight = 1, size_t max_concurrent = 0,
+                                 std::vector<std::string> models = {}) {
+    BackendConfig backend;
+    backend.url = url;
+    backend.weight = weight;
+    backend.max_concurrent = max_concurrent;
+    backend.models = models;
+    return backend;
+}
+
+static PoolConfig withoutHealthChecks(unsigned failure_threshold = 3, unsigned open_seconds = 30) {
+    PoolConfig config;
+    config.failure_threshold = failure_threshold;
+    config.open_seconds = open_seconds;
+    config.health_check_seconds = 0;
+    return config;
+}
+
+TEST(BackendPoolTest, RoutesToFewestTokensPerWeight) {
+    BackendPool pool({makeBackend("http://a/v1"), makeBackend("http://b/v1", 3)}, withoutHealthChecks());
+
+    EXPECT_EQ(1, pool.acquire("m", 100));  // 100/3 beats 100/1
+    EXPECT_EQ(1, pool.acquire("m", 100));  // 200/3
+    EXPECT_EQ(0, pool.acquire("m", 100));  // 300/3 ties with 100/1; the first backend wins
+    EXPECT_EQ(1, pool.acquire("m", 10));   // 210/3 vs 110
+
+    pool.release(1, 100, true);
+    pool.release(1, 100, true);
+    EXPECT_EQ(1, pool.acquire("m", 50));
+    EXPECT_EQ(60u, pool.stats()[1].in_flight_tokens);
+    EXPECT_EQ(4u, pool.stats()[1].requests);
+}
+
+TEST(BackendPoolTest, HonoursModelsAndExclusions) {
+    BackendPool pool({makeBackend("http://small/v1", 1, 0, {"small"}), makeBackend("http://any/v1")},
+                     withoutHealthChecks());
+
+    EXPECT_EQ(1, pool.acquire("large", 10));
+    EXPECT_EQ(0, pool.acquire("small", 10));
+    EXPECT_EQ(1, pool.acquire("small", 10, {0}));
+    EXPECT_EQ(-1, pool.acquire("large", 10, {1}));
+}
+
+TEST(BackendPoolTest, WaitsAtMaxConcurrent) {
+    BackendPool pool({makeBackend("http://a/v1", 1, 1)}, withoutHealthChecks());
+    ASSERT_EQ(0, pool.acquire("m", 10));
+
+    std::atomic<bool> acquired{false};
+    std::thread waiter([&]() {
+        EXPECT_EQ(0, pool.acquire("m", 10));
+        acquired = true;
+    });
+    std::this_thread::sleep_for(50ms);
+    EXPECT_FALSE(acquired);
+
+    pool.release(0, 10, true);
+    waiter.join();
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(1u, pool.stats()[0].in_flight);
+}
+
+TEST(BackendPoolTest, RepeatedFailuresOpenTheCircuit) {
+    BackendPool pool({makeBackend("http://a/v1"), makeBackend("http://b/v1")}, withoutHealthChecks(2));
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(0, pool.acquire("m", 10, {1}));
+        pool.release(0, 10, false);
+    }
+    EXPECT_EQ(BackendPool::Circuit::Open, pool.stats()[0].circuit);
+    EXPECT_EQ(2u, pool.stats()[0].failures);
+    EXPECT_EQ(-1, pool.acquire("m", 10, {1}));
+    EXPECT_EQ(1, pool.acquire("m", 10));
+
+    // A success in between resets the count
+    ASSERT_EQ(1, pool.acquire("m", 10));
+    pool.release(1, 10, false);
+    pool.release(1, 10, true);
+    ASSERT_EQ(1, pool.acquire("m", 10));
+    pool.release(1, 10, false);
+    EXPECT_EQ(BackendPool::Circuit::Closed, pool.stats()[1].circuit);
+}
+
+TEST(BackendPoolTest, TrialRequestClosesOrReopensTheCircuit) {
+    BackendPool pool({makeBackend("http://a/v1")}, withoutHealthChecks(1, 0));
+
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, false);
+    EXPECT_EQ(BackendPool::Circuit::Open, pool.stats()[0].circuit);
+
+    // open_seconds has passed: one trial at a time
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    EXPECT_EQ(BackendPool::Circuit::HalfOpen, pool.stats()[0].circuit);
+    EXPECT_EQ(-1, pool.acquire("m", 10));
+    pool.release(0, 10, false);
+    EXPECT_EQ(BackendPool::Circuit::Open, pool.stats()[0].circuit);
+
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, true);
+    EXPECT_EQ(BackendPool::Circuit::Closed, pool.stats()[0].circuit);
+}
+
+TEST(BackendPoolTest, HealthCheckRestoresBackend) {
+    PoolConfig config = withoutHealthChecks(1, 3600);
+    config.health_check_seconds = 1;
+    std::atomic<bool> healthy{false};
+    BackendPool pool({makeBackend("http://a/v1")}, config,
+                     [&healthy](const BackendConfig&) { return healthy.load(); });
+
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, false);
+    std::this_thread::sleep_for(1200ms);
+    EXPECT_EQ(BackendPool::Circuit::Open, pool.stats()[0].circuit);
+
+    healthy = true;
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (pool.stats()[0].circuit != BackendPool::Circuit::Closed && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(20ms);
+    }
+    EXPECT_EQ(0, pool.acquire("m", 10));
+}
+
+TEST(BackendPoolTest, HealthUrlDefaultsToOrigin) {
+    EXPECT_EQ("http://gpu1:8080/health", BackendPool::healthUrl(makeBackend("http://gpu1:8080/v1/chat/completions")));
+    EXPECT_EQ("http://gpu1:8080/health", BackendPool::healthUrl(makeBackend("http://gpu1:8080")));
+
+    BackendConfig backend = makeBackend("http://gpu1:8080/v1/chat/completions");
+    backend.health_url = "http://gpu1:8080/v1/models";
+    EXPECT_EQ("http://gpu1:8080/v1/models", BackendPool::healthUrl(backend));
+}
+
+TEST(BackendPoolTest, BackendsAreParsedFromMountConfig) {
+    MountConfig config = MountConfig::parse(R"(
+[pool]
+failure_threshold = 5
+
+[[backends]]
+url = "http://gpu1:8080/v1/chat/completions"
+weight = 2
+max_concurrent = 4
+models = ["llama-8b", "llama-3b"]
+
+[[backends]]
+url = "http://gpu2:8080/v1/chat/completions"
+cache_prompt = true
+)");
+    ASSERT_EQ(2u, config.backends.size());
+    EXPECT_EQ(2u, config.backends[0].weight);
+    EXPECT_EQ(4u, config.backends[0].max_concurrent);
+    EXPECT_EQ((std::vector<std::string>{"llama-8b", "llama-3b"}), config.backends[0].models);
+    EXPECT_TRUE(config.backends[1].models.empty());
+    EXPECT_TRUE(config.backends[1].cache_prompt);
+    EXPECT_EQ(5u, config.pool.failure_threshold);
+    EXPECT_EQ(30u, config.pool.open_seconds);
+
+    EXPECT_THROW(MountConfig::parse("[[backends]]\nweight = 1\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[[backends]]\nurl = \"http://a/v1\"\nmax_concurrent = -1\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[pool]\nretry_max_ms = -100\n"), std::runtime_error);
+}
+
+TEST(BackendPoolTest, ThrottlingBacksOffWithoutOpeningTheCircuit) {
+    PoolConfig config = withoutHealthChecks(1);
+    config.adaptive_concurrency = true;
+    config.initial_concurrency = 4;
+    BackendPool pool({makeBackend("http://a/v1"), makeBackend("http://b/v1")}, config);
+
+    BackendPool::Outcome throttled;
+    throttled.throttled = true;
+    throttled.retry_after = 10s;
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, throttled);
+
+    BackendPool::Stats stats = pool.stats()[0];
+    EXPECT_EQ(BackendPool::Circuit::Closed, stats.circuit);
+    EXPECT_EQ(1u, stats.throttled);
+    EXPECT_EQ(2u, stats.concurrency_limit);
+
+    // Inside Retry-After, only the other backend takes requests
+    EXPECT_EQ(1, pool.acquire("m", 10));
+    EXPECT_EQ(-1, pool.acquire("m", 10, {1}, false));
+}
+
+TEST(BackendPoolTest, RejectedRequestsDontOpenTheCircuit) {
+    BackendPool pool({makeBackend("http://a/v1")}, withoutHealthChecks(2));
+
+    // A 400 for an over-long prompt says nothing about the backend
+    BackendPool::Outcome rejected;
+    rejected.client_error = true;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(0, pool.acquire("m", 10));
+        pool.release(0, 10, rejected);
+    }
+    EXPECT_EQ(BackendPool::Circuit::Closed, pool.stats()[0].circuit);
+    EXPECT_EQ(0u, pool.stats()[0].failures);
+
+    // Nor does it add to a run of real failures
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, false);
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, rejected);
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, false);
+    EXPECT_EQ(BackendPool::Circuit::Closed, pool.stats()[0].circuit);
+}
+
+TEST(BackendPoolTest, RetryAfterIsWaitedOut) {
+    PoolConfig config = withoutHealthChecks();
+    BackendPool pool({makeBackend("http://a/v1")}, config);
+
+    BackendPool::Outcome throttled;
+    throttled.throttled = true;
+    throttled.retry_after = 200ms;
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, throttled);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(0, pool.acquire("m", 10));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 150ms);
+}
+
+TEST(BackendPoolTest, RateLimitSpacesRequests) {
+    BackendConfig backend = makeBackend("http://a/v1");
+    backend.requests_per_second = 20;
+    backend.burst = 1;
+    BackendPool pool({backend}, withoutHealthChecks());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(0, pool.acquire("m", 10));
+        pool.release(0, 10, true);
+    }
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 90ms);
+}
+
+TEST(BackendPoolTest, SlowFirstTokensLowerTheLimit) {
+    PoolConfig config = withoutHealthChecks();
+    config.adaptive_concurrency = true;
+    config.initial_concurrency = 8;
+    config.latency_target_ms = 500;
+    BackendPool pool({makeBackend("http://a/v1", 1, 4)}, config);
+    EXPECT_EQ(4u, pool.stats()[0].concurrency_limit);  // Capped by max_concurrent
+
+    BackendPool::Outcome slow;
+    slow.success = true;
+    slow.latency = 2s;
+    ASSERT_EQ(0, pool.acquire("m", 10));
+    pool.release(0, 10, slow);
+    EXPECT_EQ(2u, pool.stats()[0].concurrency_limit);
+    EXPECT_EQ(0u, pool.stats()[0].failures);
+}
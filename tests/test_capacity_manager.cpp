@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include "capacity_manager.h"
+#include "db_manager.h"
+#include "content_store.h"
+#include <algorithm>
+#include <filesystem>
+
+class CapacityManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_db_path_ = "./test_capacity_db_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        db_ = std::make_unique<DBManager>(test_db_path_);
+        content_ = std::make_unique<ContentStore>(*db_);
+        config_.enabled = true;
+        config_.budget_bytes = 1000;
+        config_.low_watermark = 0.5;
+    }
+
+    void TearDown() override {
+        content_.reset();
+        db_.reset();
+        std::filesystem::remove_all(test_db_path_);
+    }
+
+    void store(CapacityManager& capacity, const std::string& path, size_t bytes, bool generated) {
+        db_->put("meta:" + path, generated ? "type:file;generated;seed=7" : "type:file");
+        // Distinct per path, so the bodies aren't shared
+        std::string body = path.substr(0, bytes) + std::string(bytes - std::min(bytes, path.size()), 'x');
+        content_->put(path, body);
+        capacity.recordStore(path, bytes, generated);
+    }
+
+    static bool any(const std::string&) { return true; }
+
+    std::string test_db_path_;
+    std::unique_ptr<DBManager> db_;
+    std::unique_ptr<ContentStore> content_;
+    CapacityConfig config_;
+};
+
+TEST_F(CapacityManagerTest, MetadataFlags) {
+    std::string metadata = "type:file";
+    metadata = FileMetadata::withFlag(metadata, "generated");
+    metadata = FileMetadata::withFlag(metadata, "seed=42");
+    EXPECT_EQ("type:file;generated;seed=42", metadata);
+    EXPECT_TRUE(FileMetadata::hasFlag(metadata, "generated"));
+    EXPECT_TRUE(FileMetadata::hasFlag(metadata, "seed"));
+    EXPECT_FALSE(FileMetadata::hasFlag(metadata, "gen"));
+    EXPECT_EQ(42u, FileMetadata::pinnedSeed("/a.txt", metadata));
+
+    EXPECT_EQ("type:file;seed=42", FileMetadata::withoutFlag(metadata, "generated"));
+    EXPECT_EQ("type:file;generated", FileMetadata::withoutFlag(metadata, "seed"));
+
+    // Derived seeds are stable per path
+    EXPECT_EQ(FileMetadata::pinnedSeed("/a.txt", "type:file"), FileMetadata::pinnedSeed("/a.txt", ""));
+    EXPECT_NE(FileMetadata::pinnedSeed("/a.txt", ""), FileMetadata::pinnedSeed("/b.txt", ""));
+
+    EXPECT_EQ(3u, FileMetadata::version("type:file;generated;version=3;seed=42"));
+    EXPECT_EQ(0u, FileMetadata::version(metadata));
+}
+
+TEST_F(CapacityManagerTest, EvictsColdestGeneratedFiles) {
+    config_.low_watermark = 0.6;
+    CapacityManager capacity(*db_, *content_, config_);
+    store(capacity, "/cold.txt", 300, true);
+    store(capacity, "/warm.txt", 300, true);
+    store(capacity, "/hot.txt", 300, true);
+    for (int i = 0; i < 3; i++) {
+        capacity.recordAccess("/hot.txt");
+        capacity.recordAccess("/warm.txt");
+    }
+    capacity.recordAccess("/hot.txt");
+    EXPECT_EQ(0u, capacity.enforce(any));
+
+    store(capacity, "/new.txt", 200, true);
+    EXPECT_EQ(2u, capacity.enforce(any));
+
+    // Down to the low watermark, coldest first
+    EXPECT_FALSE(db_->exists("content:/cold.txt"));
+    EXPECT_FALSE(db_->exists("content:/new.txt"));
+    EXPECT_TRUE(db_->exists("content:/warm.txt"));
+    EXPECT_TRUE(db_->exists("content:/hot.txt"));
+
+    std::string metadata;
+    EXPECT_TRUE(db_->get("meta:/cold.txt", metadata));
+    EXPECT_TRUE(FileMetadata::hasFlag(metadata, "evicted"));
+    EXPECT_EQ(7u, FileMetadata::pinnedSeed("/cold.txt", metadata));
+
+    CapacityStats stats = capacity.getStats();
+    EXPECT_EQ(600u, stats.usage_bytes);
+    EXPECT_EQ(2u, stats.evictions);
+    EXPECT_EQ(500u, stats.evicted_bytes);
+}
+
+TEST_F(CapacityManagerTest, NeverEvictsUserFiles) {
+    CapacityManager capacity(*db_, *content_, config_);
+    store(capacity, "/notes.txt", 800, false);
+    store(capacity, "/generated.txt", 300, true);
+
+    // A generated file modified since it was tracked is protected as well
+    db_->put("meta:/generated.txt", "type:file;seed=7");
+
+    EXPECT_EQ(0u, capacity.enforce(any));
+    EXPECT_TRUE(db_->exists("content:/notes.txt"));
+    EXPECT_TRUE(db_->exists("content:/generated.txt"));
+}
+
+TEST_F(CapacityManagerTest, SkipsBusyFilesAndRebuildsUsage) {
+    {
+        CapacityManager capacity(*db_, *content_, config_);
+        store(capacity, "/open.txt", 600, true);
+        store(capacity, "/closed.txt", 600, true);
+        EXPECT_EQ(1u, capacity.enforce([](const std::string& path) { return path != "/open.txt"; }));
+        EXPECT_TRUE(db_->exists("content:/open.txt"));
+        EXPECT_FALSE(db_->exists("content:/closed.txt"));
+    }
+
+    CapacityManager reloaded(*db_, *content_, config_);
+    CapacityStats stats = reloaded.getStats();
+    EXPECT_EQ(1u, stats.files);
+    EXPECT_EQ(600u, stats.usage_bytes);
+}
+
+TEST_F(CapacityManagerTest, CountsSharedBodiesOnce) {
+    CapacityManager capacity(*db_, *content_, config_);
+    store(capacity, "/a.txt", 400, true);
+    db_->put("meta:/b.txt", "type:file;generated");
+    ASSERT_TRUE(content_->copy("/a.txt", "/b.txt"));
+    capacity.recordStore("/b.txt", 400, true);
+
+    CapacityStats stats = capacity.getStats();
+    EXPECT_EQ(400u, stats.usage_bytes);
+    EXPECT_EQ(2u, stats.files);
+    EXPECT_EQ(1u, stats.blobs);
+
+    // Both copies' accesses keep the shared body warmer than /c.txt
+    store(capacity, "/c.txt", 700, true);
+    EXPECT_EQ(1u, capacity.enforce(any));
+    EXPECT_FALSE(db_->exists("content:/c.txt"));
+    EXPECT_TRUE(db_->exists("content:/a.txt"));
+    EXPECT_TRUE(db_->exists("content:/b.txt"));
+    EXPECT_EQ(700u, capacity.getStats().evicted_bytes);
+
+    {
+        CapacityManager reloaded(*db_, *content_, config_);
+        EXPECT_EQ(400u, reloaded.getStats().usage_bytes);
+        EXPECT_EQ(1u, reloaded.getStats().blobs);
+    }
+
+    // The blob is freed with its last path
+    content_->remove("/a.txt");
+    capacity.recordRemove("/a.txt");
+    EXPECT_EQ(400u, capacity.getStats().usage_bytes);
+    content_->remove("/b.txt");
+    capacity.recordRemove("/b.txt");
+    EXPECT_EQ(0u, capacity.getStats().usage_bytes);
+    EXPECT_EQ(0u, capacity.getStats().blobs);
+}
+
+TEST_F(CapacityManagerTest, EvictsSharedBodiesWithAllTheirPaths) {
+    CapacityManager capacity(*db_, *content_, config_);
+    store(capacity, "/user.txt", 700, false);
+    store(capacity, "/a/LICENSE", 400, true);
+    db_->put("meta:/b/LICENSE", "type:file;generated");
+    ASSERT_TRUE(content_->copy("/a/LICENSE", "/b/LICENSE"));
+    capacity.recordStore("/b/LICENSE", 400, true);
+    
+    // Not while one copy is open
+    EXPECT_EQ(0u, capacity.enforce([](const std::string& path) { return path != "/b/LICENSE"; }));
+    EXPECT_TRUE(db_->exists("content:/a/LICENSE"));
+    
+    EXPECT_EQ(2u, capacity.enforce(any));
+    EXPECT_FALSE(db_->exists("content:/a/LICENSE"));
+    EXPECT_FALSE(db_->exists("content:/b/LICENSE"));
+    std::string metadata;
+    ASSERT_TRUE(db_->get("meta:/b/LICENSE", metadata));
+    EXPECT_TRUE(FileMetadata::hasFlag(metadata, "evicted"));
+    
+    CapacityStats stats = capacity.getStats();
+    EXPECT_EQ(700u, stats.usage_bytes);
+    EXPECT_EQ(400u, stats.evicted_bytes);
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include "content_store.h"
+#include "db_manager.h"
+#include <filesystem>
+
+class ContentStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_db_path_ = "./test_content_db_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        db_ = std::make_unique<DBManager>(test_db_path_);
+        content_ = std::make_unique<ContentStore>(*db_);
+    }
+
+    void TearDown() override {
+        content_.reset();
+        db_.reset();
+        std::filesystem::remove_all(test_db_path_);
+    }
+
+    size_t countKeys(const std::string& prefix) {
+        return db_->listKeys(prefix).size();
+    }
+
+    std::string refcountOf(const std::string& path) {
+        std::string reference;
+        db_->get("content:" + path, reference);
+        std::string hash = reference.substr(6, 16);
+        std::string count;
+        db_->get("refcount:" + hash, count);
+        return count;
+    }
+
+    std::string test_db_path_;
+    std::unique_ptr<DBManager> db_;
+    std::unique_ptr<ContentStore> content_;
+};
+
+TEST_F(ContentStoreTest, Hash) {
+    // Reference values for XXH64 with seed 0
+    EXPECT_EQ(0xEF46DB3751D8E999ull, ContentStore::hash(""));
+    EXPECT_EQ(0xD24EC4F1A98C6E5Bull, ContentStore::hash("a"));
+    EXPECT_EQ(0x44BC2CF5AD770999ull, ContentStore::hash("abc"));
+}
+
+TEST_F(ContentStoreTest, IdenticalBodiesShareOneBlob) {
+    std::string body(4096, 'x');
+    ASSERT_TRUE(content_->put("/a.txt", body));
+    ASSERT_TRUE(content_->put("/b.txt", body));
+
+    EXPECT_EQ(1u, countKeys("blob:"));
+    EXPECT_EQ("2", refcountOf("/a.txt"));
+
+    std::string result;
+    ASSERT_TRUE(content_->get("/b.txt", result));
+    EXPECT_EQ(body, result);
+
+    uint64_t size = 0;
+    ASSERT_TRUE(content_->size("/a.txt", size));
+    EXPECT_EQ(4096u, size);
+}
+
+TEST_F(ContentStoreTest, WritesAreCopyOnWrite) {
+    ASSERT_TRUE(content_->put("/a.txt", "shared"));
+    ASSERT_TRUE(content_->copy("/a.txt", "/b.txt"));
+    EXPECT_EQ(1u, countKeys("blob:"));
+    EXPECT_EQ("2", refcountOf("/b.txt"));
+
+    ASSERT_TRUE(content_->put("/b.txt", "changed"));
+    std::string result;
+    ASSERT_TRUE(content_->get("/a.txt", result));
+    EXPECT_EQ("shared", result);
+    ASSERT_TRUE(content_->get("/b.txt", result));
+    EXPECT_EQ("changed", result);
+    EXPECT_EQ(2u, countKeys("blob:"));
+    EXPECT_EQ("1", refcountOf("/a.txt"));
+}
+
+TEST_F(ContentStoreTest, RemovingLastReferenceDropsBlob) {
+    ASSERT_TRUE(content_->put("/a.txt", "body"));
+    ASSERT_TRUE(content_->put("/b.txt", "body"));
+
+    ASSERT_TRUE(content_->remove("/a.txt"));
+    EXPECT_FALSE(content_->exists("/a.txt"));
+    EXPECT_EQ(1u, countKeys("blob:"));
+
+    ASSERT_TRUE(content_->remove("/b.txt"));
+    EXPECT_EQ(0u, countKeys("blob:"));
+    EXPECT_EQ(0u, countKeys("refcount:"));
+}
+
+TEST_F(ContentStoreTest, WriteAppliesExtraKeysAtomically) {
+    ASSERT_TRUE(content_->write({{"/a.txt", "one"}, {"/b.txt", "one"}}, {},
+                                {{"meta:/a.txt", "type:file"}, {"meta:/b.txt", "type:file"}}));
+    EXPECT_TRUE(db_->exists("meta:/a.txt"));
+    EXPECT_EQ(1u, countKeys("blob:"));
+    EXPECT_EQ("2", refcountOf("/a.txt"));
+}
+
+TEST_F(ContentStoreTest, SnapshotsReadReplacedBodies) {
+    ASSERT_TRUE(content_->put("/a.txt", "version 1"));
+    DBManager::Snapshot snapshot = db_->snapshot();
+
+    // The old blob is released, but the snapshot still sees it
+    ASSERT_TRUE(content_->put("/a.txt", "version 2, longer"));
+    EXPECT_EQ(1u, countKeys("blob:"));
+
+    std::string result;
+    ASSERT_TRUE(content_->get("/a.txt", result, snapshot));
+    EXPECT_EQ("version 1", result);
+    uint64_t size = 0;
+    ASSERT_TRUE(content_->size("/a.txt", size, snapshot));
+    EXPECT_EQ(9u, size);
+    ASSERT_TRUE(content_->get("/a.txt", result));
+    EXPECT_EQ("version 2, longer", result);
+}
+
+TEST_F(ContentStoreTest, ReadsAndDeduplicatesInlineContent) {
+    // Content written before deduplication is stored inline
+    db_->put("content:/old1.txt", "legacy");
+    db_->put("content:/old2.txt", "legacy");
+
+    std::string result;
+    ASSERT_TRUE(content_->get("/old1.txt", result));
+    EXPECT_EQ("legacy", result);
+    uint64_t size = 0;
+    ASSERT_TRUE(content_->size("/old1.txt", size));
+    EXPECT_EQ(6u, size);
+
+    EXPECT_EQ(2u, content_->deduplicate());
+    EXPECT_EQ(1u, countKeys("blob:"));
+    EXPECT_EQ("2", refcountOf("/old2.txt"));
+    ASSERT_TRUE(content_->get("/old2.txt", result));
+    EXPECT_EQ("legacy", result);
+
+    // Nothing left to convert
+    EXPECT_EQ(0u, content_->deduplicate());
+}
+
+TEST_F(ContentStoreTest, PreviewRecords) {
+    std::string body = "#include <stdio.h>\n" + std::string(5000, 'x') + "\nint main() {}\n";
+    FilePreview preview = FilePreview::fromContent(body);
+    EXPECT_EQ("text", preview.type);
+    EXPECT_EQ(body.size(), preview.size);
+    EXPECT_EQ(FilePreview::HEAD_BYTES, preview.head.size());
+    EXPECT_EQ(FilePreview::TAIL_BYTES, preview.tail.size());
+    EXPECT_EQ(0u, preview.head.find("#include"));
+
+    FilePreview parsed;
+    ASSERT_TRUE(FilePreview::parse(preview.serialize(), parsed));
+    EXPECT_EQ(preview.head, parsed.head);
+    EXPECT_EQ(preview.tail, parsed.tail);
+    EXPECT_EQ(preview.size, parsed.size);
+
+    // Cuts never split a UTF-8 sequence
+    std::string accented = std::string(199, 'a') + "\xc3\xa9";
+    EXPECT_EQ(std::string(199, 'a'), FilePreview::fromContent(accented).head);
+
+    EXPECT_EQ("png", FilePreview::detectType(std::string("\x89PNG\r\n\x1a\n", 8)));
+    EXPECT_EQ("binary", FilePreview::detectType(std::string("ab\0cd", 5)));
+    EXPECT_EQ("empty", FilePreview::detectType(""));
+    EXPECT_TRUE(FilePreview::fromContent(std::string("\x89PNG", 4)).head.empty());
+}
+
+TEST_F(ContentStoreTest, DigestFollowsWrites) {
+    ASSERT_TRUE(content_->put("/src/a.c", "int a;"));
+    ASSERT_TRUE(content_->put("/src/b.c", "int b;"));
+    ASSERT_TRUE(content_->copy("/src/a.c", "/src/c.c"));
+    ASSERT_TRUE(content_->put("/other.c", "int other;"));
+
+    DirectoryDigest digest;
+    ASSERT_TRUE(content_->directoryDigest("/src", digest));
+    ASSERT_EQ(3u, digest.files.size());
+    EXPECT_EQ("int a;", digest.files["/src/c.c"].head);
+    EXPECT_TRUE(digest.files["/src/a.c"].tail.empty());
+
+    ASSERT_TRUE(content_->put("/src/b.c", "int b = 2;"));
+    ASSERT_TRUE(content_->remove("/src/a.c"));
+    ASSERT_TRUE(content_->directoryDigest("/src", digest));
+    ASSERT_EQ(2u, digest.files.size());
+    EXPECT_EQ("int b = 2;", digest.files["/src/b.c"].head);
+    EXPECT_EQ(10u, digest.files["/src/b.c"].size);
+
+    FilePreview preview;
+    EXPECT_FALSE(content_->preview("/src/a.c", preview));
+    ASSERT_TRUE(content_->preview("/src/b.c", preview));
+    EXPECT_EQ("int b = 2;", preview.tail);
+
+    ASSERT_TRUE(content_->remove("/src/b.c"));
+    ASSERT_TRUE(content_->remove("/src/c.c"));
+    EXPECT_FALSE(content_->directoryDigest("/src", digest));
+    EXPECT_TRUE(content_->directoryDigest("", digest));
+}
+
+TEST_F(ContentStoreTest, DeferredWritesRefreshDerivedRecordsOnce) {
+    ASSERT_TRUE(content_->put("/src/a.c", "int a;"));
+    ASSERT_TRUE(content_->write({{"/src/a.c", "int a = 1;"}}, {}, {}, {}, false));
+    ASSERT_TRUE(content_->write({{"/src/b.c", "int b;"}}, {}, {}, {}, false));
+
+    std::string body;
+    ASSERT_TRUE(content_->get("/src/a.c", body));
+    EXPECT_EQ("int a = 1;", body);
+    DirectoryDigest digest;
+    ASSERT_TRUE(content_->directoryDigest("/src", digest));
+    ASSERT_EQ(1u, digest.files.size());
+    EXPECT_EQ("int a;", digest.files["/src/a.c"].head);
+
+    ASSERT_TRUE(content_->refreshDerived("/src/a.c"));
+    ASSERT_TRUE(content_->refreshDerived("/src/b.c"));
+    ASSERT_TRUE(content_->directoryDigest("/src", digest));
+    ASSERT_EQ(2u, digest.files.size());
+    EXPECT_EQ("int a = 1;", digest.files["/src/a.c"].head);
+    FilePreview preview;
+    ASSERT_TRUE(content_->preview("/src/b.c", preview));
+    EXPECT_EQ("int b;", preview.tail);
+
+    // Removed before the refresh: the records go with the file
+    ASSERT_TRUE(content_->remove("/src/b.c"));
+    ASSERT_TRUE(content_->refreshDerived("/src/b.c"));
+    EXPECT_FALSE(content_->preview("/src/b.c", preview));
+    ASSERT_TRUE(content_->directoryDigest("/src", digest));
+    EXPECT_EQ(1u, digest.files.size());
+}
+
+TEST_F(ContentStoreTest, RebuildsPreviewsForUntrackedContent) {
+    // Written around the store, as by archive imports or older versions
+    db_->put("content:/a/x.txt", "x body");
+    db_->put("content:/a/sub/y.txt", "y body");
+    db_->put("content:/ab/z.txt", "z body");
+    db_->put("preview:/a/stale.txt", FilePreview::fromContent("stale").serialize());
+
+    EXPECT_EQ(2u, content_->rebuildPreviews("/a"));
+
+    DirectoryDigest digest;
+    ASSERT_TRUE(content_->directoryDigest("/a", digest));
+    ASSERT_EQ(1u, digest.files.size());
+    EXPECT_EQ("x body", digest.files["/a/x.txt"].head);
+    ASSERT_TRUE(content_->directoryDigest("/a/sub", digest));
+    EXPECT_EQ(1u, digest.files.size());
+
+    FilePreview preview;
+    EXPECT_FALSE(content_->preview("/a/stale.txt", preview));
+    EXPECT_FALSE(content_->preview("/ab/z.txt", preview));
+}
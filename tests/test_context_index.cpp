@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "context_index.h"
+#include "content_store.h"
+#include "db_manager.h"
+#include <filesystem>
+
+class ContextIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_db_path_ = "./test_context_index_db_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        db_ = std::make_unique<DBManager>(test_db_path_);
+        content_ = std::make_unique<ContentStore>(*db_);
+    }
+
+    void TearDown() override {
+        content_.reset();
+        db_.reset();
+        std::filesystem::remove_all(test_db_path_);
+    }
+
+    std::vector<std::string> searchPaths(const std::string& query, size_t k = 10,
+                                         const std::unordered_set<std::string>& exclude = {}) {
+        std::vector<std::string> paths;
+        for (const auto& hit : content_->index().search(query, k, exclude)) {
+            paths.push_back(hit.path);
+        }
+        return paths;
+    }
+
+    std::string test_db_path_;
+    std::unique_ptr<DBManager> db_;
+    std::unique_ptr<ContentStore> content_;
+};
+
+TEST_F(ContextIndexTest, SplitsIdentifiers) {
+    EXPECT_EQ((std::vector<std::string>{"parsehttpheader", "parse", "http", "header"}),
+              ContextIndex::terms("parseHTTPHeader"));
+    EXPECT_EQ((std::vector<std::string>{"read_config", "read", "config", "x2"}),
+              ContextIndex::terms("read_config(42, x2);"));
+    EXPECT_EQ((std::vector<std::string>{"src", "net", "http_client", "http", "client", "cpp"}),
+              ContextIndex::terms("/src/net/http_client.cpp"));
+}
+
+TEST_F(ContextIndexTest, RanksByRelevance) {
+    ASSERT_TRUE(content_->put("/src/http/client.cpp", "HttpClient::send(Request request) { socket_.write(request); }"));
+    ASSERT_TRUE(content_->put("/src/http/request.h", "struct Request { std::string url; Headers headers; };"));
+    ASSERT_TRUE(content_->put("/src/db/store.cpp", "Store::put(Key key, Value value) { batch_.put(key, value); }"));
+    ASSERT_TRUE(content_->put("/docs/readme.md", "Build with cmake."));
+
+    std::vector<std::string> hits = searchPaths("/src/http/server.cpp");
+    ASSERT_GE(hits.size(), 2u);
+    EXPECT_TRUE(hits[0] == "/src/http/client.cpp" || hits[0] == "/src/http/request.h");
+    EXPECT_EQ(hits.end(), std::find(hits.begin(), hits.end(), "/docs/readme.md"));
+
+    // Content matches too, not only paths
+    EXPECT_EQ("/src/http/request.h", searchPaths("/tests/url_headers_test.py", 1).front());
+
+    EXPECT_EQ(1u, searchPaths("/src/http/server.cpp", 1).size());
+    EXPECT_EQ(hits.size() - 1, searchPaths("/src/http/server.cpp", 10, {hits[0]}).size());
+}
+
+TEST_F(ContextIndexTest, FollowsWritesAndRemovals) {
+    ASSERT_TRUE(content_->put("/a/widget.cpp", "Sprocket::draw()"));
+    EXPECT_EQ(1u, searchPaths("sprocket").size());
+
+    // Rewritten without the term
+    ASSERT_TRUE(content_->put("/a/widget.cpp", "Gadget::draw()"));
+    EXPECT_EQ(1u, searchPaths("gadget").size());
+    EXPECT_EQ(0u, db_->listKeys("index:sprocket:").size());
+
+    ASSERT_TRUE(content_->copy("/a/widget.cpp", "/b/copy.cpp"));
+    EXPECT_EQ(2u, searchPaths("gadget").size());
+
+    ASSERT_TRUE(content_->remove("/a/widget.cpp"));
+    ASSERT_TRUE(content_->remove("/b/copy.cpp"));
+    EXPECT_EQ(0u, searchPaths("gadget").size());
+    EXPECT_EQ(0u, db_->listKeys("index:").size());
+    EXPECT_EQ(0u, db_->listKeys("indexdoc:").size());
+
+    uint64_t documents, length;
+    ASSERT_TRUE(content_->index().stats(documents, length));
+    EXPECT_EQ(0u, documents);
+    EXPECT_EQ(0u, length);
+}
+
+TEST_F(ContextIndexTest, DeferredWritesWaitForRefresh) {
+    ASSERT_TRUE(content_->put("/a/widget.cpp", "Sprocket::draw()"));
+
+    // Chunks of an open file keep the old entries until it is refreshed
+    ASSERT_TRUE(content_->write({{"/a/widget.cpp", "Gadget::"}}, {}, {}, {}, false));
+    ASSERT_TRUE(content_->write({{"/a/widget.cpp", "Gadget::draw()"}}, {}, {}, {}, false));
+    EXPECT_EQ(1u, searchPaths("sprocket").size());
+    EXPECT_TRUE(searchPaths("gadget").empty());
+
+    ASSERT_TRUE(content_->refreshDerived("/a/widget.cpp"));
+    EXPECT_TRUE(searchPaths("sprocket").empty());
+    EXPECT_EQ(1u, searchPaths("gadget").size());
+
+    // Refreshing a removed file is a no-op
+    ASSERT_TRUE(content_->remove("/a/widget.cpp"));
+    ASSERT_TRUE(content_->refreshDerived("/a/widget.cpp"));
+    EXPECT_EQ(0u, db_->listKeys("indexdoc:").size());
+}
+
+TEST_F(ContextIndexTest, PostingsCarryDocumentLength) {
+    ASSERT_TRUE(content_->put("/a/widget.cpp", "Gadget::draw()"));
+    std::string posting;
+    ASSERT_TRUE(db_->get("index:gadget:/a/widget.cpp", posting));
+    EXPECT_EQ("1 " + std::to_string(ContextIndex::Document::analyze("/a/widget.cpp", "Gadget::draw()").length),
+              posting);
+
+    // A longer body with the same frequency still updates the posting
+    std::string longer = "Gadget::draw() { paint(); flush(); }";
+    ASSERT_TRUE(content_->put("/a/widget.cpp", longer));
+    ASSERT_TRUE(db_->get("index:gadget:/a/widget.cpp", posting));
+    EXPECT_EQ("1 " + std::to_string(ContextIndex::Document::analyze("/a/widget.cpp", longer).length), posting);
+}
+
+TEST_F(ContextIndexTest, SkipsBinaryFiles) {
+    ASSERT_TRUE(content_->put("/img/logo.png", std::string("\x89PNG\r\n\x1a\n", 8)));
+    EXPECT_TRUE(searchPaths("logo").empty());
+
+    // Replacing text with binary drops it from the index
+    ASSERT_TRUE(content_->put("/data/table.txt", "table rows"));
+    ASSERT_TRUE(content_->put("/data/table.txt", std::string("ab\0cd", 5)));
+    EXPECT_TRUE(searchPaths("table").empty());
+}
+
+TEST_F(ContextIndexTest, RebuildIndexesUntrackedContent) {
+    db_->put("content:/lib/parser.c", "int parse_token(void);");
+    db_->put("content:/lib/lexer.c", "int next_token(void);");
+    ASSERT_TRUE(content_->put("/lib/gone.c", "int token;"));
+    db_->remove("content:/lib/gone.c");
+
+    EXPECT_EQ(2u, content_->rebuildPreviews("/lib"));
+    EXPECT_EQ((std::vector<std::string>{"/lib/parser.c"}), searchPaths("parse"));
+    EXPECT_EQ(2u, searchPaths("token").size());
+    EXPECT_EQ(0u, db_->listKeys("indexdoc:/lib/gone.c").size());
+
+    uint64_t documents, length;
+    ASSERT_TRUE(content_->index().stats(documents, length));
+    EXPECT_EQ(2u, documents);
+}
+
+TEST_F(ContextIndexTest, SnippetCoversMatchingLines) {
+    std::string body;
+    for (int i = 0; i < 200; i++) {
+        body += i == 150 ? "void renderFrame();\n" : "// filler line " + std::to_string(i) + "\n";
+    }
+
+    std::string snippet = ContextIndex::snippet(body, "/src/render.cpp", 4096);
+    EXPECT_NE(std::string::npos, snippet.find("renderFrame"));
+    EXPECT_LE(snippet.size(), 4096u);
+    EXPECT_EQ(std::string::npos, snippet.find("filler line 0\n"));
+
+    EXPECT_LE(ContextIndex::snippet(body, "/src/render.cpp", 100).size(), 100u);
+    EXPECT_EQ(0u, ContextIndex::snippet(body, "/unrelated", 4096).find("// filler line 0\n"));
+}
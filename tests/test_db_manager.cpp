@@ -77,4 +77,150 @@ TEST_F(DBManagerTest, EmptyPrefix) {
     
     auto keys = db_->listKeys("");
     EXPECT_GE(keys.size(), 2);
-}
\ No newline at end of file
+}
+
+TEST_F(DBManagerTest, WriteBatch) {
+    db_->put("stale", "value");
+    
+    EXPECT_TRUE(db_->writeBatch({{"batch/a", "1"}, {"batch/b", "2"}}, {"stale"}));
+    
+    std::string value;
+    EXPECT_TRUE(db_->get("batch/a", value));
+    EXPECT_EQ("1", value);
+    EXPECT_TRUE(db_->get("batch/b", value));
+    EXPECT_EQ("2", value);
+    EXPECT_FALSE(db_->exists("stale"));
+}
+
+TEST_F(DBManagerTest, SnapshotsKeepTheirView) {
+    db_->put("k", "old");
+    DBManager::Snapshot snapshot = db_->snapshot();
+    
+    db_->put("k", "new");
+    db_->put("added", "x");
+    
+    std::string value;
+    EXPECT_TRUE(db_->get("k", value, snapshot));
+    EXPECT_EQ("old", value);
+    EXPECT_FALSE(db_->get("added", value, snapshot));
+    EXPECT_TRUE(db_->get("k", value));
+    EXPECT_EQ("new", value);
+}
+
+TEST_F(DBManagerTest, ScanPrefixes) {
+    db_->put("a:1", "x");
+    db_->put("a:2", "y");
+    db_->put("b:1", "z");
+    db_->put("c:1", "skipped");
+    
+    std::vector<std::string> visited;
+    EXPECT_TRUE(db_->scan({"a:", "b:"}, [&](const std::string& key, const std::string& value) {
+        visited.push_back(key + "=" + value);
+        return true;
+    }));
+    EXPECT_EQ((std::vector<std::string>{"a:1=x", "a:2=y", "b:1=z"}), visited);
+    
+    EXPECT_FALSE(db_->scan({"a:"}, [](const std::string&, const std::string&) { return false; }));
+}
+
+class LayeredDBManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::string suffix = std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        base_path_ = "./test_base_db_" + suffix;
+        upper_path_ = "./test_upper_db_" + suffix;
+        
+        DBManager base(base_path_);
+        base.put("meta:/a.txt", "type:file");
+        base.put("content:/a.txt", "base a");
+        base.put("content:/b.txt", "base b");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(base_path_);
+        std::filesystem::remove_all(upper_path_);
+    }
+
+    std::string base_path_;
+    std::string upper_path_;
+};
+
+TEST_F(LayeredDBManagerTest, ReadsFallThroughToBase) {
+    DBManager db(upper_path_, base_path_);
+    
+    std::string value;
+    EXPECT_TRUE(db.get("content:/a.txt", value));
+    EXPECT_EQ("base a", value);
+    
+    EXPECT_TRUE(db.put("content:/a.txt", "upper a"));
+    EXPECT_TRUE(db.put("content:/c.txt", "upper c"));
+    EXPECT_TRUE(db.get("content:/a.txt", value));
+    EXPECT_EQ("upper a", value);
+    
+    EXPECT_EQ((std::vector<std::string>{"content:/a.txt", "content:/b.txt", "content:/c.txt"}),
+              db.listKeys("content:"));
+}
+
+TEST_F(LayeredDBManagerTest, WhiteoutsHideBaseKeys) {
+    {
+        DBManager db(upper_path_, base_path_);
+        EXPECT_TRUE(db.remove("content:/b.txt"));
+        EXPECT_FALSE(db.exists("content:/b.txt"));
+        EXPECT_EQ((std::vector<std::string>{"content:/a.txt"}), db.listKeys("content:"));
+        EXPECT_EQ(2u, db.listKeys("").size());  // Whiteout markers are not listed
+    }
+    {
+        DBManager upper(upper_path_);
+        EXPECT_EQ((std::vector<std::string>{"whiteout:content:/b.txt"}), upper.listKeys("whiteout:"));
+    }
+    
+    // The base is untouched and the whiteout survives a remount
+    {
+        DBManager base(base_path_ + "_copy", base_path_);
+        EXPECT_TRUE(base.exists("content:/b.txt"));
+    }
+    std::filesystem::remove_all(base_path_ + "_copy");
+    
+    {
+        DBManager db(upper_path_, base_path_);
+        EXPECT_FALSE(db.exists("content:/b.txt"));
+        
+        // Writing the key again removes the whiteout
+        EXPECT_TRUE(db.put("content:/b.txt", "new b"));
+        std::string value;
+        EXPECT_TRUE(db.get("content:/b.txt", value));
+        EXPECT_EQ("new b", value);
+    }
+    
+    DBManager upper(upper_path_);
+    EXPECT_TRUE(upper.listKeys("whiteout:").empty());
+}
+
+TEST_F(LayeredDBManagerTest, IngestedKeysReplaceWhiteouts) {
+    std::string export_dir = upper_path_ + "_export";
+    std::filesystem::create_directory(export_dir);
+    SstExportWriter writer(export_dir, 1 << 20);
+    ASSERT_TRUE(writer.put("content:/a.txt", "imported a"));
+    ASSERT_TRUE(writer.put("content:/b.txt", "imported b"));
+    ASSERT_TRUE(writer.finish());
+    
+    {
+        DBManager db(upper_path_, base_path_);
+        EXPECT_TRUE(db.remove("content:/a.txt"));
+        EXPECT_TRUE(db.remove("content:/b.txt"));
+        EXPECT_TRUE(db.remove("meta:/a.txt"));
+        
+        ASSERT_TRUE(db.ingestFiles(writer.files()));
+        std::string value;
+        EXPECT_TRUE(db.get("content:/b.txt", value));
+        EXPECT_EQ("imported b", value);
+        EXPECT_EQ((std::vector<std::string>{"content:/a.txt", "content:/b.txt"}), db.listKeys("content:"));
+        
+        // Deletions of keys the import didn't contain still stand
+        EXPECT_FALSE(db.exists("meta:/a.txt"));
+    }
+    
+    DBManager upper(upper_path_);
+    EXPECT_EQ((std::vector<std::string>{"whiteout:meta:/a.txt"}), upper.listKeys("whiteout:"));
+    std::filesystem::remove_all(export_dir);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include "generation_batcher.h"
+#include "llm_client.h"
+#include <algorithm>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+class GenerationBatcherTest : public ::testing::Test {
+protected:
+    GenerationBatcher::Send recorder() {
+        return [this](const std::vector<std::string>& paths,
+                      const std::vector<std::shared_ptr<StreamingBuffer>>& buffers) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sent_.push_back(paths);
+            for (size_t i = 0; i < buffers.size(); i++) {
+                buffers[i]->appendData(paths[i]);
+                buffers[i]->markComplete();
+            }
+        };
+    }
+
+    std::vector<std::vector<std::string>> sent() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sent_;
+    }
+
+    std::mutex mutex_;
+    std::vector<std::vector<std::string>> sent_;
+};
+
+TEST_F(GenerationBatcherTest, GroupsFilesWithinWindow) {
+    GenerationBatcher batcher;
+    auto a = batcher.add("/src", "/src/a.c", 100ms, 8, recorder());
+    auto b = batcher.add("/src", "/src/b.c", 100ms, 8, recorder());
+    auto other = batcher.add("/docs", "/docs/x.md", 100ms, 8, recorder());
+    EXPECT_EQ(3u, batcher.pendingFiles());
+
+    // Buffers fill once the window has passed
+    char buf[16];
+    EXPECT_EQ(8u, b->readData(buf, sizeof(buf), 0));
+    EXPECT_EQ("/src/a.c", a->getContent());
+
+    auto batches = sent();
+    while (batches.size() < 2) {
+        std::this_thread::sleep_for(5ms);
+        batches = sent();
+    }
+    std::sort(batches.begin(), batches.end());
+    EXPECT_EQ((std::vector<std::string>{"/docs/x.md"}), batches[0]);
+    EXPECT_EQ((std::vector<std::string>{"/src/a.c", "/src/b.c"}), batches[1]);
+    EXPECT_EQ(0u, batcher.pendingFiles());
+}
+
+TEST_F(GenerationBatcherTest, FullBatchIsSentImmediately) {
+    GenerationBatcher batcher;
+    batcher.add("/src", "/src/a.c", 10s, 2, recorder());
+    EXPECT_TRUE(sent().empty());
+    auto b = batcher.add("/src", "/src/b.c", 10s, 2, recorder());
+    EXPECT_TRUE(b->isComplete());
+    ASSERT_EQ(1u, sent().size());
+
+    // The next file opens a new batch
+    batcher.add("/src", "/src/c.c", 10s, 2, recorder());
+    EXPECT_EQ(1u, batcher.pendingFiles());
+}
+
+TEST_F(GenerationBatcherTest, PendingBatchesAreSentOnDestruction) {
+    std::shared_ptr<StreamingBuffer> buffer;
+    {
+        GenerationBatcher batcher;
+        buffer = batcher.add("/src", "/src/a.c", 10s, 8, recorder());
+    }
+    EXPECT_TRUE(buffer->isComplete());
+    EXPECT_EQ(1u, sent().size());
+}
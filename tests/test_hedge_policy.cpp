@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "hedge_policy.h"
+
+using namespace std::chrono_literals;
+
+static HedgeConfig enabledConfig() {
+    HedgeConfig config;
+    config.enabled = true;
+    config.min_samples = 10;
+    config.min_delay_ms = 50;
+    return config;
+}
+
+TEST(HedgePolicyTest, DelayFollowsPercentileOfFirstTokens) {
+    HedgePolicy policy(enabledConfig());
+    for (int i = 1; i <= 9; i++) {
+        policy.recordFirstToken(std::chrono::milliseconds(i * 100), false);
+    }
+    EXPECT_FALSE(policy.delay());  // Too few samples
+
+    policy.recordFirstToken(1000ms, false);
+    ASSERT_TRUE(policy.delay());
+    EXPECT_EQ(1000ms, *policy.delay());  // p95 of 100..1000
+
+    // Old samples age out of the window
+    for (size_t i = 0; i < HedgePolicy::MAX_SAMPLES; i++) {
+        policy.recordFirstToken(200ms, false);
+    }
+    EXPECT_EQ(200ms, *policy.delay());
+}
+
+TEST(HedgePolicyTest, DelayHasAFloor) {
+    HedgePolicy policy(enabledConfig());
+    for (int i = 0; i < 10; i++) {
+        policy.recordFirstToken(5ms, false);
+    }
+    EXPECT_EQ(50ms, *policy.delay());
+}
+
+TEST(HedgePolicyTest, DisabledNeverHedges) {
+    HedgePolicy policy{HedgeConfig()};
+    for (int i = 0; i < 100; i++) {
+        policy.recordFirstToken(100ms, false);
+    }
+    EXPECT_FALSE(policy.delay());
+}
+
+TEST(HedgePolicyTest, HedgesAreCappedAtFraction) {
+    HedgeConfig config = enabledConfig();
+    config.max_fraction = 0.1;
+    HedgePolicy policy(config);
+
+    for (int i = 0; i < 9; i++) {
+        policy.recordRequest();
+    }
+    EXPECT_FALSE(policy.admitHedge());
+    policy.recordRequest();
+    EXPECT_TRUE(policy.admitHedge());
+    EXPECT_FALSE(policy.admitHedge());
+
+    for (int i = 0; i < 10; i++) {
+        policy.recordRequest();
+    }
+    EXPECT_TRUE(policy.admitHedge());
+
+    policy.recordFirstToken(100ms, true);
+    HedgePolicy::Stats stats = policy.stats();
+    EXPECT_EQ(20u, stats.requests);
+    EXPECT_EQ(2u, stats.hedged);
+    EXPECT_EQ(1u, stats.hedge_wins);
+}
+
+TEST(HedgePolicyTest, HedgingIsParsedFromMountConfig) {
+    MountConfig config = MountConfig::parse("[hedging]\nenabled = true\npercentile = 0.99\nmax_fraction = 0.02\n");
+    EXPECT_TRUE(config.hedging.enabled);
+    EXPECT_DOUBLE_EQ(0.99, config.hedging.percentile);
+    EXPECT_DOUBLE_EQ(0.02, config.hedging.max_fraction);
+    EXPECT_EQ(250u, config.hedging.min_delay_ms);
+
+    EXPECT_THROW(MountConfig::parse("[hedging]\npercentile = 95\n"), std::runtime_error);
+}
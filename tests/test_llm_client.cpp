@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "llm_client.h"
 #include <cstdlib>
+#include <set>
 
 class LLMClientTest : public ::testing::Test {
 protected:
@@ -78,4 +79,183 @@ TEST_F(LLMClientTest, MockedResponse) {
         EXPECT_TRUE(error_msg.find("CURL") != std::string::npos || 
                     error_msg.find("API") != std::string::npos);
     }
-}
\ No newline at end of file
+}
+
+TEST_F(LLMClientTest, PromptStaysWithinTokenBudget) {
+    std::vector<FileContext> folder_context;
+    for (int i = 0; i < 50; i++) {
+        folder_context.push_back({"/src/file" + std::to_string(i) + ".c", std::string(200, 'f')});
+    }
+    std::vector<FileContext> recent_files;
+    for (int i = 0; i < 6; i++) {
+        recent_files.push_back({"/recent/" + std::to_string(i) + ".txt", std::string(3600, 'a' + i)});
+    }
+
+    GenerationOptions options;
+    options.prompt_token_budget = 1500;
+    std::string prompt = LLMClient::buildPrompt("/src/main.c", folder_context, recent_files, options);
+
+    Tokenizer estimator;
+    EXPECT_LE(estimator.count(prompt), 1500u);
+    EXPECT_NE(std::string::npos, prompt.find("/src/main.c"));
+    EXPECT_NE(std::string::npos, prompt.find("/src/file0.c"));
+    EXPECT_EQ(std::string::npos, prompt.find("/src/file49.c"));
+
+    // The newest recent file is kept, the oldest dropped first
+    EXPECT_NE(std::string::npos, prompt.find("--- /recent/5.txt ---"));
+    EXPECT_EQ(std::string::npos, prompt.find("--- /recent/0.txt ---"));
+
+    // Without a budget everything goes in
+    std::string unbounded = LLMClient::buildPrompt("/src/main.c", folder_context, recent_files);
+    EXPECT_NE(std::string::npos, unbounded.find("/src/file49.c"));
+    EXPECT_NE(std::string::npos, unbounded.find(std::string(3600, 'a')));
+}
+
+
+TEST_F(LLMClientTest, SiblingPromptsShareEverythingButTheTarget) {
+    std::vector<FileContext> folder_context;
+    for (int i = 0; i < 20; i++) {
+        folder_context.push_back({"/src/file" + std::to_string(i) + ".c", std::string(200, 'f')});
+    }
+    std::vector<FileContext> recent_files = {{"/include/api.h", "int api(void);"}};
+
+    GenerationOptions options;
+    options.prompt_token_budget = 1000;
+    std::string first = LLMClient::buildPrompt("/src/a.c", folder_context, recent_files, options);
+    std::string second = LLMClient::buildPrompt("/src/a_much_longer_sibling_name.c", folder_context, recent_files, options);
+
+    // The target path comes after all shared context
+    size_t target = first.find("/src/a.c");
+    ASSERT_NE(std::string::npos, target);
+    EXPECT_GT(target, first.find("--- /include/api.h ---"));
+    size_t common = 0;
+    while (common < first.size() && common < second.size() && first[common] == second[common]) {
+        common++;
+    }
+    EXPECT_GE(common, target - 1 - std::string("Generate content for the file at absolute path: ").size());
+}
+
+TEST_F(LLMClientTest, SlotAffinityIsStable) {
+    EXPECT_EQ(LLMClient::slotFor("/src", 4), LLMClient::slotFor("/src", 4));
+    EXPECT_LT(LLMClient::slotFor("/docs", 4), 4u);
+    EXPECT_EQ(0u, LLMClient::slotFor("/src", 0));
+
+    // Directories spread over the slots
+    std::set<unsigned> used;
+    for (int i = 0; i < 32; i++) {
+        used.insert(LLMClient::slotFor("/dir" + std::to_string(i), 4));
+    }
+    EXPECT_EQ(4u, used.size());
+}
+
+
+TEST_F(LLMClientTest, BatchResponseIsSplitIntoFiles) {
+    std::vector<std::string> paths = {"/src/a.c", "/src/b.c", "/src/c.c"};
+    std::vector<std::shared_ptr<StreamingBuffer>> buffers;
+    for (size_t i = 0; i < paths.size(); i++) {
+        buffers.push_back(std::make_shared<StreamingBuffer>());
+    }
+
+    BatchDemultiplexer demux(paths, buffers);
+    // Markers and content split at arbitrary points, as deltas arrive
+    demux.append("<<<FI");
+    demux.append("LE /src/b.c>>>\nint b");
+    EXPECT_EQ("int b", buffers[1]->getContent());  // Streamed before the line ends
+    demux.append(" = 1;\n<<<");
+    demux.append("END>>>\nstray text\n<<<FILE /src/a.c>>>\r\n");
+    demux.append("<<not a marker\nint a;\n<<<END>>>");
+    EXPECT_TRUE(buffers[1]->isComplete());
+    EXPECT_FALSE(buffers[0]->isComplete());
+
+    EXPECT_EQ((std::vector<size_t>{2}), demux.finish());
+    EXPECT_EQ("int b = 1;\n", buffers[1]->getContent());
+    EXPECT_TRUE(buffers[0]->isComplete());
+    EXPECT_EQ("<<not a marker\nint a;\n", buffers[0]->getContent());
+    EXPECT_FALSE(buffers[2]->isComplete());
+}
+
+TEST_F(LLMClientTest, TruncatedBatchKeepsPartialFile) {
+    std::vector<std::string> paths = {"/a.txt", "/b.txt"};
+    std::vector<std::shared_ptr<StreamingBuffer>> buffers = {
+        std::make_shared<StreamingBuffer>(), std::make_shared<StreamingBuffer>()};
+
+    BatchDemultiplexer demux(paths, buffers);
+    demux.append("<<<FILE /a.txt>>>\nfirst\n<<<FILE /b.txt>>>\nsecond, cut o");
+    EXPECT_TRUE(buffers[0]->isComplete());  // A new section closes the previous one
+    EXPECT_TRUE(demux.finish("CURL request failed: timeout").empty());
+    EXPECT_EQ("first\n", buffers[0]->getContent());
+    EXPECT_TRUE(buffers[1]->hasError());
+}
+
+TEST_F(LLMClientTest, SseDecoderHandlesSplitEvents) {
+    SseDecoder decoder;
+    std::string content;
+    bool done = false;
+    auto on_content = [&content](const std::string& delta) { content += delta; return true; };
+    auto on_done = [&done]() { done = true; return true; };
+
+    std::string stream = "data: {\"choices\":[{\"delta\":{\"role\":\"assistant\"}}]}\n\n"
+                         "data: {\"choices\":[{\"delta\":{\"content\":\"Hel\"}}]}\n\n"
+                         ": keep-alive\n\n"
+                         "data: not json\n\n"
+                         "data: {\"choices\":[{\"delta\":{\"content\":\"lo\"}}]}\n\n"
+                         "data: [DONE]\n\n";
+    // Byte by byte, as the worst case of network reads
+    for (char c : stream) {
+        EXPECT_TRUE(decoder.feed(&c, 1, on_content, on_done));
+    }
+    EXPECT_EQ("Hello", content);
+    EXPECT_TRUE(done);
+    EXPECT_TRUE(decoder.pending().empty());
+
+    // A callback refusing stops the decoder
+    SseDecoder refusing;
+    EXPECT_FALSE(refusing.feed(stream.data(), stream.size(), [](const std::string&) { return false; }, on_done));
+
+    // Error bodies aren't events and stay pending
+    SseDecoder error;
+    std::string body = "{\"error\":{\"message\":\"overloaded\"}}";
+    EXPECT_TRUE(error.feed(body.data(), body.size(), on_content, on_done));
+    EXPECT_EQ(body, error.pending());
+}
+
+TEST_F(LLMClientTest, BatchPromptSharesPrefixWithSinglePrompt) {
+    std::vector<FileContext> folder_context = {{"/src/main.c", "int main() {}"}};
+    std::string single = LLMClient::buildPrompt("/src/a.c", folder_context, {});
+    std::string batch = LLMClient::buildBatchPrompt({"/src/a.c", "/src/b.c"}, folder_context, {});
+
+    std::string shared = single.substr(0, single.find("\nGenerate content"));
+    EXPECT_EQ(0u, batch.find(shared));
+    EXPECT_NE(std::string::npos, batch.find("- /src/b.c\n"));
+    EXPECT_NE(std::string::npos, batch.find("<<<FILE /src/a.c>>>"));
+}
+
+TEST_F(LLMClientTest, FailsOverBeforeFirstToken) {
+    // Nothing listens on these ports, so both attempts fail before any token
+    BackendConfig first, second;
+    first.url = "http://127.0.0.1:1/v1/chat/completions";
+    second.url = "http://127.0.0.1:2/v1/chat/completions";
+    PoolConfig pool;
+    pool.health_check_seconds = 0;
+    pool.max_retries = 1;
+    pool.retry_base_ms = 10;
+    LLMClient client({first, second}, pool);
+
+    auto buffer = client.generateFileContentStream("/test/file.txt", {}, {});
+    char buf[16];
+    buffer->readData(buf, sizeof(buf), 0);
+    EXPECT_TRUE(buffer->hasError());
+    EXPECT_NE(std::string::npos, buffer->getError().find("CURL"));
+
+    // Each backend once per round: the first try and one retry
+    auto stats = client.pool().stats();
+    EXPECT_EQ(2u, stats[0].requests);
+    EXPECT_EQ(2u, stats[1].requests);
+    EXPECT_EQ(0u, stats[0].in_flight);
+
+    // Models no backend serves fail without a request
+    second.models = first.models = {"small"};
+    LLMClient restricted({first, second}, pool);
+    EXPECT_THROW(restricted.generateFileContent("/test/file.txt", {}, {}, "large"), std::runtime_error);
+    EXPECT_EQ(0u, restricted.pool().stats()[0].requests);
+}
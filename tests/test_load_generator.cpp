@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include "load_generator.h"
+#include <fcntl.h>
+#include <nlohmann/json.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+// Workloads run against a plain temporary directory standing in for a mount
+class LoadGeneratorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char dir_template[] = "/tmp/test_load_generator_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(dir_template));
+        root_ = dir_template;
+    }
+
+    void TearDown() override {
+        std::string command = "rm -rf " + root_;
+        system(command.c_str());
+    }
+
+    off_t sizeOf(const std::string& path) {
+        struct stat st;
+        return stat((root_ + path).c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    static AccessRecord access(uint64_t time_us, const std::string& op, const std::string& path, uint64_t fh = 0,
+                               uint64_t size = 0, int64_t offset = 0, int flags = 0) {
+        AccessRecord record;
+        record.time_us = time_us;
+        record.op = op;
+        record.path = path;
+        record.fh = fh;
+        record.size = size;
+        record.offset = offset;
+        record.flags = flags;
+        return record;
+    }
+
+    std::string root_;
+};
+
+TEST_F(LoadGeneratorTest, WritesFilesInBlocks) {
+    LoadConfig config;
+    config.workload = "writes";
+    config.threads = 3;
+    config.ops = 5;
+    config.file_size = 10000;
+    config.block_size = 4096;
+    LoadGenerator generator(root_, config);
+    generator.setup();
+    LoadResult result = generator.run();
+
+    EXPECT_EQ(5u, result.stats.count());
+    EXPECT_EQ(0u, result.stats.errors());
+    EXPECT_EQ(50000u, result.stats.bytes());
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(10000, sizeOf("/load/writes/file" + std::to_string(i) + ".bin"));
+    }
+}
+
+TEST_F(LoadGeneratorTest, WalksTreesAndCountsMissingFiles) {
+    LoadConfig config;
+    config.workload = "mixed";
+    config.threads = 2;
+    config.ops = 10;
+    config.dirs = 3;
+    config.files_per_dir = 4;
+    config.fanout = 2;
+    config.populated = 0.5;
+    LoadGenerator mixed(root_, config);
+    mixed.setup();
+    LoadResult result = mixed.run();
+
+    const auto& ops = result.stats.ops();
+    EXPECT_EQ(20u, ops.at("list").latencies_us.size());
+    EXPECT_EQ(40u, ops.at("stat").latencies_us.size());
+    EXPECT_EQ(20u, ops.at("cat").latencies_us.size());
+    EXPECT_EQ(0u, ops.at("list").errors);
+    EXPECT_GT(ops.at("stat").errors, 0u);  // Some picks are unpopulated
+
+    // The tree is now 3 directories under /load plus the stored files
+    size_t stored = 0;
+    for (size_t d = 0; d < 3; d++) {
+        for (size_t f = 0; f < 4; f++) {
+            stored += sizeOf("/load/dir" + std::to_string(d) + "/file" + std::to_string(f) + ".txt") >= 0;
+        }
+    }
+    config.workload = "ls-storm";
+    config.ops = 2;
+    result = LoadGenerator(root_, config).run();
+    // Per walk and thread: /load and its directories listed, every entry stat'ed
+    EXPECT_EQ(2u * 2 * 4, result.stats.ops().at("list").latencies_us.size());
+    EXPECT_EQ(2u * 2 * (3 + stored), result.stats.ops().at("stat").latencies_us.size());
+    EXPECT_EQ(0u, result.stats.errors());
+}
+
+TEST_F(LoadGeneratorTest, HerdReadsTheSameFileFromEveryThread) {
+    LoadConfig config;
+    config.workload = "herd";
+    config.threads = 4;
+    config.ops = 3;
+    LoadResult result = LoadGenerator(root_, config).run();
+
+    // Plain directories don't generate, so every read is of a missing file
+    EXPECT_EQ(12u, result.stats.ops().at("cat").latencies_us.size());
+    EXPECT_EQ(12u, result.stats.errors());
+}
+
+TEST_F(LoadGeneratorTest, ReplaysTracesWithTiming) {
+    LoadConfig config;
+    config.workload = "replay";
+    config.threads = 2;
+    config.trace = {access(0, "mkdir", "/logs"),
+                    access(1000, "create", "/logs/a.log", 7, 0, 0, O_WRONLY),
+                    access(2000, "write", "/logs/a.log", 7, 100, 0),
+                    access(3000, "write", "/logs/a.log", 7, 50, 100),
+                    access(4000, "release", "/logs/a.log", 7),
+                    access(20000, "getattr", "/logs/a.log"),
+                    access(21000, "open", "/logs/a.log", 9, 0, 0, O_RDONLY),
+                    access(22000, "read", "/logs/a.log", 9, 4096, 0),
+                    access(23000, "release", "/logs/a.log", 9),
+                    access(24000, "read", "/logs/b.log", 11, 10, 0),
+                    access(25000, "getxattr", "/logs/a.log")};
+    LoadResult result = LoadGenerator(root_, config).run();
+
+    EXPECT_EQ(150, sizeOf("/logs/a.log"));
+    EXPECT_GE(result.elapsed_seconds, 0.024);
+    const auto& ops = result.stats.ops();
+    EXPECT_EQ(150u, ops.at("write").bytes);
+    EXPECT_EQ(0u, ops.at("stat").errors);  // getattr is replayed as lstat
+    EXPECT_EQ(1u, ops.at("read").errors);  // Handle 11 was never opened
+    EXPECT_EQ(0u, ops.count("getxattr"));
+    EXPECT_EQ(10u, result.stats.count());
+}
+
+TEST_F(LoadGeneratorTest, ReportsPercentilesAsJson) {
+    std::vector<uint64_t> sorted;
+    for (uint64_t i = 1; i <= 1000; i++) {
+        sorted.push_back(i);
+    }
+    EXPECT_EQ(500u, LoadStats::percentile(sorted, 0.5));
+    EXPECT_EQ(990u, LoadStats::percentile(sorted, 0.99));
+    EXPECT_EQ(999u, LoadStats::percentile(sorted, 0.999));
+    EXPECT_EQ(0u, LoadStats::percentile({}, 0.5));
+
+    LoadResult result;
+    result.elapsed_seconds = 2;
+    for (uint64_t latency : sorted) {
+        result.stats.record("stat", latency, latency % 100 != 0);
+    }
+    LoadConfig config;
+    config.workload = "mixed";
+    json report = json::parse(result.toJson(config));
+    EXPECT_EQ(1000u, report["ops"]);
+    EXPECT_EQ(10u, report["errors"]);
+    EXPECT_DOUBLE_EQ(500.0, report["ops_per_second"].get<double>());
+    EXPECT_EQ(990u, report["latency_us"]["p99"]);
+    EXPECT_EQ(1000u, report["ops_by_type"]["stat"]["count"]);
+    EXPECT_FALSE(report.contains("replay"));
+
+    config.workload = "bogus";
+    EXPECT_THROW(LoadGenerator("/tmp", config).run(), std::invalid_argument);
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "local_generator.h"
+
+class LocalGeneratorTest : public ::testing::Test {
+protected:
+    bool generate(const std::string& path, std::string& content, std::string* name = nullptr) {
+        return registry_.generate(path, GeneratorRegistry::defaultRules(), content, name);
+    }
+
+    static uint32_t read32be(const std::string& data, size_t pos) {
+        return (static_cast<uint32_t>(static_cast<unsigned char>(data[pos])) << 24) |
+               (static_cast<uint32_t>(static_cast<unsigned char>(data[pos + 1])) << 16) |
+               (static_cast<uint32_t>(static_cast<unsigned char>(data[pos + 2])) << 8) |
+               static_cast<uint32_t>(static_cast<unsigned char>(data[pos + 3]));
+    }
+
+    GeneratorRegistry registry_;
+};
+
+TEST_F(LocalGeneratorTest, MatchesFileNamesAndPaths) {
+    EXPECT_TRUE(GeneratorRegistry::matches("*.png", "/assets/logo.png"));
+    EXPECT_TRUE(GeneratorRegistry::matches("*.png", "/assets/LOGO.PNG"));
+    EXPECT_FALSE(GeneratorRegistry::matches("*.png", "/assets/logo.png.txt"));
+    EXPECT_TRUE(GeneratorRegistry::matches("/vendor/*", "/vendor/lib/a.c"));
+    EXPECT_FALSE(GeneratorRegistry::matches("/vendor/*", "/src/a.c"));
+}
+
+TEST_F(LocalGeneratorTest, DefaultRules) {
+    std::string content = "x";
+    std::string name;
+    ASSERT_TRUE(generate("/project/src/pkg/__init__.py", content, &name));
+    EXPECT_EQ("empty", name);
+    EXPECT_TRUE(content.empty());
+
+    ASSERT_TRUE(generate("/project/LICENSE", content, &name));
+    EXPECT_EQ("license", name);
+    EXPECT_NE(std::string::npos, content.find("MIT License"));
+    EXPECT_NE(std::string::npos, content.find("Copyright (c) 2024 The project Authors"));
+
+    // Everything else goes to the LLM
+    EXPECT_FALSE(generate("/project/src/main.cpp", content));
+}
+
+TEST_F(LocalGeneratorTest, ConfiguredRulesTakePrecedence) {
+    std::vector<GeneratorRule> rules = {
+        {"LICENSE", "license", {{"license", "bsd-3-clause"}, {"holder", "Example Corp"}, {"year", "2020"}}},
+        {"*.png", "llm", {}},
+        {"VERSION", "text", {{"content", "1.0.0\n"}}},
+    };
+    const auto& defaults = GeneratorRegistry::defaultRules();
+    rules.insert(rules.end(), defaults.begin(), defaults.end());
+
+    std::string content;
+    ASSERT_TRUE(registry_.generate("/LICENSE", rules, content));
+    EXPECT_EQ(0u, content.find("BSD 3-Clause License\n\nCopyright (c) 2020, Example Corp\n"));
+    EXPECT_NE(std::string::npos, content.find("3. Neither the name"));
+
+    EXPECT_FALSE(registry_.generate("/logo.png", rules, content));
+
+    ASSERT_TRUE(registry_.generate("/VERSION", rules, content));
+    EXPECT_EQ("1.0.0\n", content);
+
+    // Unknown licenses are left to the LLM
+    EXPECT_FALSE(registry_.generate("/LICENSE", {{"LICENSE", "license", {{"license", "gpl-3.0"}}}}, content));
+}
+
+TEST_F(LocalGeneratorTest, CustomGenerators) {
+    class EchoPath : public LocalGenerator {
+    public:
+        bool generate(const std::string& path, const std::map<std::string, std::string>&,
+                      std::string& content) const override {
+            content = path + "\n";
+            return true;
+        }
+    };
+    registry_.add("echo", std::make_unique<EchoPath>());
+    EXPECT_TRUE(registry_.has("echo"));
+
+    std::string content;
+    ASSERT_TRUE(registry_.generate("/a/b.marker", {{"*.marker", "echo", {}}}, content));
+    EXPECT_EQ("/a/b.marker\n", content);
+}
+
+TEST_F(LocalGeneratorTest, PngPlaceholders) {
+    std::string content;
+    ASSERT_TRUE(generate("/assets/logo.png", content));
+    ASSERT_GT(content.size(), 8u);
+    EXPECT_EQ(std::string("\x89PNG\r\n\x1a\n", 8), content.substr(0, 8));
+
+    // Walk the chunks: IHDR first, IEND last
+    std::vector<std::string> chunks;
+    size_t pos = 8;
+    while (pos + 12 <= content.size()) {
+        uint32_t length = read32be(content, pos);
+        chunks.push_back(content.substr(pos + 4, 4));
+        pos += 12 + length;
+    }
+    EXPECT_EQ(content.size(), pos);
+    ASSERT_GE(chunks.size(), 3u);
+    EXPECT_EQ("IHDR", chunks.front());
+    EXPECT_EQ("IEND", chunks.back());
+    EXPECT_EQ(64u, read32be(content, 16));
+
+    // Exact requested size, and deterministic per path
+    std::vector<GeneratorRule> rules = {{"*.png", "png", {{"size", "100000"}}}};
+    ASSERT_TRUE(registry_.generate("/assets/big.png", rules, content));
+    EXPECT_EQ(100000u, content.size());
+    std::string again;
+    ASSERT_TRUE(registry_.generate("/assets/big.png", rules, again));
+    EXPECT_EQ(content, again);
+
+    // Small budgets shrink the default dimensions
+    rules = {{"*.png", "png", {{"size", "200"}}}};
+    ASSERT_TRUE(registry_.generate("/icon.png", rules, content));
+    EXPECT_EQ(200u, content.size());
+    EXPECT_LT(read32be(content, 16), 64u);
+
+    // Dimensions too large for the size cap are halved until they fit
+    rules = {{"*.png", "png", {{"width", "8192"}, {"height", "8192"}}}};
+    ASSERT_TRUE(registry_.generate("/huge.png", rules, content));
+    uint64_t width = read32be(content, 16);
+    uint64_t height = read32be(content, 20);
+    EXPECT_EQ(width, height);
+    EXPECT_LT(width, 8192u);
+    EXPECT_LE(height * (1 + 3 * width), 64ull * 1024 * 1024);
+}
+
+TEST_F(LocalGeneratorTest, JpegPlaceholders) {
+    std::string content;
+    ASSERT_TRUE(generate("/photos/cat.jpg", content));
+    EXPECT_EQ(std::string("\xff\xd8\xff\xe0", 4), content.substr(0, 4));
+    EXPECT_EQ(std::string("\xff\xd9", 2), content.substr(content.size() - 2));
+
+    std::vector<GeneratorRule> rules = {{"*.jpg", "jpeg", {{"size", "200000"}, {"width", "640"}, {"height", "480"}}}};
+    ASSERT_TRUE(registry_.generate("/photos/dog.jpg", rules, content));
+    EXPECT_EQ(200000u, content.size());
+    EXPECT_EQ(std::string("\xff\xd9", 2), content.substr(content.size() - 2));
+}
+
+TEST_F(LocalGeneratorTest, ZipPlaceholders) {
+    std::string content;
+    ASSERT_TRUE(generate("/dist/bundle.zip", content));
+    EXPECT_EQ(std::string("PK\x03\x04", 4), content.substr(0, 4));
+    EXPECT_NE(std::string::npos, content.find("bundle.txt"));
+    EXPECT_EQ(std::string("PK\x05\x06", 4), content.substr(content.size() - 22, 4));
+
+    std::vector<GeneratorRule> rules = {{"*.zip", "zip", {{"size", "4096"}}}};
+    ASSERT_TRUE(registry_.generate("/dist/bundle.zip", rules, content));
+    EXPECT_EQ(4096u, content.size());
+}
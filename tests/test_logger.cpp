@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include "logger.h"
+#include <iostream>
+#include <sstream>
+
+class LoggerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Logger::global().setOutput(output_);
+        Logger::setLevel(LogLevel::Debug);
+        Logger::setRateLimit(0);
+    }
+
+    void TearDown() override {
+        Logger::global().setOutput(std::cerr);
+        Logger::setLevel(LogLevel::Info);
+        Logger::setRateLimit(20);
+    }
+
+    std::vector<std::string> lines() {
+        Logger::global().flush();
+        std::vector<std::string> result;
+        std::istringstream in(output_.str());
+        std::string line;
+        while (std::getline(in, line)) {
+            result.push_back(line);
+        }
+        return result;
+    }
+
+    std::ostringstream output_;
+};
+
+TEST_F(LoggerTest, FormatsMessageAndFields) {
+    LOG_INFO << "Loaded " << 3 << " files";
+    LOG_DEBUG.field("op", "read").field("path", "/a b.txt").field("latency_us", 12);
+    LOG_WARNING.field("path", "/x") << "Missing blob";
+
+    std::vector<std::string> logged = lines();
+    ASSERT_EQ(3u, logged.size());
+    EXPECT_EQ("[INFO] Loaded 3 files", logged[0]);
+    EXPECT_EQ("[DEBUG] op=read path=\"/a b.txt\" latency_us=12", logged[1]);
+    EXPECT_EQ("[WARNING] Missing blob path=/x", logged[2]);
+}
+
+TEST_F(LoggerTest, DisabledLevelsEvaluateNothing) {
+    Logger::setLevel(LogLevel::Warning);
+    int evaluated = 0;
+    auto count = [&evaluated]() { return ++evaluated; };
+
+    LOG_DEBUG << count();
+    LOG_INFO.field("n", count());
+    LOG_WARNING << count();
+
+    EXPECT_EQ(1, evaluated);
+    EXPECT_EQ(1u, lines().size());
+
+    EXPECT_EQ(LogLevel::Error, Logger::parseLevel("error"));
+    EXPECT_FALSE(Logger::parseLevel("verbose"));
+}
+
+TEST_F(LoggerTest, RateLimitsEachStatement) {
+    Logger::setRateLimit(3);
+    for (int i = 0; i < 10; i++) {
+        LOG_INFO << "repeated " << i;
+    }
+    LOG_INFO << "other statement";
+
+    std::vector<std::string> logged = lines();
+    ASSERT_EQ(4u, logged.size());
+    EXPECT_EQ("[INFO] repeated 2", logged[2]);
+    EXPECT_EQ("[INFO] other statement", logged[3]);
+}
+
+TEST_F(LoggerTest, KeepsOrderAcrossThreads) {
+    const int THREADS = 4;
+    const int LINES = 200;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < LINES; i++) {
+                LOG_INFO.field("thread", t).field("line", i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<std::string> logged = lines();
+    ASSERT_EQ(static_cast<size_t>(THREADS * LINES), logged.size());
+    std::vector<int> next(THREADS, 0);
+    for (const auto& line : logged) {
+        int thread = 0;
+        int index = 0;
+        ASSERT_EQ(2, sscanf(line.c_str(), "[INFO] thread=%d line=%d", &thread, &index)) << line;
+        EXPECT_EQ(next[thread]++, index);
+    }
+    EXPECT_EQ(0u, Logger::global().dropped());
+}
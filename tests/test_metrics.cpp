@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "metrics.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+
+TEST(MetricsTest, BucketsCoverEveryValue) {
+    for (uint64_t value = 0; value < 8; value++) {
+        EXPECT_EQ(static_cast<int>(value), Histogram::bucketOf(value));
+    }
+
+    // Each bucket starts right after the previous one ends
+    for (int bucket = 1; bucket < Histogram::BUCKETS; bucket++) {
+        uint64_t lower = Histogram::bucketLowerBound(bucket);
+        EXPECT_EQ(bucket, Histogram::bucketOf(lower));
+        EXPECT_EQ(bucket - 1, Histogram::bucketOf(lower - 1));
+    }
+    EXPECT_EQ(Histogram::BUCKETS - 1, Histogram::bucketOf(UINT64_MAX));
+}
+
+TEST(MetricsTest, PercentilesAreWithinABucket) {
+    Histogram histogram;
+    EXPECT_EQ(0u, histogram.percentile(0.5));
+
+    for (uint64_t value = 1; value <= 1000; value++) {
+        histogram.record(value);
+    }
+    EXPECT_EQ(1000u, histogram.count());
+    EXPECT_EQ(500500u, histogram.sum());
+    EXPECT_EQ(1000u, histogram.max());
+
+    uint64_t p50 = histogram.percentile(0.5);
+    EXPECT_GE(p50, 500u);
+    EXPECT_LE(p50, 500u * 9 / 8);
+    uint64_t p99 = histogram.percentile(0.99);
+    EXPECT_GE(p99, 990u);
+    EXPECT_LE(p99, 1000u);
+    EXPECT_EQ(1000u, histogram.percentile(1.0));
+}
+
+TEST(MetricsTest, FormatsTextAndPrometheus) {
+    Metrics metrics;
+    metrics.op(FuseOp::Read).calls.add(3);
+    metrics.op(FuseOp::Read).errors.add();
+    metrics.op(FuseOp::Read).latency_us.record(40);
+    metrics.cache_hits.add(3);
+    metrics.cache_misses.add();
+
+    std::string text = metrics.formatText();
+    EXPECT_NE(std::string::npos, text.find("fuse.read.calls=3\n"));
+    EXPECT_NE(std::string::npos, text.find("fuse.read.errors=1\n"));
+    EXPECT_NE(std::string::npos, text.find("fuse.read.latency_us.max=40\n"));
+    EXPECT_NE(std::string::npos, text.find("read.hit_rate=0.75\n"));
+    // Ops that were never called are left out
+    EXPECT_EQ(std::string::npos, text.find("fuse.mkdir."));
+
+    std::string prometheus = metrics.formatPrometheus();
+    EXPECT_NE(std::string::npos, prometheus.find("simfs_fuse_calls_total{op=\"read\"} 3\n"));
+    EXPECT_NE(std::string::npos, prometheus.find("simfs_fuse_latency_microseconds{op=\"read\",quantile=\"0.5\"} 40\n"));
+    EXPECT_NE(std::string::npos, prometheus.find("# TYPE simfs_cache_hits_total counter\nsimfs_cache_hits_total 3\n"));
+}
+
+TEST(MetricsTest, ServesPrometheusOnUnixSocket) {
+    std::string path = "/tmp/simfs_metrics_test_" + std::to_string(getpid()) + ".sock";
+    Metrics metrics;
+    metrics.generations.add(7);
+
+    {
+        MetricsServer server(path, metrics);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_GE(fd, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        ASSERT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+        std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+        ASSERT_EQ(static_cast<ssize_t>(request.size()), send(fd, request.data(), request.size(), 0));
+        std::string response;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, n);
+        }
+        close(fd);
+
+        EXPECT_EQ(0u, response.find("HTTP/1.0 200 OK\r\n"));
+        EXPECT_NE(std::string::npos, response.find("simfs_generations_total 7\n"));
+    }
+
+    // The socket file goes away with the server
+    EXPECT_NE(0, access(path.c_str(), F_OK));
+}
+
+TEST(MetricsTest, OnlyReplacesStaleSockets) {
+    std::string path = "/tmp/simfs_metrics_test_" + std::to_string(getpid()) + ".file";
+    Metrics metrics;
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        ASSERT_NE(nullptr, file);
+        fputs("keep", file);
+        fclose(file);
+    }
+    EXPECT_THROW(MetricsServer server(path, metrics), std::runtime_error);
+    EXPECT_EQ(0, access(path.c_str(), F_OK));
+    unlink(path.c_str());
+
+    // A socket left behind by a crashed mount is taken over
+    path = "/tmp/simfs_metrics_test_" + std::to_string(getpid()) + ".stale";
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(0, bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+    close(fd);
+    EXPECT_NO_THROW(MetricsServer server(path, metrics));
+    unlink(path.c_str());
+}
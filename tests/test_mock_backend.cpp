@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include "mock_backend.h"
+#include "llm_client.h"
+#include <chrono>
+#include <curl/curl.h>
+#include <thread>
+
+static size_t collectBody(char* data, size_t size, size_t nmemb, std::string* body) {
+    body->append(data, size * nmemb);
+    return size * nmemb;
+}
+
+// Posts a completion request directly, returning the HTTP status
+static long post(const std::string& url, const std::string& request, std::string& body) {
+    CURL* curl = curl_easy_init();
+    struct curl_slist* headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, collectBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+    long status = 0;
+    if (curl_easy_perform(curl) == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    }
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    return status;
+}
+
+static const char* REQUEST = "{\"model\":\"mock\",\"messages\":[{\"role\":\"user\",\"content\":\"hi\"}],\"stream\":true}";
+
+static MockBackendConfig instantConfig() {
+    MockBackendConfig config;
+    config.ttft = LatencyDistribution::parse("0");
+    config.tokens_per_second = 0;  // No delay between tokens
+    config.response_tokens = 40;
+    return config;
+}
+
+TEST(MockBackendTest, ServesLLMClientDeterministically) {
+    MockBackend backend(instantConfig());
+    LLMClient client(backend.url());
+
+    std::string first = client.generateFileContent("/src/main.c", {}, {});
+    std::string second = client.generateFileContent("/src/main.c", {}, {});
+    EXPECT_FALSE(first.empty());
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, client.generateFileContent("/src/other.c", {}, {}));
+
+    auto buffer = client.generateFileContentStream("/src/main.c", {}, {});
+    char buf[4096];
+    off_t offset = 0;
+    size_t n;
+    while ((n = buffer->readData(buf, sizeof(buf), offset)) > 0) {
+        offset += n;
+    }
+    EXPECT_FALSE(buffer->hasError()) << buffer->getError();
+    EXPECT_FALSE(buffer->getContent().empty());
+
+    MockBackendStats stats = backend.stats();
+    EXPECT_EQ(4u, stats.requests);
+    EXPECT_EQ(4u, stats.completed);
+    EXPECT_EQ(1u, stats.streamed);
+}
+
+TEST(MockBackendTest, PacesTokens) {
+    MockBackendConfig config = instantConfig();
+    config.ttft = LatencyDistribution::parse("fixed:100");
+    config.tokens_per_second = 100;
+    config.response_tokens = 10;
+    MockBackend backend(config);
+
+    auto start = std::chrono::steady_clock::now();
+    std::string body;
+    ASSERT_EQ(200, post(backend.url(), REQUEST, body));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    // TTFT, then one gap per token after the first (plus the closing newline)
+    EXPECT_GE(elapsed, std::chrono::milliseconds(190));
+    EXPECT_NE(std::string::npos, body.find("data: [DONE]\n\n"));
+}
+
+TEST(MockBackendTest, InjectsFailures) {
+    MockBackendConfig config = instantConfig();
+    config.throttle_rate = 1;
+    config.retry_after_seconds = 7;
+    {
+        MockBackend backend(config);
+        std::string body;
+        EXPECT_EQ(429, post(backend.url(), REQUEST, body));
+        EXPECT_EQ(1u, backend.stats().throttled);
+    }
+
+    config.throttle_rate = 0;
+    config.error_rate = 1;
+    {
+        MockBackend backend(config);
+        std::string body;
+        EXPECT_EQ(500, post(backend.url(), REQUEST, body));
+        EXPECT_NE(std::string::npos, body.find("\"error\""));
+    }
+
+    config.error_rate = 0;
+    config.disconnect_rate = 1;
+    {
+        MockBackend backend(config);
+        std::string body;
+        EXPECT_EQ(200, post(backend.url(), REQUEST, body));
+        EXPECT_EQ(std::string::npos, body.find("[DONE]"));
+        EXPECT_EQ(1u, backend.stats().disconnected);
+    }
+}
+
+TEST(MockBackendTest, LimitsConcurrency) {
+    MockBackendConfig config = instantConfig();
+    config.ttft = LatencyDistribution::parse("fixed:300");
+    config.max_concurrency = 1;
+    MockBackend backend(config);
+
+    long first_status = 0;
+    std::thread first([&]() {
+        std::string body;
+        first_status = post(backend.url(), REQUEST, body);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::string body;
+    EXPECT_EQ(429, post(backend.url(), REQUEST, body));
+    first.join();
+    EXPECT_EQ(200, first_status);
+    EXPECT_EQ(1u, backend.stats().peak_in_flight);
+}
+
+TEST(MockBackendTest, AnswersBatchPromptsWithMarkers) {
+    MockBackend backend(instantConfig());
+    std::vector<std::string> paths = {"/src/a.c", "/src/b.c"};
+    std::string prompt = LLMClient::buildBatchPrompt(paths, {}, {});
+
+    std::vector<std::shared_ptr<StreamingBuffer>> buffers = {std::make_shared<StreamingBuffer>(),
+                                                             std::make_shared<StreamingBuffer>()};
+    BatchDemultiplexer demux(paths, buffers);
+    for (const auto& token : backend.completionTokens(prompt, 0)) {
+        demux.append(token);
+    }
+    EXPECT_TRUE(demux.finish().empty());
+    EXPECT_FALSE(buffers[0]->getContent().empty());
+    EXPECT_NE(buffers[0]->getContent(), buffers[1]->getContent());
+}
+
+TEST(MockBackendTest, ParsesDistributions) {
+    LatencyDistribution fixed = LatencyDistribution::parse("250");
+    std::mt19937_64 random(1);
+    EXPECT_EQ(250, fixed.sample(random));
+
+    LatencyDistribution lognormal = LatencyDistribution::parse("lognormal:200:100");
+    EXPECT_EQ(LatencyDistribution::Kind::LogNormal, lognormal.kind);
+    double sum = 0;
+    for (int i = 0; i < 10000; i++) {
+        double value = lognormal.sample(random);
+        EXPECT_GE(value, 0);
+        sum += value;
+    }
+    EXPECT_NEAR(200, sum / 10000, 10);
+
+    EXPECT_THROW(LatencyDistribution::parse("gamma:1:2"), std::invalid_argument);
+    EXPECT_THROW(LatencyDistribution::parse("normal:-5:1"), std::invalid_argument);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "model_router.h"
+
+class ModelRouterTest : public ::testing::Test {
+protected:
+    static ModelChoice defaults() {
+        ModelChoice choice;
+        choice.model = "big";
+        return choice;
+    }
+
+    static ModelRoute route(const std::string& pattern, const std::string& model) {
+        ModelRoute route;
+        route.pattern = pattern;
+        route.model = model;
+        return route;
+    }
+};
+
+TEST_F(ModelRouterTest, ClassifiesBySize) {
+    EXPECT_EQ(SizeClass::Small, ModelRouter::classify(0));
+    EXPECT_EQ(SizeClass::Small, ModelRouter::classify(ModelRouter::SMALL_BYTES - 1));
+    EXPECT_EQ(SizeClass::Medium, ModelRouter::classify(ModelRouter::SMALL_BYTES));
+    EXPECT_EQ(SizeClass::Large, ModelRouter::classify(ModelRouter::LARGE_BYTES));
+
+    EXPECT_EQ(SizeClass::Large, ModelRouter::parseSizeClass("large"));
+    EXPECT_FALSE(ModelRouter::parseSizeClass("huge"));
+    EXPECT_STREQ("medium", ModelRouter::sizeClassName(SizeClass::Medium));
+}
+
+TEST_F(ModelRouterTest, ExpectsSizeOfSiblingsWithSameExtension) {
+    std::map<std::string, uint64_t> siblings = {
+        {"/p/a.md", 40000}, {"/p/b.md", 30000}, {"/p/c.md", 100}, {"/p/config.json", 10},
+    };
+    EXPECT_EQ(SizeClass::Large, ModelRouter::expectedSize("/p/new.md", siblings));
+    EXPECT_EQ(SizeClass::Small, ModelRouter::expectedSize("/p/other.json", siblings));
+
+    // Without siblings of the type, the extension decides
+    EXPECT_EQ(SizeClass::Small, ModelRouter::expectedSize("/p/settings.yaml", siblings));
+    EXPECT_EQ(SizeClass::Large, ModelRouter::expectedSize("/p/data.CSV", siblings));
+    EXPECT_EQ(SizeClass::Medium, ModelRouter::expectedSize("/p/main.py", siblings));
+}
+
+TEST_F(ModelRouterTest, FirstMatchingRouteWins) {
+    std::vector<ModelRoute> routes = {route("*.json", "tiny"), route("*.json", "unused"), route("/docs/*", "writer")};
+    routes[2].max_tokens = 8192;
+    routes[2].temperature = 0.9;
+
+    ModelChoice json = ModelRouter::route("/p/package.json", SizeClass::Small, routes, defaults());
+    EXPECT_EQ("tiny", json.model);
+    EXPECT_EQ(2048u, json.max_tokens);
+
+    ModelChoice doc = ModelRouter::route("/docs/guide.md", SizeClass::Large, routes, defaults());
+    EXPECT_EQ("writer", doc.model);
+    EXPECT_EQ(8192u, doc.max_tokens);
+    EXPECT_DOUBLE_EQ(0.9, doc.temperature);
+
+    EXPECT_EQ("big", ModelRouter::route("/src/main.c", SizeClass::Medium, routes, defaults()).model);
+}
+
+TEST_F(ModelRouterTest, RoutesBySizeClass) {
+    std::vector<ModelRoute> routes = {route("", "small-model"), route("", "")};
+    routes[0].size = SizeClass::Small;
+    routes[1].model.reset();
+    routes[1].draft_model = "small-model";
+
+    EXPECT_EQ("small-model", ModelRouter::route("/a.toml", SizeClass::Small, routes, defaults()).model);
+
+    // Settings a route leaves out come from the defaults
+    ModelChoice large = ModelRouter::route("/a.md", SizeClass::Large, routes, defaults());
+    EXPECT_EQ("big", large.model);
+    EXPECT_EQ("small-model", large.draft_model);
+}
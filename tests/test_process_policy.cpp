@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include "process_policy.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static CallerInfo makeCaller(const std::string& comm, uid_t uid = 1000, pid_t pid = 4242) {
+    CallerInfo caller;
+    caller.pid = pid;
+    caller.uid = uid;
+    caller.comm = comm;
+    return caller;
+}
+
+TEST(ProcessPolicyTest, DefaultRulesDenyIndexers) {
+    ProcessPolicy policy{PolicyConfig()};
+    
+    EXPECT_EQ(GenerationClass::Denied, policy.classify(makeCaller("updatedb")));
+    EXPECT_EQ(GenerationClass::Denied, policy.classify(makeCaller("tracker-miner-f")));
+    EXPECT_EQ(GenerationClass::Background, policy.classify(makeCaller("rsync")));
+    EXPECT_EQ(GenerationClass::Foreground, policy.classify(makeCaller("cat")));
+}
+
+TEST(ProcessPolicyTest, UserRulesTakePrecedence) {
+    MountConfig config = MountConfig::parse(R"(
+[policy]
+[[policy.rules]]
+process = "updatedb"
+uid = 0
+action = "foreground"
+
+[[policy.rules]]
+process = "python*"
+action = "background"
+)");
+    ProcessPolicy policy(config.policy);
+    
+    EXPECT_EQ(GenerationClass::Foreground, policy.classify(makeCaller("updatedb", 0)));
+    EXPECT_EQ(GenerationClass::Denied, policy.classify(makeCaller("updatedb", 1000)));
+    EXPECT_EQ(GenerationClass::Background, policy.classify(makeCaller("python3")));
+}
+
+TEST(ProcessPolicyTest, DefaultRulesCanBeDisabled) {
+    MountConfig config = MountConfig::parse("[policy]\nuse_default_rules = false\n");
+    ProcessPolicy policy(config.policy);
+    
+    EXPECT_EQ(GenerationClass::Foreground, policy.classify(makeCaller("updatedb")));
+}
+
+TEST(ProcessPolicyTest, InvalidActionThrows) {
+    EXPECT_THROW(MountConfig::parse("[[policy.rules]]\naction = \"sometimes\"\n"), std::runtime_error);
+}
+
+TEST(ProcessPolicyTest, NegativeLimitsThrow) {
+    // Would wrap around to effectively unlimited
+    EXPECT_THROW(MountConfig::parse("[policy]\nmax_concurrent_generations = -1\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[[policy.quotas]]\nuid = 1000\ntokens_per_window = -5\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[[policy.quotas]]\nuid = -1\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[[policy.rules]]\nuid = -1\n"), std::runtime_error);
+    EXPECT_THROW(MountConfig::parse("[policy]\nquota_window_seconds = 4294967296\n"), std::runtime_error);
+}
+
+TEST(ProcessPolicyTest, TokenQuotaIsCharged) {
+    MountConfig config = MountConfig::parse(R"(
+[policy]
+[[policy.quotas]]
+uid = 1000
+tokens_per_window = 10
+)");
+    ProcessPolicy policy(config.policy);
+    
+    EXPECT_TRUE(policy.hasTokenBudget(1000));
+    policy.admit(1000, GenerationClass::Foreground);
+    policy.release(1000, GenerationClass::Foreground, 20);
+    EXPECT_FALSE(policy.hasTokenBudget(1000));
+    EXPECT_TRUE(policy.hasTokenBudget(1001));
+}
+
+TEST(ProcessPolicyTest, BackgroundWaitsForForeground) {
+    PolicyConfig config;
+    config.max_concurrent_generations = 1;
+    ProcessPolicy policy(config);
+    
+    policy.admit(1000, GenerationClass::Foreground);
+    
+    std::atomic<int> order{0};
+    std::atomic<int> background_slot{0};
+    std::atomic<int> foreground_slot{0};
+    
+    std::thread background([&]() {
+        policy.admit(2000, GenerationClass::Background);
+        background_slot = ++order;
+        policy.release(2000, GenerationClass::Background, 0);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread foreground([&]() {
+        policy.admit(1001, GenerationClass::Foreground);
+        foreground_slot = ++order;
+        policy.release(1001, GenerationClass::Foreground, 0);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    
+    policy.release(1000, GenerationClass::Foreground, 0);
+    background.join();
+    foreground.join();
+    
+    EXPECT_EQ(1, foreground_slot.load());
+    EXPECT_EQ(2, background_slot.load());
+}
+
+TEST(ProcessPolicyTest, PerUidConcurrencyLimit) {
+    PolicyConfig config;
+    config.default_max_concurrent = 1;
+    ProcessPolicy policy(config);
+    
+    policy.admit(1000, GenerationClass::Foreground);
+    
+    std::atomic<bool> admitted{false};
+    std::thread second([&]() {
+        policy.admit(1000, GenerationClass::Foreground);
+        admitted = true;
+        policy.release(1000, GenerationClass::Foreground, 0);
+    });
+    
+    // Other uids are unaffected
+    policy.admit(1001, GenerationClass::Foreground);
+    policy.release(1001, GenerationClass::Foreground, 0);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(admitted.load());
+    
+    policy.release(1000, GenerationClass::Foreground, 0);
+    second.join();
+    EXPECT_TRUE(admitted.load());
+}
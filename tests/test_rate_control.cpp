@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "rate_control.h"
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+TEST(TokenBucketTest, AllowsBurstThenRefills) {
+    TokenBucket bucket(10, 2);  // 10 per second, 2 at once
+    auto start = Clock::now();
+
+    EXPECT_TRUE(bucket.take(start));
+    EXPECT_TRUE(bucket.take(start));
+    EXPECT_FALSE(bucket.take(start));
+    EXPECT_EQ(start + 100ms, bucket.nextAvailable(start));
+
+    EXPECT_FALSE(bucket.take(start + 50ms));
+    EXPECT_TRUE(bucket.take(start + 100ms));
+
+    // Idle time refills up to the burst only
+    EXPECT_TRUE(bucket.take(start + 10s));
+    EXPECT_TRUE(bucket.take(start + 10s));
+    EXPECT_FALSE(bucket.take(start + 10s));
+}
+
+TEST(TokenBucketTest, ZeroRateIsUnlimited) {
+    TokenBucket bucket;
+    auto now = Clock::now();
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(bucket.take(now));
+    }
+    EXPECT_EQ(now, bucket.nextAvailable(now));
+}
+
+TEST(AimdLimitTest, GrowsByOnePerWindowAndHalvesOnOverload) {
+    AimdLimit limit(4, 16);
+    EXPECT_EQ(4u, limit.limit());
+
+    for (int i = 0; i < 4; i++) {
+        limit.onSuccess();
+    }
+    EXPECT_EQ(4u, limit.limit());  // 4.9: just short of a full window
+    limit.onSuccess();
+    EXPECT_EQ(5u, limit.limit());
+
+    auto now = Clock::now();
+    limit.onOverload(now);
+    EXPECT_EQ(2u, limit.limit());
+
+    // Overload reported by requests already in flight counts once
+    limit.onOverload(now + 100ms);
+    EXPECT_EQ(2u, limit.limit());
+    limit.onOverload(now + 2s);
+    EXPECT_EQ(1u, limit.limit());
+    limit.onOverload(now + 4s);
+    EXPECT_EQ(1u, limit.limit());
+}
+
+TEST(AimdLimitTest, StaysBelowMaximum) {
+    AimdLimit limit(2, 3);
+    for (int i = 0; i < 100; i++) {
+        limit.onSuccess();
+    }
+    EXPECT_EQ(3u, limit.limit());
+    EXPECT_EQ(1u, AimdLimit(8, 1).limit());
+}
@@ -1,11 +1,15 @@
 #include <gtest/gtest.h>
 #include "simfs.h"
 #include "db_manager.h"
+#include "content_store.h"
+#include "mock_backend.h"
 #include <filesystem>
 #include <thread>
 #include <chrono>
 #include <fstream>
 #include <sys/mount.h>
+#include <poll.h>
+#include <cstring>
 #include <algorithm>
 
 class SimFSIntegrationTest : public ::testing::Test {
@@ -31,6 +35,23 @@ protected:
         std::filesystem::remove_all(test_mount_path_);
     }
 
+    void waitForStream(const std::string& path) {
+        simfs_->waitForStream(path);
+    }
+
+    void evictColdFiles() {
+        simfs_->evictColdFiles();
+    }
+    
+    bool storedContent(const std::string& path, std::string& body) {
+        return simfs_->contentStore().get(path, body);
+    }
+    
+    // Leaves the file listed, as if its content had never been generated
+    void dropContent(const std::string& path) {
+        simfs_->contentStore().remove(path);
+    }
+
     std::string test_db_path_;
     std::string test_mount_path_;
     std::unique_ptr<SimFS> simfs_;
@@ -120,4 +141,214 @@ TEST_F(SimFSIntegrationTest, LLMGeneratedContent) {
     ssize_t bytes_read2 = SimFS::read("/virtual_readme.md", buffer2, sizeof(buffer2) - 1, 0, &fi);
     EXPECT_EQ(bytes_read, bytes_read2);
     EXPECT_STREQ(buffer, buffer2);
-}
\ No newline at end of file
+}
+
+TEST_F(SimFSIntegrationTest, PollReportsPersistedFileReadable) {
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    ASSERT_EQ(0, SimFS::create("/poll.txt", 0644, &fi));
+    ASSERT_EQ(5, SimFS::write("/poll.txt", "hello", 5, 0, &fi));
+    EXPECT_EQ(0, SimFS::release("/poll.txt", &fi));
+    
+    struct fuse_file_info read_fi = {0};
+    read_fi.flags = O_RDONLY;
+    ASSERT_EQ(0, SimFS::open("/poll.txt", &read_fi));
+    
+    unsigned revents = 0;
+    EXPECT_EQ(0, SimFS::poll("/poll.txt", &read_fi, nullptr, &revents));
+    EXPECT_TRUE(revents & POLLIN);
+    EXPECT_EQ(0, SimFS::release("/poll.txt", &read_fi));
+}
+
+TEST_F(SimFSIntegrationTest, OpenStartsGenerationWhenConfigured) {
+    // Use an endpoint that refuses connections so generation fails fast
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, "http://127.0.0.1:1/v1/chat/completions");
+    SimFS::setInstance(simfs_.get());
+    
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    const char* config = "generate_on_open = true\n";
+    ASSERT_EQ(0, SimFS::create("/.simfs_config.toml", 0644, &fi));
+    ASSERT_EQ(static_cast<int>(strlen(config)), SimFS::write("/.simfs_config.toml", config, strlen(config), 0, &fi));
+    
+    struct fuse_file_info read_fi = {0};
+    read_fi.flags = O_RDONLY;
+    ASSERT_EQ(0, SimFS::open("/eager.txt", &read_fi));
+    
+    // The failed stream is already running; reading it hits EOF and nothing is persisted
+    char buffer[64];
+    EXPECT_EQ(0, SimFS::read("/eager.txt", buffer, sizeof(buffer), 0, &read_fi));
+    waitForStream("/eager.txt");
+    
+    struct stat stbuf;
+    EXPECT_EQ(0, SimFS::getattr("/eager.txt", &stbuf, nullptr));
+    EXPECT_EQ(0, stbuf.st_size);
+    EXPECT_EQ(0, SimFS::release("/eager.txt", &read_fi));
+}
+
+TEST_F(SimFSIntegrationTest, WriteDuringGenerationIsKept) {
+    MockBackendConfig backend_config;
+    backend_config.ttft = LatencyDistribution::parse("fixed:200");
+    backend_config.response_tokens = 5;
+    MockBackend backend(backend_config);
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, backend.url());
+    SimFS::setInstance(simfs_.get());
+    
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    const char* config = "generate_on_open = true\n";
+    ASSERT_EQ(0, SimFS::create("/.simfs_config.toml", 0644, &fi));
+    ASSERT_EQ(static_cast<int>(strlen(config)), SimFS::write("/.simfs_config.toml", config, strlen(config), 0, &fi));
+    
+    struct fuse_file_info read_fi = {0};
+    read_fi.flags = O_RDONLY;
+    ASSERT_EQ(0, SimFS::open("/race.txt", &read_fi));
+    
+    // The user writes the file before its generation finishes
+    struct fuse_file_info write_fi = {0};
+    write_fi.flags = O_CREAT | O_RDWR;
+    ASSERT_EQ(0, SimFS::create("/race.txt", 0644, &write_fi));
+    ASSERT_EQ(4, SimFS::write("/race.txt", "mine", 4, 0, &write_fi));
+    EXPECT_EQ(0, SimFS::release("/race.txt", &write_fi));
+    waitForStream("/race.txt");
+    EXPECT_EQ(0, SimFS::release("/race.txt", &read_fi));
+    
+    std::string body;
+    EXPECT_TRUE(storedContent("/race.txt", body));
+    EXPECT_EQ("mine", body);
+    EXPECT_EQ(1u, backend.stats().completed);
+}
+
+TEST_F(SimFSIntegrationTest, CopyOverGeneratedFileIsNeverEvicted) {
+    MountConfig config;
+    config.capacity.enabled = true;
+    config.capacity.budget_bytes = 100;
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, "http://127.0.0.1:1/v1/chat/completions", config);
+    SimFS::setInstance(simfs_.get());
+    
+    ASSERT_TRUE(simfs_->storeGeneratedFiles({{"/copy.txt", "generated"}}));
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    ASSERT_EQ(0, SimFS::create("/source.txt", 0644, &fi));
+    ASSERT_EQ(10, SimFS::write("/source.txt", "user data!", 10, 0, &fi));
+    EXPECT_EQ(0, SimFS::release("/source.txt", &fi));
+    
+    // cp over the generated file, then drop the original
+    EXPECT_EQ(10, SimFS::copy_file_range("/source.txt", nullptr, 0, "/copy.txt", nullptr, 0, 10, 0));
+    EXPECT_EQ(0, SimFS::unlink("/source.txt"));
+    
+    // Going over budget evicts only the generated file
+    ASSERT_TRUE(simfs_->storeGeneratedFiles({{"/big.txt", std::string(200, 'x')}}));
+    evictColdFiles();
+    
+    std::string body;
+    EXPECT_TRUE(storedContent("/copy.txt", body));
+    EXPECT_EQ("user data!", body);
+    EXPECT_FALSE(storedContent("/big.txt", body));
+}
+
+TEST_F(SimFSIntegrationTest, UnmountWaitsForGenerationsInFlight) {
+    MockBackendConfig backend_config;
+    backend_config.ttft = LatencyDistribution::parse("fixed:200");
+    backend_config.response_tokens = 5;
+    MockBackend backend(backend_config);
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, backend.url());
+    SimFS::setInstance(simfs_.get());
+    
+    // Batched, so the file is still waiting in the batcher at unmount
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    const char* config = "generate_on_open = true\nbatch_generation = true\nbatch_window_ms = 2000\n";
+    ASSERT_EQ(0, SimFS::create("/.simfs_config.toml", 0644, &fi));
+    ASSERT_EQ(static_cast<int>(strlen(config)), SimFS::write("/.simfs_config.toml", config, strlen(config), 0, &fi));
+    
+    struct fuse_file_info read_fi = {0};
+    read_fi.flags = O_RDONLY;
+    ASSERT_EQ(0, SimFS::open("/inflight.txt", &read_fi));
+    simfs_.reset();
+    
+    // The generation finished and was committed before SimFS went away
+    EXPECT_EQ(1u, backend.stats().completed);
+    simfs_ = std::make_unique<SimFS>(test_db_path_, backend.url());
+    SimFS::setInstance(simfs_.get());
+    std::string body;
+    EXPECT_TRUE(storedContent("/inflight.txt", body));
+    EXPECT_FALSE(body.empty());
+}
+
+TEST_F(SimFSIntegrationTest, AppendToEvictedFileKeepsItsContent) {
+    MockBackendConfig backend_config;
+    backend_config.ttft = LatencyDistribution::parse("fixed:10");
+    backend_config.response_tokens = 5;
+    MockBackend backend(backend_config);
+    MountConfig config;
+    config.capacity.enabled = true;
+    config.capacity.budget_bytes = 100;
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, backend.url(), config);
+    SimFS::setInstance(simfs_.get());
+    
+    ASSERT_TRUE(simfs_->storeGeneratedFiles({{"/notes.txt", std::string(200, 'x')}}));
+    evictColdFiles();
+    std::string body;
+    ASSERT_FALSE(storedContent("/notes.txt", body));
+    
+    // echo tail >> notes.txt: the body comes back before the append lands
+    struct fuse_file_info fi = {0};
+    fi.flags = O_WRONLY | O_APPEND;
+    ASSERT_EQ(0, SimFS::open("/notes.txt", &fi));
+    ASSERT_EQ(5, SimFS::write("/notes.txt", "tail\n", 5, 0, &fi));
+    EXPECT_EQ(0, SimFS::release("/notes.txt", &fi));
+    
+    ASSERT_TRUE(storedContent("/notes.txt", body));
+    ASSERT_GT(body.size(), 5u);
+    EXPECT_EQ("tail\n", body.substr(body.size() - 5));
+    EXPECT_EQ(std::string::npos, body.find('\0'));
+    EXPECT_EQ(1u, backend.stats().requests);
+}
+
+TEST_F(SimFSIntegrationTest, OfflineGenerationSkipsSpecialFiles) {
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    ASSERT_EQ(0, SimFS::mkdir("/proj", 0755));
+    ASSERT_EQ(0, SimFS::create("/proj/.simfs_config.toml", 0644, &fi));
+    dropContent("/proj/.simfs_config.toml");
+    EXPECT_TRUE(simfs_->listUngeneratedFiles().empty());
+    
+    auto buffer = simfs_->startOfflineGeneration("/proj/.simfs_config.toml");
+    ASSERT_TRUE(buffer);
+    EXPECT_TRUE(buffer->hasError());
+    EXPECT_TRUE(simfs_->startOfflineGeneration("/.simfs/stats")->hasError());
+    EXPECT_FALSE(simfs_->hasContent("/proj/.simfs_config.toml"));
+}
+
+TEST_F(SimFSIntegrationTest, RegenerateOnlyReplacesGeneratedFiles) {
+    MockBackendConfig backend_config;
+    backend_config.ttft = LatencyDistribution::parse("fixed:10");
+    backend_config.response_tokens = 5;
+    MockBackend backend(backend_config);
+    simfs_.reset();
+    simfs_ = std::make_unique<SimFS>(test_db_path_, backend.url());
+    SimFS::setInstance(simfs_.get());
+    
+    struct fuse_file_info fi = {0};
+    fi.flags = O_CREAT | O_RDWR;
+    ASSERT_EQ(0, SimFS::create("/mine.txt", 0644, &fi));
+    ASSERT_EQ(10, SimFS::write("/mine.txt", "user data!", 10, 0, &fi));
+    EXPECT_EQ(0, SimFS::release("/mine.txt", &fi));
+    
+    // A file the user wrote is never replaced by a generated version
+    EXPECT_EQ(-EPERM, SimFS::setxattr("/mine.txt", "user.simfs.regenerate", "1", 1, 0));
+    std::string body;
+    ASSERT_TRUE(storedContent("/mine.txt", body));
+    EXPECT_EQ("user data!", body);
+    EXPECT_EQ(0u, backend.stats().requests);
+    
+    ASSERT_TRUE(simfs_->storeGeneratedFiles({{"/generated.txt", "first version"}}));
+    EXPECT_EQ(0, SimFS::setxattr("/generated.txt", "user.simfs.regenerate", "1", 1, 0));
+    waitForStream("/generated.txt");
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "tokenizer.h"
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+
+static std::string encodeBase64(const std::string& input) {
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    size_t i = 0;
+    for (; i + 2 < input.size(); i += 3) {
+        uint32_t n = (static_cast<unsigned char>(input[i]) << 16) |
+                     (static_cast<unsigned char>(input[i + 1]) << 8) |
+                     static_cast<unsigned char>(input[i + 2]);
+        out += alphabet[(n >> 18) & 63];
+        out += alphabet[(n >> 12) & 63];
+        out += alphabet[(n >> 6) & 63];
+        out += alphabet[n & 63];
+    }
+    if (i + 1 == input.size()) {
+        uint32_t n = static_cast<unsigned char>(input[i]) << 16;
+        out += alphabet[(n >> 18) & 63];
+        out += alphabet[(n >> 12) & 63];
+        out += "==";
+    } else if (i + 2 == input.size()) {
+        uint32_t n = (static_cast<unsigned char>(input[i]) << 16) | (static_cast<unsigned char>(input[i + 1]) << 8);
+        out += alphabet[(n >> 18) & 63];
+        out += alphabet[(n >> 12) & 63];
+        out += alphabet[(n >> 6) & 63];
+        out += '=';
+    }
+    return out;
+}
+
+class TokenizerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = "./test_tokenizer_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        std::filesystem::create_directories(dir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+
+    std::string writeFile(const std::string& name, const std::string& contents) {
+        std::string path = dir_ + "/" + name;
+        std::ofstream(path, std::ios::binary) << contents;
+        return path;
+    }
+
+    // All single bytes, then merges in rank order
+    std::string writeTiktoken() {
+        std::string contents;
+        uint32_t rank = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            contents += encodeBase64(std::string(1, static_cast<char>(byte))) + " " + std::to_string(rank++) + "\n";
+        }
+        for (const char* merge : {"he", "ll", "llo", "hello", " w", "or", " wor", "ld", " world"}) {
+            contents += encodeBase64(merge) + " " + std::to_string(rank++) + "\n";
+        }
+        return writeFile("test.tiktoken", contents);
+    }
+
+    std::string dir_;
+};
+
+TEST_F(TokenizerTest, EncodesWithMerges) {
+    auto tokenizer = Tokenizer::load(writeTiktoken());
+    ASSERT_TRUE(tokenizer->exact());
+
+    EXPECT_EQ((std::vector<uint32_t>{259, 264}), tokenizer->encode("hello world"));
+    EXPECT_EQ((std::vector<uint32_t>{259, 's'}), tokenizer->encode("hellos"));
+    EXPECT_EQ((std::vector<uint32_t>{264, 's'}), tokenizer->encode(" worlds"));
+    EXPECT_EQ((std::vector<uint32_t>{'x', 'l', 'y'}), tokenizer->encode("xly"));
+    EXPECT_EQ(4u, tokenizer->count("hellos worlds"));
+    EXPECT_EQ(0u, tokenizer->count(""));
+}
+
+TEST_F(TokenizerTest, TruncatesAtTokenBoundaries) {
+    auto tokenizer = Tokenizer::load(writeTiktoken());
+
+    EXPECT_EQ("hello", tokenizer->truncate("hello worlds", 1));
+    EXPECT_EQ("hello world", tokenizer->truncate("hello worlds", 2));
+    EXPECT_EQ("hello worlds", tokenizer->truncate("hello worlds", 10));
+    EXPECT_EQ("s", tokenizer->truncateTail("hello worlds", 1));
+    EXPECT_EQ(" worlds", tokenizer->truncateTail("hello worlds", 2));
+    EXPECT_EQ("", tokenizer->truncateTail("hello worlds", 0));
+}
+
+TEST_F(TokenizerTest, Pretokenizes) {
+    EXPECT_EQ((std::vector<std::string>{"I", "'m", " here"}), Tokenizer::pretokenize("I'm here"));
+    EXPECT_EQ((std::vector<std::string>{"we", "'LL"}), Tokenizer::pretokenize("we'LL"));
+    EXPECT_EQ((std::vector<std::string>{"123", "45"}), Tokenizer::pretokenize("12345"));
+    EXPECT_EQ((std::vector<std::string>{"a", " ", " b"}), Tokenizer::pretokenize("a  b"));
+    EXPECT_EQ((std::vector<std::string>{"x", "\n\n", "y"}), Tokenizer::pretokenize("x\n\ny"));
+    EXPECT_EQ((std::vector<std::string>{"foo", "();\n"}), Tokenizer::pretokenize("foo();\n"));
+    EXPECT_EQ((std::vector<std::string>{"end", "  "}), Tokenizer::pretokenize("end  "));
+    EXPECT_EQ((std::vector<std::string>{"caf\xc3\xa9", " ok"}), Tokenizer::pretokenize("caf\xc3\xa9 ok"));
+}
+
+TEST_F(TokenizerTest, LoadsHuggingFaceByteLevelBPE) {
+    // GPT-2's byte-to-unicode mapping, as tokenizer.json stores tokens
+    std::vector<std::string> symbols;
+    int next = 256;
+    for (int byte = 0; byte < 256; byte++) {
+        bool printable = (byte >= '!' && byte <= '~') || (byte >= 0xa1 && byte <= 0xac) || byte >= 0xae;
+        int code_point = printable ? byte : next++;
+        std::string utf8;
+        if (code_point < 0x80) {
+            utf8 += static_cast<char>(code_point);
+        } else {
+            utf8 += static_cast<char>(0xc0 | (code_point >> 6));
+            utf8 += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+        symbols.push_back(utf8);
+    }
+
+    nlohmann::json vocab;
+    for (int byte = 0; byte < 256; byte++) {
+        vocab[symbols[byte]] = byte;
+    }
+    vocab[symbols[' '] + "world"] = 300;
+    vocab["<|endoftext|>"] = 301;
+    nlohmann::json config = {{"model", {{"type", "BPE"}, {"vocab", vocab}}}};
+
+    auto tokenizer = Tokenizer::load(writeFile("tokenizer.json", config.dump()));
+    EXPECT_EQ((std::vector<uint32_t>{'a', 300}), tokenizer->encode("a world"));
+    EXPECT_EQ((std::vector<uint32_t>{'\n'}), tokenizer->encode("\n"));
+}
+
+TEST_F(TokenizerTest, RejectsUnusableFiles) {
+    EXPECT_THROW(Tokenizer::load(dir_ + "/missing.tiktoken"), std::runtime_error);
+    EXPECT_THROW(Tokenizer::load(writeFile("partial.tiktoken", encodeBase64("a") + " 0\n")), std::runtime_error);
+    EXPECT_THROW(Tokenizer::load(writeFile("garbage.tiktoken", "not a rank file\n")), std::runtime_error);
+    EXPECT_THROW(Tokenizer::load(writeFile("unigram.json", R"({"model": {"type": "Unigram"}})")), std::runtime_error);
+}
+
+TEST_F(TokenizerTest, EstimatesWithoutVocabulary) {
+    Tokenizer tokenizer;
+    EXPECT_FALSE(tokenizer.exact());
+    EXPECT_EQ(3u, tokenizer.count("abcdefg"));
+    EXPECT_EQ("abcdef", tokenizer.truncate("abcdefg", 2));
+    EXPECT_EQ("defg", tokenizer.truncateTail("abcdefg", 2));
+
+    // Never splits a UTF-8 sequence
+    EXPECT_EQ(1u, tokenizer.count("ab\xc3\xa9"));
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include "tracer.h"
+#include <nlohmann/json.hpp>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+class TracerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Tracer::global().setBufferEvents(Tracer::DEFAULT_BUFFER_EVENTS);
+        Tracer::global().clear();
+        Tracer::setEnabled(true);
+    }
+
+    void TearDown() override {
+        Tracer::setEnabled(false);
+        Tracer::global().clear();
+    }
+
+    static std::vector<json> eventsOfPhase(const json& trace, const std::string& phase) {
+        std::vector<json> events;
+        for (const auto& event : trace["traceEvents"]) {
+            if (event["ph"] == phase) {
+                events.push_back(event);
+            }
+        }
+        return events;
+    }
+};
+
+TEST_F(TracerTest, RecordsNothingWhileDisabled) {
+    Tracer::setEnabled(false);
+    {
+        TraceSpan span("read", "fuse", "/a.txt");
+    }
+    EXPECT_TRUE(Tracer::global().events().empty());
+    EXPECT_EQ(0u, TraceFlow::next());
+}
+
+TEST_F(TracerTest, ExportsSpansAsChromeTrace) {
+    {
+        TraceSpan outer("read", "fuse", "/src/main.c");
+        TraceSpan inner("mutex_wait", "lock");
+        inner.end();
+        inner.end();  // Only recorded once
+    }
+
+    json trace = json::parse(Tracer::global().exportChromeJson());
+    std::vector<json> spans = eventsOfPhase(trace, "X");
+    ASSERT_EQ(2u, spans.size());
+    EXPECT_EQ("mutex_wait", spans[0]["name"]);
+    EXPECT_EQ("read", spans[1]["name"]);
+    EXPECT_EQ("fuse", spans[1]["cat"]);
+    EXPECT_EQ("/src/main.c", spans[1]["args"]["detail"]);
+    EXPECT_EQ(getpid(), spans[1]["pid"]);
+    EXPECT_EQ(spans[0]["tid"], spans[1]["tid"]);
+    EXPECT_LE(spans[1]["ts"].get<uint64_t>(), spans[0]["ts"].get<uint64_t>());
+}
+
+TEST_F(TracerTest, RingKeepsTheNewestSpans) {
+    Tracer::global().setBufferEvents(4);
+    std::thread([]() {
+        for (int i = 0; i < 10; i++) {
+            TraceSpan span(i < 6 ? "old" : "new", "test");
+        }
+    }).join();
+
+    // The thread has exited, so its spans are in the shared ring
+    std::vector<TraceEvent> events = Tracer::global().events();
+    ASSERT_EQ(4u, events.size());
+    for (const auto& event : events) {
+        EXPECT_STREQ("new", event.name);
+    }
+}
+
+TEST_F(TracerTest, FlowsLinkSpansAcrossThreads) {
+    uint64_t id = TraceFlow::next();
+    ASSERT_NE(0u, id);
+    {
+        TraceFlow flow(id);
+        TraceSpan span("resolve_config", "generation");
+    }
+    std::thread([id]() {
+        TraceFlow flow(id);
+        TraceSpan first("admission", "generation");
+        first.end();
+        TraceSpan second("commit", "generation");
+    }).join();
+    EXPECT_EQ(0u, TraceFlow::current());
+
+    json trace = json::parse(Tracer::global().exportChromeJson());
+    for (const auto& span : eventsOfPhase(trace, "X")) {
+        EXPECT_EQ(id, span["args"]["generation"].get<uint64_t>());
+    }
+    ASSERT_EQ(1u, eventsOfPhase(trace, "s").size());
+    EXPECT_EQ(1u, eventsOfPhase(trace, "t").size());
+    ASSERT_EQ(1u, eventsOfPhase(trace, "f").size());
+    EXPECT_NE(eventsOfPhase(trace, "s")[0]["tid"], eventsOfPhase(trace, "f")[0]["tid"]);
+}
+
+TEST_F(TracerTest, DumpsOnSignal) {
+    std::string path = "/tmp/simfs_trace_test_" + std::to_string(getpid()) + ".json";
+    unlink(path.c_str());
+    {
+        TraceSpan span("read", "fuse", "/dumped.txt");
+    }
+
+    {
+        TraceDumper dumper(path);
+        raise(SIGUSR2);
+        for (int i = 0; i < 200 && access(path.c_str(), F_OK) != 0; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    std::ifstream file(path);
+    ASSERT_TRUE(file.good());
+    std::stringstream contents;
+    contents << file.rdbuf();
+    EXPECT_NE(std::string::npos, contents.str().find("/dumped.txt"));
+    unlink(path.c_str());
+}
+
+TEST_F(TracerTest, DumpNeverWritesThroughPlantedSymlinks) {
+    std::string path = "/tmp/simfs_trace_test_" + std::to_string(getpid()) + "_link.json";
+    std::string victim = path + ".victim";
+    unlink(path.c_str());
+    { std::ofstream(victim) << "keep"; }
+    ASSERT_EQ(0, symlink(victim.c_str(), (path + ".tmp").c_str()));
+
+    {
+        TraceSpan span("read", "fuse", "/dumped.txt");
+    }
+    ASSERT_TRUE(Tracer::global().dump(path));
+
+    std::ifstream kept(victim);
+    std::stringstream contents;
+    contents << kept.rdbuf();
+    EXPECT_EQ("keep", contents.str());
+    struct stat info;
+    ASSERT_EQ(0, lstat(path.c_str(), &info));
+    EXPECT_TRUE(S_ISREG(info.st_mode));
+
+    unlink(path.c_str());
+    unlink((path + ".tmp").c_str());
+    unlink(victim.c_str());
+}
+
+TEST_F(TracerTest, RecordsAccessesForReplay) {
+    std::string path = "/tmp/simfs_access_test_" + std::to_string(getpid()) + ".trace";
+    {
+        AccessRecorder recorder(path);
+        EXPECT_EQ(&recorder, AccessRecorder::active());
+        EXPECT_THROW(AccessRecorder(path + ".2"), std::runtime_error);
+
+        AccessRecord open;
+        open.op = "open";
+        open.fh = 7;
+        open.path = "/dir with\ttab/a\\b.txt";
+        recorder.record(Tracer::Clock::now(), open);
+        AccessRecord read;
+        read.op = "read";
+        read.fh = 7;
+        read.size = 4096;
+        read.offset = 8192;
+        read.result = 100;
+        read.path = open.path;
+        recorder.record(Tracer::Clock::now(), read);
+    }
+    EXPECT_EQ(nullptr, AccessRecorder::active());
+
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    EXPECT_EQ(AccessRecorder::HEADER, line);
+    std::vector<AccessRecord> records;
+    while (std::getline(file, line)) {
+        AccessRecord record;
+        ASSERT_TRUE(AccessRecord::parse(line, record)) << line;
+        records.push_back(record);
+    }
+    std::remove(path.c_str());
+
+    ASSERT_EQ(2u, records.size());
+    EXPECT_EQ("/dir with\ttab/a\\b.txt", records[0].path);
+    EXPECT_EQ(7u, records[1].fh);
+    EXPECT_EQ(4096u, records[1].size);
+    EXPECT_EQ(8192, records[1].offset);
+    EXPECT_EQ(100, records[1].result);
+    EXPECT_LE(records[0].time_us, records[1].time_us);
+    EXPECT_FALSE(AccessRecord::parse("12\tread\tnot a number", records[0]));
+}
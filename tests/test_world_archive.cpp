@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "world_archive.h"
+#include "db_manager.h"
+#include <filesystem>
+#include <stdexcept>
+
+class WorldArchiveTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::string suffix = std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        source_path_ = "./test_archive_source_" + suffix;
+        target_path_ = "./test_archive_target_" + suffix;
+        archive_path_ = "./test_archive_" + suffix;
+        source_ = std::make_unique<DBManager>(source_path_);
+        target_ = std::make_unique<DBManager>(target_path_);
+    }
+
+    void TearDown() override {
+        source_.reset();
+        target_.reset();
+        std::filesystem::remove_all(source_path_);
+        std::filesystem::remove_all(target_path_);
+        std::filesystem::remove_all(archive_path_);
+    }
+
+    void addFile(const std::string& path, const std::string& content) {
+        source_->put("meta:" + path, "type:file");
+        source_->put("content:" + path, content);
+    }
+
+    std::string source_path_;
+    std::string target_path_;
+    std::string archive_path_;
+    std::unique_ptr<DBManager> source_;
+    std::unique_ptr<DBManager> target_;
+};
+
+TEST_F(WorldArchiveTest, RebasePath) {
+    EXPECT_EQ("/b/x.c", WorldArchive::rebasePath("/a/x.c", "/a", "/b"));
+    EXPECT_EQ("/b", WorldArchive::rebasePath("/a", "/a", "/b"));
+    EXPECT_EQ("", WorldArchive::rebasePath("/a-b/x.c", "/a", "/b"));
+    EXPECT_EQ("/w/a/x.c", WorldArchive::rebasePath("/a/x.c", "/", "/w"));
+    EXPECT_EQ("/x.c", WorldArchive::rebasePath("/a/x.c", "/a", "/"));
+}
+
+TEST_F(WorldArchiveTest, ExportsOnlyTheSubtree) {
+    source_->put("meta:/proj", "type:dir");
+    addFile("/proj/main.c", "int main() {}");
+    addFile("/proj/src/util.c", "void util() {}");
+    addFile("/proj-old/main.c", "old");
+    addFile("/other.txt", "other");
+
+    ArchiveStats exported = WorldArchive::exportSubtree(*source_, "/proj", archive_path_);
+    EXPECT_EQ("/proj", exported.root);
+    EXPECT_EQ(5u, exported.entries);
+    EXPECT_EQ(1u, exported.sst_files);
+
+    ArchiveStats imported = WorldArchive::importArchive(*target_, archive_path_);
+    EXPECT_EQ(exported.entries, imported.entries);
+
+    std::string value;
+    EXPECT_TRUE(target_->get("content:/proj/src/util.c", value));
+    EXPECT_EQ("void util() {}", value);
+    EXPECT_TRUE(target_->exists("meta:/proj"));
+    EXPECT_FALSE(target_->exists("meta:/proj-old/main.c"));
+    EXPECT_FALSE(target_->exists("meta:/other.txt"));
+}
+
+TEST_F(WorldArchiveTest, RebasesKeysAndPathValues) {
+    addFile("/proj/main.c", "#include \"util.h\"");
+    addFile("/proj/util.h", "void util();");
+    source_->put("transition:/proj/main.c", "3\t/proj/util.h\n1\t/elsewhere.txt\n");
+    source_->put("refs:/proj/main.c", "/proj/util.h\n");
+
+    WorldArchive::exportSubtree(*source_, "/proj/", archive_path_, "/worlds/w1");
+    ArchiveStats imported = WorldArchive::importArchive(*target_, archive_path_);
+    EXPECT_EQ("/worlds/w1", imported.root);
+
+    std::string value;
+    EXPECT_TRUE(target_->get("content:/worlds/w1/util.h", value));
+    EXPECT_EQ("void util();", value);
+    EXPECT_FALSE(target_->exists("content:/proj/util.h"));
+
+    EXPECT_TRUE(target_->get("transition:/worlds/w1/main.c", value));
+    EXPECT_EQ("3\t/worlds/w1/util.h\n1\t/elsewhere.txt\n", value);
+    EXPECT_TRUE(target_->get("refs:/worlds/w1/main.c", value));
+    EXPECT_EQ("/worlds/w1/util.h\n", value);
+
+    // Directories above the rebased root are created
+    EXPECT_TRUE(target_->get("meta:/worlds", value));
+    EXPECT_EQ("type:dir", value);
+    EXPECT_TRUE(target_->exists("meta:/worlds/w1"));
+}
+
+TEST_F(WorldArchiveTest, SplitsLargeExports) {
+    for (int i = 0; i < 10; i++) {
+        addFile("/data/file" + std::to_string(i) + ".txt", std::string(100, 'x'));
+    }
+
+    ArchiveStats exported = WorldArchive::exportSubtree(*source_, "/", archive_path_, "", 250);
+    EXPECT_GT(exported.sst_files, 1u);
+
+    WorldArchive::importArchive(*target_, archive_path_);
+    EXPECT_EQ(10u, target_->listKeys("content:/data/").size());
+}
+
+TEST_F(WorldArchiveTest, RejectsNonEmptyArchiveDirectory) {
+    addFile("/a.txt", "a");
+    WorldArchive::exportSubtree(*source_, "/", archive_path_);
+    EXPECT_THROW(WorldArchive::exportSubtree(*source_, "/", archive_path_), std::runtime_error);
+    EXPECT_THROW(WorldArchive::importArchive(*target_, source_path_), std::runtime_error);
+}